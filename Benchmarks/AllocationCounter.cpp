@@ -0,0 +1,53 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local uint64_t t_allocations{};
+    thread_local uint64_t t_bytes{};
+
+    void* CountedAllocate(std::size_t size) noexcept
+    {
+        t_allocations++;
+        t_bytes += size;
+        return std::malloc((size > 0) ? size : 1);
+    }
+}
+
+AllocationCounts GetThreadAllocationCounts()
+{
+    return { t_allocations, t_bytes };
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* p = CountedAllocate(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+    return CountedAllocate(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { std::free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { std::free(p); }
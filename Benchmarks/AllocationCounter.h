@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Every operator new on the calling thread is counted (AllocationCounter.cpp replaces them for the whole
+// benchmark binary), for benchmarks that report allocations per row alongside time
+struct AllocationCounts
+{
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+AllocationCounts GetThreadAllocationCounts();
+
+// Counts what the calling thread allocates from construction on
+struct AllocationScope
+{
+public:
+    AllocationScope() : m_start(GetThreadAllocationCounts()) {}
+
+    AllocationCounts Elapsed() const
+    {
+        const AllocationCounts now = GetThreadAllocationCounts();
+        return { now.allocations - m_start.allocations, now.bytes - m_start.bytes };
+    }
+
+private:
+    AllocationCounts m_start;
+};
@@ -0,0 +1,83 @@
+// The batch size policy against made up providers, each with its own cost per GetNextRows call. Nothing sleeps,
+// the provider's cost is added up instead, so the counters are what matter: how long until the first batch is
+// back, how long the whole rowset takes and where the batch size settled. The time per iteration is only the
+// policy's own overhead.
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include "BatchSizeController.h"
+
+namespace
+{
+    // What a GetNextRows call for rows rows costs: a fixed cost per call plus a cost per row, and past the knee
+    // every row costs slowdown times more (the provider's buffers stop fitting, or it starts contending)
+    struct LatencyProfile
+    {
+        const char* name;
+        uint64_t callMicroseconds;
+        double rowMicroseconds;
+        size_t knee;
+        double slowdown;
+
+        uint64_t Cost(size_t rows) const
+        {
+            const size_t fast = (std::min)(rows, knee);
+            return callMicroseconds + static_cast<uint64_t>((fast * rowMicroseconds) + ((rows - fast) * rowMicroseconds * slowdown));
+        }
+    };
+
+    const LatencyProfile c_profiles[] = {
+        { "warm_local", 300, 2.0, SIZE_MAX, 1.0 },
+        { "cold_index", 5000, 8.0, SIZE_MAX, 1.0 },
+        { "contended", 1000, 3.0, 2048, 3.0 },
+        { "remote", 20000, 4.0, 8192, 2.0 },
+    };
+
+    constexpr size_t c_rowsetRows{ 20000 };
+
+    void BM_BatchSizePolicy(benchmark::State& state)
+    {
+        LatencyProfile const& profile = c_profiles[state.range(0)];
+        const bool adaptive = state.range(1) != 0;
+        state.SetLabel(profile.name);
+
+        // The app's settings, against the fixed 5000 rows a call it used to ask for
+        AdaptiveBatchSizeController controller = adaptive ? AdaptiveBatchSizeController(64, 16384, 2) : AdaptiveBatchSizeController(5000, 5000, 2);
+
+        uint64_t firstBatch = 0;
+        uint64_t total = 0;
+        size_t calls = 0;
+        for (auto _ : state)
+        {
+            controller.Reset();
+            total = 0;
+            calls = 0;
+            size_t remaining = c_rowsetRows;
+            while (true)
+            {
+                const size_t requested = controller.NextBatchSize();
+                const size_t returned = (std::min)(requested, remaining);
+                const uint64_t cost = profile.Cost(returned);
+                controller.OnBatchFetched(returned, cost);
+                total += cost;
+                if (calls++ == 0)
+                {
+                    firstBatch = cost;
+                }
+                remaining -= returned;
+                if (returned < requested)
+                {
+                    break;
+                }
+            }
+            benchmark::DoNotOptimize(total);
+        }
+
+        state.counters["first_batch_ms"] = static_cast<double>(firstBatch) / 1000;
+        state.counters["rowset_ms"] = static_cast<double>(total) / 1000;
+        state.counters["calls"] = static_cast<double>(calls);
+        state.counters["settled_batch"] = static_cast<double>(controller.NextBatchSize());
+    }
+    BENCHMARK(BM_BatchSizePolicy)->ArgNames({ "profile", "adaptive" })->ArgsProduct({ { 0, 1, 2, 3 }, { 0, 1 } });
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CancellationToken.h"
+#include "ColumnarRowBatch.h"
+#include "ResultStore.h"
+#include "RowsetTrace.h"
+#include "SearchItemUtils.h"
+#include "StringAtoms.h"
+
+// Made up results shaped like what the indexer hands back: files spread over a few hundred folders with word
+// names and the usual extensions, some folders and a little mail. Seeded, every run on every box gets the same
+// corpus so the numbers can be compared against the baseline.
+struct CorpusItem
+{
+    std::wstring name;
+    std::wstring url;
+    std::wstring kind;
+};
+
+// The columns the app binds, in BoundColumnIndex order
+enum CorpusColumn
+{
+    CorpusNameColumn,
+    CorpusUrlColumn,
+    CorpusKindColumn,
+    CorpusColumnCount
+};
+
+inline std::vector<std::wstring> GetCorpusColumns()
+{
+    return { L"System.ItemNameDisplay", L"System.ItemUrl", L"System.KindText" };
+}
+
+inline std::vector<CorpusItem> MakeCorpus(size_t count, uint32_t seed = 1, uint32_t mailPercent = 5)
+{
+    static const wchar_t* const c_words[] = {
+        L"report", L"budget", L"notes", L"draft", L"final", L"photo", L"holiday", L"invoice", L"project", L"alpha",
+        L"beta", L"release", L"meeting", L"summary", L"design", L"review", L"plan", L"quarterly", L"sales",
+        L"customer", L"contract", L"resume", L"letter", L"presentation", L"screenshot", L"backup", L"archive",
+        L"music", L"mix", L"video", L"clip", L"family", L"garden", L"recipe", L"travel", L"paris", L"tokyo",
+        L"schema", L"config", L"readme", L"setup", L"install", L"driver", L"update", L"test", L"sample", L"data",
+        L"export", L"import", L"template", L"invoice", L"tax", L"receipt", L"scan", L"map", L"index", L"main" };
+    struct Extension { const wchar_t* extension; const wchar_t* kind; };
+    static const Extension c_extensions[] = {
+        { L".docx", L"Document" }, { L".pdf", L"Document" }, { L".txt", L"Document" }, { L".xlsx", L"Document" },
+        { L".pptx", L"Document" }, { L".jpg", L"Picture" }, { L".png", L"Picture" }, { L".mp3", L"Music" },
+        { L".mp4", L"Video" }, { L".zip", L"Compressed folder" }, { L".exe", L"Program" }, { L".cpp", L"Document" },
+        { L".h", L"Document" }, { L".json", L"Document" }, { L".lnk", L"Link" }, { L".md", L"Document" } };
+    static const wchar_t* const c_roots[] = {
+        L"C:/Users/someone/Documents", L"C:/Users/someone/Pictures", L"C:/Users/someone/Music",
+        L"C:/Users/someone/Downloads", L"C:/Users/someone/source/repos", L"C:/Users/someone/OneDrive/Desktop",
+        L"D:/Archive", L"C:/ProgramData/Microsoft/Windows/Start Menu/Programs" };
+    constexpr size_t c_wordCount = sizeof(c_words) / sizeof(c_words[0]);
+    constexpr size_t c_extensionCount = sizeof(c_extensions) / sizeof(c_extensions[0]);
+    constexpr size_t c_rootCount = sizeof(c_roots) / sizeof(c_roots[0]);
+
+    std::mt19937 random(seed);
+    auto pick = [&](size_t count) { return static_cast<size_t>(random() % count); };
+    auto words = [&](size_t maxWords, wchar_t separator)
+    {
+        std::wstring text(c_words[pick(c_wordCount)]);
+        for (size_t i = pick(maxWords); i > 0; --i)
+        {
+            text += separator;
+            text += c_words[pick(c_wordCount)];
+        }
+        return text;
+    };
+
+    // A folder per 32 results, a few levels deep
+    std::vector<std::wstring> folders;
+    const size_t folderCount = (std::max)(count / 32, static_cast<size_t>(8));
+    for (size_t i = 0; i < folderCount; ++i)
+    {
+        std::wstring folder(c_roots[pick(c_rootCount)]);
+        for (size_t depth = 1 + pick(3); depth > 0; --depth)
+        {
+            folder += L'/';
+            folder += words(2, L' ');
+        }
+        folders.push_back(std::move(folder));
+    }
+
+    std::vector<CorpusItem> items;
+    items.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        CorpusItem item;
+        const uint32_t roll = static_cast<uint32_t>(pick(100));
+        if (roll < mailPercent)
+        {
+            item.name = words(4, L' ');
+            item.url = L"mapi16://{S-1-5-21-1004336348-1177238915-682003330-512}/someone@contoso.com($a1b2c3d4)/0/Inbox/" +
+                item.name + L" " + std::to_wstring(i);
+            item.kind = L"Email";
+        }
+        else
+        {
+            // Skewed so a handful of folders hold most of the results, like a real profile
+            const double skew = static_cast<double>(random()) / static_cast<double>(random.max());
+            std::wstring const& folder = folders[static_cast<size_t>(skew * skew * static_cast<double>(folders.size() - 1))];
+            if (roll < (mailPercent + 8))
+            {
+                item.name = words(2, L' ');
+                item.kind = L"Folder";
+            }
+            else
+            {
+                Extension const& extension = c_extensions[pick(c_extensionCount)];
+                item.name = words(2, (roll & 1) ? L'_' : L' ');
+                if (roll & 2)
+                {
+                    item.name += L" (" + std::to_wstring(pick(20)) + L")";
+                }
+                item.name += extension.extension;
+                item.kind = extension.kind;
+            }
+            item.url = L"file:" + folder + L"/" + item.name;
+        }
+        items.push_back(std::move(item));
+    }
+    return items;
+}
+
+// The corpus rows from start on as one batch, the way the provider hands them back
+inline void AppendCorpusRows(std::vector<CorpusItem> const& items, size_t start, size_t rows, ColumnarRowBatch& batch)
+{
+    batch.Reset(CorpusColumnCount, rows, rows * 128);
+    for (size_t i = start; i < (start + rows); ++i)
+    {
+        batch.AppendValue(CorpusNameColumn, items[i].name.data(), items[i].name.size());
+        batch.AppendValue(CorpusUrlColumn, items[i].url.data(), items[i].url.size());
+        batch.AppendValue(CorpusKindColumn, items[i].kind.data(), items[i].kind.size());
+        batch.CommitRow();
+    }
+}
+
+// The corpus as one query's trace, in batches of batchSize rows that each took fixedMicroseconds plus
+// microsecondsPerRow per row at the indexer
+inline std::vector<uint8_t> RecordCorpusTrace(std::vector<CorpusItem> const& items, size_t batchSize, uint64_t fixedMicroseconds,
+    uint64_t microsecondsPerRow)
+{
+    std::vector<uint8_t> trace;
+    RowsetTraceWriter writer([&](const void* data, size_t size)
+        {
+            trace.insert(trace.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+        });
+
+    const uint32_t query = writer.RecordQuery(L"SELECT System.ItemNameDisplay, System.ItemUrl, System.KindText FROM SystemIndex", GetCorpusColumns());
+    ColumnarRowBatch batch;
+    for (size_t start = 0; start < items.size(); start += batchSize)
+    {
+        const size_t rows = (std::min)(batchSize, items.size() - start);
+        AppendCorpusRows(items, start, rows, batch);
+        writer.RecordBatch(query, batchSize, fixedMicroseconds + (rows * microsecondsPerRow), batch);
+    }
+    return trace;
+}
+
+// The corpus as a recorded query, to hand to a ReplayRowBatchSource as the stand-in for a rowset
+inline RecordedQuery MakeCorpusQuery(std::vector<CorpusItem> const& items, size_t batchSize, uint64_t fixedMicroseconds,
+    uint64_t microsecondsPerRow)
+{
+    const std::vector<uint8_t> trace = RecordCorpusTrace(items, batchSize, fixedMicroseconds, microsecondsPerRow);
+    std::vector<RecordedQuery> queries;
+    ReadRowsetTrace(trace.data(), trace.size(), queries);
+    return std::move(queries.front());
+}
+
+// SearchUXQueryHelper::MaterializeRow for a corpus row, on the fetch's workers
+inline void MaterializeCorpusRow(ColumnarRowBatch const& rows, size_t row, ResultStore& results)
+{
+    AppendSearchResult(results, rows.GetString(row, CorpusNameColumn), rows.GetString(row, CorpusUrlColumn), rows.GetString(row, CorpusKindColumn));
+}
+
+// Every fetch in the benchmarks and tests shares these, like the app's fetches share theirs
+inline BatchWorkerPool& GetFetchWorkers()
+{
+    static BatchWorkerPool s_workers;
+    return s_workers;
+}
+
+// A provider that takes batchDelay for every batch of corpus rows it hands back. Canceling the token while it
+// waits aborts the wait the way ICommand::Cancel aborts the provider, and that batch comes back empty.
+struct SlowRowBatchSource : public IRowBatchSource
+{
+public:
+    SlowRowBatchSource(std::vector<CorpusItem> const& items, std::chrono::microseconds batchDelay, CancellationToken cancellation) :
+        m_items(items), m_batchDelay(batchDelay), m_cancellation(std::move(cancellation))
+    {
+    }
+
+    size_t NextBatch(size_t maxRows, FetchedRowBatch& fetched) override
+    {
+        {
+            CancellationRegistration abort(m_cancellation, [this]()
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_aborted = true;
+                    m_wake.notify_all();
+                });
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_batchesStarted++;
+            m_wake.notify_all();
+            if (m_wake.wait_for(lock, m_batchDelay, [this]() { return m_aborted; }))
+            {
+                return 0;
+            }
+        }
+
+        const size_t rows = (std::min)(maxRows, m_items.size() - m_next);
+        AppendCorpusRows(m_items, m_next, rows, fetched.rows);
+        m_next += rows;
+        return rows;
+    }
+
+    // Until the fetch is waiting on its count'th batch
+    void WaitForBatch(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_wake.wait(lock, [&]() { return m_batchesStarted >= count; });
+    }
+
+private:
+    std::vector<CorpusItem> const& m_items;
+    const std::chrono::microseconds m_batchDelay;
+    const CancellationToken m_cancellation;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    size_t m_batchesStarted{};
+    bool m_aborted{};
+    size_t m_next{};
+};
@@ -0,0 +1,137 @@
+// Logging a line the way _tracelog used to, formatting it on the calling thread and waiting for it to be appended
+// to the file, against BinaryLogger copying the arguments into the thread's ring. From one thread and from four at
+// once, both write to a temporary file. %ls since the C library's wide printf reads %s as narrow.
+#include <benchmark/benchmark.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include "BinaryLog.h"
+
+namespace
+{
+    // _tracelog before BinaryLogger, less the WinRT file
+    struct BlockingLogger
+    {
+    public:
+        BlockingLogger() : m_file(std::tmpfile()) {}
+        ~BlockingLogger() { std::fclose(m_file); }
+
+        bool Log(const wchar_t* format, ...)
+        {
+            wchar_t buffer[10000];
+            va_list argptr;
+            va_start(argptr, format);
+            const int length = std::vswprintf(buffer, std::size(buffer), format, argptr);
+            va_end(argptr);
+            if (length < 0)
+            {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::fwrite(buffer, sizeof(wchar_t), static_cast<size_t>(length), m_file);
+            return std::fflush(m_file) == 0;
+        }
+
+        void Drain() {}
+
+    private:
+        std::mutex m_lock;
+        FILE* const m_file;
+    };
+
+    struct BinaryFileLogger
+    {
+    public:
+        BinaryFileLogger() :
+            m_logger([this](const void* data, size_t size)
+                {
+                    std::fwrite(data, 1, size, m_file.get());
+                    std::fflush(m_file.get());
+                })
+        {
+        }
+
+        template <typename... TArgs>
+        bool Log(const wchar_t* format, TArgs const&... args)
+        {
+            return m_logger.Log(format, args...);
+        }
+
+        void Drain() { m_logger.Flush(); }
+
+    private:
+        // Closed after the logger is done with it
+        std::unique_ptr<FILE, decltype(&std::fclose)> m_file{ std::tmpfile(), &std::fclose };
+        BinaryLogger m_logger;
+    };
+
+    // Shared by every thread of a run, the way every thread shares the app's log
+    template <typename TLogger>
+    TLogger& GetLogger()
+    {
+        static TLogger s_logger;
+        return s_logger;
+    }
+
+    // A line like the ones the fetch logs, with a query's text in it. Every 256 lines the rings get drained outside
+    // of the timing, the way the drain thread keeps up with anything short of a flood, so it's the cost to the
+    // logging thread and not of dropping records.
+    template <typename TLogger>
+    void BM_TraceLog(benchmark::State& state)
+    {
+        TLogger& logger = GetLogger<TLogger>();
+        const std::wstring query(L"SELECT System.ItemNameDisplay FROM SystemIndex WHERE CONTAINS('report')");
+        uint32_t rows = 0;
+        uint64_t dropped = 0;
+        for (auto _ : state)
+        {
+            if (!logger.Log(L"\nFetched %d rows in %d us on %d: %ls", rows, rows * 3, static_cast<int>(state.thread_index()), query.c_str()))
+            {
+                dropped++;
+            }
+            rows++;
+            if ((rows % 256) == 0)
+            {
+                state.PauseTiming();
+                logger.Drain();
+                state.ResumeTiming();
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.counters["dropped_percent"] = benchmark::Counter(100.0 * static_cast<double>(dropped) /
+            static_cast<double>((std::max)(state.iterations(), static_cast<benchmark::IterationCount>(1))), benchmark::Counter::kAvgThreads);
+    }
+    BENCHMARK_TEMPLATE(BM_TraceLog, BlockingLogger)->Threads(1)->Threads(4)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_TraceLog, BinaryFileLogger)->Threads(1)->Threads(4)->UseRealTime();
+
+    // What the drain does with it later, turning a log back into text
+    void BM_DecodeBinaryLog(benchmark::State& state)
+    {
+        std::vector<uint8_t> log;
+        {
+            BinaryLogger logger([&](const void* data, size_t size)
+                {
+                    log.insert(log.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+                }, 4 * 1024 * 1024);
+            for (uint32_t i = 0; i < 10000; ++i)
+            {
+                logger.Log(L"\nFetched %d rows in %d us: %ls", i, i * 3, L"report");
+            }
+        }
+
+        size_t records = 0;
+        for (auto _ : state)
+        {
+            records = 0;
+            DecodeBinaryLog(log.data(), log.size(), [&](uint64_t, uint32_t, std::wstring const& text)
+                {
+                    benchmark::DoNotOptimize(text.data());
+                    records++;
+                });
+        }
+        state.SetItemsProcessed(state.iterations() * records);
+    }
+    BENCHMARK(BM_DecodeBinaryLog)->Unit(benchmark::kMillisecond);
+}
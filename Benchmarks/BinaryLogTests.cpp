@@ -0,0 +1,268 @@
+// BinaryLogger written to memory and decoded back: the arguments come back the way the format asks for them, the
+// ring wraps around without losing or mangling a record, and what doesn't fit is counted instead
+#include <gtest/gtest.h>
+
+#include <thread>
+#include "BinaryLog.h"
+
+namespace
+{
+    struct DecodedRecord
+    {
+        uint64_t timestamp;
+        uint32_t threadId;
+        std::wstring text;
+    };
+
+    struct MemoryLog
+    {
+    public:
+        BinaryLogger::WriteFunction Writer()
+        {
+            return [this](const void* data, size_t size)
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_bytes.insert(m_bytes.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+                };
+        }
+
+        std::vector<DecodedRecord> Decode(bool* readable = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::vector<DecodedRecord> records;
+            const bool decoded = DecodeBinaryLog(m_bytes.data(), m_bytes.size(), [&](uint64_t timestamp, uint32_t threadId, std::wstring const& text)
+                {
+                    records.push_back({ timestamp, threadId, text });
+                });
+            if (readable != nullptr)
+            {
+                *readable = decoded;
+            }
+            return records;
+        }
+
+        std::vector<uint8_t> Bytes()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_bytes;
+        }
+
+    private:
+        std::mutex m_lock;
+        std::vector<uint8_t> m_bytes;
+    };
+
+    enum class Color : uint8_t { Red = 2 };
+
+    // The drain never runs on its own in these, only Flush and the destructor write
+    constexpr std::chrono::hours c_noDrain{ 1 };
+
+    template <typename... TArgs>
+    std::wstring Format(const wchar_t* format, TArgs const&... args)
+    {
+        std::vector<uint8_t> bytes((size_t{ 0 } + ... + BinaryLogArgs::Size(args)));
+        uint8_t* out = bytes.data();
+        ((out = BinaryLogArgs::Write(out, args)), ...);
+        return FormatBinaryLogRecord(format, bytes.data(), bytes.size());
+    }
+
+    // A record of argBytes bytes of 'x'
+    bool WriteRecord(BinaryLogRing& ring, uint64_t timestamp, size_t argBytes)
+    {
+        bool crossedHalf = false;
+        return ring.TryWrite(L"record", timestamp, argBytes, [&](uint8_t* out) { memset(out, 'x', argBytes); }, &crossedHalf);
+    }
+
+    std::vector<uint64_t> DrainTimestamps(BinaryLogRing& ring, size_t argBytes)
+    {
+        std::vector<uint64_t> timestamps;
+        ring.Drain([&](BinaryLogRing::RecordHeader const& header, const uint8_t* args)
+            {
+                EXPECT_EQ(header.argBytes, argBytes);
+                EXPECT_EQ(std::wstring_view(header.format), L"record");
+                for (size_t i = 0; i < header.argBytes; ++i)
+                {
+                    EXPECT_EQ(args[i], 'x');
+                }
+                timestamps.push_back(header.timestamp);
+            });
+        return timestamps;
+    }
+}
+
+TEST(BinaryLogTests, RecordsRoundTrip)
+{
+    MemoryLog log;
+    {
+        BinaryLogger logger(log.Writer(), 64 * 1024, c_noDrain);
+        const std::wstring query(L"report");
+        const wchar_t* missing = nullptr;
+        EXPECT_TRUE(logger.Log(L"\nFetched %d rows in %u us", -5, 1234u));
+        EXPECT_TRUE(logger.Log(L"\n%s, %ls and %s", query, std::wstring_view(L"budget"), missing));
+        EXPECT_TRUE(logger.Log(L"\n%x %X %5d|%-4d| %c %.2f %%", 255u, 255u, 42, 7, L'z', 2.5));
+        EXPECT_TRUE(logger.Log(L"\nint64 %lld uint64 %llu color %d", INT64_MIN, UINT64_MAX, Color::Red));
+        logger.Flush();
+        EXPECT_TRUE(logger.Log(L"\nFetched %d rows in %u us", 6, 10u)); // after the format was written out
+    }
+
+    bool readable = false;
+    const std::vector<DecodedRecord> records = log.Decode(&readable);
+    EXPECT_TRUE(readable);
+    ASSERT_EQ(records.size(), 5u);
+    EXPECT_EQ(records[0].text, L"\nFetched -5 rows in 1234 us");
+    EXPECT_EQ(records[1].text, L"\nreport, budget and (null)");
+    EXPECT_EQ(records[2].text, L"\nff FF    42|7   | z 2.50 %");
+    EXPECT_EQ(records[3].text, L"\nint64 -9223372036854775808 uint64 18446744073709551615 color 2");
+    EXPECT_EQ(records[4].text, L"\nFetched 6 rows in 10 us");
+    for (size_t i = 1; i < records.size(); ++i)
+    {
+        EXPECT_EQ(records[i].threadId, records[0].threadId);
+        EXPECT_GE(records[i].timestamp, records[i - 1].timestamp);
+    }
+}
+
+// Strings are cut at c_maxStringChars, and a format asking for more than was logged leaves the rest out
+TEST(BinaryLogTests, MismatchedArgumentsAreLeftOut)
+{
+    EXPECT_EQ(Format(L"%d and %d", 1), L"1 and ");
+    EXPECT_EQ(Format(L"%s", std::wstring(5000, L'a')), std::wstring(BinaryLogArgs::c_maxStringChars, L'a'));
+    EXPECT_EQ(Format(L"100%"), L"100%");
+    EXPECT_EQ(Format(L"%d", 1.5), L"1.5");
+}
+
+// Every session starts over with a header of its own, so logs from several runs appended together decode
+TEST(BinaryLogTests, SessionsAppendedTogetherDecode)
+{
+    MemoryLog log;
+    for (int session = 0; session < 2; ++session)
+    {
+        BinaryLogger logger(log.Writer(), 64 * 1024, c_noDrain);
+        logger.Log(session == 0 ? L"first %d" : L"second %d", session);
+    }
+
+    const std::vector<DecodedRecord> records = log.Decode();
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].text, L"first 0");
+    EXPECT_EQ(records[1].text, L"second 1");
+}
+
+// A log that was cut short still gives back every record before the cut, and anything that isn't a log is refused
+TEST(BinaryLogTests, TruncatedLogsDecodeUpToTheCut)
+{
+    MemoryLog log;
+    {
+        BinaryLogger logger(log.Writer(), 64 * 1024, c_noDrain);
+        for (int i = 0; i < 10; ++i)
+        {
+            logger.Log(L"record %d", i);
+        }
+    }
+
+    const std::vector<uint8_t> bytes = log.Bytes();
+    for (size_t cut = 0; cut < bytes.size(); ++cut)
+    {
+        size_t decoded = 0;
+        DecodeBinaryLog(bytes.data(), cut, [&](uint64_t, uint32_t, std::wstring const& text)
+            {
+                EXPECT_EQ(text, L"record " + std::to_wstring(decoded));
+                decoded++;
+            });
+        ASSERT_LE(decoded, 10u);
+    }
+
+    const uint8_t garbage[] = { 'R', 1, 2, 3, 4, 5, 6, 7, 8 };
+    EXPECT_FALSE(DecodeBinaryLog(garbage, sizeof(garbage), [](uint64_t, uint32_t, std::wstring const&) {}));
+}
+
+// 40 byte records in a 4096 byte ring leave 16 bytes at the end, less than a header, and the padding has to be
+// skipped without one. Every record comes back in order with its arguments intact across many laps.
+TEST(BinaryLogTests, RingWrapsAroundWithPadding)
+{
+    BinaryLogRing ring(4096, 1);
+    const size_t argBytes = 40 - sizeof(BinaryLogRing::RecordHeader);
+    uint64_t written = 0;
+    uint64_t read = 0;
+    for (int lap = 0; lap < 20; ++lap)
+    {
+        // Unevenly sized bites so the wrap lands between records and drains at different places
+        for (size_t i = 0; i < 37 + lap; ++i)
+        {
+            ASSERT_TRUE(WriteRecord(ring, written, argBytes));
+            written++;
+        }
+        for (uint64_t timestamp : DrainTimestamps(ring, argBytes))
+        {
+            ASSERT_EQ(timestamp, read);
+            read++;
+        }
+    }
+    EXPECT_EQ(read, written);
+    EXPECT_EQ(ring.TakeDropped(), 0u);
+}
+
+// A full ring turns records away until it's drained, and anything longer than a quarter of it never fits
+TEST(BinaryLogTests, FullRingDropsAndCounts)
+{
+    BinaryLogRing ring(4096, 1);
+    size_t fitted = 0;
+    while (WriteRecord(ring, fitted, 40))
+    {
+        fitted++;
+    }
+    EXPECT_EQ(fitted, 4096u / 64);
+    EXPECT_FALSE(WriteRecord(ring, 0, 40));
+    EXPECT_EQ(ring.TakeDropped(), 2u);
+    EXPECT_EQ(ring.TakeDropped(), 0u);
+
+    EXPECT_EQ(DrainTimestamps(ring, 40).size(), fitted);
+    EXPECT_TRUE(WriteRecord(ring, 0, 40));
+    EXPECT_FALSE(WriteRecord(ring, 0, 1024));
+    EXPECT_EQ(ring.TakeDropped(), 1u);
+}
+
+// Dropped records show up in the log as a count where they would have been
+TEST(BinaryLogTests, DroppedRecordsAreNoted)
+{
+    MemoryLog log;
+    {
+        BinaryLogger logger(log.Writer(), 4096, c_noDrain);
+        const std::wstring tooLong(1000, L'a');
+        EXPECT_TRUE(logger.Log(L"before"));
+        EXPECT_FALSE(logger.Log(L"%s", tooLong));
+        EXPECT_FALSE(logger.Log(L"%s", tooLong));
+        EXPECT_TRUE(logger.Log(L"after"));
+    }
+
+    const std::vector<DecodedRecord> records = log.Decode();
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].text, L"before");
+    EXPECT_EQ(records[1].text, L"after");
+    EXPECT_EQ(records[2].text, L"\n[2 log records dropped]");
+    EXPECT_EQ(records[2].threadId, 0u);
+}
+
+// A thread that logged and went away before the drain got to it still has its records written, under a thread id
+// of its own, and whatever logs after it gets a ring of its own
+TEST(BinaryLogTests, AbandonedRingsAreDrained)
+{
+    MemoryLog log;
+    BinaryLogger logger(log.Writer(), 4096, c_noDrain);
+    for (int i = 0; i < 3; ++i)
+    {
+        std::thread([&logger, i]() { logger.Log(L"thread %d", i); }).join();
+    }
+    logger.Flush();
+    logger.Log(L"main");
+    logger.Flush();
+
+    const std::vector<DecodedRecord> records = log.Decode();
+    ASSERT_EQ(records.size(), 4u);
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(records[i].text, L"thread " + std::to_wstring(i));
+    }
+    EXPECT_EQ(records[3].text, L"main");
+    EXPECT_NE(records[0].threadId, records[1].threadId);
+    EXPECT_NE(records[1].threadId, records[2].threadId);
+    EXPECT_NE(records[2].threadId, records[3].threadId);
+}
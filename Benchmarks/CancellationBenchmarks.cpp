@@ -0,0 +1,62 @@
+// How long a canceled fetch takes to return, from Cancel to FetchRowsPipelined coming back, against a provider
+// that would otherwise take a second per batch. Either the fetch is waiting on the provider when it's
+// canceled, or the provider is quick and the workers are busy building results at 200us a row.
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    void BM_CancellationLatency(benchmark::State& state)
+    {
+        const bool busyWorkers = state.range(0) != 0;
+        const size_t workers = static_cast<size_t>(state.range(1));
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(4000);
+
+        for (auto _ : state)
+        {
+            CancellationSource cancellation;
+            SlowRowBatchSource source(s_corpus, busyWorkers ? std::chrono::microseconds(0) : std::chrono::seconds(1), cancellation.Token());
+            std::atomic<bool> materializing{};
+
+            auto fetch = std::async(std::launch::async, [&]()
+                {
+                    AdaptiveBatchSizeController controller(64, 1024, 2);
+                    return FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), workers, 2, controller, UINT64_MAX,
+                        [&](ColumnarRowBatch const& rows, size_t row, ResultStore& results)
+                        {
+                            if (busyWorkers)
+                            {
+                                materializing = true;
+                                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                            }
+                            MaterializeCorpusRow(rows, row, results);
+                        },
+                        [](FetchedRowBatch const&, ResultStore const&) {},
+                        cancellation.Token());
+                });
+
+            if (busyWorkers)
+            {
+                while (!materializing)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            else
+            {
+                source.WaitForBatch(1);
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            cancellation.Cancel();
+            fetch.wait();
+            state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    BENCHMARK(BM_CancellationLatency)->ArgNames({ "busy_workers", "workers" })->ArgsProduct({ { 0, 1 }, { 1, 2 } })
+        ->Unit(benchmark::kMicrosecond)->UseManualTime()->Iterations(50);
+}
@@ -0,0 +1,122 @@
+// Canceling a fetch against a deliberately slow provider: the fetch has to get out of the way within a bounded
+// time wherever it is, waiting on the provider, building results or handing them over, and nothing fetched
+// for a canceled query gets consumed
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    constexpr auto c_cancelDeadline = std::chrono::milliseconds(500);
+
+    const std::vector<CorpusItem>& GetCorpus()
+    {
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(4000);
+        return s_corpus;
+    }
+
+    struct FetchOutcome
+    {
+        uint64_t fetched{};
+        size_t consumedRows{};
+        size_t consumedBatches{};
+    };
+
+    template <typename TMaterialized, typename TOnConsume>
+    FetchOutcome Fetch(IRowBatchSource& source, CancellationToken const& cancellation, size_t workers, TMaterialized&& onMaterialize,
+        TOnConsume&& onConsume)
+    {
+        FetchOutcome outcome;
+        AdaptiveBatchSizeController controller(64, 1024, 2);
+        outcome.fetched = FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), workers, 2, controller, UINT64_MAX,
+            [&](ColumnarRowBatch const& rows, size_t row, ResultStore& results)
+            {
+                onMaterialize(row);
+                MaterializeCorpusRow(rows, row, results);
+            },
+            [&](FetchedRowBatch const& batch, ResultStore const&)
+            {
+                outcome.consumedRows += batch.rows.RowCount();
+                outcome.consumedBatches++;
+                onConsume(outcome.consumedBatches);
+            },
+            cancellation);
+        return outcome;
+    }
+}
+
+TEST(CancellationTests, CancelBeforeTheFetchStartsFetchesNothing)
+{
+    CancellationSource cancellation;
+    cancellation.Cancel();
+    SlowRowBatchSource source(GetCorpus(), std::chrono::seconds(30), cancellation.Token());
+
+    const FetchOutcome outcome = Fetch(source, cancellation.Token(), 2, [](size_t) {}, [](size_t) {});
+    EXPECT_EQ(outcome.fetched, 0u);
+    EXPECT_EQ(outcome.consumedBatches, 0u);
+}
+
+// The provider would take 30s for the batch, canceling aborts it like ICommand::Cancel does
+TEST(CancellationTests, CancelAbortsAFetchWaitingOnTheProvider)
+{
+    CancellationSource cancellation;
+    SlowRowBatchSource source(GetCorpus(), std::chrono::seconds(30), cancellation.Token());
+    auto fetch = std::async(std::launch::async, [&]() { return Fetch(source, cancellation.Token(), 2, [](size_t) {}, [](size_t) {}); });
+
+    source.WaitForBatch(1);
+    cancellation.Cancel();
+    ASSERT_EQ(fetch.wait_for(c_cancelDeadline), std::future_status::ready);
+    EXPECT_LT(cancellation.Token().MicrosecondsSinceCancellation(), static_cast<uint64_t>(std::chrono::microseconds(c_cancelDeadline).count()));
+
+    const FetchOutcome outcome = fetch.get();
+    EXPECT_EQ(outcome.fetched, 0u);
+    EXPECT_EQ(outcome.consumedBatches, 0u);
+}
+
+TEST(CancellationTests, CancelBetweenBatchesStopsTheFetch)
+{
+    CancellationSource cancellation;
+    SlowRowBatchSource source(GetCorpus(), std::chrono::milliseconds(2), cancellation.Token());
+
+    const FetchOutcome outcome = Fetch(source, cancellation.Token(), 2, [](size_t) {}, [&](size_t consumedBatches)
+        {
+            if (consumedBatches == 3)
+            {
+                cancellation.Cancel();
+            }
+        });
+
+    // Batches already fetched or on the workers when it was canceled are dropped, not handed over
+    EXPECT_EQ(outcome.consumedBatches, 3u);
+    EXPECT_LT(outcome.fetched, GetCorpus().size());
+}
+
+// A batch that takes a long time to turn into results is given up between rows
+TEST(CancellationTests, CancelStopsWorkersBetweenRows)
+{
+    CancellationSource cancellation;
+    SlowRowBatchSource source(GetCorpus(), std::chrono::microseconds(0), cancellation.Token());
+    std::atomic<size_t> materialized{};
+
+    auto fetch = std::async(std::launch::async, [&]()
+        {
+            return Fetch(source, cancellation.Token(), 1, [&](size_t)
+                {
+                    materialized++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }, [](size_t) {});
+        });
+
+    while (materialized == 0)
+    {
+        std::this_thread::yield();
+    }
+    cancellation.Cancel();
+    ASSERT_EQ(fetch.wait_for(c_cancelDeadline), std::future_status::ready);
+
+    const FetchOutcome outcome = fetch.get();
+    EXPECT_EQ(outcome.consumedBatches, 0u);
+    EXPECT_LT(materialized.load(), 64u);
+}
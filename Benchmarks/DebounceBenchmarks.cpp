@@ -0,0 +1,79 @@
+// SimulateDebounce over generated typing traces, the fixed 85ms we always waited against the adaptive policy
+// the app uses, for a few kinds of typists and indexers. Nothing waits, the counters are the comparison: how
+// many queries ran per keystroke, how many of those were thrown away, the indexer time they wasted and how
+// long after a keystroke its results showed up.
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include "DebounceScheduler.h"
+
+namespace
+{
+    struct Typist
+    {
+        const char* name;
+        uint64_t interval; // milliseconds between keys, give or take half of it
+    };
+    const Typist c_typists[] = { { "fast", 90 }, { "average", 160 }, { "hunt_and_peck", 350 } };
+
+    struct Indexer
+    {
+        const char* name;
+        uint64_t cost; // milliseconds per query, give or take half of it
+    };
+    const Indexer c_indexers[] = { { "warm", 15 }, { "busy", 120 } };
+
+    // Words of 3 to 12 keys with a pause of one to three seconds between them
+    std::vector<uint64_t> MakeKeystrokes(Typist const& typist, size_t words, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<uint64_t> keystrokes;
+        uint64_t now = 0;
+        for (size_t word = 0; word < words; ++word)
+        {
+            now += 1000 + (random() % 2000);
+            for (size_t key = 3 + (random() % 10); key > 0; --key)
+            {
+                now += (typist.interval / 2) + (random() % (typist.interval + 1));
+                keystrokes.push_back(now);
+            }
+        }
+        return keystrokes;
+    }
+
+    void BM_SimulateDebounce(benchmark::State& state)
+    {
+        const bool adaptive = state.range(0) != 0;
+        Typist const& typist = c_typists[state.range(1)];
+        Indexer const& indexer = c_indexers[state.range(2)];
+        state.SetLabel(std::string(adaptive ? "adaptive " : "fixed ") + typist.name + " " + indexer.name);
+
+        const std::vector<uint64_t> keystrokes = MakeKeystrokes(typist, 200, 9);
+        std::vector<uint64_t> costs;
+        std::mt19937 random(10);
+        for (size_t i = 0; i < keystrokes.size(); ++i)
+        {
+            costs.push_back((indexer.cost / 2) + (random() % (indexer.cost + 1)));
+        }
+
+        DebounceSimulation simulation;
+        for (auto _ : state)
+        {
+            std::unique_ptr<IDebouncePolicy> policy = adaptive ?
+                std::unique_ptr<IDebouncePolicy>(std::make_unique<AdaptiveDebouncePolicy>(85, 20, 250, 30)) :
+                std::unique_ptr<IDebouncePolicy>(std::make_unique<FixedDebouncePolicy>(85));
+            simulation = SimulateDebounce(std::move(policy), keystrokes, [&](size_t i) { return costs[i]; });
+            benchmark::DoNotOptimize(simulation.queriesStarted);
+        }
+
+        const double count = static_cast<double>(keystrokes.size());
+        state.counters["queries_per_key"] = static_cast<double>(simulation.queriesStarted) / count;
+        state.counters["superseded"] = static_cast<double>(simulation.queriesSuperseded);
+        state.counters["wasted_ms_per_key"] = static_cast<double>(simulation.wastedQueryTime) / count;
+        state.counters["result_latency_ms"] = (simulation.queriesCompleted > 0) ?
+            (static_cast<double>(simulation.totalResultLatency) / static_cast<double>(simulation.queriesCompleted)) : 0;
+        state.SetItemsProcessed(state.iterations() * keystrokes.size());
+    }
+    BENCHMARK(BM_SimulateDebounce)->ArgNames({ "adaptive", "typist", "indexer" })->ArgsProduct({ { 0, 1 }, { 0, 1, 2 }, { 0, 1 } })
+        ->Unit(benchmark::kMicrosecond);
+}
@@ -0,0 +1,225 @@
+// The per keystroke and per row paths every query goes through: building the query text, deciding whether the
+// last query can be narrowed down, turning rows into results and finding their thumbnails, and fetching a
+// rowset's worth of rows through the pipeline.
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include "BenchmarkCorpus.h"
+#include "QueryTemplate.h"
+#include "ThumbnailCache.h"
+#include "TrigramIndex.h"
+
+namespace
+{
+    const std::vector<CorpusItem>& GetCorpus()
+    {
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(20000);
+        return s_corpus;
+    }
+
+    // Someone typing "quarterly report", one query per keystroke
+    const std::vector<std::wstring>& GetKeystrokes()
+    {
+        static const std::vector<std::wstring> s_keystrokes = []()
+        {
+            const std::wstring text(L"quarterly report");
+            std::vector<std::wstring> keystrokes;
+            for (size_t i = 1; i <= text.size(); ++i)
+            {
+                keystrokes.push_back(text.substr(0, i));
+            }
+            return keystrokes;
+        }();
+        return s_keystrokes;
+    }
+
+    void BM_QueryTemplateFill(benchmark::State& state)
+    {
+        const bool contentSearch = state.range(0) != 0;
+        const QueryTemplate compiled(
+            L"SELECT TOP 5000 \"System.ItemUrl\", \"System.ItemNameDisplay\", \"path\", \"System.Search.EntryID\", \"System.Kind\", "
+            L"\"System.KindText\", \"System.Search.GatherTime\", \"System.Search.QueryPropertyHits\" FROM \"SystemIndex\" WHERE "
+            L"(SCOPE='file:' OR SCOPE='mapi:' OR SCOPE='mapi16:')",
+            L" ORDER BY System.Search.Rank, System.DateModified, System.ItemNameDisplay DESC");
+        auto const& keystrokes = GetKeystrokes();
+
+        std::wstring query;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            compiled.Fill(query, keystrokes[i++ % keystrokes.size()], contentSearch, 7);
+            benchmark::DoNotOptimize(query.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_QueryTemplateFill)->ArgName("content")->Arg(0)->Arg(1);
+
+    void BM_IsSearchTextPrefix(benchmark::State& state)
+    {
+        auto const& keystrokes = GetKeystrokes();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            const size_t next = (i++ % (keystrokes.size() - 1)) + 1;
+            benchmark::DoNotOptimize(IsSearchTextPrefix(keystrokes[next - 1], keystrokes[next]));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_IsSearchTextPrefix);
+
+    void BM_UrlToFilePath(benchmark::State& state)
+    {
+        auto const& corpus = GetCorpus();
+        std::wstring path;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            path.assign(corpus[i++ % corpus.size()].url);
+            benchmark::DoNotOptimize(UrlToFilePath(path));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_UrlToFilePath);
+
+    void BM_IsMailUrl(benchmark::State& state)
+    {
+        auto const& corpus = GetCorpus();
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(IsMailUrl(corpus[i++ % corpus.size()].url));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_IsMailUrl);
+
+    void BM_ClassifyItem(benchmark::State& state)
+    {
+        auto const& corpus = GetCorpus();
+        StringAtomTable atoms;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            CorpusItem const& item = corpus[i++ % corpus.size()];
+            benchmark::DoNotOptimize(ClassifyItem(atoms, item.url, item.kind));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ClassifyItem);
+
+    // What every shown row does for its thumbnail once the extensions have been loaded
+    void BM_ThumbnailCacheFind(benchmark::State& state)
+    {
+        using Thumbnail = std::shared_ptr<const std::vector<uint8_t>>;
+        auto const& corpus = GetCorpus();
+        StringAtomTable atoms;
+        ExtensionThumbnailCache<Thumbnail> cache;
+        std::vector<StringAtom> keys;
+        for (auto const& item : corpus)
+        {
+            const StringAtom key = ClassifyItem(atoms, item.url, item.kind).GetThumbnailKey();
+            if (cache.NeedProcessThumbnailForItem(key))
+            {
+                cache.Add(key, std::make_shared<const std::vector<uint8_t>>(256));
+            }
+            keys.push_back(key);
+        }
+
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(cache.Find(keys[i++ % keys.size()]));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ThumbnailCacheFind);
+
+    void BM_ResultStoreAppend(benchmark::State& state)
+    {
+        auto const& corpus = GetCorpus();
+        ResultStore store;
+        for (auto _ : state)
+        {
+            store.Clear();
+            for (auto const& item : corpus)
+            {
+                AppendSearchResult(store, item.name, item.url, item.kind);
+            }
+            benchmark::DoNotOptimize(store.Size());
+        }
+        state.SetItemsProcessed(state.iterations() * corpus.size());
+    }
+    BENCHMARK(BM_ResultStoreAppend);
+
+    void BM_ResultStoreGetRow(benchmark::State& state)
+    {
+        auto const& corpus = GetCorpus();
+        ResultStore store;
+        for (auto const& item : corpus)
+        {
+            AppendSearchResult(store, item.name, item.url, item.kind);
+        }
+
+        ResultRowBuffer buffer;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(store.GetRow(i++ % store.Size(), buffer));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ResultStoreGetRow);
+
+    void BM_TrigramFind(benchmark::State& state)
+    {
+        static const std::shared_ptr<const TrigramFilenameIndex> s_index = []()
+        {
+            auto index = std::make_shared<TrigramFilenameIndex>(200000);
+            for (auto const& item : MakeCorpus(100000, 2))
+            {
+                index->Add(item.name, item.url, item.kind);
+            }
+            index->Finalize();
+            return index;
+        }();
+
+        const wchar_t* const terms[] = { L"quarterly", L"report", L"invoice 1", L"holiday photo", L"setup.exe" };
+        std::vector<uint32_t> ids;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            s_index->Find(terms[i++ % (sizeof(terms) / sizeof(terms[0]))], 50, ids);
+            benchmark::DoNotOptimize(ids.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_TrigramFind);
+
+    // FetchRows over a stand-in rowset: the whole corpus replayed without waiting, turned into results on the
+    // pipeline's workers and appended to the query's results in order
+    void BM_FetchRowsPipelined(benchmark::State& state)
+    {
+        const size_t workers = static_cast<size_t>(state.range(0));
+        auto const& corpus = GetCorpus();
+        const RecordedQuery query = MakeCorpusQuery(corpus, 256, 200, 5);
+
+        AdaptiveBatchSizeController controller(64, 16384, 2);
+        ResultStore store;
+        for (auto _ : state)
+        {
+            store.Clear();
+            ReplayRowBatchSource source(query, GetCorpusColumns(), 0);
+            FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), workers, 2, controller, corpus.size(), MaterializeCorpusRow,
+                [&](FetchedRowBatch const&, ResultStore const& results)
+                {
+                    for (size_t i = 0; i < results.Size(); ++i)
+                    {
+                        store.AppendFrom(results, i);
+                    }
+                });
+            benchmark::DoNotOptimize(store.Size());
+        }
+        state.SetItemsProcessed(state.iterations() * corpus.size());
+    }
+    BENCHMARK(BM_FetchRowsPipelined)->ArgName("workers")->Arg(1)->Arg(2)->UseRealTime();
+}
@@ -0,0 +1,160 @@
+// QueryFlightRecorder keeping the last few queries in its slots and within its budgets, holding slow query dumps
+// to one per interval, and WriteChromeTrace escaping whatever SQL it's handed
+#include <gtest/gtest.h>
+
+#include "QueryFlightRecorder.h"
+
+namespace
+{
+    struct Dump
+    {
+        uint32_t cookie;
+        std::vector<QueryTimeline> window;
+    };
+
+    QueryFlightRecorder MakeRecorder(size_t queryCount, size_t eventsPerQuery, size_t textCharsPerQuery, std::vector<Dump>* dumps = nullptr)
+    {
+        return QueryFlightRecorder(queryCount, eventsPerQuery, textCharsPerQuery, 100, 1000, [dumps](uint32_t cookie, std::vector<QueryTimeline>&& window)
+            {
+                if (dumps != nullptr)
+                {
+                    dumps->push_back({ cookie, std::move(window) });
+                }
+            });
+    }
+
+    std::vector<uint32_t> Cookies(std::vector<QueryTimeline> const& window)
+    {
+        std::vector<uint32_t> cookies;
+        for (auto const& timeline : window)
+        {
+            cookies.push_back(timeline.cookie);
+        }
+        return cookies;
+    }
+}
+
+// A newer query takes its slot over from the one before it, and anything late from the old one is dropped
+// instead of ending up on the new one
+TEST(QueryFlightRecorderTests, NewerQueriesTakeOverSlots)
+{
+    QueryFlightRecorder recorder = MakeRecorder(4, 16, 64);
+    recorder.OnSpan(0, QueryStage::Execute, 0, 10, 0, 0); // not a query
+    for (uint32_t cookie = 1; cookie <= 4; ++cookie)
+    {
+        recorder.OnSpan(cookie, QueryStage::Execute, cookie, 10, 0, 0);
+    }
+    EXPECT_EQ(Cookies(recorder.Snapshot()), (std::vector<uint32_t>{ 1, 2, 3, 4 }));
+
+    recorder.OnSpan(6, QueryStage::Execute, 6, 10, 0, 0);
+    recorder.OnSpan(2, QueryStage::FirstRows, 7, 10, 0, 0);
+    recorder.OnQuery(2, L"SELECT late", 0);
+    recorder.OnSpan(2, QueryStage::CreateResult, 8, 10, 0, 0);
+
+    const std::vector<QueryTimeline> window = recorder.Snapshot();
+    ASSERT_EQ(Cookies(window), (std::vector<uint32_t>{ 1, 3, 4, 6 }));
+    QueryTimeline const& taken = window[3];
+    ASSERT_EQ(taken.events.size(), 1u);
+    EXPECT_EQ(taken.events[0].stage, QueryStage::Execute);
+    EXPECT_EQ(taken.events[0].start, 6u);
+    EXPECT_TRUE(taken.text.empty());
+    EXPECT_EQ(taken.resultsCreated, 0u);
+}
+
+// Past its event budget a query only counts what it dropped, the per row spans are added up instead of kept
+TEST(QueryFlightRecorderTests, EventsPastTheBudgetAreCounted)
+{
+    QueryFlightRecorder recorder = MakeRecorder(2, 3, 64);
+    for (uint64_t i = 0; i < 5; ++i)
+    {
+        recorder.OnSpan(1, QueryStage::NextRows, i, 10, 100, i);
+    }
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        recorder.OnSpan(1, QueryStage::CreateResult, i, 2, 0, 0);
+    }
+
+    const std::vector<QueryTimeline> window = recorder.Snapshot();
+    ASSERT_EQ(window.size(), 1u);
+    ASSERT_EQ(window[0].events.size(), 3u);
+    EXPECT_EQ(window[0].events[2].arg1, 2u);
+    EXPECT_EQ(window[0].droppedEvents, 2u);
+    EXPECT_EQ(window[0].resultsCreated, 100u);
+    EXPECT_EQ(window[0].createResultMicroseconds, 200u);
+}
+
+// SQL is kept up to the character budget, what's cut off is counted, and the query still gets its event
+TEST(QueryFlightRecorderTests, SqlPastTheBudgetIsCut)
+{
+    QueryFlightRecorder recorder = MakeRecorder(2, 16, 10);
+    recorder.OnQuery(1, L"SELECT a", 3);
+    recorder.OnQuery(1, L"SELECT b", 4);
+    recorder.OnQuery(1, L"SELECT c", 5);
+
+    const std::vector<QueryTimeline> window = recorder.Snapshot();
+    ASSERT_EQ(window.size(), 1u);
+    QueryTimeline const& timeline = window[0];
+    EXPECT_EQ(timeline.text, L"SELECT aSE");
+    EXPECT_EQ(timeline.droppedChars, 14u);
+    ASSERT_EQ(timeline.events.size(), 3u);
+    auto sql = [&](size_t i) { return std::wstring_view(timeline.text).substr(timeline.events[i].textOffset, timeline.events[i].textLength); };
+    EXPECT_EQ(sql(0), L"SELECT a");
+    EXPECT_EQ(sql(1), L"SE");
+    EXPECT_EQ(sql(2), L"");
+    EXPECT_EQ(timeline.events[2].stage, QueryStage::Count);
+    EXPECT_EQ(timeline.events[2].arg0, 5u);
+}
+
+// Only a query that took the threshold or longer is dumped, and then no more than once per interval
+TEST(QueryFlightRecorderTests, SlowQueryDumpsAreRateLimited)
+{
+    std::vector<Dump> dumps;
+    QueryFlightRecorder recorder = MakeRecorder(8, 16, 64, &dumps);
+    recorder.OnSpan(1, QueryStage::Complete, 0, 99, 0, 0);
+    EXPECT_TRUE(dumps.empty());
+
+    recorder.OnSpan(2, QueryStage::Execute, 0, 500, 0, 0); // slow, but not the whole query
+    EXPECT_TRUE(dumps.empty());
+
+    recorder.OnSpan(2, QueryStage::Complete, 0, 100, 0, 0);
+    ASSERT_EQ(dumps.size(), 1u);
+    EXPECT_EQ(dumps[0].cookie, 2u);
+    EXPECT_EQ(Cookies(dumps[0].window), (std::vector<uint32_t>{ 1, 2 }));
+
+    recorder.OnSpan(3, QueryStage::Complete, 500, 500, 0, 0); // 900us after the last dump
+    EXPECT_EQ(dumps.size(), 1u);
+
+    recorder.OnSpan(4, QueryStage::Complete, 900, 200, 0, 0); // 1000us after it
+    ASSERT_EQ(dumps.size(), 2u);
+    EXPECT_EQ(dumps[1].cookie, 4u);
+    EXPECT_EQ(Cookies(dumps[1].window), (std::vector<uint32_t>{ 1, 2, 3, 4 }));
+}
+
+// Quotes and backslashes are escaped, control characters written out as \u, and everything else goes out as
+// UTF-8, a character outside the BMP as one four byte sequence whether wchar_t held it as a surrogate pair or not
+TEST(QueryFlightRecorderTests, ChromeTraceEscapesSql)
+{
+    QueryFlightRecorder recorder = MakeRecorder(2, 16, 256);
+    recorder.OnQuery(1, L"'a\"b\\c'\n\t\x01 caf\u00E9 \u20AC \U0001F600", 9);
+    const std::string json = WriteChromeTrace(recorder.Snapshot());
+
+    EXPECT_NE(json.find("\"sql\":\"'a\\\"b\\\\c'\\u000a\\u0009\\u0001 caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80\"}}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"reuseWhereId\":9"), std::string::npos);
+}
+
+// Every query gets a track named for it, the spans measured from the keystroke go on it and the rest on the
+// thread that recorded them, and Complete carries what the timeline had to add up or leave out
+TEST(QueryFlightRecorderTests, ChromeTraceEvents)
+{
+    QueryFlightRecorder recorder = MakeRecorder(2, 1, 256);
+    recorder.OnSpan(3, QueryStage::Complete, 40, 60, 0, 0);
+    recorder.OnSpan(3, QueryStage::NextRows, 50, 5, 100, 20);
+    recorder.OnSpan(3, QueryStage::CreateResult, 55, 7, 0, 0);
+    const std::string json = WriteChromeTrace(recorder.Snapshot());
+
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", 0), 0u);
+    EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+    EXPECT_NE(json.find("{\"ph\":\"M\",\"pid\":1,\"tid\":1000003,\"name\":\"thread_name\",\"args\":{\"name\":\"Query 3\"}}"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"tid\":1000003,\"name\":\"Complete\",\"ts\":40,\"dur\":60,\"args\":{\"cookie\":3,\"resultsCreated\":1,"
+        "\"createResultUs\":7,\"droppedEvents\":1,\"droppedSqlChars\":0}}"), std::string::npos) << json;
+}
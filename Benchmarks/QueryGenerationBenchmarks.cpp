@@ -0,0 +1,173 @@
+// Building a keystroke's query text: the way QueryStringBuilder used to, a fresh builder per keystroke putting
+// the projection, the scope and the search terms together with string concatenation, against filling the
+// compiled QueryTemplate into a buffer that is kept from one keystroke to the next. The old builder also asked
+// User::FindAllAsync for the profiles to leave out on every keystroke, which can't be stood in for here, so
+// the difference in the app is bigger than this.
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include "AllocationCounter.h"
+#include "QueryTemplate.h"
+
+namespace
+{
+    const wchar_t* const c_select = L"SELECT";
+    const wchar_t* const c_fromIndex = L"FROM SystemIndex WHERE";
+    const wchar_t* const c_scopeFileConditions = L" SCOPE='file:' AND SCOPE <> 'file://C:/users/tltay'";
+    const wchar_t* const c_scopeEmailConditions = L" OR SCOPE='mapi:' OR SCOPE='mapi16:'";
+    const wchar_t* const c_orderConditions = L" ORDER BY System.Search.Rank, System.DateModified, System.ItemNameDisplay DESC";
+
+    // QueryStringBuilder before its query templates, less the user scope
+    struct ConcatenatingQueryBuilder
+    {
+        std::vector<std::wstring> m_properties{ L"System.ItemUrl", L"System.ItemNameDisplay", L"path", L"System.Search.EntryID",
+            L"System.Kind", L"System.KindText", L"System.Search.GatherTime", L"System.Search.QueryPropertyHits" };
+
+        std::wstring GenerateProperties()
+        {
+            std::wstring propertyStr;
+            for (auto prop : m_properties)
+            {
+                propertyStr += L' ';
+                propertyStr += prop.c_str();
+                propertyStr += L',';
+            }
+            propertyStr.pop_back();
+            propertyStr += L' ';
+            return propertyStr;
+        }
+
+        std::wstring GenerateSelectQueryWithScope(bool mailSearchEnabled)
+        {
+            std::wstring queryStr(c_select);
+            queryStr += GenerateProperties();
+            queryStr += c_fromIndex;
+            queryStr += L' ';
+            queryStr += L"(";
+            queryStr += c_scopeFileConditions;
+            if (mailSearchEnabled)
+            {
+                queryStr += c_scopeEmailConditions;
+            }
+            queryStr += L")";
+            return queryStr;
+        }
+
+        std::vector<std::wstring> GenerateSearchQueryTokens(const wchar_t* searchText)
+        {
+            std::vector<std::wstring> strings;
+            std::wstringstream f(searchText);
+            std::wstring s;
+            while (std::getline(f, s, L' ')) {
+                strings.push_back(s);
+            }
+            return strings;
+        }
+
+        std::wstring GenerateQuery(const wchar_t* searchText, bool contentSearchEnabled, bool mailSearchEnabled, uint32_t whereId)
+        {
+            std::wstring queryStr(GenerateSelectQueryWithScope(mailSearchEnabled));
+            size_t lenSearchText = wcslen(searchText);
+
+            if ((lenSearchText > 0))
+            {
+                queryStr += L" AND (CONTAINS(System.ItemNameDisplay, '\"";
+                queryStr += searchText;
+                queryStr += L"*\"')";
+            }
+
+            std::vector<std::wstring> tokens = GenerateSearchQueryTokens(searchText);
+
+            if (contentSearchEnabled && (lenSearchText > 0))
+            {
+                queryStr += L" OR (";
+                for (size_t i = 0; i < tokens.size(); ++i)
+                {
+                    queryStr += L"CONTAINS(*, '\"";
+                    queryStr += tokens[i].c_str();
+                    queryStr += L"*\"')";
+
+                    if (i < (tokens.size() - 1))
+                    {
+                        queryStr += L" AND ";
+                    }
+                }
+                queryStr += L')';
+            }
+
+            if (lenSearchText)
+            {
+                queryStr += L")";
+            }
+
+            queryStr += L" AND ReuseWhere(";
+            queryStr += std::to_wstring(whereId);
+            queryStr += L")";
+
+            queryStr += c_orderConditions;
+            return queryStr;
+        }
+    };
+
+    // Someone typing "quarterly sales report", one query per keystroke
+    const std::vector<std::wstring>& GetKeystrokes()
+    {
+        static const std::vector<std::wstring> s_keystrokes = []()
+        {
+            const std::wstring text(L"quarterly sales report");
+            std::vector<std::wstring> keystrokes;
+            for (size_t i = 1; i <= text.size(); ++i)
+            {
+                keystrokes.push_back(text.substr(0, i));
+            }
+            return keystrokes;
+        }();
+        return s_keystrokes;
+    }
+
+    void BM_GenerateQuery(benchmark::State& state)
+    {
+        const bool compiled = state.range(0) != 0;
+        const bool contentSearch = state.range(1) != 0;
+        const QueryTemplate queryTemplate(ConcatenatingQueryBuilder().GenerateSelectQueryWithScope(true), c_orderConditions);
+        auto const& keystrokes = GetKeystrokes();
+
+        // Both have to come up with the same query or there's nothing to compare
+        std::wstring query;
+        for (size_t i = 0; i < keystrokes.size(); ++i)
+        {
+            queryTemplate.Fill(query, keystrokes[i], contentSearch, static_cast<uint32_t>(i));
+            if (query != ConcatenatingQueryBuilder().GenerateQuery(keystrokes[i].c_str(), contentSearch, true, static_cast<uint32_t>(i)))
+            {
+                state.SkipWithError("the template's query doesn't match the builder's");
+                return;
+            }
+        }
+
+        size_t i = 0;
+        AllocationScope allocations;
+        for (auto _ : state)
+        {
+            std::wstring const& keystroke = keystrokes[i % keystrokes.size()];
+            const uint32_t whereId = static_cast<uint32_t>(i++);
+            if (compiled)
+            {
+                queryTemplate.Fill(query, keystroke, contentSearch, whereId);
+                benchmark::DoNotOptimize(query.data());
+            }
+            else
+            {
+                // A builder per keystroke, like SearchUXQueryHelper::ExecuteSyncInternal had
+                ConcatenatingQueryBuilder builder;
+                std::wstring generated = builder.GenerateQuery(keystroke.c_str(), contentSearch, true, whereId);
+                benchmark::DoNotOptimize(generated.data());
+            }
+        }
+
+        const AllocationCounts counts = allocations.Elapsed();
+        state.counters["allocs_per_query"] = static_cast<double>(counts.allocations) / static_cast<double>(state.iterations());
+        state.counters["bytes_per_query"] = static_cast<double>(counts.bytes) / static_cast<double>(state.iterations());
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_GenerateQuery)->ArgNames({ "template", "content" })->ArgsProduct({ { 0, 1 }, { 0, 1 } });
+}
@@ -0,0 +1,70 @@
+// What recording a span costs, since the tracker is left on in production and CreateResult records one per row.
+// With and without a listener, from one thread and from several at once into the same histograms.
+#include <benchmark/benchmark.h>
+
+#include "QueryLatency.h"
+
+namespace
+{
+    struct NullListener : public IQueryLatencyListener
+    {
+        void OnSpan(uint32_t, QueryStage, uint64_t, uint64_t microseconds, uint64_t, uint64_t) override
+        {
+            benchmark::DoNotOptimize(microseconds);
+        }
+    };
+
+    QueryLatencyTracker& GetTracker(bool listening)
+    {
+        static NullListener s_listener;
+        static QueryLatencyTracker s_tracker;
+        static QueryLatencyTracker s_listenedTracker(&s_listener);
+        return listening ? s_listenedTracker : s_tracker;
+    }
+
+    void BM_RecordSpan(benchmark::State& state)
+    {
+        QueryLatencyTracker& tracker = GetTracker(state.range(0) != 0);
+        if (state.thread_index() == 0)
+        {
+            tracker.OnKeystroke(1, 0);
+        }
+
+        uint64_t microseconds = static_cast<uint64_t>(state.thread_index());
+        for (auto _ : state)
+        {
+            tracker.RecordSpan(1, QueryStage::CreateResult, 0, microseconds);
+            microseconds = (microseconds + 37) % 5000;
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_RecordSpan)->ArgName("listener")->Arg(0)->Arg(1);
+    BENCHMARK(BM_RecordSpan)->ArgName("listener")->Arg(0)->Threads(4)->UseRealTime();
+
+    // A span the way the app records one, with its two clock reads
+    void BM_QueryLatencySpan(benchmark::State& state)
+    {
+        QueryLatencyTracker& tracker = GetTracker(false);
+        for (auto _ : state)
+        {
+            QueryLatencySpan span(tracker, 1, QueryStage::CreateResult);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_QueryLatencySpan);
+
+    void BM_SummarizeStage(benchmark::State& state)
+    {
+        QueryLatencyTracker& tracker = GetTracker(false);
+        for (uint64_t i = 0; i < 100000; ++i)
+        {
+            tracker.Record(0, QueryStage::NextRows, (i * 7919) % 200000);
+        }
+
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(tracker.Summarize(QueryStage::NextRows));
+        }
+    }
+    BENCHMARK(BM_SummarizeStage);
+}
@@ -0,0 +1,168 @@
+// LatencyHistogram's buckets and percentiles, and QueryLatencyTracker charging spans to the queries they're for
+#include <gtest/gtest.h>
+
+#include <vector>
+#include "QueryLatency.h"
+
+namespace
+{
+    struct RecordedSpan
+    {
+        uint32_t cookie;
+        QueryStage stage;
+        uint64_t start;
+        uint64_t microseconds;
+        uint64_t arg0;
+        uint64_t arg1;
+    };
+
+    struct SpanListener : public IQueryLatencyListener
+    {
+        void OnSpan(uint32_t cookie, QueryStage stage, uint64_t start, uint64_t microseconds, uint64_t arg0, uint64_t arg1) override
+        {
+            spans.push_back({ cookie, stage, start, microseconds, arg0, arg1 });
+        }
+
+        std::vector<RecordedSpan> spans;
+    };
+
+    uint64_t Stage(QueryLatencyBreakdown const& breakdown, QueryStage stage)
+    {
+        return breakdown.stageMicroseconds[static_cast<size_t>(stage)];
+    }
+}
+
+// Below the sub bucket count every value has a bucket of its own
+TEST(QueryLatencyTests, SmallValuesAreExact)
+{
+    for (uint64_t value = 0; value < 32; ++value)
+    {
+        EXPECT_EQ(LatencyHistogram::GetEquivalentValue(value), value);
+    }
+}
+
+// Past that a bucket is a 32nd of its power of two, so it is never off by more than about 3%, and the buckets
+// cover every value without overlapping
+TEST(QueryLatencyTests, BucketsStayWithinTheirPrecision)
+{
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(32), 32u);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(63), 63u);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(64), 65u);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(65), 65u);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(66), 67u);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(1000), 1007u);
+
+    uint64_t previous = 0;
+    for (uint64_t value = 1; value < (1ull << 22); value += 1 + (value / 997))
+    {
+        const uint64_t equivalent = LatencyHistogram::GetEquivalentValue(value);
+        ASSERT_GE(equivalent, value);
+        ASSERT_LE(equivalent - value, value / 32) << value;
+        ASSERT_GE(equivalent, previous) << value;
+        ASSERT_EQ(LatencyHistogram::GetEquivalentValue(equivalent), equivalent) << value;
+        ASSERT_GT(LatencyHistogram::GetEquivalentValue(equivalent + 1), equivalent) << value;
+        previous = equivalent;
+    }
+}
+
+// Anything past the top bucket is clamped into it
+TEST(QueryLatencyTests, HugeValuesAreClamped)
+{
+    const uint64_t top = (1ull << 38) - 1;
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(top), top);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(1ull << 38), top);
+    EXPECT_EQ(LatencyHistogram::GetEquivalentValue(UINT64_MAX), top);
+
+    LatencyHistogram histogram;
+    histogram.Record(1ull << 40);
+    const LatencySummary summary = histogram.Summarize();
+    EXPECT_EQ(summary.p50, top);
+    EXPECT_EQ(summary.max, 1ull << 40);
+}
+
+TEST(QueryLatencyTests, PercentilesAreTheirBucketsLargestValue)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.Summarize().count, 0u);
+    EXPECT_EQ(histogram.Summarize().p99, 0u);
+
+    for (uint64_t value = 1; value <= 100; ++value)
+    {
+        histogram.Record(value);
+    }
+
+    const LatencySummary summary = histogram.Summarize();
+    EXPECT_EQ(summary.count, 100u);
+    EXPECT_EQ(summary.mean, 50u);
+    EXPECT_EQ(summary.max, 100u);
+    EXPECT_EQ(summary.p50, 50u);
+    EXPECT_EQ(summary.p90, LatencyHistogram::GetEquivalentValue(90));
+    EXPECT_EQ(summary.p90, 91u);
+    EXPECT_EQ(summary.p99, 99u);
+}
+
+// A percentile never comes out past the largest value recorded
+TEST(QueryLatencyTests, PercentilesAreCappedAtTheMax)
+{
+    LatencyHistogram histogram;
+    histogram.Record(1000);
+    const LatencySummary summary = histogram.Summarize();
+    EXPECT_EQ(summary.p50, 1000u);
+    EXPECT_EQ(summary.p99, 1000u);
+
+    histogram.Record(0);
+    EXPECT_EQ(histogram.Summarize().p50, 0u);
+}
+
+TEST(QueryLatencyTests, SpansAreChargedToTheirQuery)
+{
+    SpanListener listener;
+    QueryLatencyTracker tracker(&listener);
+    tracker.OnKeystroke(7, 1000);
+    tracker.RecordSpan(7, QueryStage::CreateResult, 1100, 10, 1, 2);
+    tracker.RecordSpan(7, QueryStage::CreateResult, 1110, 15);
+    tracker.RecordSpan(8, QueryStage::Execute, 1200, 50); // never had a keystroke
+    tracker.RecordSpan(0, QueryStage::Thumbnail, 1300, 70);
+    tracker.RecordSinceKeystroke(7, QueryStage::FirstBind, 1400);
+
+    QueryLatencyBreakdown breakdown;
+    ASSERT_TRUE(tracker.GetBreakdown(7, breakdown));
+    EXPECT_EQ(Stage(breakdown, QueryStage::CreateResult), 25u);
+    EXPECT_EQ(Stage(breakdown, QueryStage::FirstBind), 400u);
+    EXPECT_EQ(Stage(breakdown, QueryStage::Execute), 0u);
+    EXPECT_EQ(Stage(breakdown, QueryStage::Thumbnail), 0u);
+    EXPECT_FALSE(tracker.GetBreakdown(8, breakdown));
+
+    // Every span goes into its stage's histogram whatever query it was for
+    EXPECT_EQ(tracker.Summarize(QueryStage::CreateResult).count, 2u);
+    EXPECT_EQ(tracker.Summarize(QueryStage::Execute).count, 1u);
+    EXPECT_EQ(tracker.Summarize(QueryStage::Thumbnail).count, 1u);
+
+    ASSERT_EQ(listener.spans.size(), 5u);
+    EXPECT_EQ(listener.spans[0].arg0, 1u);
+    EXPECT_EQ(listener.spans[0].arg1, 2u);
+    EXPECT_EQ(listener.spans[4].stage, QueryStage::FirstBind);
+    EXPECT_EQ(listener.spans[4].start, 1000u);
+    EXPECT_EQ(listener.spans[4].microseconds, 400u);
+}
+
+// A query's slot goes to the one 64 keystrokes later, after that the old one is forgotten
+TEST(QueryLatencyTests, NewerQueriesTakeOverSlots)
+{
+    QueryLatencyTracker tracker;
+    tracker.OnKeystroke(1, 0);
+    tracker.RecordSpan(1, QueryStage::Execute, 0, 100);
+    tracker.OnKeystroke(65, 500);
+
+    QueryLatencyBreakdown breakdown;
+    EXPECT_FALSE(tracker.GetBreakdown(1, breakdown));
+    ASSERT_TRUE(tracker.GetBreakdown(65, breakdown));
+    EXPECT_EQ(Stage(breakdown, QueryStage::Execute), 0u);
+
+    // Nothing late from the old query ends up on the new one
+    tracker.RecordSpan(1, QueryStage::Execute, 0, 100);
+    tracker.RecordSinceKeystroke(1, QueryStage::Complete, 1000);
+    ASSERT_TRUE(tracker.GetBreakdown(65, breakdown));
+    EXPECT_EQ(Stage(breakdown, QueryStage::Execute), 0u);
+    EXPECT_EQ(tracker.Summarize(QueryStage::Complete).count, 0u);
+}
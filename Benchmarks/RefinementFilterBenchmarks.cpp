@@ -0,0 +1,86 @@
+// Refining the previous results for a longer text, over as many results as the helper will refine locally and
+// over ten times that. The matcher against lower casing every name and searching it, the straightforward way.
+#include <benchmark/benchmark.h>
+
+#include <cwctype>
+#include "BenchmarkCorpus.h"
+#include "RefinementFilter.h"
+
+namespace
+{
+    const wchar_t* const c_refinements[] = { L"quarterly r", L"invoice 1", L"holiday p", L"setup.", L"zzz" };
+    constexpr size_t c_refinementCount{ sizeof(c_refinements) / sizeof(c_refinements[0]) };
+
+    const std::vector<std::wstring>& GetNames()
+    {
+        static const std::vector<std::wstring> s_names = []()
+        {
+            std::vector<std::wstring> names;
+            for (auto const& item : MakeCorpus(20000, 4))
+            {
+                names.push_back(item.name);
+            }
+            return names;
+        }();
+        return s_names;
+    }
+
+    void BM_RefineResults(benchmark::State& state)
+    {
+        const size_t count = static_cast<size_t>(state.range(0));
+        auto const& names = GetNames();
+
+        size_t i = 0;
+        size_t matched = 0;
+        for (auto _ : state)
+        {
+            std::vector<size_t> matches = RefineResults(count, c_refinements[i++ % c_refinementCount], [&](size_t item)
+                {
+                    return std::wstring_view(names[item]);
+                });
+            matched += matches.size();
+            benchmark::DoNotOptimize(matches.data());
+        }
+        state.counters["matches"] = static_cast<double>(matched) / static_cast<double>(state.iterations());
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_RefineResults)->ArgName("results")->Arg(2000)->Arg(20000);
+
+    void BM_RefineResultsLowerCaseFind(benchmark::State& state)
+    {
+        const size_t count = static_cast<size_t>(state.range(0));
+        auto const& names = GetNames();
+
+        size_t i = 0;
+        size_t matched = 0;
+        std::wstring lower;
+        for (auto _ : state)
+        {
+            std::wstring needle(c_refinements[i++ % c_refinementCount]);
+            std::vector<size_t> matches;
+            for (size_t item = 0; item < count; ++item)
+            {
+                lower.clear();
+                for (wchar_t ch : names[item])
+                {
+                    lower += static_cast<wchar_t>(std::towlower(ch));
+                }
+
+                // Word starts only, like the matcher
+                for (size_t pos = lower.find(needle); pos != std::wstring::npos; pos = lower.find(needle, pos + 1))
+                {
+                    if ((pos == 0) || !std::iswalnum(lower[pos - 1]))
+                    {
+                        matches.push_back(item);
+                        break;
+                    }
+                }
+            }
+            matched += matches.size();
+            benchmark::DoNotOptimize(matches.data());
+        }
+        state.counters["matches"] = static_cast<double>(matched) / static_cast<double>(state.iterations());
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_RefineResultsLowerCaseFind)->ArgName("results")->Arg(2000)->Arg(20000);
+}
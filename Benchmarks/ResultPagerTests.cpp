@@ -0,0 +1,139 @@
+// ResultPager over a million row stand-in rowset, driven the way SearchUXQueryHelper drives it: the first pages
+// when the query runs, then another request each time the list is scrolled to its end. What's pulled off of the
+// rowset has to follow how far the list got, not how many rows matched.
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include "ResultPager.h"
+
+namespace
+{
+    constexpr size_t c_rowsetRows{ 1000000 };
+    constexpr size_t c_pageSize{ 50 };
+
+    // Hands out rows until it runs out, and says so once a fetch comes back short like GetNextRows does
+    struct FakeRowset
+    {
+        explicit FakeRowset(size_t rows) : m_rows(rows) {}
+
+        size_t Fetch(size_t rows, bool& exhausted)
+        {
+            const size_t fetched = (std::min)(rows, m_rows - m_cursor);
+            m_cursor += fetched;
+            m_calls++;
+            exhausted = fetched < rows;
+            return fetched;
+        }
+
+        size_t Cursor() const { return m_cursor; }
+        size_t Calls() const { return m_calls; }
+
+    private:
+        const size_t m_rows;
+        size_t m_cursor{};
+        size_t m_calls{};
+    };
+
+    // What ExecuteQueryStringSync and OnPostFetchRows do
+    void FetchFirstPages(ResultPager& pager, FakeRowset& rowset, size_t firstPageSize)
+    {
+        pager.Reset(firstPageSize);
+        bool exhausted = false;
+        const size_t fetched = rowset.Fetch(pager.InitialFetchSize(), exhausted);
+        pager.OnRowsFetched(fetched, exhausted);
+    }
+
+    // What LoadMoreResults does when the list asks for count more
+    size_t LoadMore(ResultPager& pager, FakeRowset& rowset, size_t count)
+    {
+        const size_t rows = pager.FetchSizeFor(count);
+        if (rows == 0)
+        {
+            return 0;
+        }
+        bool exhausted = false;
+        const size_t fetched = rowset.Fetch(rows, exhausted);
+        pager.OnRowsFetched(fetched, exhausted);
+        return fetched;
+    }
+}
+
+TEST(ResultPagerTests, FirstFetchOnlyFillsTheViewport)
+{
+    ResultPager pager(c_pageSize, 0);
+    FakeRowset rowset(c_rowsetRows);
+    FetchFirstPages(pager, rowset, 37);
+
+    EXPECT_EQ(rowset.Cursor(), c_pageSize);
+    EXPECT_EQ(pager.FetchedRows(), c_pageSize);
+    EXPECT_TRUE(pager.HasMoreRows());
+}
+
+TEST(ResultPagerTests, ScrollingFetchesWhatTheListAsksFor)
+{
+    ResultPager pager(c_pageSize, 0);
+    FakeRowset rowset(c_rowsetRows);
+    FetchFirstPages(pager, rowset, c_pageSize);
+
+    // A few hundred screens worth of scrolling is still a small slice of the rowset
+    for (size_t scroll = 0; scroll < 200; ++scroll)
+    {
+        EXPECT_EQ(LoadMore(pager, rowset, c_pageSize), c_pageSize);
+    }
+    EXPECT_EQ(rowset.Cursor(), c_pageSize * 201);
+    EXPECT_EQ(pager.FetchedRows(), rowset.Cursor());
+    EXPECT_EQ(rowset.Calls(), 201u);
+    EXPECT_TRUE(pager.HasMoreRows());
+}
+
+TEST(ResultPagerTests, RequestsAreRoundedUpToPagesWithReadAhead)
+{
+    ResultPager pager(c_pageSize, 2);
+    FakeRowset rowset(c_rowsetRows);
+    FetchFirstPages(pager, rowset, 120);
+    EXPECT_EQ(rowset.Cursor(), (3 + 2) * c_pageSize);
+
+    EXPECT_EQ(LoadMore(pager, rowset, 1), (1 + 2) * c_pageSize);
+    EXPECT_EQ(LoadMore(pager, rowset, 0), (1 + 2) * c_pageSize);
+    EXPECT_EQ(LoadMore(pager, rowset, 101), (3 + 2) * c_pageSize);
+}
+
+TEST(ResultPagerTests, ScrollingToTheEndReachesEveryRowOnce)
+{
+    ResultPager pager(c_pageSize, 0);
+    FakeRowset rowset(c_rowsetRows);
+    FetchFirstPages(pager, rowset, c_pageSize);
+
+    // Fling to the bottom, the list asks for a lot more at a time
+    size_t requests = 0;
+    while (pager.HasMoreRows())
+    {
+        LoadMore(pager, rowset, 4096);
+        ASSERT_LT(++requests, c_rowsetRows / 4096 + 2);
+    }
+    EXPECT_EQ(rowset.Cursor(), c_rowsetRows);
+    EXPECT_EQ(pager.FetchedRows(), c_rowsetRows);
+
+    // Once it's exhausted nothing more gets asked of the rowset
+    const size_t calls = rowset.Calls();
+    EXPECT_EQ(pager.FetchSizeFor(c_pageSize), 0u);
+    EXPECT_EQ(LoadMore(pager, rowset, c_pageSize), 0u);
+    EXPECT_EQ(rowset.Calls(), calls);
+}
+
+TEST(ResultPagerTests, ResetStartsTheNextRowsetOver)
+{
+    ResultPager pager(c_pageSize, 0);
+    FakeRowset first(120);
+    FetchFirstPages(pager, first, c_pageSize);
+    while (LoadMore(pager, first, c_pageSize) > 0)
+    {
+    }
+    ASSERT_FALSE(pager.HasMoreRows());
+
+    FakeRowset second(c_rowsetRows);
+    FetchFirstPages(pager, second, 80);
+    EXPECT_TRUE(pager.HasMoreRows());
+    EXPECT_EQ(pager.FetchedRows(), 2 * c_pageSize);
+    EXPECT_EQ(second.Cursor(), 2 * c_pageSize);
+}
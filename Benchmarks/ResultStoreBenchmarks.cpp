@@ -0,0 +1,341 @@
+// Building a query's results, 100k rows of the corpus: an object per result with strings of its own, the way results
+// were kept before ResultStore, against ResultStore. The time is the whole build, bytes_per_row what it keeps.
+//
+// Also how much front coding the folders and rebuilding file urls saves over keeping a row's url and launch uri as
+// they are, and what putting them back together costs, for the corpus and for a source tree's deep folders.
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <numeric>
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    // A SearchResult before the column store, less the WinRT object around it
+    struct ObjectResult
+    {
+        std::wstring displayName;
+        std::wstring url;
+        std::wstring launchUri;
+        StringAtom thumbnailKey{};
+        bool isMail{};
+        bool isFolder{};
+        bool canDisplay{ true };
+        int64_t rank{};
+    };
+
+    struct ObjectResults
+    {
+    public:
+        void Clear() { m_results.clear(); }
+        size_t Size() const { return m_results.size(); }
+
+        void Append(ResultRow const& row)
+        {
+            auto result = std::make_unique<ObjectResult>();
+            result->displayName = row.displayName;
+            result->url = row.url;
+            result->launchUri = row.launchUri;
+            result->thumbnailKey = row.thumbnailKey;
+            result->isMail = row.isMail;
+            result->isFolder = row.isFolder;
+            result->canDisplay = row.canDisplay;
+            result->rank = row.rank;
+            m_results.push_back(std::move(result));
+        }
+
+        // Strings that fit in the object don't allocate
+        size_t MemoryBytes() const
+        {
+            auto stringBytes = [](std::wstring const& value)
+            {
+                return (value.capacity() > std::wstring().capacity()) ? (value.capacity() + 1) * sizeof(wchar_t) : 0;
+            };
+
+            size_t bytes = m_results.capacity() * sizeof(std::unique_ptr<ObjectResult>);
+            for (auto const& result : m_results)
+            {
+                bytes += sizeof(ObjectResult) + stringBytes(result->displayName) + stringBytes(result->url) + stringBytes(result->launchUri);
+            }
+            return bytes;
+        }
+
+    private:
+        std::vector<std::unique_ptr<ObjectResult>> m_results;
+    };
+
+    // The corpus as the rows the fetch hands the results, classified once up front so only building is timed
+    struct CorpusRows
+    {
+        std::vector<CorpusItem> items;
+        std::vector<std::wstring> launchUris;
+        std::vector<ResultRow> rows;
+    };
+
+    CorpusRows const& GetCorpusRows()
+    {
+        static const CorpusRows s_rows = []()
+        {
+            CorpusRows corpus;
+            corpus.items = MakeCorpus(100000, 3);
+            corpus.launchUris.reserve(corpus.items.size());
+            for (auto const& item : corpus.items)
+            {
+                std::wstring launchUri(item.url);
+                const ItemAtoms atoms = ClassifyItem(GetStringAtoms(), item.url, item.kind);
+                const bool isMail = atoms.IsMail() || !UrlToFilePath(launchUri);
+                corpus.launchUris.push_back(isMail ? item.url : launchUri);
+
+                ResultRow row;
+                row.displayName = item.name;
+                row.url = item.url;
+                row.isMail = isMail;
+                row.isFolder = atoms.IsFolder();
+                row.thumbnailKey = isMail ? c_noAtom : atoms.GetThumbnailKey();
+                row.rank = static_cast<int64_t>(corpus.items.size() - corpus.rows.size());
+                corpus.rows.push_back(row);
+            }
+
+            // Only now that launchUris is done moving
+            for (size_t i = 0; i < corpus.rows.size(); ++i)
+            {
+                corpus.rows[i].launchUri = corpus.launchUris[i];
+            }
+            return corpus;
+        }();
+        return s_rows;
+    }
+
+    // A fresh set of results every iteration, the way the first query of a run builds them
+    template <typename TResults>
+    void BM_BuildResults(benchmark::State& state)
+    {
+        auto const& rows = GetCorpusRows().rows;
+        size_t memoryBytes = 0;
+        for (auto _ : state)
+        {
+            TResults results;
+            for (auto const& row : rows)
+            {
+                results.Append(row);
+            }
+            benchmark::DoNotOptimize(results.Size());
+
+            state.PauseTiming();
+            memoryBytes = results.MemoryBytes();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * rows.size());
+        state.counters["bytes_per_row"] = static_cast<double>(memoryBytes) / static_cast<double>(rows.size());
+    }
+    BENCHMARK_TEMPLATE(BM_BuildResults, ObjectResults)->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_BuildResults, ResultStore)->Unit(benchmark::kMillisecond);
+
+    // Every row's url and launch uri as they are, one after the other in a single buffer
+    struct PlainPathStore
+    {
+    public:
+        void Append(ResultRow const& row)
+        {
+            m_starts.push_back(static_cast<uint32_t>(m_chars.size()));
+            m_chars.append(row.url);
+            m_starts.push_back(static_cast<uint32_t>(m_chars.size()));
+            m_chars.append(row.launchUri);
+        }
+
+        size_t Size() const { return m_starts.size() / 2; }
+
+        void GetPaths(size_t index, ResultRowBuffer& buffer) const
+        {
+            const uint32_t url = m_starts[index * 2];
+            const uint32_t launchUri = m_starts[(index * 2) + 1];
+            const uint32_t end = ((index * 2) + 2 < m_starts.size()) ? m_starts[(index * 2) + 2] : static_cast<uint32_t>(m_chars.size());
+            buffer.url.assign(m_chars, url, launchUri - url);
+            buffer.launchUri.assign(m_chars, launchUri, end - launchUri);
+        }
+
+        size_t MemoryBytes() const
+        {
+            return (m_chars.capacity() * sizeof(wchar_t)) + (m_starts.capacity() * sizeof(uint32_t));
+        }
+
+    private:
+        std::wstring m_chars;
+        std::vector<uint32_t> m_starts;
+    };
+
+    // Counts the rank, date and thumbnail columns too, so what it saves on paths is a little more than it shows
+    struct FrontCodedPathStore
+    {
+    public:
+        void Append(ResultRow const& row)
+        {
+            ResultRow paths;
+            paths.url = row.url;
+            paths.launchUri = row.launchUri;
+            m_results.Append(paths);
+        }
+
+        size_t Size() const { return m_results.Size(); }
+
+        void GetPaths(size_t index, ResultRowBuffer& buffer) const
+        {
+            const ResultRow row = m_results.GetRow(index, buffer);
+            if (row.url.data() != buffer.url.data())
+            {
+                buffer.url.assign(row.url);
+            }
+        }
+
+        size_t MemoryBytes() const { return m_results.MemoryBytes(); }
+
+    private:
+        ResultStore m_results;
+    };
+
+    // Files deep in a few repos, a couple hundred folders each holding a few dozen sources
+    std::vector<CorpusItem> MakeSourceTreeCorpus(size_t count, uint32_t seed)
+    {
+        static const wchar_t* const c_parts[] = {
+            L"src", L"include", L"lib", L"common", L"core", L"platform", L"windows", L"linux", L"net", L"http", L"io",
+            L"storage", L"index", L"query", L"parser", L"util", L"test", L"tests", L"unit", L"integration", L"internal",
+            L"detail", L"impl", L"generated", L"third_party", L"protobuf", L"compiler", L"runtime" };
+        static const wchar_t* const c_extensions[] = { L".cpp", L".h", L".cc", L".hpp", L".cs", L".json", L".md" };
+        constexpr size_t c_partCount = sizeof(c_parts) / sizeof(c_parts[0]);
+        constexpr size_t c_extensionCount = sizeof(c_extensions) / sizeof(c_extensions[0]);
+
+        std::mt19937 random(seed);
+        auto pick = [&](size_t count) { return static_cast<size_t>(random() % count); };
+
+        std::vector<std::wstring> folders;
+        for (size_t i = 0; i < (std::max)(count / 40, static_cast<size_t>(8)); ++i)
+        {
+            std::wstring folder(L"C:/Users/someone/source/repos/");
+            folder += (i % 3 == 0) ? L"WinSearch" : (i % 3 == 1) ? L"engine-core" : L"tools";
+            for (size_t depth = 3 + pick(5); depth > 0; --depth)
+            {
+                folder += L'/';
+                folder += c_parts[pick(c_partCount)];
+            }
+            folders.push_back(std::move(folder));
+        }
+        std::sort(folders.begin(), folders.end());
+
+        std::vector<CorpusItem> items;
+        items.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            CorpusItem item;
+            item.name = std::wstring(c_parts[pick(c_partCount)]) + L"_" + c_parts[pick(c_partCount)] + c_extensions[pick(c_extensionCount)];
+            item.kind = L"Document";
+            item.url = L"file:" + folders[(i / 40 + pick(4)) % folders.size()] + L"/" + item.name;
+            items.push_back(std::move(item));
+        }
+        return items;
+    }
+
+    // The rows of a corpus with the paths put in the order the list reads them in, the first page and then
+    // wherever the user scrolls to
+    struct PathCorpus
+    {
+        std::vector<std::wstring> urls;
+        std::vector<std::wstring> launchUris;
+        std::vector<size_t> readOrder;
+    };
+
+    PathCorpus MakePathCorpus(std::vector<CorpusItem> const& items)
+    {
+        PathCorpus corpus;
+        for (auto const& item : items)
+        {
+            std::wstring launchUri(item.url);
+            if (!UrlToFilePath(launchUri))
+            {
+                launchUri = item.url;
+            }
+            corpus.urls.push_back(item.url);
+            corpus.launchUris.push_back(std::move(launchUri));
+        }
+
+        // Pages of 50 rows at random
+        std::vector<size_t> pages((items.size() + 49) / 50);
+        std::iota(pages.begin(), pages.end(), size_t{});
+        std::shuffle(pages.begin(), pages.end(), std::mt19937(5));
+        for (size_t page : pages)
+        {
+            for (size_t row = page * 50; row < (std::min)((page + 1) * 50, items.size()); ++row)
+            {
+                corpus.readOrder.push_back(row);
+            }
+        }
+        return corpus;
+    }
+
+    PathCorpus const& GetPathCorpus(int64_t corpus)
+    {
+        static const PathCorpus s_corpora[] = { MakePathCorpus(MakeCorpus(100000, 4)), MakePathCorpus(MakeSourceTreeCorpus(100000, 4)) };
+        return s_corpora[corpus];
+    }
+
+    template <typename TStore>
+    void FillPaths(PathCorpus const& corpus, TStore& store)
+    {
+        for (size_t i = 0; i < corpus.urls.size(); ++i)
+        {
+            ResultRow row;
+            row.url = corpus.urls[i];
+            row.launchUri = corpus.launchUris[i];
+            store.Append(row);
+        }
+    }
+
+    // corpus 0 is MakeCorpus, 1 the source tree
+    template <typename TStore>
+    void BM_StorePaths(benchmark::State& state)
+    {
+        PathCorpus const& corpus = GetPathCorpus(state.range(0));
+        size_t memoryBytes = 0;
+        for (auto _ : state)
+        {
+            TStore store;
+            FillPaths(corpus, store);
+            benchmark::DoNotOptimize(store.Size());
+
+            state.PauseTiming();
+            memoryBytes = store.MemoryBytes();
+            state.ResumeTiming();
+        }
+
+        size_t pathChars = 0;
+        for (size_t i = 0; i < corpus.urls.size(); ++i)
+        {
+            pathChars += corpus.urls[i].size() + corpus.launchUris[i].size();
+        }
+        state.SetItemsProcessed(state.iterations() * corpus.urls.size());
+        state.counters["bytes_per_row"] = static_cast<double>(memoryBytes) / static_cast<double>(corpus.urls.size());
+        state.counters["path_bytes_per_row"] = static_cast<double>(pathChars * sizeof(wchar_t)) / static_cast<double>(corpus.urls.size());
+    }
+    BENCHMARK_TEMPLATE(BM_StorePaths, PlainPathStore)->ArgName("corpus")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+    BENCHMARK_TEMPLATE(BM_StorePaths, FrontCodedPathStore)->ArgName("corpus")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+    // Both paths of a row, copied out the way a projection gets them
+    template <typename TStore>
+    void BM_DecodePaths(benchmark::State& state)
+    {
+        PathCorpus const& corpus = GetPathCorpus(state.range(0));
+        TStore store;
+        FillPaths(corpus, store);
+
+        ResultRowBuffer buffer;
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            store.GetPaths(corpus.readOrder[i++ % corpus.readOrder.size()], buffer);
+            benchmark::DoNotOptimize(buffer.url.data());
+            benchmark::DoNotOptimize(buffer.launchUri.data());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(BM_DecodePaths, PlainPathStore)->ArgName("corpus")->Arg(0)->Arg(1);
+    BENCHMARK_TEMPLATE(BM_DecodePaths, FrontCodedPathStore)->ArgName("corpus")->Arg(0)->Arg(1);
+}
@@ -0,0 +1,231 @@
+// ReuseWhereCache driven by replayed keystrokes the way the helper drives it: every query looks up the
+// narrowest restriction cached for its text, runs against it and caches its own rowset's where id under its
+// text once it's done. The fake rowsets remember what text they were evaluated for, so every restriction a
+// lookup hands back can be checked to still cover the text it was looked up for.
+#include <gtest/gtest.h>
+
+#include <memory>
+#include "ReuseWhereCache.h"
+
+namespace
+{
+    struct FakeRowset
+    {
+        std::wstring text; // normalized
+        uint32_t options;
+        uint32_t whereId;
+    };
+    using RowsetHandle = std::shared_ptr<FakeRowset>;
+
+    constexpr size_t c_rowsetCostBytes{ 64 * 1024 };
+
+    // Stands in for the indexer and for the SearchQueryBase state the cache gets filled from
+    struct KeystrokeReplay
+    {
+    public:
+        explicit KeystrokeReplay(size_t maxEntries = 32, size_t maxBytes = 4 * 1024 * 1024) : m_cache(maxEntries, maxBytes)
+        {
+        }
+
+        // PrimeIndexAndCacheWhereId, the unrestricted query everything else narrows down from
+        void Prime(uint32_t options)
+        {
+            m_rowset = Evaluate(L"", options);
+            m_cache.Insert(L"", options, m_rowset->whereId, m_rowset, c_rowsetCostBytes);
+        }
+
+        // AcquireReuseWhereId, ExecuteQueryStringSync and CacheReuseWhereId for one keystroke. A canceled query
+        // is superseded before the provider gets to evaluate it.
+        RowsetHandle Type(std::wstring const& text, uint32_t options, bool canceled = false)
+        {
+            uint32_t whereId = 0;
+            RowsetHandle restriction;
+            const bool found = m_cache.Lookup(text, options, &whereId, &restriction);
+            EXPECT_TRUE(found) << "nothing primed for options " << options;
+            if (found)
+            {
+                // Whatever restriction we start from has to cover everything the text can match
+                const std::wstring normalized = NormalizeSearchText(text);
+                EXPECT_EQ(restriction->options, options);
+                EXPECT_EQ(normalized.compare(0, restriction->text.size(), restriction->text), 0)
+                    << "restriction for '" << std::string(restriction->text.begin(), restriction->text.end()) << "' used for '"
+                    << std::string(normalized.begin(), normalized.end()) << "'";
+                EXPECT_EQ(restriction->whereId, whereId);
+            }
+
+            // The previous query's rowset goes before anything else, canceled or not
+            m_rowset = nullptr;
+            if (!canceled)
+            {
+                m_rowset = Evaluate(text, options);
+            }
+
+            if (m_rowset != nullptr)
+            {
+                m_cache.Insert(text, options, m_rowset->whereId, m_rowset, c_rowsetCostBytes);
+            }
+            return restriction;
+        }
+
+        ReuseWhereCacheStats Stats() { return m_cache.GetStats(); }
+        ReuseWhereCache<RowsetHandle>& Cache() { return m_cache; }
+
+        // Drops our own reference, so only the cache keeps rowsets alive
+        void ReleaseRowset() { m_rowset = nullptr; }
+
+    private:
+        RowsetHandle Evaluate(std::wstring const& text, uint32_t options)
+        {
+            return std::make_shared<FakeRowset>(FakeRowset{ NormalizeSearchText(text), options, ++m_nextWhereId });
+        }
+
+        ReuseWhereCache<RowsetHandle> m_cache;
+        RowsetHandle m_rowset;
+        uint32_t m_nextWhereId{};
+    };
+
+    std::vector<std::wstring> Keystrokes(std::wstring const& text)
+    {
+        std::vector<std::wstring> keystrokes;
+        for (size_t i = 1; i <= text.size(); ++i)
+        {
+            keystrokes.push_back(text.substr(0, i));
+        }
+        return keystrokes;
+    }
+}
+
+TEST(ReuseWhereCacheTests, EveryKeystrokeStartsFromThePreviousOne)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+
+    std::wstring previous;
+    for (auto const& text : Keystrokes(L"quarterly report"))
+    {
+        RowsetHandle restriction = replay.Type(text, 0);
+        ASSERT_NE(restriction, nullptr);
+        EXPECT_EQ(restriction->text, NormalizeSearchText(previous));
+        previous = text;
+    }
+
+    const ReuseWhereCacheStats stats = replay.Stats();
+    EXPECT_EQ(stats.misses, 0u);
+    EXPECT_EQ(stats.exactHits, 1u); // the space after quarterly doesn't change the text
+}
+
+TEST(ReuseWhereCacheTests, BackspaceAndRetypeHitExactly)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+    for (auto const& text : Keystrokes(L"invoice"))
+    {
+        replay.Type(text, 0);
+    }
+
+    // invoic, invoi, then invoic and invoice again
+    EXPECT_EQ(replay.Type(L"invoic", 0)->text, L"invoic");
+    EXPECT_EQ(replay.Type(L"invoi", 0)->text, L"invoi");
+    EXPECT_EQ(replay.Type(L"invoic", 0)->text, L"invoic");
+    EXPECT_EQ(replay.Type(L"invoice", 0)->text, L"invoice");
+    EXPECT_EQ(replay.Stats().exactHits, 4u);
+
+    // A typo after a backspace starts from the longest prefix that still fits
+    EXPECT_EQ(replay.Type(L"invoiz", 0)->text, L"invoi");
+}
+
+TEST(ReuseWhereCacheTests, CaseAndSpacingShareRestrictions)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+    replay.Type(L"holiday photo", 0);
+
+    EXPECT_EQ(replay.Type(L"  Holiday   PHOTO", 0)->text, L"holiday photo");
+    EXPECT_EQ(replay.Type(L"holiday photos", 0)->text, L"holiday photo");
+}
+
+TEST(ReuseWhereCacheTests, OptionSetsDontShareRestrictions)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+    replay.Prime(1);
+    for (auto const& text : Keystrokes(L"budget"))
+    {
+        replay.Type(text, 0);
+    }
+
+    // Content search toggled on, the name-only restrictions don't cover it
+    EXPECT_EQ(replay.Type(L"budget", 1)->text, L"");
+    EXPECT_EQ(replay.Type(L"budgets", 1)->text, L"budget");
+
+    // And toggled back off, what name-only typing left behind is still there
+    EXPECT_EQ(replay.Type(L"budgets", 0)->text, L"budget");
+}
+
+// A query superseded before it ran has no rowset of its own, nothing may get cached under its text
+TEST(ReuseWhereCacheTests, CanceledKeystrokesCacheNothing)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+    replay.Type(L"re", 0);
+    replay.Type(L"rep", 0, true);
+    replay.Type(L"repo", 0, true);
+
+    // Had the previous rowset stuck around, "repo" would now find the restriction for "re" cached as its own
+    RowsetHandle restriction = replay.Type(L"repor", 0);
+    EXPECT_EQ(restriction->text, L"re");
+    EXPECT_EQ(replay.Stats().entries, 3u); // "", re and repor
+}
+
+TEST(ReuseWhereCacheTests, EvictionReleasesTheOldestRowsets)
+{
+    KeystrokeReplay replay(4);
+    replay.Prime(0);
+    std::vector<std::weak_ptr<FakeRowset>> rowsets;
+    for (auto const& text : Keystrokes(L"screenshot"))
+    {
+        replay.Type(text, 0);
+        uint32_t whereId;
+        RowsetHandle handle;
+        ASSERT_TRUE(replay.Cache().Lookup(text, 0, &whereId, &handle));
+        rowsets.push_back(handle);
+    }
+    replay.ReleaseRowset();
+
+    const ReuseWhereCacheStats stats = replay.Stats();
+    EXPECT_EQ(stats.entries, 4u);
+    EXPECT_EQ(stats.evictions, 7u);
+    for (size_t i = 0; i < rowsets.size(); ++i)
+    {
+        EXPECT_EQ(rowsets[i].expired(), i < (rowsets.size() - 4)) << i;
+    }
+}
+
+TEST(ReuseWhereCacheTests, ByteBudgetKeepsTheNewestEntry)
+{
+    KeystrokeReplay replay(32, c_rowsetCostBytes / 2);
+    replay.Prime(0);
+    replay.Type(L"a", 0);
+    replay.Type(L"ab", 0);
+
+    // Every entry is over budget on its own, the newest one stays anyway
+    const ReuseWhereCacheStats stats = replay.Stats();
+    EXPECT_EQ(stats.entries, 1u);
+    EXPECT_EQ(replay.Type(L"abc", 0)->text, L"ab");
+}
+
+TEST(ReuseWhereCacheTests, ReinsertingAKeyReleasesTheOldRowset)
+{
+    KeystrokeReplay replay;
+    replay.Prime(0);
+    replay.Type(L"notes", 0);
+    uint32_t whereId;
+    RowsetHandle handle;
+    ASSERT_TRUE(replay.Cache().Lookup(L"notes", 0, &whereId, &handle));
+    std::weak_ptr<FakeRowset> first = handle;
+    handle = nullptr;
+
+    replay.Type(L"notes", 0);
+    EXPECT_TRUE(first.expired());
+    EXPECT_EQ(replay.Stats().entries, 2u);
+}
@@ -0,0 +1,160 @@
+// Decoding a fetched batch of rows: what FetchRows did before rows were bound, a property store per row and a
+// PROPVARIANT and a std::wstring per value, against DecodeRowBatch copying out of the accessor's row buffer into
+// a ColumnarRowBatch. The row buffers are laid out the way BindRowsetColumns lays them out, filled from the
+// corpus in place of GetData.
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <memory>
+#include "AllocationCounter.h"
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    constexpr size_t c_batchRows{ 256 };
+    constexpr size_t c_expectedCharsPerRow{ 256 };
+    constexpr uint32_t c_statusOk{ 0 };
+
+    // DBSTATUS, padding, DBLENGTH and the value, per column
+    struct ColumnLayout
+    {
+        size_t statusOffset;
+        size_t lengthOffset;
+        size_t valueOffset;
+        size_t maxChars;
+    };
+
+    struct BoundRows
+    {
+        std::vector<ColumnLayout> layouts;
+        size_t rowSize{};
+        std::vector<std::vector<uint8_t>> rows;
+    };
+
+    const BoundRows& GetBoundRows()
+    {
+        static const BoundRows s_rows = []()
+        {
+            // MAX_PATH, INTERNET_MAX_URL_LENGTH and the kind, like SearchUXQueryHelper binds them
+            const size_t maxChars[CorpusColumnCount] = { 260, 2084, 128 };
+            BoundRows bound;
+            for (size_t maxChar : maxChars)
+            {
+                ColumnLayout layout;
+                layout.statusOffset = bound.rowSize;
+                layout.lengthOffset = layout.statusOffset + sizeof(uint32_t) + sizeof(uint32_t);
+                layout.valueOffset = layout.lengthOffset + sizeof(uint64_t);
+                layout.maxChars = maxChar;
+                bound.rowSize = layout.valueOffset + (((maxChar + 1) * sizeof(wchar_t) + 7) & ~static_cast<size_t>(7));
+                bound.layouts.push_back(layout);
+            }
+
+            for (auto const& item : MakeCorpus(c_batchRows, 3))
+            {
+                std::vector<uint8_t> row(bound.rowSize);
+                const std::wstring* values[CorpusColumnCount] = { &item.name, &item.url, &item.kind };
+                for (size_t i = 0; i < CorpusColumnCount; ++i)
+                {
+                    ColumnLayout const& layout = bound.layouts[i];
+                    const uint64_t length = values[i]->size() * sizeof(wchar_t);
+                    std::memcpy(row.data() + layout.statusOffset, &c_statusOk, sizeof(c_statusOk));
+                    std::memcpy(row.data() + layout.lengthOffset, &length, sizeof(length));
+                    std::memcpy(row.data() + layout.valueOffset, values[i]->c_str(), length + sizeof(wchar_t));
+                }
+                bound.rows.push_back(std::move(row));
+            }
+            return bound;
+        }();
+        return s_rows;
+    }
+
+    void ReportAllocations(benchmark::State& state, AllocationScope const& allocations)
+    {
+        const AllocationCounts counts = allocations.Elapsed();
+        const double rows = static_cast<double>(state.iterations() * c_batchRows);
+        state.counters["allocs_per_row"] = static_cast<double>(counts.allocations) / rows;
+        state.counters["bytes_per_row"] = static_cast<double>(counts.bytes) / rows;
+        state.SetItemsProcessed(state.iterations() * c_batchRows);
+    }
+
+    // What GetRowFromHROW and the GetValue calls cost: an object per row, and per value a PROPVARIANT's string
+    // that then got copied into a std::wstring
+    void BM_DecodePropertyStore(benchmark::State& state)
+    {
+        struct PropertyStore
+        {
+            std::unique_ptr<wchar_t[]> values[CorpusColumnCount];
+            size_t lengths[CorpusColumnCount];
+        };
+        auto const& bound = GetBoundRows();
+
+        std::vector<std::vector<std::wstring>> batch;
+        AllocationScope allocations;
+        for (auto _ : state)
+        {
+            batch.clear();
+            for (auto const& row : bound.rows)
+            {
+                auto store = std::make_unique<PropertyStore>();
+                for (size_t i = 0; i < CorpusColumnCount; ++i)
+                {
+                    ColumnLayout const& layout = bound.layouts[i];
+                    uint64_t length;
+                    std::memcpy(&length, row.data() + layout.lengthOffset, sizeof(length));
+                    store->lengths[i] = static_cast<size_t>(length / sizeof(wchar_t));
+                    store->values[i].reset(new wchar_t[store->lengths[i] + 1]);
+                    std::memcpy(store->values[i].get(), row.data() + layout.valueOffset, length + sizeof(wchar_t));
+                }
+
+                std::vector<std::wstring> values;
+                values.reserve(CorpusColumnCount);
+                for (size_t i = 0; i < CorpusColumnCount; ++i)
+                {
+                    std::unique_ptr<wchar_t[]> variant(new wchar_t[store->lengths[i] + 1]);
+                    std::memcpy(variant.get(), store->values[i].get(), (store->lengths[i] + 1) * sizeof(wchar_t));
+                    values.emplace_back(variant.get(), store->lengths[i]);
+                }
+                batch.push_back(std::move(values));
+            }
+            benchmark::DoNotOptimize(batch.data());
+        }
+        ReportAllocations(state, allocations);
+    }
+    BENCHMARK(BM_DecodePropertyStore);
+
+    void BM_DecodeColumnar(benchmark::State& state)
+    {
+        auto const& bound = GetBoundRows();
+
+        ColumnarRowBatch batch;
+        AllocationScope allocations;
+        for (auto _ : state)
+        {
+            batch.Reset(bound.layouts.size(), bound.rows.size(), bound.rows.size() * c_expectedCharsPerRow);
+            for (auto const& row : bound.rows)
+            {
+                for (size_t i = 0; i < bound.layouts.size(); ++i)
+                {
+                    ColumnLayout const& layout = bound.layouts[i];
+                    uint32_t status;
+                    std::memcpy(&status, row.data() + layout.statusOffset, sizeof(status));
+                    if (status == c_statusOk)
+                    {
+                        uint64_t length;
+                        std::memcpy(&length, row.data() + layout.lengthOffset, sizeof(length));
+                        const size_t chars = (std::min)(static_cast<size_t>(length / sizeof(wchar_t)), layout.maxChars);
+                        batch.AppendValue(i, reinterpret_cast<const wchar_t*>(row.data() + layout.valueOffset), chars);
+                    }
+                    else
+                    {
+                        batch.AppendNull(i);
+                    }
+                }
+                batch.CommitRow();
+            }
+            benchmark::DoNotOptimize(batch.RowCount());
+        }
+        ReportAllocations(state, allocations);
+    }
+    BENCHMARK(BM_DecodeColumnar);
+}
@@ -0,0 +1,95 @@
+// Fetching a whole rowset the old way, one batch fetched and then turned into results before the next one is
+// asked for, against the pipeline that asks for the next batch while the workers build results. The stand-in
+// rowset takes as long per row as the trace it was recorded with says the indexer did.
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    constexpr size_t c_rows{ 10000 };
+
+    const RecordedQuery& GetQuery()
+    {
+        // ~400us to evaluate a batch of 256 and 2us a row on top, about what a warm local index does
+        static const RecordedQuery s_query = MakeCorpusQuery(MakeCorpus(c_rows, 3), 256, 400, 2);
+        return s_query;
+    }
+
+    void BM_FetchSerial(benchmark::State& state)
+    {
+        AdaptiveBatchSizeController controller(64, 16384, 2);
+        ResultStore results;
+        FetchedRowBatch fetched;
+        ColumnarRowBatch const& batch = fetched.rows;
+        for (auto _ : state)
+        {
+            results.Clear();
+            controller.Reset();
+            ReplayRowBatchSource source(GetQuery(), GetCorpusColumns(), 1);
+            while (true)
+            {
+                auto start = std::chrono::steady_clock::now();
+                const size_t rows = source.NextBatch(controller.NextBatchSize(), fetched);
+                controller.OnBatchFetched(rows, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+                if (rows == 0)
+                {
+                    break;
+                }
+                for (size_t row = 0; row < rows; ++row)
+                {
+                    MaterializeCorpusRow(batch, row, results);
+                }
+            }
+            benchmark::DoNotOptimize(results.Size());
+        }
+        state.SetItemsProcessed(state.iterations() * c_rows);
+    }
+    BENCHMARK(BM_FetchSerial)->Iterations(10)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    void BM_FetchPipelined(benchmark::State& state)
+    {
+        AdaptiveBatchSizeController controller(64, 16384, 2);
+        ResultStore results;
+        for (auto _ : state)
+        {
+            results.Clear();
+            ReplayRowBatchSource source(GetQuery(), GetCorpusColumns(), 1);
+            FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), static_cast<size_t>(state.range(0)), 2, controller, UINT64_MAX,
+                MaterializeCorpusRow,
+                [&](FetchedRowBatch const&, ResultStore const& batchResults)
+                {
+                    for (size_t i = 0; i < batchResults.Size(); ++i)
+                    {
+                        results.AppendFrom(batchResults, i);
+                    }
+                });
+            benchmark::DoNotOptimize(results.Size());
+        }
+        state.SetItemsProcessed(state.iterations() * c_rows);
+    }
+    BENCHMARK(BM_FetchPipelined)->ArgName("workers")->Arg(1)->Arg(2)->Iterations(10)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    // What the pipeline costs a fetch before any rows, a page of 50 the way paging asks for them with four
+    // workers. Workers started and joined for the one run the way every FetchRows used to, against the pool.
+    void BM_PipelineRun(benchmark::State& state)
+    {
+        const bool pooled = (state.range(0) != 0);
+        BatchWorkerPool pool;
+        for (auto _ : state)
+        {
+            std::unique_ptr<BatchWorkerPool> perRun(pooled ? nullptr : new BatchWorkerPool());
+            OrderedBatchPipeline<int, int> pipeline(pooled ? pool : *perRun, 4, 2);
+            int next = 0;
+            int consumed = 0;
+            pipeline.Run(
+                [&](int& batch) { batch = next++; return batch < 1; },
+                [](int& batch) { return batch * 50; },
+                [&](int& rows) { consumed += rows; });
+            benchmark::DoNotOptimize(consumed);
+        }
+    }
+    BENCHMARK(BM_PipelineRun)->ArgName("pooled")->Arg(0)->Arg(1)->UseRealTime();
+}
@@ -0,0 +1,248 @@
+// OrderedBatchPipeline with batches that stand in for HROWs, every one produced has to be given back exactly once
+// whether it got transformed or the pipeline stopped first
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include "RowFetchPipeline.h"
+
+namespace
+{
+    // Batch ids that are out and haven't been given back yet
+    struct HeldRows
+    {
+        void Take(int id)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            EXPECT_TRUE(m_held.insert(id).second);
+        }
+
+        void Release(int id)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            EXPECT_EQ(m_held.erase(id), 1u) << "batch " << id << " given back twice";
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_held.size();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::set<int> m_held;
+    };
+
+    void Jitter(int id)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds((id * 7919) % 500));
+    }
+}
+
+TEST(RowFetchPipelineTests, BatchesAreConsumedInProductionOrder)
+{
+    BatchWorkerPool workers;
+    OrderedBatchPipeline<int, int> pipeline(workers, 4, 2);
+    int next = 0;
+    std::vector<int> consumed;
+    pipeline.Run(
+        [&](int& batch) { batch = next++; return batch < 200; },
+        [](int& batch) { Jitter(batch); return batch; },
+        [&](int& result) { consumed.push_back(result); });
+
+    ASSERT_EQ(consumed.size(), 200u);
+    for (int i = 0; i < 200; ++i)
+    {
+        EXPECT_EQ(consumed[i], i);
+    }
+}
+
+// A consumer failing with batches still queued behind it used to strand them, in the app that leaked HROWs
+TEST(RowFetchPipelineTests, BatchesQueuedWhenConsumeFailsAreDiscarded)
+{
+    HeldRows held;
+    BatchWorkerPool workers;
+    OrderedBatchPipeline<int, int> pipeline(workers, 3, 4);
+    int next = 0;
+    size_t discarded = 0;
+    EXPECT_THROW(pipeline.Run(
+        [&](int& batch) { batch = next++; held.Take(batch); return true; },
+        [&](int& batch) { Jitter(batch); held.Release(batch); return batch; },
+        [](int& result)
+        {
+            if (result == 20)
+            {
+                throw std::runtime_error("consumer failed");
+            }
+        },
+        [&](int& batch) { held.Release(batch); discarded++; }), std::runtime_error);
+
+    EXPECT_EQ(held.Count(), 0u);
+    EXPECT_GT(next, 20);
+    EXPECT_GT(discarded, 0u);
+}
+
+TEST(RowFetchPipelineTests, BatchesQueuedWhenTransformFailsAreDiscarded)
+{
+    HeldRows held;
+    BatchWorkerPool workers;
+    OrderedBatchPipeline<int, int> pipeline(workers, 2, 2);
+    int next = 0;
+    EXPECT_THROW(pipeline.Run(
+        [&](int& batch) { batch = next++; held.Take(batch); return true; },
+        [&](int& batch)
+        {
+            // The transform owns the batch once it has it, like the app's scope_exit releasing the rows
+            held.Release(batch);
+            Jitter(batch);
+            if (batch == 10)
+            {
+                throw std::runtime_error("decode failed");
+            }
+            return batch;
+        },
+        [](int&) {},
+        [&](int& batch) { held.Release(batch); }), std::runtime_error);
+
+    EXPECT_EQ(held.Count(), 0u);
+}
+
+// The batch the producer had just fetched when it found out something failed
+TEST(RowFetchPipelineTests, BatchProducedAfterFailureIsDiscarded)
+{
+    HeldRows held;
+    BatchWorkerPool workers;
+    OrderedBatchPipeline<int, int> pipeline(workers, 1, 1);
+    int next = 0;
+    EXPECT_THROW(pipeline.Run(
+        [&](int& batch)
+        {
+            batch = next++;
+            held.Take(batch);
+            if (batch > 0)
+            {
+                // Long enough for the worker to have failed on batch 0
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return true;
+        },
+        [&](int& batch) { held.Release(batch); return batch; },
+        [](int&) { throw std::runtime_error("consumer failed"); },
+        [&](int& batch) { held.Release(batch); }), std::runtime_error);
+
+    EXPECT_EQ(held.Count(), 0u);
+}
+
+TEST(RowFetchPipelineTests, ProducerFailureReachesCaller)
+{
+    HeldRows held;
+    BatchWorkerPool workers;
+    OrderedBatchPipeline<int, int> pipeline(workers, 2, 2);
+    int next = 0;
+    EXPECT_THROW(pipeline.Run(
+        [&](int& batch)
+        {
+            if (next == 50)
+            {
+                throw std::runtime_error("GetNextRows failed");
+            }
+            batch = next++;
+            held.Take(batch);
+            return true;
+        },
+        [&](int& batch) { held.Release(batch); return batch; },
+        [](int&) {},
+        [&](int& batch) { held.Release(batch); }), std::runtime_error);
+
+    EXPECT_EQ(held.Count(), 0u);
+}
+
+// Later runs get the threads the first one started, and whatever the workers were told to do when they started
+// happens once per thread and not once per run
+TEST(RowFetchPipelineTests, WorkersAreKeptBetweenRuns)
+{
+    std::mutex lock;
+    std::set<std::thread::id> started;
+    std::set<std::thread::id> used;
+    {
+        BatchWorkerPool workers([&]()
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                EXPECT_TRUE(started.insert(std::this_thread::get_id()).second);
+            });
+
+        for (int run = 0; run < 20; ++run)
+        {
+            OrderedBatchPipeline<int, int> pipeline(workers, 3, 2);
+            int next = 0;
+            int consumed = 0;
+            pipeline.Run(
+                [&](int& batch) { batch = next++; return batch < 30; },
+                [&](int& batch)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    used.insert(std::this_thread::get_id());
+                    return batch;
+                },
+                [&](int& result) { EXPECT_EQ(result, consumed++); });
+            ASSERT_EQ(consumed, 30);
+        }
+        EXPECT_LE(workers.ThreadCount(), 3u);
+    }
+
+    EXPECT_LE(started.size(), 3u);
+    for (auto const& id : used)
+    {
+        EXPECT_EQ(started.count(id), 1u);
+    }
+}
+
+// Two fetches at once from the same workers, neither one waits on the other for a thread. The first one's
+// workers are stuck until the second one lets them go.
+TEST(RowFetchPipelineTests, ConcurrentRunsDontWaitForEachOther)
+{
+    BatchWorkerPool workers;
+    std::promise<void> firstStuck;
+    std::promise<void> secondDone;
+    std::shared_future<void> secondDoneFuture = secondDone.get_future().share();
+
+    auto first = std::async(std::launch::async, [&]()
+        {
+            OrderedBatchPipeline<int, int> pipeline(workers, 2, 2);
+            int next = 0;
+            int consumed = 0;
+            pipeline.Run(
+                [&](int& batch) { batch = next++; return batch < 4; },
+                [&](int& batch)
+                {
+                    if (batch == 0)
+                    {
+                        firstStuck.set_value();
+                    }
+                    secondDoneFuture.wait();
+                    return batch;
+                },
+                [&](int&) { consumed++; });
+            return consumed;
+        });
+
+    firstStuck.get_future().wait();
+    {
+        OrderedBatchPipeline<int, int> pipeline(workers, 2, 2);
+        int next = 0;
+        int consumed = 0;
+        pipeline.Run(
+            [&](int& batch) { batch = next++; return batch < 10; },
+            [](int& batch) { return batch; },
+            [&](int&) { consumed++; });
+        EXPECT_EQ(consumed, 10);
+    }
+    secondDone.set_value();
+
+    EXPECT_EQ(first.get(), 4);
+    EXPECT_GE(workers.ThreadCount(), 3u);
+}
@@ -0,0 +1,99 @@
+// Replays a rowset trace through the pipelined fetch, every query in it fetched and turned into results the way
+// FetchRows does, without waiting out the time the indexer took. Set WINSEARCH_ROWSET_TRACE to a RowsetTrace.bin
+// the app recorded with WINSEARCH_RECORD_ROWSETS to replay that, it has to be read on a box with the same
+// wchar_t size it was recorded on. Without it the corpus gets recorded to a trace file and replayed from there.
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    std::vector<uint8_t> LoadTrace()
+    {
+        std::filesystem::path path;
+        bool generated = false;
+        if (const char* recorded = std::getenv("WINSEARCH_ROWSET_TRACE"))
+        {
+            path = recorded;
+        }
+        else
+        {
+            // Written out through RowsetTraceWriter like the app writes it, three queries of different sizes
+            path = std::filesystem::temp_directory_path() / "WinSearchRowsetTrace.bin";
+            generated = true;
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            RowsetTraceWriter writer([&](const void* data, size_t size)
+                {
+                    file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+                });
+
+            uint32_t seed = 30;
+            for (const size_t count : { 20000, 5000, 500 })
+            {
+                const std::vector<CorpusItem> items = MakeCorpus(count, seed++);
+                const uint32_t query = writer.RecordQuery(L"SELECT System.ItemNameDisplay, System.ItemUrl, System.KindText FROM SystemIndex",
+                    GetCorpusColumns());
+                for (size_t start = 0; start < items.size(); start += 1024)
+                {
+                    const size_t rows = (std::min)(static_cast<size_t>(1024), items.size() - start);
+                    ColumnarRowBatch batch;
+                    AppendCorpusRows(items, start, rows, batch);
+                    writer.RecordBatch(query, 1024, 400 + (rows * 2), batch);
+                }
+            }
+        }
+
+        std::vector<uint8_t> trace;
+        {
+            std::ifstream file(path, std::ios::binary);
+            trace.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        if (generated)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        }
+        return trace;
+    }
+
+    void BM_ReplayRowsetTrace(benchmark::State& state)
+    {
+        const size_t workers = static_cast<size_t>(state.range(0));
+        static const std::vector<uint8_t> s_trace = LoadTrace();
+        std::vector<RecordedQuery> queries;
+        if (!ReadRowsetTrace(s_trace.data(), s_trace.size(), queries) || queries.empty())
+        {
+            state.SkipWithError("no queries in the rowset trace");
+            return;
+        }
+
+        AdaptiveBatchSizeController controller(64, 16384, 2);
+        ResultStore results;
+        uint64_t rows = 0;
+        for (auto _ : state)
+        {
+            for (auto const& query : queries)
+            {
+                results.Clear();
+                controller.Reset();
+                ReplayRowBatchSource source(query, GetCorpusColumns(), 0);
+                rows += FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), workers, 2, controller, UINT64_MAX, MaterializeCorpusRow,
+                    [&](FetchedRowBatch const&, ResultStore const& batchResults)
+                    {
+                        for (size_t i = 0; i < batchResults.Size(); ++i)
+                        {
+                            results.AppendFrom(batchResults, i);
+                        }
+                    });
+                benchmark::DoNotOptimize(results.Size());
+            }
+        }
+        state.counters["queries"] = static_cast<double>(queries.size());
+        state.SetItemsProcessed(static_cast<int64_t>(rows));
+    }
+    BENCHMARK(BM_ReplayRowsetTrace)->ArgName("workers")->Arg(1)->Arg(2)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
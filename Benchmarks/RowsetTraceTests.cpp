@@ -0,0 +1,141 @@
+// RowsetTraceWriter to ReadRowsetTrace to ReplayRowBatchSource, what a trace recorded with
+// WINSEARCH_RECORD_ROWSETS goes through before a replay hands its rows to the fetch
+#include <gtest/gtest.h>
+
+#include "BenchmarkCorpus.h"
+
+namespace
+{
+    struct RecordingBuffer
+    {
+        std::vector<uint8_t> data;
+
+        RowsetTraceWriter::WriteFunction Writer()
+        {
+            return [this](const void* bytes, size_t size)
+                {
+                    data.insert(data.end(), static_cast<const uint8_t*>(bytes), static_cast<const uint8_t*>(bytes) + size);
+                };
+        }
+    };
+
+    ColumnarRowBatch MakeBatch(std::vector<CorpusItem> const& items, size_t start, size_t count)
+    {
+        ColumnarRowBatch batch;
+        batch.Reset(CorpusColumnCount, count, count * 128);
+        for (size_t i = start; i < (start + count); ++i)
+        {
+            batch.AppendValue(CorpusNameColumn, items[i].name.data(), items[i].name.size());
+            batch.AppendValue(CorpusUrlColumn, items[i].url.data(), items[i].url.size());
+            if ((i % 7) == 0)
+            {
+                batch.AppendNull(CorpusKindColumn);
+            }
+            else
+            {
+                batch.AppendValue(CorpusKindColumn, items[i].kind.data(), items[i].kind.size());
+            }
+            batch.CommitRow();
+        }
+        return batch;
+    }
+}
+
+// Two queries recorded interleaved, the way two threads fetching at once record them, come back apart with
+// every value and null where it was
+TEST(RowsetTraceTests, InterleavedQueriesReadBackApart)
+{
+    const std::vector<CorpusItem> items = MakeCorpus(300, 21);
+    RecordingBuffer buffer;
+    RowsetTraceWriter writer(buffer.Writer());
+    const uint32_t first = writer.RecordQuery(L"SELECT first", GetCorpusColumns());
+    const uint32_t second = writer.RecordQuery(L"SELECT second", GetCorpusColumns());
+    writer.RecordBatch(first, 64, 500, MakeBatch(items, 0, 64));
+    writer.RecordBatch(second, 64, 900, MakeBatch(items, 200, 50));
+    writer.RecordBatch(first, 128, 700, MakeBatch(items, 64, 128));
+    ASSERT_FALSE(writer.Failed());
+
+    std::vector<RecordedQuery> queries;
+    ASSERT_TRUE(ReadRowsetTrace(buffer.data.data(), buffer.data.size(), queries));
+    ASSERT_EQ(queries.size(), 2u);
+    EXPECT_EQ(queries[0].sql, L"SELECT first");
+    EXPECT_EQ(queries[1].sql, L"SELECT second");
+    EXPECT_EQ(queries[0].columns, GetCorpusColumns());
+    ASSERT_EQ(queries[0].batches.size(), 2u);
+    ASSERT_EQ(queries[1].batches.size(), 1u);
+    EXPECT_EQ(queries[0].batches[1].requested, 128u);
+    EXPECT_EQ(queries[0].batches[1].elapsedMicroseconds, 700u);
+
+    RecordedBatch const& batch = queries[1].batches[0];
+    ASSERT_EQ(batch.rows.RowCount(), 50u);
+    for (size_t row = 0; row < batch.rows.RowCount(); ++row)
+    {
+        CorpusItem const& item = items[200 + row];
+        EXPECT_EQ(batch.rows.GetString(row, CorpusNameColumn), item.name);
+        EXPECT_EQ(batch.rows.GetString(row, CorpusUrlColumn), item.url);
+        EXPECT_EQ(batch.rows.IsNull(row, CorpusKindColumn), ((200 + row) % 7) == 0);
+    }
+}
+
+// A trace cut off in the middle of a batch, the app going away while recording, keeps every batch before it
+TEST(RowsetTraceTests, TruncatedTraceKeepsCompleteBatches)
+{
+    const std::vector<CorpusItem> items = MakeCorpus(256, 22);
+    const std::vector<uint8_t> trace = RecordCorpusTrace(items, 64, 100, 1);
+
+    std::vector<RecordedQuery> queries;
+    ASSERT_TRUE(ReadRowsetTrace(trace.data(), trace.size() - 10, queries));
+    ASSERT_EQ(queries.size(), 1u);
+    EXPECT_EQ(queries[0].batches.size(), 3u);
+
+    std::vector<uint8_t> notATrace(trace);
+    notATrace[0] ^= 0xFF;
+    EXPECT_FALSE(ReadRowsetTrace(notATrace.data(), notATrace.size(), queries));
+}
+
+// Replayed in other batch sizes than it was recorded in, a query hands back the same rows in the same order
+// and charges what the indexer took for them, scaled by the replay speed
+TEST(RowsetTraceTests, ReplayReslicesAndChargesRecordedTime)
+{
+    const std::vector<CorpusItem> items = MakeCorpus(1000, 23);
+    // 100us a batch of 100 rows and 2us a row, 3us a row all told
+    const RecordedQuery query = MakeCorpusQuery(items, 100, 100, 2);
+
+    std::chrono::microseconds slept{};
+    ReplayRowBatchSource source(query, GetCorpusColumns(), 2, [&](std::chrono::microseconds duration) { slept += duration; });
+
+    FetchedRowBatch fetched;
+    ColumnarRowBatch const& batch = fetched.rows;
+    size_t next = 0;
+    for (const size_t maxRows : { 64, 250, 1000 })
+    {
+        const size_t rows = source.NextBatch(maxRows, fetched);
+        ASSERT_EQ(rows, (std::min)(maxRows, items.size() - next));
+        for (size_t row = 0; row < rows; ++row, ++next)
+        {
+            EXPECT_EQ(batch.GetString(row, CorpusUrlColumn), items[next].url);
+        }
+    }
+    EXPECT_EQ(next, items.size());
+    EXPECT_EQ(source.NextBatch(64, fetched), 0u);
+    EXPECT_NEAR(static_cast<double>(slept.count()), (items.size() * 3) / 2.0, 3.0);
+}
+
+// Columns asked for in another order come back in that order, ones the trace doesn't have come back null
+TEST(RowsetTraceTests, ReplayMapsColumnsByName)
+{
+    const std::vector<CorpusItem> items = MakeCorpus(10, 24);
+    const RecordedQuery query = MakeCorpusQuery(items, 10, 0, 0);
+
+    ReplayRowBatchSource source(query, { L"System.ItemUrl", L"System.Size", L"System.ItemNameDisplay" }, 0);
+    FetchedRowBatch fetched;
+    ColumnarRowBatch const& batch = fetched.rows;
+    ASSERT_EQ(source.NextBatch(10, fetched), items.size());
+    ASSERT_EQ(batch.ColumnCount(), 3u);
+    for (size_t row = 0; row < items.size(); ++row)
+    {
+        EXPECT_EQ(batch.GetString(row, 0), items[row].url);
+        EXPECT_TRUE(batch.IsNull(row, 1));
+        EXPECT_EQ(batch.GetString(row, 2), items[row].name);
+    }
+}
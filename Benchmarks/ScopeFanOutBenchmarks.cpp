@@ -0,0 +1,143 @@
+// A files scope that answers in a couple of milliseconds a batch and a mail store that takes 40, queried the
+// way it was before scopes were fanned out, as one query that hands rows back at the pace of the slower store,
+// and fanned out: a query per scope on a thread of its own, merged with IncrementalMerge. Fanned out, the
+// files get shown on their own as soon as their first batch is in, like the helper does while the other
+// scopes catch up. The time per iteration is the time to the first result shown, the counters have when the
+// merged results started and when everything was in.
+#include <benchmark/benchmark.h>
+
+#include <thread>
+#include "BenchmarkCorpus.h"
+#include "ScopeMerge.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr auto c_filesBatchDelay = std::chrono::milliseconds(2);
+    constexpr auto c_mailBatchDelay = std::chrono::milliseconds(40);
+
+    struct RankedRow
+    {
+        uint32_t scope;
+        uint64_t rank;
+    };
+
+    struct RankOrder
+    {
+        bool operator()(RankedRow const& left, RankedRow const& right) const { return left.rank < right.rank; }
+    };
+
+    struct FanOutTimes
+    {
+        double firstShown{};
+        double firstMerged{};
+        double drained{};
+    };
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    template <typename TConsume>
+    void FetchScope(IRowBatchSource& source, TConsume&& consume)
+    {
+        AdaptiveBatchSizeController controller(64, 1024, 2);
+        FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), 1, 2, controller, UINT64_MAX,
+            [](ColumnarRowBatch const&, size_t, ResultStore&) {},
+            [&](FetchedRowBatch const& batch, ResultStore const&) { consume(batch.rows.RowCount()); });
+    }
+
+    FanOutTimes RunCombined(std::vector<CorpusItem> const& items)
+    {
+        FanOutTimes times;
+        const auto start = Clock::now();
+        SlowRowBatchSource source(items, c_mailBatchDelay, {});
+        FetchScope(source, [&](size_t)
+            {
+                if (times.firstShown == 0)
+                {
+                    times.firstShown = SecondsSince(start);
+                    times.firstMerged = times.firstShown;
+                }
+            });
+        times.drained = SecondsSince(start);
+        return times;
+    }
+
+    FanOutTimes RunFannedOut(std::vector<CorpusItem> const& files, std::vector<CorpusItem> const& mail)
+    {
+        FanOutTimes times;
+        std::mutex lock;
+        IncrementalMerge<RankedRow, RankOrder> merge(2);
+        const auto start = Clock::now();
+
+        auto runScope = [&](size_t scope, std::vector<CorpusItem> const& items, std::chrono::microseconds batchDelay)
+            {
+                SlowRowBatchSource source(items, batchDelay, {});
+                uint64_t next = 0;
+                auto drain = [&]()
+                    {
+                        if ((merge.Drain([](RankedRow&&) {}) > 0) && (times.firstMerged == 0))
+                        {
+                            times.firstMerged = SecondsSince(start);
+                        }
+                    };
+
+                FetchScope(source, [&](size_t rows)
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        for (size_t i = 0; i < rows; ++i, ++next)
+                        {
+                            // Ranks interleave, every scope has rows that belong near the top
+                            merge.Push(scope, { static_cast<uint32_t>(scope), (next * (scope + 2)) });
+                        }
+                        if (times.firstShown == 0)
+                        {
+                            times.firstShown = SecondsSince(start);
+                        }
+                        drain();
+                    });
+
+                std::lock_guard<std::mutex> guard(lock);
+                merge.Finish(scope);
+                drain();
+            };
+
+        std::thread mailThread([&]() { runScope(1, mail, c_mailBatchDelay); });
+        runScope(0, files, c_filesBatchDelay);
+        mailThread.join();
+        times.drained = SecondsSince(start);
+        return times;
+    }
+
+    void BM_ScopeFanOut(benchmark::State& state)
+    {
+        const bool fannedOut = state.range(0) != 0;
+        static const std::vector<CorpusItem> s_files = MakeCorpus(2000, 11, 0);
+        static const std::vector<CorpusItem> s_mail = MakeCorpus(1000, 12, 100);
+        static const std::vector<CorpusItem> s_combined = []()
+        {
+            std::vector<CorpusItem> combined(s_files);
+            combined.insert(combined.end(), s_mail.begin(), s_mail.end());
+            return combined;
+        }();
+
+        FanOutTimes total;
+        for (auto _ : state)
+        {
+            const FanOutTimes times = fannedOut ? RunFannedOut(s_files, s_mail) : RunCombined(s_combined);
+            state.SetIterationTime(times.firstShown);
+            total.firstShown += times.firstShown;
+            total.firstMerged += times.firstMerged;
+            total.drained += times.drained;
+        }
+
+        const double iterations = static_cast<double>(state.iterations());
+        state.counters["first_result_ms"] = (total.firstShown * 1000) / iterations;
+        state.counters["first_merged_ms"] = (total.firstMerged * 1000) / iterations;
+        state.counters["drained_ms"] = (total.drained * 1000) / iterations;
+    }
+    BENCHMARK(BM_ScopeFanOut)->ArgName("fanned_out")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseManualTime()->Iterations(3);
+}
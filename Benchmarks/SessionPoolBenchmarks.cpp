@@ -0,0 +1,62 @@
+// What a query pays for its session with and without a warm pool, against a stand-in provider that takes as long
+// as the collator usually does to initialize a data source and create a session
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "SessionPool.h"
+
+namespace
+{
+    constexpr std::chrono::microseconds c_sessionCreationTime{ 3000 };
+
+    struct SlowSessionProvider : ISessionProvider<std::shared_ptr<int>>
+    {
+        std::shared_ptr<int> CreateSession() override
+        {
+            std::this_thread::sleep_for(c_sessionCreationTime);
+            return std::make_shared<int>(0);
+        }
+    };
+
+    // The first query after the helper's Init, prewarmed is what Init does now. Setting up a pool takes far longer
+    // than what gets measured, so the iterations are fixed.
+    void BM_SessionPoolFirstAcquire(benchmark::State& state)
+    {
+        const bool prewarmed = state.range(0) != 0;
+        auto provider = std::make_shared<SlowSessionProvider>();
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            auto pool = std::make_unique<SessionPool<std::shared_ptr<int>>>(provider, 4);
+            if (prewarmed)
+            {
+                pool->Prewarm(2);
+            }
+            state.ResumeTiming();
+
+            auto lease = pool->Acquire();
+            benchmark::DoNotOptimize(lease.get());
+        }
+    }
+    BENCHMARK(BM_SessionPoolFirstAcquire)->ArgName("prewarmed")->Arg(0)->Arg(1)->Iterations(20)->UseRealTime();
+
+    // Every query after that, the lease only takes the pool's lock
+    void BM_SessionPoolAcquireHit(benchmark::State& state)
+    {
+        static SessionPool<std::shared_ptr<int>> s_pool(std::make_shared<SlowSessionProvider>(), 4);
+        if (state.thread_index() == 0)
+        {
+            s_pool.Prewarm(4);
+        }
+
+        for (auto _ : state)
+        {
+            auto lease = s_pool.Acquire();
+            benchmark::DoNotOptimize(lease.get());
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_SessionPoolAcquireHit)->Threads(1)->Threads(4)->UseRealTime();
+}
@@ -0,0 +1,166 @@
+// SessionPool against a stand-in provider whose sessions know whether anyone is using them
+#include <gtest/gtest.h>
+
+#include <thread>
+#include "SessionPool.h"
+
+namespace
+{
+    struct FakeSession
+    {
+        int id{};
+        std::atomic<int> users{};
+    };
+
+    struct FakeSessionProvider : ISessionProvider<std::shared_ptr<FakeSession>>
+    {
+        std::shared_ptr<FakeSession> CreateSession() override
+        {
+            if (failNext.exchange(false))
+            {
+                throw std::runtime_error("provider is gone");
+            }
+            std::this_thread::sleep_for(creationTime);
+            auto session = std::make_shared<FakeSession>();
+            session->id = ++created;
+            return session;
+        }
+
+        std::atomic<int> created{};
+        std::atomic<bool> failNext{};
+        std::chrono::microseconds creationTime{ 0 };
+    };
+
+    using FakeSessionPool = SessionPool<std::shared_ptr<FakeSession>>;
+}
+
+TEST(SessionPoolTests, PrewarmedSessionsAreHits)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 4);
+    pool.Prewarm(2);
+    EXPECT_EQ(pool.IdleCount(), 2u);
+    EXPECT_EQ(provider->created, 2);
+
+    {
+        auto first = pool.Acquire();
+        auto second = pool.Acquire();
+        EXPECT_NE(first.get()->id, second.get()->id);
+    }
+
+    SessionPoolStats stats = pool.GetStats();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 0u);
+    EXPECT_EQ(provider->created, 2);
+    EXPECT_EQ(pool.IdleCount(), 2u);
+}
+
+TEST(SessionPoolTests, PrewarmStopsAtMaxIdle)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 2);
+    pool.Prewarm(8);
+    EXPECT_EQ(pool.IdleCount(), 2u);
+
+    // Already warm, nothing more to create
+    pool.Prewarm(2);
+    EXPECT_EQ(provider->created, 2);
+}
+
+TEST(SessionPoolTests, LeaseReturnsSessionUnlessDiscarded)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 4);
+
+    int broken = 0;
+    {
+        auto lease = pool.Acquire();
+        broken = lease.get()->id;
+        lease.Discard();
+    }
+    EXPECT_EQ(pool.IdleCount(), 0u);
+
+    {
+        auto lease = pool.Acquire();
+        EXPECT_NE(lease.get()->id, broken);
+    }
+    EXPECT_EQ(pool.IdleCount(), 1u);
+
+    SessionPoolStats stats = pool.GetStats();
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.discarded, 1u);
+}
+
+TEST(SessionPoolTests, SessionsPastMaxIdleAreDropped)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 1);
+    {
+        auto first = pool.Acquire();
+        auto second = pool.Acquire();
+    }
+    EXPECT_EQ(pool.IdleCount(), 1u);
+    EXPECT_EQ(pool.GetStats().discarded, 1u);
+}
+
+TEST(SessionPoolTests, ProviderFailureReachesCaller)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 4);
+    provider->failNext = true;
+    EXPECT_THROW(pool.Acquire(), std::runtime_error);
+    EXPECT_EQ(pool.IdleCount(), 0u);
+
+    auto lease = pool.Acquire();
+    EXPECT_NE(lease.get(), nullptr);
+}
+
+TEST(SessionPoolTests, CreationTimeIsTracked)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    provider->creationTime = std::chrono::milliseconds(2);
+    FakeSessionPool pool(provider, 4);
+    pool.Prewarm(2);
+
+    SessionPoolStats stats = pool.GetStats();
+    EXPECT_GE(stats.maxCreationMicroseconds, 2000u);
+    EXPECT_GE(stats.AverageCreationMicroseconds(), 2000u);
+    EXPECT_EQ(stats.created, 2u);
+    EXPECT_EQ(stats.misses, 0u);
+}
+
+// Leases cross threads the way queries do, no session may ever be in two hands at once
+TEST(SessionPoolTests, ConcurrentLeasesNeverShareASession)
+{
+    auto provider = std::make_shared<FakeSessionProvider>();
+    FakeSessionPool pool(provider, 4);
+    pool.Prewarm(4);
+
+    std::atomic<bool> shared{};
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 8; ++thread)
+    {
+        threads.emplace_back([&]()
+            {
+                for (int i = 0; i < 2000; ++i)
+                {
+                    auto lease = pool.Acquire();
+                    if (lease.get()->users.fetch_add(1) != 0)
+                    {
+                        shared = true;
+                    }
+                    std::this_thread::yield();
+                    lease.get()->users.fetch_sub(1);
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_FALSE(shared);
+    SessionPoolStats stats = pool.GetStats();
+    EXPECT_EQ(stats.hits + stats.misses, 16000u);
+    EXPECT_LE(pool.IdleCount(), 4u);
+}
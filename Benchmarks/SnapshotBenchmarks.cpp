@@ -0,0 +1,133 @@
+// Starting up with the filename index: opening the snapshot a previous run left behind against building it
+// again from the priming query's rows, at the most entries the app keeps. The snapshot is generated from the
+// corpus and written to a temporary file, the cold start reads it back in (where the app maps it) and answers
+// a first lookup.
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include "BenchmarkCorpus.h"
+#include "TrigramIndex.h"
+
+namespace
+{
+    constexpr size_t c_entries{ 500000 };
+
+    const std::vector<CorpusItem>& GetCorpus()
+    {
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(c_entries, 6);
+        return s_corpus;
+    }
+
+    std::shared_ptr<TrigramFilenameIndex> BuildIndex()
+    {
+        auto index = std::make_shared<TrigramFilenameIndex>(c_entries);
+        for (auto const& item : GetCorpus())
+        {
+            index->Add(item.name, item.url, item.kind);
+        }
+        index->Finalize();
+        return index;
+    }
+
+    std::vector<uint8_t> WriteSnapshot(TrigramFilenameIndex const& index)
+    {
+        std::vector<uint8_t> snapshot;
+        index.WriteSnapshot([&](const void* data, size_t size)
+            {
+                snapshot.insert(snapshot.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+            }, 1);
+        return snapshot;
+    }
+
+    // Written once per run, removed when the benchmarks exit
+    struct SnapshotFile
+    {
+        SnapshotFile()
+        {
+            const std::vector<uint8_t> snapshot = WriteSnapshot(*BuildIndex());
+            size = snapshot.size();
+            path = std::filesystem::temp_directory_path() / "WinSearchBenchmarkSnapshot.wsidx";
+            std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(snapshot.data()), static_cast<std::streamsize>(snapshot.size()));
+        }
+        ~SnapshotFile()
+        {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+
+        std::filesystem::path path;
+        size_t size{};
+    };
+
+    const SnapshotFile& GetSnapshotFile()
+    {
+        static const SnapshotFile s_file;
+        return s_file;
+    }
+
+    void BM_SnapshotWrite(benchmark::State& state)
+    {
+        const auto index = BuildIndex();
+        size_t bytes = 0;
+        for (auto _ : state)
+        {
+            bytes = WriteSnapshot(*index).size();
+        }
+        state.counters["snapshot_mb"] = static_cast<double>(bytes) / (1024 * 1024);
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    }
+    BENCHMARK(BM_SnapshotWrite)->Unit(benchmark::kMillisecond)->Iterations(5)->UseRealTime();
+
+    // Only the header check and validation, the snapshot is already in memory
+    void BM_SnapshotOpen(benchmark::State& state)
+    {
+        const auto snapshot = std::make_shared<const std::vector<uint8_t>>(WriteSnapshot(*BuildIndex()));
+        for (auto _ : state)
+        {
+            uint32_t tag = 0;
+            auto index = TrigramFilenameIndex::OpenSnapshot(snapshot->data(), snapshot->size(), snapshot, &tag);
+            if (index == nullptr)
+            {
+                state.SkipWithError("snapshot didn't open");
+                break;
+            }
+            benchmark::DoNotOptimize(index->Size());
+        }
+    }
+    BENCHMARK(BM_SnapshotOpen)->Unit(benchmark::kMicrosecond);
+
+    // From nothing to the first page of results: the snapshot off of disk, or the index built from the rows
+    void BM_FilenameIndexColdStart(benchmark::State& state)
+    {
+        const bool fromSnapshot = state.range(0) != 0;
+        state.SetLabel(fromSnapshot ? "snapshot" : "rebuild");
+        GetCorpus();
+        SnapshotFile const& file = GetSnapshotFile();
+
+        std::vector<uint32_t> ids;
+        for (auto _ : state)
+        {
+            std::shared_ptr<const TrigramFilenameIndex> index;
+            if (fromSnapshot)
+            {
+                auto snapshot = std::make_shared<std::vector<uint8_t>>(file.size);
+                std::ifstream(file.path, std::ios::binary).read(reinterpret_cast<char*>(snapshot->data()), static_cast<std::streamsize>(file.size));
+                uint32_t tag = 0;
+                index = TrigramFilenameIndex::OpenSnapshot(snapshot->data(), snapshot->size(), snapshot, &tag);
+            }
+            else
+            {
+                index = BuildIndex();
+            }
+
+            if ((index == nullptr) || !index->Find(L"quarterly", 50, ids))
+            {
+                state.SkipWithError("no index to answer from");
+                break;
+            }
+            benchmark::DoNotOptimize(ids.data());
+        }
+    }
+    BENCHMARK(BM_FilenameIndexColdStart)->ArgName("snapshot")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->Iterations(3)->UseRealTime();
+}
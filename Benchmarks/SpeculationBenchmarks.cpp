@@ -0,0 +1,197 @@
+// Speculation replayed over a generated typing trace on a simulated clock: after every keystroke's query the
+// planner picks continuations, and they run one after another within the budget until the next keystroke
+// cancels them, like RunSpeculation does. Counters are what matters: how many keystrokes were answered from
+// speculation, and how much of the time spent speculating went to results nobody used. The time per
+// iteration is what planning costs on the UI side, catalog lookups included.
+#include <benchmark/benchmark.h>
+
+#include <list>
+#include "BenchmarkCorpus.h"
+#include "ReuseWhereCache.h"
+#include "SpeculationPlanner.h"
+#include "TrigramIndex.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Keystroke
+    {
+        std::wstring text; // normalized
+        std::chrono::microseconds at;
+    };
+
+    // People mostly look for the same few things again. Each search types the start of a word from one of
+    // the names, about a keystroke every 80 to 250ms, and pauses a second or so before the next search.
+    std::vector<Keystroke> MakeTypingTrace(std::vector<CorpusItem> const& corpus, size_t searches, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::wstring> favorites;
+        for (size_t i = 0; i < 40; ++i)
+        {
+            favorites.push_back(NormalizeSearchText(corpus[random() % corpus.size()].name));
+        }
+
+        std::vector<Keystroke> trace;
+        std::chrono::microseconds now{};
+        for (size_t search = 0; search < searches; ++search)
+        {
+            // Skewed towards the first favorites, with a fresh name every so often
+            const double skew = static_cast<double>(random()) / static_cast<double>(random.max());
+            const std::wstring name = ((random() % 5) == 0) ? NormalizeSearchText(corpus[random() % corpus.size()].name) :
+                favorites[static_cast<size_t>(skew * skew * static_cast<double>(favorites.size() - 1))];
+
+            const size_t length = (std::min)(name.size(), static_cast<size_t>(3 + (random() % 10)));
+            for (size_t i = 1; i <= length; ++i)
+            {
+                now += std::chrono::milliseconds(80 + (random() % 170));
+                trace.push_back({ name.substr(0, i), now });
+            }
+            now += std::chrono::milliseconds(800 + (random() % 1500));
+        }
+        return trace;
+    }
+
+    struct ReplayOutcome
+    {
+        SpeculationStats stats;
+        uint64_t canceled{};
+        std::chrono::microseconds spent{};
+        std::chrono::microseconds wastedTime{};
+    };
+
+    ReplayOutcome ReplaySpeculation(std::vector<Keystroke> const& trace, TrigramFilenameIndex const& catalog, std::chrono::microseconds queryCost,
+        std::chrono::microseconds speculationCost)
+    {
+        struct Cached
+        {
+            std::wstring text;
+            bool used;
+        };
+        constexpr size_t c_maxContinuations{ 3 };
+        constexpr size_t c_maxCached{ 8 };
+        constexpr size_t c_catalogSample{ 512 };
+
+        SpeculationPlanner planner;
+        SpeculationBudget budget{ std::chrono::milliseconds(1000), std::chrono::milliseconds(250) };
+        std::list<Cached> cached; // most recently used first
+        ReplayOutcome outcome;
+        std::vector<uint32_t> ids;
+
+        for (size_t i = 0; i < trace.size(); ++i)
+        {
+            Keystroke const& keystroke = trace[i];
+
+            // TryAnswerFromSpeculation
+            planner.OnTextTyped(keystroke.text);
+            auto hit = std::find_if(cached.begin(), cached.end(), [&](Cached const& entry) { return entry.text == keystroke.text; });
+            if (hit != cached.end())
+            {
+                if (!hit->used)
+                {
+                    planner.Stats().hits++;
+                    hit->used = true;
+                }
+                cached.splice(cached.begin(), cached, hit);
+            }
+
+            // RunSpeculation, from when the keystroke's own query is done until the next keystroke
+            const std::vector<std::wstring> continuations = planner.Plan(keystroke.text, c_maxContinuations, [&](auto&& callback)
+                {
+                    if (catalog.Find(keystroke.text, c_catalogSample, ids))
+                    {
+                        for (uint32_t id : ids)
+                        {
+                            callback(catalog.GetName(id));
+                        }
+                    }
+                });
+
+            const std::chrono::microseconds next = ((i + 1) < trace.size()) ? trace[i + 1].at : std::chrono::microseconds::max();
+            std::chrono::microseconds now = keystroke.at + queryCost;
+            for (auto const& continuation : continuations)
+            {
+                if ((now >= next) || !budget.CanSpend(Clock::time_point(now)))
+                {
+                    break;
+                }
+                if (std::any_of(cached.begin(), cached.end(), [&](Cached const& entry) { return entry.text == continuation; }))
+                {
+                    continue;
+                }
+                planner.Stats().planned++;
+
+                const std::chrono::microseconds elapsed = (std::min)(speculationCost, next - now);
+                now += elapsed;
+                budget.OnSpent(Clock::time_point(now), elapsed);
+                outcome.spent += elapsed;
+                if (elapsed < speculationCost)
+                {
+                    // The next keystroke canceled it
+                    outcome.canceled++;
+                    outcome.wastedTime += elapsed;
+                    break;
+                }
+
+                cached.push_front({ continuation, false });
+                planner.Stats().completed++;
+                while (cached.size() > c_maxCached)
+                {
+                    if (!cached.back().used)
+                    {
+                        planner.Stats().wasted++;
+                        outcome.wastedTime += speculationCost;
+                    }
+                    cached.pop_back();
+                }
+            }
+        }
+
+        // Whatever is left over at the end was never used either
+        for (auto const& entry : cached)
+        {
+            if (!entry.used)
+            {
+                planner.Stats().wasted++;
+                outcome.wastedTime += speculationCost;
+            }
+        }
+        outcome.stats = planner.Stats();
+        return outcome;
+    }
+
+    void BM_SpeculationReplay(benchmark::State& state)
+    {
+        const auto speculationCost = std::chrono::milliseconds(state.range(0));
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(20000, 7);
+        static const std::shared_ptr<TrigramFilenameIndex> s_catalog = []()
+        {
+            auto index = std::make_shared<TrigramFilenameIndex>(s_corpus.size());
+            for (auto const& item : s_corpus)
+            {
+                index->Add(item.name, item.url, item.kind);
+            }
+            index->Finalize();
+            return index;
+        }();
+        static const std::vector<Keystroke> s_trace = MakeTypingTrace(s_corpus, 300, 8);
+
+        ReplayOutcome outcome;
+        for (auto _ : state)
+        {
+            outcome = ReplaySpeculation(s_trace, *s_catalog, std::chrono::milliseconds(60), speculationCost);
+            benchmark::DoNotOptimize(outcome.stats.hits);
+        }
+
+        const double keystrokes = static_cast<double>(s_trace.size());
+        state.counters["keystrokes"] = keystrokes;
+        state.counters["hit_rate"] = static_cast<double>(outcome.stats.hits) / keystrokes;
+        state.counters["completed"] = static_cast<double>(outcome.stats.completed);
+        state.counters["canceled"] = static_cast<double>(outcome.canceled);
+        state.counters["wasted"] = static_cast<double>(outcome.stats.wasted);
+        state.counters["wasted_work"] = (outcome.spent.count() > 0) ?
+            (static_cast<double>(outcome.wastedTime.count()) / static_cast<double>(outcome.spent.count())) : 0;
+        state.SetItemsProcessed(state.iterations() * s_trace.size());
+    }
+    BENCHMARK(BM_SpeculationReplay)->ArgName("speculation_ms")->Arg(20)->Arg(60)->Arg(150)->Unit(benchmark::kMillisecond);
+}
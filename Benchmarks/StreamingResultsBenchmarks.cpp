@@ -0,0 +1,66 @@
+// Time to first result against a fake rowset, publishing a page at a time against publishing once the rowset is
+// drained (what the UI got before results were streamed)
+#include <benchmark/benchmark.h>
+
+#include <future>
+#include "BenchmarkCorpus.h"
+#include "StreamingResults.h"
+
+namespace
+{
+    void BM_TimeToFirstResult(benchmark::State& state)
+    {
+        const bool streaming = state.range(0) != 0;
+        static const RecordedQuery s_query = MakeCorpusQuery(MakeCorpus(4000), 256, 1000, 10);
+
+        ResultStreamPublisher publisher;
+        publisher.SetPageSizes(streaming ? 50 : SIZE_MAX, streaming ? 500 : SIZE_MAX);
+
+        uint32_t cookie = 0;
+        double firstResult = 0;
+        double drained = 0;
+        for (auto _ : state)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            publisher.Request(++cookie);
+            auto fetch = std::async(std::launch::async, [&]()
+                {
+                    publisher.Begin(cookie);
+                    ReplayRowBatchSource source(s_query, GetCorpusColumns(), 1);
+                    AdaptiveBatchSizeController controller(64, 16384, 2);
+                    size_t count = 0;
+                    FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), 1, 2, controller, UINT64_MAX,
+                        [](ColumnarRowBatch const&, size_t, ResultStore&) {},
+                        [&](FetchedRowBatch const& batch, ResultStore const&)
+                        {
+                            for (size_t row = 0; row < batch.rows.RowCount(); ++row)
+                            {
+                                publisher.OnRowsAvailable(++count);
+                            }
+                            if (streaming)
+                            {
+                                publisher.Flush(count);
+                            }
+                        });
+                    publisher.Complete(cookie, count);
+                });
+
+            ResultStreamUpdate update;
+            bool sawFirst = false;
+            while (!update.completed)
+            {
+                update = publisher.WaitForUpdate(cookie, update.revision, update.available);
+                if (!sawFirst && (update.available > 0))
+                {
+                    sawFirst = true;
+                    firstResult += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                }
+            }
+            drained += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            fetch.get();
+        }
+        state.counters["first_result_ms"] = benchmark::Counter(firstResult, benchmark::Counter::kAvgIterations);
+        state.counters["drained_ms"] = benchmark::Counter(drained, benchmark::Counter::kAvgIterations);
+    }
+    BENCHMARK(BM_TimeToFirstResult)->ArgName("streaming")->Arg(0)->Arg(1)->Iterations(10)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
@@ -0,0 +1,130 @@
+// ResultStreamPublisher between a fetch thread reading a fake rowset and a waiter standing in for the UI
+#include <gtest/gtest.h>
+
+#include <future>
+#include "BenchmarkCorpus.h"
+#include "StreamingResults.h"
+
+namespace
+{
+    // Fetches the whole stand-in rowset for cookie and publishes it the way the helper does: Begin, a row at a
+    // time through OnRowsAvailable, a Flush after every batch and Complete at the end
+    size_t FetchAndPublish(ResultStreamPublisher& publisher, uint32_t cookie, RecordedQuery const& query)
+    {
+        publisher.Begin(cookie);
+        ReplayRowBatchSource source(query, GetCorpusColumns(), 1);
+        AdaptiveBatchSizeController controller(64, 16384, 2);
+        ResultStore results;
+        FetchRowsPipelined<ResultStore>(source, GetFetchWorkers(), 1, 2, controller, UINT64_MAX, MaterializeCorpusRow,
+            [&](FetchedRowBatch const&, ResultStore const& batchResults)
+            {
+                for (size_t i = 0; i < batchResults.Size(); ++i)
+                {
+                    results.AppendFrom(batchResults, i);
+                    publisher.OnRowsAvailable(results.Size());
+                }
+                publisher.Flush(results.Size());
+            });
+        publisher.Complete(cookie, results.Size());
+        return results.Size();
+    }
+
+    uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+// A rowset that takes ~60ms to drain has to put its first page in front of the UI long before that
+TEST(StreamingResultsTests, FirstPageArrivesBeforeTheRowsetIsDrained)
+{
+    const RecordedQuery query = MakeCorpusQuery(MakeCorpus(4000), 256, 1000, 10);
+    ResultStreamPublisher publisher;
+    publisher.SetPageSizes(50, 500);
+
+    const auto start = std::chrono::steady_clock::now();
+    publisher.Request(1);
+    auto fetch = std::async(std::launch::async, [&]() { return FetchAndPublish(publisher, 1, query); });
+
+    uint64_t firstPage = 0;
+    ResultStreamUpdate update;
+    while (!update.completed)
+    {
+        update = publisher.WaitForUpdate(1, update.revision, update.available);
+        ASSERT_FALSE(update.superseded);
+        if ((firstPage == 0) && (update.available > 0))
+        {
+            firstPage = MicrosecondsSince(start);
+            EXPECT_GE(update.available, 50u);
+        }
+    }
+    const uint64_t drained = MicrosecondsSince(start);
+
+    EXPECT_EQ(fetch.get(), 4000u);
+    EXPECT_EQ(update.available, 4000u);
+    EXPECT_GT(update.timeToFirstResultMicroseconds, 0u);
+    EXPECT_LE(update.timeToFirstResultMicroseconds, firstPage);
+    EXPECT_LT(firstPage * 4, drained);
+}
+
+TEST(StreamingResultsTests, NewerRequestSupersedesWaiter)
+{
+    ResultStreamPublisher publisher;
+    publisher.Request(1);
+    auto waiter = std::async(std::launch::async, [&]() { return publisher.WaitForUpdate(1, 0, 0); });
+    publisher.Request(2);
+
+    const ResultStreamUpdate update = waiter.get();
+    EXPECT_TRUE(update.superseded);
+}
+
+TEST(StreamingResultsTests, ReplacingRowsBumpsTheRevision)
+{
+    ResultStreamPublisher publisher;
+    publisher.SetPageSizes(10, 10);
+    publisher.Request(1);
+    publisher.Begin(1);
+    publisher.OnRowsAvailable(25);
+
+    ResultStreamUpdate update = publisher.WaitForUpdate(1, 0, 0);
+    EXPECT_EQ(update.available, 25u);
+
+    // Indexer results replacing a refinement start over at zero under a new revision
+    publisher.Begin(1);
+    ResultStreamUpdate replaced = publisher.WaitForUpdate(1, update.revision, update.available);
+    EXPECT_NE(replaced.revision, update.revision);
+    EXPECT_EQ(replaced.available, 0u);
+    EXPECT_FALSE(replaced.superseded);
+}
+
+TEST(StreamingResultsTests, RowsAreHeldBackUntilThePageFills)
+{
+    ResultStreamPublisher publisher;
+    publisher.SetPageSizes(20, 100);
+    publisher.Request(1);
+    publisher.Begin(1);
+    for (size_t count = 1; count < 20; ++count)
+    {
+        publisher.OnRowsAvailable(count);
+    }
+
+    const ResultStreamUpdate begun = publisher.WaitForUpdate(1, 0, 0);
+    EXPECT_EQ(begun.available, 0u);
+
+    publisher.OnRowsAvailable(20);
+    EXPECT_EQ(publisher.WaitForUpdate(1, begun.revision, 0).available, 20u);
+
+    // A slow provider's partial batch still goes out on the flush
+    publisher.OnRowsAvailable(21);
+    publisher.Flush(21);
+    EXPECT_EQ(publisher.WaitForUpdate(1, begun.revision, 20).available, 21u);
+}
+
+TEST(StreamingResultsTests, AbandonReleasesWaiters)
+{
+    ResultStreamPublisher publisher;
+    publisher.Request(1);
+    auto waiter = std::async(std::launch::async, [&]() { return publisher.WaitForUpdate(1, 0, 0); });
+    publisher.Abandon();
+    EXPECT_TRUE(waiter.get().superseded);
+}
@@ -0,0 +1,183 @@
+// Classifying rows as they're decoded, counting what gets allocated: the way it was done before atoms, comparing
+// kind strings, copying every url to make a file path out of it and keying thumbnails on the extension's text,
+// against ClassifyItem and the atom keyed cache. Also what the atom table itself allocates as it fills up.
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include "AllocationCounter.h"
+#include "BenchmarkCorpus.h"
+#include "ThumbnailCache.h"
+
+namespace
+{
+    using Thumbnail = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // ExtensionThumbnailCache before it was keyed on atoms
+    struct TextKeyedThumbnailCache
+    {
+    public:
+        Thumbnail Find(std::wstring_view key)
+        {
+            Shard& shard = GetShard(key);
+            std::shared_lock<std::shared_mutex> lock(shard.lock);
+            for (auto const& entry : shard.thumbnails)
+            {
+                if (entry.first == key)
+                {
+                    return entry.second;
+                }
+            }
+            return nullptr;
+        }
+
+        void Add(std::wstring_view key, Thumbnail thumbnail)
+        {
+            Shard& shard = GetShard(key);
+            std::unique_lock<std::shared_mutex> lock(shard.lock);
+            for (auto& entry : shard.thumbnails)
+            {
+                if (entry.first == key)
+                {
+                    entry.second = std::move(thumbnail);
+                    return;
+                }
+            }
+            shard.thumbnails.emplace_back(key, std::move(thumbnail));
+        }
+
+    private:
+        static constexpr size_t c_shardCount{ 16 };
+
+        struct alignas(64) Shard
+        {
+            std::shared_mutex lock;
+            std::vector<std::pair<std::wstring, Thumbnail>> thumbnails;
+        };
+
+        Shard& GetShard(std::wstring_view key)
+        {
+            return m_shards[std::hash<std::wstring_view>{}(key) % c_shardCount];
+        }
+
+        Shard m_shards[c_shardCount];
+    };
+
+    // GetExtension before it was a single pass
+    std::wstring_view GetExtensionWithFind(std::wstring_view path)
+    {
+        const size_t dot = path.rfind(L'.');
+        if (dot == std::wstring_view::npos)
+        {
+            return {};
+        }
+
+        const size_t separator = path.find_last_of(L"\\/");
+        if ((separator != std::wstring_view::npos) && (separator > dot))
+        {
+            return {};
+        }
+        return path.substr(dot);
+    }
+
+    // A fifth of it mail, like an inbox heavy profile
+    const std::vector<CorpusItem>& GetCorpus()
+    {
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(10000, 40, 20);
+        return s_corpus;
+    }
+
+    // What a row is worked out to be, the folder and mail flags, the path it launches with and its thumbnail
+    void BM_ClassifyRows(benchmark::State& state)
+    {
+        const bool atoms = state.range(0) != 0;
+        auto const& corpus = GetCorpus();
+        const Thumbnail loaded = std::make_shared<const std::vector<uint8_t>>(256);
+        TextKeyedThumbnailCache textCache;
+        ExtensionThumbnailCache<Thumbnail> atomCache;
+        std::wstring filePath;
+
+        AllocationScope allocations;
+        for (auto _ : state)
+        {
+            for (auto const& item : corpus)
+            {
+                if (atoms)
+                {
+                    const ItemAtoms classified = ClassifyItem(GetStringAtoms(), item.url, item.kind);
+                    bool isMail = classified.IsMail();
+                    if (!isMail)
+                    {
+                        // Into the helper's buffer, the result store keeps its own copy
+                        filePath.assign(item.url);
+                        isMail = !UrlToFilePath(filePath);
+                    }
+                    const StringAtom key = isMail ? c_noAtom : classified.GetThumbnailKey();
+                    if (atomCache.NeedProcessThumbnailForItem(key))
+                    {
+                        atomCache.Add(key, loaded);
+                    }
+                    benchmark::DoNotOptimize(classified.IsFolder());
+                }
+                else
+                {
+                    const bool isFolder = (item.kind == L"Folder");
+                    std::wstring path(item.url);
+                    const bool isMail = (item.url.find(L"mapi") != std::wstring::npos) || !UrlToFilePath(path);
+                    const std::wstring_view key = isMail ? std::wstring_view() : (isFolder ? std::wstring_view(L"\\folder") : GetExtensionWithFind(path));
+                    if (!key.empty() && (textCache.Find(key) == nullptr))
+                    {
+                        textCache.Add(key, loaded);
+                    }
+                    benchmark::DoNotOptimize(path.data());
+                }
+            }
+        }
+
+        const AllocationCounts counts = allocations.Elapsed();
+        const double rows = static_cast<double>(state.iterations() * corpus.size());
+        state.counters["allocs_per_row"] = static_cast<double>(counts.allocations) / rows;
+        state.counters["bytes_per_row"] = static_cast<double>(counts.bytes) / rows;
+        state.SetItemsProcessed(state.iterations() * corpus.size());
+    }
+    BENCHMARK(BM_ClassifyRows)->ArgName("atoms")->Arg(0)->Arg(1);
+
+    // A fresh table interning count distinct extensions, one allocation for each one's text and none for
+    // looking it up again
+    void BM_InternDistinct(benchmark::State& state)
+    {
+        const size_t count = static_cast<size_t>(state.range(0));
+        std::vector<std::wstring> extensions;
+        for (size_t i = 0; i < count; ++i)
+        {
+            extensions.push_back(L".x" + std::to_wstring(i));
+        }
+
+        uint64_t internAllocations = 0;
+        uint64_t findAllocations = 0;
+        for (auto _ : state)
+        {
+            auto table = std::make_unique<StringAtomTable>();
+            AllocationScope interning;
+            for (auto const& extension : extensions)
+            {
+                benchmark::DoNotOptimize(table->Intern(extension));
+            }
+            internAllocations += interning.Elapsed().allocations;
+
+            AllocationScope finding;
+            for (auto const& extension : extensions)
+            {
+                benchmark::DoNotOptimize(table->Find(extension));
+            }
+            findAllocations += finding.Elapsed().allocations;
+        }
+
+        const double atoms = static_cast<double>(state.iterations() * count);
+        state.counters["allocs_per_intern"] = static_cast<double>(internAllocations) / atoms;
+        state.counters["allocs_per_find"] = static_cast<double>(findAllocations) / atoms;
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+    BENCHMARK(BM_InternDistinct)->ArgName("atoms")->Arg(64)->Arg(2048);
+}
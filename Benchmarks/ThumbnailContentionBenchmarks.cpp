@@ -0,0 +1,135 @@
+// Thumbnail lookups from several threads at once, the way rows being built and shown on different threads hit
+// them: ExtensionThumbnailCache against the sharded reader/writer locked cache it replaced, with and without a
+// thread adding now and then, and MappedThumbnailStore, which takes a lock for every lookup.
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include "ThumbnailCache.h"
+#include "ThumbnailStore.h"
+
+namespace
+{
+    using Thumbnail = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // ExtensionThumbnailCache before readers stopped taking a lock
+    struct ShardedThumbnailCache
+    {
+    public:
+        Thumbnail Find(StringAtom key)
+        {
+            Shard& shard = m_shards[key % c_shardCount];
+            const size_t index = key / c_shardCount;
+            std::shared_lock<std::shared_mutex> lock(shard.lock);
+            return (index < shard.thumbnails.size()) ? shard.thumbnails[index] : nullptr;
+        }
+
+        void Add(StringAtom key, Thumbnail thumbnail)
+        {
+            Shard& shard = m_shards[key % c_shardCount];
+            const size_t index = key / c_shardCount;
+            std::unique_lock<std::shared_mutex> lock(shard.lock);
+            if (index >= shard.thumbnails.size())
+            {
+                shard.thumbnails.resize(index + 1, nullptr);
+            }
+            shard.thumbnails[index] = std::move(thumbnail);
+        }
+
+    private:
+        static constexpr size_t c_shardCount{ 16 };
+
+        struct alignas(64) Shard
+        {
+            std::shared_mutex lock;
+            std::vector<Thumbnail> thumbnails;
+        };
+
+        Shard m_shards[c_shardCount];
+    };
+
+    // The extensions a results list of mostly documents and pictures goes through
+    const std::vector<StringAtom>& GetKeys()
+    {
+        static const std::vector<StringAtom> s_keys = []()
+        {
+            std::vector<StringAtom> keys;
+            for (const wchar_t* extension : { L".docx", L".pdf", L".txt", L".xlsx", L".pptx", L".jpg", L".png", L".mp3", L".mp4",
+                L".zip", L".exe", L".cpp", L".h", L".json", L".lnk", L".md" })
+            {
+                keys.push_back(GetStringAtoms().Intern(extension));
+            }
+            keys.push_back(c_folderThumbnailAtom);
+            return keys;
+        }();
+        return s_keys;
+    }
+
+    template <typename TCache>
+    TCache& GetFilledCache()
+    {
+        static TCache* s_cache = []()
+        {
+            auto cache = new TCache();
+            for (const StringAtom key : GetKeys())
+            {
+                cache->Add(key, std::make_shared<const std::vector<uint8_t>>(256));
+            }
+            return cache;
+        }();
+        return *s_cache;
+    }
+
+    // writes:1 has the first thread replace a thumbnail every 1024 lookups, what a load finishing looks like
+    template <typename TCache>
+    void BM_ThumbnailCacheContention(benchmark::State& state)
+    {
+        const bool writes = state.range(0) != 0;
+        TCache& cache = GetFilledCache<TCache>();
+        auto const& keys = GetKeys();
+        const Thumbnail replacement = std::make_shared<const std::vector<uint8_t>>(256);
+
+        size_t i = static_cast<size_t>(state.thread_index()) * 7;
+        for (auto _ : state)
+        {
+            const StringAtom key = keys[i++ % keys.size()];
+            if (writes && (state.thread_index() == 0) && ((i % 1024) == 0))
+            {
+                cache.Add(key, replacement);
+            }
+            benchmark::DoNotOptimize(cache.Find(key));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(BM_ThumbnailCacheContention, ExtensionThumbnailCache<Thumbnail>)->ArgName("writes")->Arg(0)->Arg(1)
+        ->ThreadRange(1, 8)->UseRealTime();
+    BENCHMARK_TEMPLATE(BM_ThumbnailCacheContention, ShardedThumbnailCache)->ArgName("writes")->Arg(0)->Arg(1)
+        ->ThreadRange(1, 8)->UseRealTime();
+
+    // A cache miss that goes to the store, what every extension costs the first time it's shown in a run
+    void BM_ThumbnailStoreContention(benchmark::State& state)
+    {
+        static std::vector<uint8_t> s_view(1024 * 1024);
+        static MappedThumbnailStore* s_store = []()
+        {
+            auto store = new MappedThumbnailStore(s_view.data(), s_view.size());
+            const std::vector<uint8_t> encoded(3 * 1024, 0x5A);
+            for (const StringAtom key : GetKeys())
+            {
+                store->Insert(GetStringAtoms().GetText(key), encoded.data(), encoded.size());
+            }
+            return store;
+        }();
+        auto const& keys = GetKeys();
+
+        std::vector<uint8_t> bytes;
+        size_t i = static_cast<size_t>(state.thread_index()) * 7;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(s_store->Find(GetStringAtoms().GetText(keys[i++ % keys.size()]), bytes));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(BM_ThumbnailStoreContention)->ThreadRange(1, 8)->UseRealTime();
+}
@@ -0,0 +1,276 @@
+// ThumbnailScheduler against a fake thumbnail source standing in for the shell: loads block until the test lets
+// them go, keys can be made to fail, and the scheduler's retry clock is stepped by hand
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include "ThumbnailScheduler.h"
+
+namespace
+{
+    using Thumbnail = std::shared_ptr<const std::wstring>;
+    using Scheduler = ThumbnailScheduler<Thumbnail>;
+
+    struct FakeThumbnailSource
+    {
+    public:
+        Scheduler::LoadFunction Loader()
+        {
+            return [this](StringAtom key, std::wstring const& path, bool) -> Thumbnail
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_loads[key]++;
+                    m_running++;
+                    m_changed.notify_all();
+                    m_changed.wait(lock, [&]() { return m_open; });
+                    m_running--;
+                    return (m_failing.count(key) != 0) ? nullptr : std::make_shared<const std::wstring>(path);
+                };
+        }
+
+        // Loads from now on wait in the source until Open
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_open = false;
+        }
+
+        void Open()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_open = true;
+            m_changed.notify_all();
+        }
+
+        void SetFailing(StringAtom key, bool failing)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (failing)
+            {
+                m_failing.insert(key);
+            }
+            else
+            {
+                m_failing.erase(key);
+            }
+        }
+
+        void WaitForRunning(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [&]() { return m_running >= count; });
+        }
+
+        size_t Loads(StringAtom key)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_loads[key];
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_changed;
+        bool m_open{ true };
+        size_t m_running{};
+        std::set<StringAtom> m_failing;
+        std::unordered_map<StringAtom, size_t> m_loads;
+    };
+
+    // What a row's callback got, thumbnail or null
+    struct Callbacks
+    {
+    public:
+        Scheduler::Callback Callback()
+        {
+            return [this](Thumbnail const& thumbnail)
+                {
+                    (thumbnail != nullptr) ? m_loaded++ : m_failed++;
+                };
+        }
+
+        std::atomic<size_t> m_loaded{};
+        std::atomic<size_t> m_failed{};
+    };
+
+    struct ManualClock
+    {
+        std::chrono::steady_clock::time_point now{};
+
+        ThumbnailRetryPolicy Policy(std::chrono::milliseconds initialDelay, std::chrono::milliseconds maxDelay)
+        {
+            ThumbnailRetryPolicy policy;
+            policy.initialDelay = initialDelay;
+            policy.maxDelay = maxDelay;
+            policy.now = [this]() { return now; };
+            return policy;
+        }
+    };
+
+    struct Keys
+    {
+        StringAtomTable atoms;
+        const StringAtom pdf{ atoms.Intern(L".pdf") };
+        const StringAtom docx{ atoms.Intern(L".docx") };
+        const StringAtom jpg{ atoms.Intern(L".jpg") };
+        const StringAtom png{ atoms.Intern(L".png") };
+    };
+}
+
+// Every row of an extension asking while its load runs shares that one load, and rows asking afterwards get it
+// straight from the cache
+TEST(ThumbnailSchedulerTests, RowsOfAnExtensionShareOneLoad)
+{
+    Keys keys;
+    FakeThumbnailSource source;
+    ExtensionThumbnailCache<Thumbnail> cache;
+    Scheduler scheduler(cache, source.Loader(), 2, 16);
+    Callbacks callbacks;
+
+    source.Close();
+    Thumbnail cached;
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_FALSE(scheduler.Request(keys.pdf, L"C:/a" + std::to_wstring(i) + L".pdf", false, callbacks.Callback(), &cached));
+    }
+    source.WaitForRunning(1);
+    source.Open();
+    scheduler.WaitForIdle();
+
+    EXPECT_EQ(source.Loads(keys.pdf), 1u);
+    EXPECT_EQ(callbacks.m_loaded, 10u);
+    ThumbnailSchedulerStats stats = scheduler.GetStats();
+    EXPECT_EQ(stats.requests, 10u);
+    EXPECT_EQ(stats.coalesced, 9u);
+    EXPECT_EQ(stats.loads, 1u);
+
+    ASSERT_TRUE(scheduler.Request(keys.pdf, L"C:/b.pdf", false, callbacks.Callback(), &cached));
+    EXPECT_EQ(*cached, L"C:/a0.pdf");
+    EXPECT_EQ(scheduler.GetStats().requests, 10u);
+}
+
+// With every worker busy and the queue full, the request that has waited longest is dropped and told so
+TEST(ThumbnailSchedulerTests, FullQueueDropsTheOldestRequest)
+{
+    Keys keys;
+    FakeThumbnailSource source;
+    ExtensionThumbnailCache<Thumbnail> cache;
+    Scheduler scheduler(cache, source.Loader(), 1, 2);
+    Callbacks running;
+    Callbacks oldest;
+    Callbacks newer;
+
+    source.Close();
+    Thumbnail cached;
+    scheduler.Request(keys.pdf, L"C:/a.pdf", false, running.Callback(), &cached);
+    source.WaitForRunning(1);
+    scheduler.Request(keys.docx, L"C:/a.docx", false, oldest.Callback(), &cached);
+    scheduler.Request(keys.jpg, L"C:/a.jpg", false, newer.Callback(), &cached);
+    scheduler.Request(keys.png, L"C:/a.png", false, newer.Callback(), &cached);
+
+    EXPECT_EQ(oldest.m_failed, 1u);
+    EXPECT_EQ(scheduler.GetStats().dropped, 1u);
+
+    source.Open();
+    scheduler.WaitForIdle();
+    EXPECT_EQ(running.m_loaded, 1u);
+    EXPECT_EQ(newer.m_loaded, 2u);
+    EXPECT_EQ(source.Loads(keys.docx), 0u);
+}
+
+// A key whose load failed is turned away without a load until its delay is up, the delay doubles with every
+// failure up to the cap, and a load that succeeds starts it over
+TEST(ThumbnailSchedulerTests, FailedLoadsBackOff)
+{
+    using namespace std::chrono_literals;
+    Keys keys;
+    FakeThumbnailSource source;
+    ExtensionThumbnailCache<Thumbnail> cache;
+    ManualClock clock;
+    Scheduler scheduler(cache, source.Loader(), 1, 16, nullptr, nullptr, clock.Policy(100ms, 300ms));
+    Callbacks callbacks;
+    Thumbnail cached;
+
+    auto request = [&]()
+        {
+            const bool found = scheduler.Request(keys.pdf, L"C:/a.pdf", false, callbacks.Callback(), &cached);
+            scheduler.WaitForIdle();
+            return found;
+        };
+
+    source.SetFailing(keys.pdf, true);
+    EXPECT_FALSE(request());
+    EXPECT_EQ(source.Loads(keys.pdf), 1u);
+    EXPECT_EQ(callbacks.m_failed, 1u);
+
+    // Turned away for 100ms, then 200ms, then capped at 300ms
+    const std::chrono::milliseconds delays[] = { 100ms, 200ms, 300ms, 300ms };
+    size_t loads = 1;
+    for (auto delay : delays)
+    {
+        clock.now += delay - 1ms;
+        EXPECT_FALSE(request());
+        EXPECT_EQ(source.Loads(keys.pdf), loads);
+
+        clock.now += 1ms;
+        EXPECT_FALSE(request());
+        EXPECT_EQ(source.Loads(keys.pdf), ++loads);
+    }
+    EXPECT_EQ(scheduler.GetStats().suppressed, 4u);
+    EXPECT_EQ(callbacks.m_failed, loads);
+
+    // Other keys don't wait on it
+    EXPECT_FALSE(scheduler.Request(keys.docx, L"C:/a.docx", false, callbacks.Callback(), &cached));
+    scheduler.WaitForIdle();
+    EXPECT_EQ(source.Loads(keys.docx), 1u);
+
+    source.SetFailing(keys.pdf, false);
+    clock.now += 300ms;
+    EXPECT_FALSE(request());
+    EXPECT_TRUE(request());
+    EXPECT_EQ(*cached, L"C:/a.pdf");
+}
+
+// Shutdown lets the running load finish, drops the queue without calling back and turns away anything after it
+TEST(ThumbnailSchedulerTests, ShutdownDropsTheQueue)
+{
+    Keys keys;
+    FakeThumbnailSource source;
+    ExtensionThumbnailCache<Thumbnail> cache;
+    Scheduler scheduler(cache, source.Loader(), 1, 16);
+    Callbacks running;
+    Callbacks queued;
+
+    source.Close();
+    Thumbnail cached;
+    scheduler.Request(keys.pdf, L"C:/a.pdf", false, running.Callback(), &cached);
+    source.WaitForRunning(1);
+    scheduler.Request(keys.docx, L"C:/a.docx", false, queued.Callback(), &cached);
+    scheduler.Request(keys.jpg, L"C:/a.jpg", false, queued.Callback(), &cached);
+
+    // The load is let go once Shutdown has started, which is when requests stop getting counted
+    std::thread shutdown([&]() { scheduler.Shutdown(); });
+    while (true)
+    {
+        const uint64_t requests = scheduler.GetStats().requests;
+        scheduler.Request(keys.docx, L"C:/b.docx", false, queued.Callback(), &cached);
+        if (scheduler.GetStats().requests == requests)
+        {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    source.Open();
+    shutdown.join();
+
+    EXPECT_EQ(running.m_loaded, 1u);
+    EXPECT_EQ(queued.m_loaded + queued.m_failed, 0u);
+    EXPECT_EQ(source.Loads(keys.docx) + source.Loads(keys.jpg), 0u);
+
+    EXPECT_FALSE(scheduler.Request(keys.png, L"C:/a.png", false, queued.Callback(), &cached));
+    scheduler.WaitForIdle();
+    EXPECT_EQ(source.Loads(keys.png), 0u);
+
+    // Whatever did get loaded is still there
+    EXPECT_TRUE(scheduler.Request(keys.pdf, L"C:/b.pdf", false, queued.Callback(), &cached));
+}
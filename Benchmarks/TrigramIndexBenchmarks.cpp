@@ -0,0 +1,96 @@
+// The filename index at a million entries, twice what the app builds it with: how long it takes to build,
+// what it costs in memory and how quickly it answers the first page, against matching every name one by one
+// the way there was to do without it
+#include <benchmark/benchmark.h>
+
+#include "BenchmarkCorpus.h"
+#include "TrigramIndex.h"
+
+namespace
+{
+    constexpr size_t c_corpusSize{ 1000000 };
+    constexpr size_t c_firstPageSize{ 50 };
+
+    // A common word, a two word name, something nothing matches and as short as the index takes
+    const wchar_t* const c_terms[] = { L"report", L"quarterly report", L"zyzzyva", L"tax" };
+    const char* const c_termLabels[] = { "common", "two_words", "no_match", "three_chars" };
+
+    const std::vector<CorpusItem>& GetCorpus()
+    {
+        static const std::vector<CorpusItem> s_corpus = MakeCorpus(c_corpusSize, 5);
+        return s_corpus;
+    }
+
+    std::shared_ptr<TrigramFilenameIndex> BuildIndex()
+    {
+        auto index = std::make_shared<TrigramFilenameIndex>(c_corpusSize);
+        for (auto const& item : GetCorpus())
+        {
+            index->Add(item.name, item.url, item.kind);
+        }
+        index->Finalize();
+        return index;
+    }
+
+    const TrigramFilenameIndex& GetIndex()
+    {
+        static const std::shared_ptr<TrigramFilenameIndex> s_index = BuildIndex();
+        return *s_index;
+    }
+
+    void BM_TrigramBuild1M(benchmark::State& state)
+    {
+        GetCorpus();
+        size_t memoryBytes = 0;
+        for (auto _ : state)
+        {
+            auto index = BuildIndex();
+            memoryBytes = index->MemoryBytes();
+            benchmark::DoNotOptimize(index->Size());
+        }
+        state.counters["memory_mb"] = static_cast<double>(memoryBytes) / (1024 * 1024);
+        state.counters["bytes_per_entry"] = static_cast<double>(memoryBytes) / c_corpusSize;
+        state.SetItemsProcessed(state.iterations() * c_corpusSize);
+    }
+    BENCHMARK(BM_TrigramBuild1M)->Unit(benchmark::kMillisecond)->Iterations(1)->UseRealTime();
+
+    void BM_TrigramFind1M(benchmark::State& state)
+    {
+        const wchar_t* term = c_terms[state.range(0)];
+        state.SetLabel(c_termLabels[state.range(0)]);
+        auto const& index = GetIndex();
+
+        std::vector<uint32_t> ids;
+        for (auto _ : state)
+        {
+            index.Find(term, c_firstPageSize, ids);
+            benchmark::DoNotOptimize(ids.data());
+        }
+        state.counters["matches"] = static_cast<double>(ids.size());
+    }
+    BENCHMARK(BM_TrigramFind1M)->ArgName("term")->DenseRange(0, 3);
+
+    void BM_LinearScan1M(benchmark::State& state)
+    {
+        const wchar_t* term = c_terms[state.range(0)];
+        state.SetLabel(c_termLabels[state.range(0)]);
+        auto const& corpus = GetCorpus();
+
+        std::vector<uint32_t> ids;
+        for (auto _ : state)
+        {
+            ids.clear();
+            CaseInsensitiveMatcher matcher(term);
+            for (size_t i = 0; (i < corpus.size()) && (ids.size() < c_firstPageSize); ++i)
+            {
+                if (matcher.Matches(corpus[i].name))
+                {
+                    ids.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            benchmark::DoNotOptimize(ids.data());
+        }
+        state.counters["matches"] = static_cast<double>(ids.size());
+    }
+    BENCHMARK(BM_LinearScan1M)->ArgName("term")->DenseRange(0, 3)->Unit(benchmark::kMicrosecond);
+}
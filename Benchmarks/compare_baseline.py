@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Runs the benchmarks and compares them against the stored baseline.
+
+Every benchmark is compared by its time per iteration, the wall clock time for the ones registered with
+UseRealTime or UseManualTime (their names end in /real_time or /manual_time) and CPU time for the rest. Counters are reported alongside but never
+fail the comparison, most of them depend on the box.
+
+Fails if a benchmark has no baseline or a baseline has no benchmark, so the baseline gets updated along with the
+benchmarks, and unless --report-only, if anything got slower than --threshold allows.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+# Fields of Google Benchmark's output that say how it was run rather than what it measured
+SKIPPED_FIELDS = {
+    "family_index", "per_family_instance_index", "run_name", "run_type", "repetitions", "repetition_index",
+    "threads", "iterations", "label", "error_occurred", "error_message",
+}
+
+
+def run_benchmarks(binary, min_time, benchmark_filter):
+    with tempfile.TemporaryDirectory() as directory:
+        output = os.path.join(directory, "benchmarks.json")
+        command = [binary, "--benchmark_out=" + output, "--benchmark_out_format=json"]
+        if min_time is not None:
+            command.append("--benchmark_min_time=" + str(min_time))
+        if benchmark_filter:
+            command.append("--benchmark_filter=" + benchmark_filter)
+        subprocess.run(command, check=True, stdout=sys.stderr)
+        with open(output, encoding="utf-8") as f:
+            results = json.load(f)
+
+    benchmarks = {}
+    for entry in results["benchmarks"]:
+        if entry.get("run_type", "iteration") != "iteration":
+            continue
+        if entry.get("error_occurred"):
+            raise SystemExit("%s failed: %s" % (entry["name"], entry.get("error_message", "")))
+        benchmarks[entry["name"]] = {key: value for key, value in entry.items() if key not in SKIPPED_FIELDS}
+    return benchmarks
+
+
+def measured_time(name, entry):
+    return entry["real_time"] if name.endswith(("/real_time", "/manual_time")) else entry["cpu_time"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--benchmark", required=True, help="the benchmark executable")
+    parser.add_argument("--baseline", required=True, help="the baseline JSON")
+    parser.add_argument("--min-time", type=float, help="passed on as --benchmark_min_time")
+    parser.add_argument("--filter", help="passed on as --benchmark_filter, only those benchmarks are compared")
+    parser.add_argument("--threshold", type=float, default=0.2, help="how much slower counts as a regression")
+    parser.add_argument("--report-only", action="store_true", help="don't fail on regressions")
+    parser.add_argument("--update", action="store_true",
+                        help="write the results as the new baseline, with --filter only for those benchmarks")
+    args = parser.parse_args()
+
+    current = run_benchmarks(args.benchmark, args.min_time, args.filter)
+
+    if args.update:
+        # With a filter only the benchmarks that ran are replaced, the rest of the baseline stays as it was
+        merged = {}
+        if args.filter and os.path.exists(args.baseline):
+            with open(args.baseline, encoding="utf-8") as f:
+                merged = {entry["name"]: entry for entry in json.load(f)["benchmarks"]}
+        merged.update({name: dict(entry, name=name) for name, entry in current.items()})
+        baseline = {"benchmarks": [merged[name] for name in sorted(merged)]}
+        with open(args.baseline, "w", encoding="utf-8", newline="\n") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("wrote %d benchmarks to %s" % (len(current), args.baseline))
+        return 0
+
+    with open(args.baseline, encoding="utf-8") as f:
+        baseline = {entry["name"]: entry for entry in json.load(f)["benchmarks"]}
+    if args.filter:
+        baseline = {name: entry for name, entry in baseline.items() if name in current}
+
+    failures = []
+    width = max(len(name) for name in set(current) | set(baseline))
+    print("%-*s %14s %14s %8s" % (width, "benchmark", "baseline", "current", "ratio"))
+    for name in sorted(set(current) | set(baseline)):
+        if name not in baseline:
+            print("%-*s %14s %14s %8s  no baseline" % (width, name, "-", "-", "-"))
+            failures.append("%s has no baseline" % name)
+            continue
+        if name not in current:
+            print("%-*s %14s %14s %8s  not run" % (width, name, "-", "-", "-"))
+            failures.append("%s is in the baseline but wasn't run" % name)
+            continue
+
+        old = measured_time(name, baseline[name])
+        new = measured_time(name, current[name])
+        unit = current[name].get("time_unit", "ns")
+        ratio = (new / old) if old > 0 else 1.0
+        status = ""
+        if ratio > (1.0 + args.threshold):
+            status = "  slower"
+            if not args.report_only:
+                failures.append("%s is %.0f%% slower" % (name, (ratio - 1.0) * 100))
+        elif ratio < (1.0 - args.threshold):
+            status = "  faster"
+        print("%-*s %12.1f%-2s %12.1f%-2s %8.2f%s" % (width, name, old, unit, new, unit, ratio, status))
+
+        counters = {key: value for key, value in current[name].items()
+                    if key not in ("name", "real_time", "cpu_time", "time_unit") and isinstance(value, (int, float))}
+        for key in sorted(counters):
+            old_counter = baseline[name].get(key)
+            print("%-*s %14s %14s" % (width, "    " + key, "-" if old_counter is None else "%.4g" % old_counter,
+                                      "%.4g" % counters[key]))
+
+    if failures:
+        print("\n" + "\n".join(failures))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,22 +1,22 @@
-﻿#pragma once
-
-#pragma push_macro("GetCurrentTime")
-#undef GetCurrentTime
-
-#include "App.xaml.g.h"
-
-#pragma pop_macro("GetCurrentTime")
-
-namespace winrt::WinSearch::implementation
-{
-    struct App : AppT<App>
-    {
-        App();
-
-        void OnLaunched(Microsoft::UI::Xaml::LaunchActivatedEventArgs const&);
-        void OnSuspending(IInspectable const&, Windows::ApplicationModel::SuspendingEventArgs const&);
-
-    private:
-        winrt::Microsoft::UI::Xaml::Window window{ nullptr };
-    };
-}
+﻿#pragma once
+
+#pragma push_macro("GetCurrentTime")
+#undef GetCurrentTime
+
+#include "App.xaml.g.h"
+
+#pragma pop_macro("GetCurrentTime")
+
+namespace winrt::WinSearch::implementation
+{
+    struct App : AppT<App>
+    {
+        App();
+
+        void OnLaunched(Microsoft::UI::Xaml::LaunchActivatedEventArgs const&);
+        void OnSuspending(IInspectable const&, Windows::ApplicationModel::SuspendingEventArgs const&);
+
+    private:
+        winrt::Microsoft::UI::Xaml::Window window{ nullptr };
+    };
+}
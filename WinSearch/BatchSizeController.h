@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct BatchSizeDecision
+{
+    size_t requested;
+    size_t returned;
+    uint64_t elapsedMicroseconds;
+};
+
+// Platform neutral policy for how many rows to ask the provider for on each GetNextRows call.
+// We start small so the first page gets to the UI quickly, then grow the batch geometrically for as long
+// as the provider throughput (rows per microsecond) keeps getting better. Once a bigger batch stops paying
+// off we stay at the best size we found for the rest of the rowset.
+struct AdaptiveBatchSizeController
+{
+public:
+    AdaptiveBatchSizeController(size_t initialBatchSize, size_t maxBatchSize, size_t growthFactor) :
+        m_initialBatchSize((std::max)(initialBatchSize, static_cast<size_t>(1))),
+        m_maxBatchSize((std::max)(maxBatchSize, initialBatchSize)),
+        m_growthFactor((std::max)(growthFactor, static_cast<size_t>(2)))
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_batchSize = m_initialBatchSize;
+        m_bestThroughput = 0.0;
+        m_growing = true;
+        m_history.clear();
+    }
+
+    size_t NextBatchSize() const { return m_batchSize; }
+    size_t MaxBatchSize() const { return m_maxBatchSize; }
+
+    void OnBatchFetched(size_t returned, uint64_t elapsedMicroseconds)
+    {
+        m_history.push_back({ m_batchSize, returned, elapsedMicroseconds });
+
+        if (returned < m_batchSize)
+        {
+            // Short batch, we hit the end of the rowset and the timing doesn't say anything about the size
+            return;
+        }
+
+        if (!m_growing)
+        {
+            return;
+        }
+
+        const double throughput = static_cast<double>(returned) / static_cast<double>((std::max)(elapsedMicroseconds, static_cast<uint64_t>(1)));
+        if ((m_history.size() > 1) && (throughput < m_bestThroughput))
+        {
+            // The bigger batch didn't help, go back to the last one that did and stop experimenting
+            m_batchSize = (std::max)(m_batchSize / m_growthFactor, m_initialBatchSize);
+            m_growing = false;
+            return;
+        }
+
+        m_bestThroughput = throughput;
+        if (m_batchSize >= m_maxBatchSize)
+        {
+            m_growing = false;
+            return;
+        }
+        m_batchSize = (std::min)(m_batchSize * m_growthFactor, m_maxBatchSize);
+    }
+
+    std::vector<BatchSizeDecision> const& GetHistory() const { return m_history; }
+
+private:
+    const size_t m_initialBatchSize;
+    const size_t m_maxBatchSize;
+    const size_t m_growthFactor;
+    size_t m_batchSize{};
+    double m_bestThroughput{};
+    bool m_growing{ true };
+    std::vector<BatchSizeDecision> m_history;
+};
@@ -0,0 +1,651 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Platform neutral logger that keeps formatting and file I/O off of the threads doing the logging. A call copies
+// the format pointer and its raw arguments into a lock-free ring owned by the calling thread, a background thread
+// drains the rings and writes them out in batches, and the text only gets put together when the log is decoded.
+// When a ring is full the record is dropped and counted instead of waiting for the drain.
+//
+// Formats have to be string literals (or otherwise live as long as the logger), only the pointer gets recorded.
+//
+// The log is a series of entries, each starting with its type:
+//   header:  magic, version, wchar_t size. Starts every session, format ids start over after one.
+//   format:  id, length, the format's characters
+//   record:  format id, thread, microseconds, argument bytes, the arguments as a type and its value each
+//   dropped: how many records didn't fit since the last one of these
+// Everything is in native byte order.
+constexpr uint32_t c_binaryLogMagic{ 0x474C5357 }; // WSLG
+constexpr uint32_t c_binaryLogVersion{ 1 };
+
+struct BinaryLogEntry
+{
+    static constexpr uint8_t c_header{ 'H' };
+    static constexpr uint8_t c_format{ 'F' };
+    static constexpr uint8_t c_record{ 'R' };
+    static constexpr uint8_t c_dropped{ 'D' };
+};
+
+struct BinaryLogArgs
+{
+public:
+    static constexpr uint8_t c_signed{ 'i' };
+    static constexpr uint8_t c_unsigned{ 'u' };
+    static constexpr uint8_t c_double{ 'f' };
+    static constexpr uint8_t c_string{ 's' }; // uint16_t length, then the characters
+
+    // Longer strings get cut off, a record has to fit comfortably in a ring
+    static constexpr size_t c_maxStringChars{ 2048 };
+
+    template <typename T>
+    static size_t Size(T const& value)
+    {
+        if constexpr (IsString<T>())
+        {
+            return 1 + sizeof(uint16_t) + (StringLength(value) * sizeof(wchar_t));
+        }
+        else
+        {
+            return 1 + sizeof(uint64_t);
+        }
+    }
+
+    template <typename T>
+    static uint8_t* Write(uint8_t* out, T const& value)
+    {
+        if constexpr (IsString<T>())
+        {
+            const uint16_t length = static_cast<uint16_t>(StringLength(value));
+            *out++ = c_string;
+            memcpy(out, &length, sizeof(length));
+            out += sizeof(length);
+            memcpy(out, StringData(value), length * sizeof(wchar_t));
+            return out + (length * sizeof(wchar_t));
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            const double converted = static_cast<double>(value);
+            *out++ = c_double;
+            memcpy(out, &converted, sizeof(converted));
+            return out + sizeof(converted);
+        }
+        else if constexpr (std::is_pointer_v<T>)
+        {
+            const uint64_t converted = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value));
+            *out++ = c_unsigned;
+            memcpy(out, &converted, sizeof(converted));
+            return out + sizeof(converted);
+        }
+        else
+        {
+            static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "can't log this type");
+            using TInteger = std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::enable_if<true, T>>;
+            const bool isSigned = std::is_signed_v<typename TInteger::type>;
+            const uint64_t converted = isSigned ? static_cast<uint64_t>(static_cast<int64_t>(value)) : static_cast<uint64_t>(value);
+            *out++ = isSigned ? c_signed : c_unsigned;
+            memcpy(out, &converted, sizeof(converted));
+            return out + sizeof(converted);
+        }
+    }
+
+private:
+    template <typename T>
+    static constexpr bool IsString()
+    {
+        using TDecayed = std::decay_t<T>;
+        return std::is_same_v<TDecayed, const wchar_t*> || std::is_same_v<TDecayed, wchar_t*> ||
+            std::is_same_v<TDecayed, std::wstring> || std::is_same_v<TDecayed, std::wstring_view>;
+    }
+
+    static std::wstring_view View(const wchar_t* value) { return (value != nullptr) ? std::wstring_view(value) : std::wstring_view(L"(null)"); }
+    static std::wstring_view View(std::wstring_view value) { return value; }
+
+    template <typename T>
+    static size_t StringLength(T const& value) { return (std::min)(View(value).size(), c_maxStringChars); }
+
+    template <typename T>
+    static const wchar_t* StringData(T const& value) { return View(value).data(); }
+};
+
+// Single producer, single consumer ring of variable sized records. The producer is the thread that owns it, the
+// consumer is the drain. Positions only ever go up, the index into the buffer is the position masked by the size.
+struct BinaryLogRing
+{
+public:
+    struct RecordHeader
+    {
+        uint32_t length; // of the whole record, padded to 8 bytes
+        uint32_t argBytes;
+        uint64_t timestamp;
+        const wchar_t* format; // nullptr for the padding in front of a wrap
+    };
+
+    BinaryLogRing(size_t capacity, uint32_t threadId) : m_buffer(RoundUpToPowerOfTwo(capacity)), m_threadId(threadId) {}
+
+    uint32_t ThreadId() const { return m_threadId; }
+    size_t Capacity() const { return m_buffer.size(); }
+
+    // fill(uint8_t* args) writes argBytes bytes of arguments. Returns false if the record didn't fit and was dropped,
+    // *crossedHalf is set when this record filled the ring past half way.
+    template <typename TFill>
+    bool TryWrite(const wchar_t* format, uint64_t timestamp, size_t argBytes, TFill&& fill, bool* crossedHalf)
+    {
+        const size_t length = Align(sizeof(RecordHeader) + argBytes);
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        const size_t offset = static_cast<size_t>(tail & (m_buffer.size() - 1));
+        const size_t untilWrap = m_buffer.size() - offset;
+
+        // Records never wrap, if this one doesn't fit before the end it goes at the start and the rest is padding
+        const size_t padding = (untilWrap < length) ? untilWrap : 0;
+        if ((length > (m_buffer.size() / 4)) || ((tail - head) + padding + length > m_buffer.size()))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint8_t* out = m_buffer.data() + offset;
+        if (padding != 0)
+        {
+            RecordHeader pad{ static_cast<uint32_t>(padding), 0, 0, nullptr };
+            if (padding >= sizeof(pad))
+            {
+                memcpy(out, &pad, sizeof(pad));
+            }
+            out = m_buffer.data();
+        }
+
+        RecordHeader header{ static_cast<uint32_t>(length), static_cast<uint32_t>(argBytes), timestamp, format };
+        memcpy(out, &header, sizeof(header));
+        fill(out + sizeof(header));
+
+        const uint64_t newTail = tail + padding + length;
+        m_tail.store(newTail, std::memory_order_release);
+        *crossedHalf = ((tail - head) < (m_buffer.size() / 2)) && ((newTail - head) >= (m_buffer.size() / 2));
+        return true;
+    }
+
+    // Hands every record written so far to read(RecordHeader const&, const uint8_t* args)
+    template <typename TRead>
+    void Drain(TRead&& read)
+    {
+        const uint64_t tail = m_tail.load(std::memory_order_acquire);
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while (head != tail)
+        {
+            const size_t offset = static_cast<size_t>(head & (m_buffer.size() - 1));
+            const size_t untilWrap = m_buffer.size() - offset;
+            if (untilWrap < sizeof(RecordHeader))
+            {
+                // Padding too small to hold a header
+                head += untilWrap;
+                continue;
+            }
+
+            RecordHeader header;
+            memcpy(&header, m_buffer.data() + offset, sizeof(header));
+            if (header.format != nullptr)
+            {
+                read(header, m_buffer.data() + offset + sizeof(header));
+            }
+            head += header.length;
+        }
+        m_head.store(head, std::memory_order_release);
+    }
+
+    uint64_t TakeDropped() { return m_dropped.exchange(0, std::memory_order_relaxed); }
+
+    // Set once the owning thread is gone, the drain lets go of the ring after emptying it
+    std::atomic<bool> abandoned{};
+
+private:
+    static size_t Align(size_t length) { return (length + 7) & ~static_cast<size_t>(7); }
+
+    static size_t RoundUpToPowerOfTwo(size_t capacity)
+    {
+        size_t rounded = 4096;
+        while (rounded < capacity)
+        {
+            rounded *= 2;
+        }
+        return rounded;
+    }
+
+    std::vector<uint8_t> m_buffer;
+    const uint32_t m_threadId;
+    alignas(64) std::atomic<uint64_t> m_head{};
+    alignas(64) std::atomic<uint64_t> m_tail{};
+    std::atomic<uint64_t> m_dropped{};
+};
+
+struct BinaryLogger
+{
+public:
+    // write(data, size) appends to the log and throws if it can't. Once it throws, nothing more gets written.
+    using WriteFunction = std::function<void(const void*, size_t)>;
+
+    explicit BinaryLogger(WriteFunction write, size_t ringBytes = 256 * 1024,
+        std::chrono::milliseconds drainInterval = std::chrono::milliseconds(100)) :
+        m_write(std::move(write)), m_ringBytes(ringBytes), m_drainInterval(drainInterval), m_instance(NextInstance())
+    {
+        m_batch.push_back(BinaryLogEntry::c_header);
+        Append(m_batch, c_binaryLogMagic);
+        Append(m_batch, c_binaryLogVersion);
+        Append(m_batch, static_cast<uint32_t>(sizeof(wchar_t)));
+
+        m_drainThread = std::thread([this]() { DrainLoop(); });
+    }
+
+    ~BinaryLogger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeLock);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_drainThread.join();
+        Flush();
+    }
+
+    BinaryLogger(BinaryLogger const&) = delete;
+    BinaryLogger& operator=(BinaryLogger const&) = delete;
+
+    // False if the record was dropped
+    template <typename... TArgs>
+    bool Log(const wchar_t* format, TArgs const&... args)
+    {
+        BinaryLogRing& ring = GetThreadRing();
+        const size_t argBytes = (size_t{ 0 } + ... + BinaryLogArgs::Size(args));
+        bool crossedHalf = false;
+        const bool written = ring.TryWrite(format, NowMicroseconds(), argBytes, [&](uint8_t* out)
+            {
+                ((out = BinaryLogArgs::Write(out, args)), ...);
+            }, &crossedHalf);
+
+        if (crossedHalf)
+        {
+            // Don't wait for the timer, a burst could fill the rest of the ring before then
+            m_wake.notify_one();
+        }
+        return written;
+    }
+
+    // Writes out everything logged so far
+    void Flush()
+    {
+        std::lock_guard<std::mutex> lock(m_drainLock);
+        DrainAll();
+    }
+
+    static uint64_t NowMicroseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+private:
+    struct ThreadRingHolder
+    {
+        ~ThreadRingHolder()
+        {
+            if (ring != nullptr)
+            {
+                ring->abandoned.store(true, std::memory_order_release);
+            }
+        }
+
+        uint64_t instance{};
+        std::shared_ptr<BinaryLogRing> ring;
+    };
+
+    static uint64_t NextInstance()
+    {
+        static std::atomic<uint64_t> s_nextInstance{ 1 };
+        return s_nextInstance++;
+    }
+
+    BinaryLogRing& GetThreadRing()
+    {
+        static thread_local ThreadRingHolder t_holder;
+        if (t_holder.instance != m_instance)
+        {
+            // First time this thread logs (to this logger), the only time logging takes a lock
+            if (t_holder.ring != nullptr)
+            {
+                t_holder.ring->abandoned.store(true, std::memory_order_release);
+            }
+
+            std::lock_guard<std::mutex> lock(m_ringsLock);
+            t_holder.ring = std::make_shared<BinaryLogRing>(m_ringBytes, m_nextThreadId++);
+            t_holder.instance = m_instance;
+            m_rings.push_back(t_holder.ring);
+        }
+        return *t_holder.ring;
+    }
+
+    void DrainLoop()
+    {
+        std::unique_lock<std::mutex> wakeLock(m_wakeLock);
+        while (!m_stopping)
+        {
+            m_wake.wait_for(wakeLock, m_drainInterval);
+            wakeLock.unlock();
+            Flush();
+            wakeLock.lock();
+        }
+    }
+
+    // m_drainLock is held
+    void DrainAll()
+    {
+        std::vector<std::shared_ptr<BinaryLogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(m_ringsLock);
+            rings = m_rings;
+        }
+
+        std::vector<BinaryLogRing*> emptied;
+        for (auto const& ring : rings)
+        {
+            // Checked first, anything the thread logged before it went away gets drained below
+            const bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+            ring->Drain([&](BinaryLogRing::RecordHeader const& header, const uint8_t* args)
+                {
+                    const uint32_t formatId = GetFormatId(header.format);
+                    m_batch.push_back(BinaryLogEntry::c_record);
+                    Append(m_batch, formatId);
+                    Append(m_batch, ring->ThreadId());
+                    Append(m_batch, header.timestamp);
+                    Append(m_batch, header.argBytes);
+                    m_batch.insert(m_batch.end(), args, args + header.argBytes);
+                });
+
+            const uint64_t dropped = ring->TakeDropped();
+            if (dropped != 0)
+            {
+                m_batch.push_back(BinaryLogEntry::c_dropped);
+                Append(m_batch, dropped);
+            }
+
+            if (abandoned)
+            {
+                emptied.push_back(ring.get());
+            }
+        }
+
+        if (!emptied.empty())
+        {
+            std::lock_guard<std::mutex> lock(m_ringsLock);
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [&](auto const& ring)
+                {
+                    return std::find(emptied.begin(), emptied.end(), ring.get()) != emptied.end();
+                }), m_rings.end());
+        }
+
+        if (!m_batch.empty() && !m_failed)
+        {
+            try
+            {
+                m_write(m_batch.data(), m_batch.size());
+            }
+            catch (...)
+            {
+                m_failed = true;
+            }
+        }
+        m_batch.clear();
+    }
+
+    uint32_t GetFormatId(const wchar_t* format)
+    {
+        auto found = m_formatIds.find(format);
+        if (found != m_formatIds.end())
+        {
+            return found->second;
+        }
+
+        const uint32_t id = static_cast<uint32_t>(m_formatIds.size());
+        m_formatIds.emplace(format, id);
+        const std::wstring_view text(format);
+        m_batch.push_back(BinaryLogEntry::c_format);
+        Append(m_batch, id);
+        Append(m_batch, static_cast<uint32_t>(text.size()));
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+        m_batch.insert(m_batch.end(), bytes, bytes + (text.size() * sizeof(wchar_t)));
+        return id;
+    }
+
+    template <typename T>
+    static void Append(std::vector<uint8_t>& buffer, T value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+    }
+
+    WriteFunction m_write;
+    const size_t m_ringBytes;
+    const std::chrono::milliseconds m_drainInterval;
+    const uint64_t m_instance;
+
+    std::mutex m_ringsLock;
+    std::vector<std::shared_ptr<BinaryLogRing>> m_rings;
+    uint32_t m_nextThreadId{ 1 };
+
+    // Only touched by whoever is draining
+    std::mutex m_drainLock;
+    std::unordered_map<const wchar_t*, uint32_t> m_formatIds;
+    std::vector<uint8_t> m_batch;
+    bool m_failed{};
+
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    bool m_stopping{};
+    std::thread m_drainThread;
+};
+
+// printf style, the subset the app's formats use: d i u x X o c with any length modifier, s S with or without
+// l/w (always wide), f e g, and %%. Anything that doesn't line up with the recorded arguments is left out.
+inline std::wstring FormatBinaryLogRecord(std::wstring_view format, const uint8_t* args, size_t argBytes)
+{
+    std::wstring text;
+    size_t argPos = 0;
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+        if ((format[i] != L'%') || ((i + 1) == format.size()))
+        {
+            text += format[i];
+            continue;
+        }
+        if (format[i + 1] == L'%')
+        {
+            text += L'%';
+            i++;
+            continue;
+        }
+
+        // Flags, width and precision get passed on, the length modifier is ours to pick
+        std::wstring spec(L"%");
+        size_t pos = i + 1;
+        while ((pos < format.size()) && (wcschr(L"-+ #0123456789.", format[pos]) != nullptr))
+        {
+            spec += format[pos++];
+        }
+        while ((pos < format.size()) && (wcschr(L"hlwLzjtI3264", format[pos]) != nullptr))
+        {
+            pos++;
+        }
+        if (pos == format.size())
+        {
+            break;
+        }
+        const wchar_t conversion = format[pos];
+        i = pos;
+
+        if ((argPos >= argBytes) || ((argBytes - argPos) < 1))
+        {
+            continue;
+        }
+        const uint8_t type = args[argPos++];
+        if (type == BinaryLogArgs::c_string)
+        {
+            uint16_t length = 0;
+            if ((argBytes - argPos) < sizeof(length))
+            {
+                break;
+            }
+            memcpy(&length, args + argPos, sizeof(length));
+            argPos += sizeof(length);
+            if ((argBytes - argPos) < (length * sizeof(wchar_t)))
+            {
+                break;
+            }
+            const size_t start = text.size();
+            text.resize(start + length);
+            memcpy(&text[start], args + argPos, length * sizeof(wchar_t));
+            argPos += length * sizeof(wchar_t);
+            continue;
+        }
+
+        uint64_t value = 0;
+        if ((argBytes - argPos) < sizeof(value))
+        {
+            break;
+        }
+        memcpy(&value, args + argPos, sizeof(value));
+        argPos += sizeof(value);
+
+        wchar_t buffer[128]{};
+        if (type == BinaryLogArgs::c_double)
+        {
+            double number = 0;
+            memcpy(&number, &value, sizeof(number));
+            spec += (wcschr(L"feEgG", conversion) != nullptr) ? conversion : L'g';
+            std::swprintf(buffer, std::size(buffer), spec.c_str(), number);
+        }
+        else if (conversion == L'c')
+        {
+            buffer[0] = static_cast<wchar_t>(value);
+        }
+        else
+        {
+            const bool isSigned = (type == BinaryLogArgs::c_signed) && ((conversion == L'd') || (conversion == L'i'));
+            spec += L"ll";
+            spec += (wcschr(L"diuxXo", conversion) != nullptr) ? conversion : (isSigned ? L'd' : L'u');
+            if (isSigned)
+            {
+                std::swprintf(buffer, std::size(buffer), spec.c_str(), static_cast<long long>(value));
+            }
+            else
+            {
+                std::swprintf(buffer, std::size(buffer), spec.c_str(), static_cast<unsigned long long>(value));
+            }
+        }
+        text += buffer;
+    }
+    return text;
+}
+
+// Turns a log back into text, calling record(timestamp, threadId, text) for every record in the order they were
+// drained (in order per thread). Dropped records show up as a note with a thread of 0. Returns false if it isn't
+// a log we can read, a log that was cut short still hands back everything up to where it ends.
+template <typename TRecord>
+bool DecodeBinaryLog(const uint8_t* data, size_t size, TRecord&& record)
+{
+    size_t pos = 0;
+    auto read = [&](auto& value)
+    {
+        if ((size - pos) < sizeof(value))
+        {
+            return false;
+        }
+        memcpy(&value, data + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    };
+
+    std::unordered_map<uint32_t, std::wstring> formats;
+    bool sawHeader = false;
+    uint64_t lastTimestamp = 0;
+    while (pos < size)
+    {
+        const uint8_t type = data[pos++];
+        if (type == BinaryLogEntry::c_header)
+        {
+            uint32_t magic = 0;
+            uint32_t version = 0;
+            uint32_t charSize = 0;
+            if (!read(magic) || !read(version) || !read(charSize) ||
+                (magic != c_binaryLogMagic) || (version != c_binaryLogVersion) || (charSize != sizeof(wchar_t)))
+            {
+                return sawHeader;
+            }
+            sawHeader = true;
+            formats.clear();
+        }
+        else if (!sawHeader)
+        {
+            return false;
+        }
+        else if (type == BinaryLogEntry::c_format)
+        {
+            uint32_t id = 0;
+            uint32_t length = 0;
+            if (!read(id) || !read(length) || (length > ((size - pos) / sizeof(wchar_t))))
+            {
+                break;
+            }
+            std::wstring& format = formats[id];
+            format.resize(length);
+            memcpy(&format[0], data + pos, length * sizeof(wchar_t));
+            pos += length * sizeof(wchar_t);
+        }
+        else if (type == BinaryLogEntry::c_record)
+        {
+            uint32_t formatId = 0;
+            uint32_t threadId = 0;
+            uint64_t timestamp = 0;
+            uint32_t argBytes = 0;
+            if (!read(formatId) || !read(threadId) || !read(timestamp) || !read(argBytes) || (argBytes > (size - pos)))
+            {
+                break;
+            }
+            auto format = formats.find(formatId);
+            if (format != formats.end())
+            {
+                record(timestamp, threadId, FormatBinaryLogRecord(format->second, data + pos, argBytes));
+            }
+            pos += argBytes;
+            lastTimestamp = timestamp;
+        }
+        else if (type == BinaryLogEntry::c_dropped)
+        {
+            uint64_t dropped = 0;
+            if (!read(dropped))
+            {
+                break;
+            }
+            record(lastTimestamp, 0u, L"\n[" + std::to_wstring(dropped) + L" log records dropped]");
+        }
+        else
+        {
+            break;
+        }
+    }
+    return sawHeader;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Platform neutral cooperative cancellation. Every query gets its own source, the fetch loops poll the token
+// between batches and rows, and provider level aborts (ICommand::Cancel) hang off of registered callbacks.
+struct CancellationState
+{
+    std::atomic<bool> canceled{ false };
+    std::mutex lock;
+    std::vector<std::pair<uint64_t, std::function<void()>>> callbacks;
+    uint64_t nextCallbackId{ 1 };
+    std::chrono::steady_clock::time_point canceledAt{};
+};
+
+struct CancellationToken
+{
+public:
+    CancellationToken() = default; // can never be canceled
+    explicit CancellationToken(std::shared_ptr<CancellationState> state) : m_state(std::move(state)) {}
+
+    bool IsCancellationRequested() const
+    {
+        return m_state && m_state->canceled.load(std::memory_order_acquire);
+    }
+
+    // How long ago Cancel was called, used to measure how quickly a superseded query gets out of the way
+    uint64_t MicrosecondsSinceCancellation() const
+    {
+        if (!IsCancellationRequested())
+        {
+            return 0;
+        }
+
+        std::chrono::steady_clock::time_point canceledAt;
+        {
+            std::lock_guard<std::mutex> lock(m_state->lock);
+            canceledAt = m_state->canceledAt;
+        }
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - canceledAt).count());
+    }
+
+    // Runs callback when the token gets canceled, or right away if it already is. Callbacks run under the
+    // token lock, so once Unregister returns the callback is guaranteed not to be running. They must not
+    // register or unregister callbacks themselves.
+    uint64_t Register(std::function<void()> callback) const
+    {
+        if (!m_state)
+        {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(m_state->lock);
+        if (m_state->canceled)
+        {
+            callback();
+            return 0;
+        }
+
+        uint64_t id = m_state->nextCallbackId++;
+        m_state->callbacks.emplace_back(id, std::move(callback));
+        return id;
+    }
+
+    void Unregister(uint64_t id) const
+    {
+        if (!m_state || (id == 0))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_state->lock);
+        auto& callbacks = m_state->callbacks;
+        for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
+        {
+            if (it->first == id)
+            {
+                callbacks.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<CancellationState> m_state;
+};
+
+// Unregisters its callback when it goes out of scope
+struct CancellationRegistration
+{
+public:
+    CancellationRegistration(CancellationToken const& token, std::function<void()> callback) :
+        m_token(token), m_id(token.Register(std::move(callback)))
+    {
+    }
+    CancellationRegistration(CancellationRegistration const&) = delete;
+    CancellationRegistration& operator=(CancellationRegistration const&) = delete;
+    ~CancellationRegistration() { m_token.Unregister(m_id); }
+
+private:
+    CancellationToken m_token;
+    uint64_t m_id;
+};
+
+struct CancellationSource
+{
+public:
+    CancellationSource() : m_state(std::make_shared<CancellationState>()) {}
+
+    CancellationToken Token() const { return CancellationToken(m_state); }
+
+    void Cancel()
+    {
+        std::lock_guard<std::mutex> lock(m_state->lock);
+        if (m_state->canceled)
+        {
+            return;
+        }
+
+        m_state->canceledAt = std::chrono::steady_clock::now();
+        m_state->canceled.store(true, std::memory_order_release);
+        for (auto& callback : m_state->callbacks)
+        {
+            callback.second();
+        }
+        m_state->callbacks.clear();
+    }
+
+private:
+    std::shared_ptr<CancellationState> m_state;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Platform neutral batch of rows decoded straight out of the provider's row buffers and stored column by column.
+// Every string value of the batch is copied into a single arena, so decoding a batch costs a couple of
+// allocations no matter how many rows and values it has. Values are null terminated in the arena, so the views
+// handed out can also be used where a PCWSTR is needed.
+struct ColumnarRowBatch
+{
+public:
+    void Reset(size_t columnCount, size_t expectedRows, size_t expectedChars)
+    {
+        m_columns.resize(columnCount);
+        for (auto& column : m_columns)
+        {
+            column.clear();
+            column.reserve(expectedRows);
+        }
+        m_arena.clear();
+        m_arena.reserve(expectedChars);
+        m_rowCount = 0;
+    }
+
+    // Every column gets exactly one value (or null) per row, then the row is committed
+    void AppendValue(size_t column, const wchar_t* value, size_t length)
+    {
+        Cell cell{ static_cast<uint32_t>(m_arena.size()), static_cast<uint32_t>(length) };
+        m_arena.insert(m_arena.end(), value, value + length);
+        m_arena.push_back(L'\0');
+        m_columns[column].push_back(cell);
+    }
+
+    void AppendNull(size_t column)
+    {
+        m_columns[column].push_back({ 0, c_nullLength });
+    }
+
+    void CommitRow() { m_rowCount++; }
+
+    size_t RowCount() const { return m_rowCount; }
+    size_t ColumnCount() const { return m_columns.size(); }
+    size_t ArenaBytes() const { return m_arena.capacity() * sizeof(wchar_t); }
+
+    bool IsNull(size_t row, size_t column) const
+    {
+        return m_columns[column][row].length == c_nullLength;
+    }
+
+    // Null values come back as an empty (but still terminated) string
+    std::wstring_view GetString(size_t row, size_t column) const
+    {
+        const Cell& cell = m_columns[column][row];
+        if (cell.length == c_nullLength)
+        {
+            return std::wstring_view(c_empty, 0);
+        }
+        return std::wstring_view(m_arena.data() + cell.offset, cell.length);
+    }
+
+private:
+    struct Cell
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static constexpr uint32_t c_nullLength{ 0xFFFFFFFF };
+    static constexpr const wchar_t* c_empty{ L"" };
+
+    std::vector<std::vector<Cell>> m_columns;
+    std::vector<wchar_t> m_arena;
+    size_t m_rowCount{};
+};
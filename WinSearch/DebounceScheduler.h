@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// What the scheduler knows when a keystroke comes in, all times in milliseconds
+struct DebounceSignals
+{
+    uint64_t sinceLastKeystroke; // UINT64_MAX for the first keystroke
+    uint64_t typingIntervalP50;  // 0 until we've seen a few keystrokes in a row
+    uint64_t queryCostP50;       // 0 until we've seen a few queries complete
+    uint64_t queryCostP95;
+};
+
+struct DebounceDecision
+{
+    uint64_t delay; // milliseconds to wait for another keystroke before firing the query
+    const wchar_t* reason;
+};
+
+struct IDebouncePolicy
+{
+    virtual ~IDebouncePolicy() = default;
+    virtual DebounceDecision Decide(DebounceSignals const& signals) = 0;
+};
+
+// What we always did, wait the same amount no matter what
+struct FixedDebouncePolicy : public IDebouncePolicy
+{
+public:
+    explicit FixedDebouncePolicy(uint64_t delay) : m_delay(delay) {}
+
+    DebounceDecision Decide(DebounceSignals const&) override { return { m_delay, L"fixed" }; }
+
+private:
+    const uint64_t m_delay;
+};
+
+// Fires right away when queries are cheap and the user isn't in the middle of a burst, a superseded query
+// gets canceled mid-fetch so a cheap one costs little. During a burst we wait a bit longer than the user's
+// usual gap between keys so the next one lands before we fire, but never longer than the default delay, and
+// slow queries stretch that further since each superseded one holds up the indexer for longer.
+struct AdaptiveDebouncePolicy : public IDebouncePolicy
+{
+public:
+    AdaptiveDebouncePolicy(uint64_t defaultDelay, uint64_t minDelay, uint64_t maxDelay, uint64_t fastQueryCost) :
+        m_defaultDelay(defaultDelay), m_minDelay(minDelay), m_maxDelay((std::max)(maxDelay, minDelay)), m_fastQueryCost(fastQueryCost)
+    {
+    }
+
+    DebounceDecision Decide(DebounceSignals const& signals) override
+    {
+        if ((signals.typingIntervalP50 == 0) || (signals.queryCostP50 == 0))
+        {
+            return { m_defaultDelay, L"learning" };
+        }
+
+        // Well past the usual gap, the user is picking out keys rather than typing a word
+        const bool burst = signals.sinceLastKeystroke <= (signals.typingIntervalP50 * 2);
+        if (!burst && (signals.queryCostP95 <= m_fastQueryCost))
+        {
+            return { 0, L"paused, fast indexer" };
+        }
+
+        // Whatever the burst, the last key of it is waiting on us, so never longer than the default. Waiting
+        // out a slow typist's gap only costs them the whole gap when they stop.
+        uint64_t delay = burst ? (std::min)((signals.typingIntervalP50 * 3) / 2, m_defaultDelay) : m_minDelay;
+        const wchar_t* reason = burst ? L"burst" : L"paused, slow indexer";
+        if ((signals.queryCostP50 / 2) > delay)
+        {
+            delay = signals.queryCostP50 / 2;
+            reason = burst ? L"burst, slow indexer" : reason;
+        }
+        return { (std::min)((std::max)(delay, m_minDelay), m_maxDelay), reason };
+    }
+
+private:
+    const uint64_t m_defaultDelay;
+    const uint64_t m_minDelay;
+    const uint64_t m_maxDelay;
+    const uint64_t m_fastQueryCost;
+};
+
+// Platform neutral bookkeeping for how long to coalesce keystrokes before running a query. Learns the
+// user's gaps between keystrokes and the cost of recent queries over a rolling window, the policy turns
+// those into a delay.
+struct DebounceScheduler
+{
+public:
+    explicit DebounceScheduler(std::unique_ptr<IDebouncePolicy> policy) : m_policy(std::move(policy)) {}
+
+    // now is any monotonic millisecond clock
+    DebounceDecision OnKeystroke(uint64_t now, DebounceSignals* signalsOut = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        DebounceSignals signals{};
+        signals.sinceLastKeystroke = m_hasKeystroke ? (now - m_lastKeystroke) : UINT64_MAX;
+        if (m_hasKeystroke && (signals.sinceLastKeystroke <= c_maxTypingInterval))
+        {
+            // Longer gaps are the user stopping to look, they say nothing about how fast they type
+            Record(m_typingIntervals, m_typingIntervalsNext, signals.sinceLastKeystroke);
+        }
+        m_hasKeystroke = true;
+        m_lastKeystroke = now;
+
+        signals.typingIntervalP50 = Percentile(m_typingIntervals, 50);
+        signals.queryCostP50 = Percentile(m_queryCosts, 50);
+        signals.queryCostP95 = Percentile(m_queryCosts, 95);
+        if (signalsOut != nullptr)
+        {
+            *signalsOut = signals;
+        }
+        return m_policy->Decide(signals);
+    }
+
+    // Only for queries that ran to completion, canceled ones didn't pay the full cost
+    void OnQueryCompleted(uint64_t elapsed)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        Record(m_queryCosts, m_queryCostsNext, elapsed);
+    }
+
+private:
+    static void Record(std::vector<uint64_t>& window, size_t& next, uint64_t value)
+    {
+        if (window.size() < c_windowSize)
+        {
+            window.push_back(value);
+            return;
+        }
+        window[next] = value;
+        next = (next + 1) % c_windowSize;
+    }
+
+    static uint64_t Percentile(std::vector<uint64_t> const& window, size_t percentile)
+    {
+        if (window.size() < c_minSamples)
+        {
+            return 0;
+        }
+        std::vector<uint64_t> sorted(window);
+        auto nth = sorted.begin() + (((sorted.size() - 1) * percentile) / 100);
+        std::nth_element(sorted.begin(), nth, sorted.end());
+        return *nth;
+    }
+
+    static constexpr size_t c_windowSize{ 32 };
+    static constexpr size_t c_minSamples{ 3 };
+    static constexpr uint64_t c_maxTypingInterval{ 1000 };
+
+    std::mutex m_lock;
+    std::unique_ptr<IDebouncePolicy> m_policy;
+    std::vector<uint64_t> m_typingIntervals;
+    size_t m_typingIntervalsNext{};
+    std::vector<uint64_t> m_queryCosts;
+    size_t m_queryCostsNext{};
+    uint64_t m_lastKeystroke{};
+    bool m_hasKeystroke{};
+};
+
+struct DebounceSimulation
+{
+    uint64_t queriesStarted{};
+    uint64_t queriesCompleted{};
+    uint64_t queriesSuperseded{}; // started, then canceled by the next keystroke
+    uint64_t wastedQueryTime{};   // milliseconds spent on superseded queries
+    uint64_t totalResultLatency{}; // keystroke to results, summed over completed queries
+};
+
+// Offline replay of a keystroke timing trace (milliseconds, ascending) against a policy, to compare policies
+// without the indexer. queryCost(index) is the latency model, how long the query for keystroke index takes.
+// Same rules as the app: every keystroke cancels the pending or running query and schedules a new one.
+template <typename TQueryCost>
+DebounceSimulation SimulateDebounce(std::unique_ptr<IDebouncePolicy> policy, std::vector<uint64_t> const& keystrokes, TQueryCost&& queryCost)
+{
+    DebounceScheduler scheduler(std::move(policy));
+    DebounceSimulation simulation;
+    for (size_t i = 0; i < keystrokes.size(); ++i)
+    {
+        const uint64_t fireTime = keystrokes[i] + scheduler.OnKeystroke(keystrokes[i]).delay;
+        const bool last = (i + 1) == keystrokes.size();
+        if (!last && (fireTime >= keystrokes[i + 1]))
+        {
+            // Coalesced into the next keystroke's query
+            continue;
+        }
+
+        simulation.queriesStarted++;
+        const uint64_t cost = queryCost(i);
+        if (!last && ((fireTime + cost) > keystrokes[i + 1]))
+        {
+            simulation.queriesSuperseded++;
+            simulation.wastedQueryTime += keystrokes[i + 1] - fireTime;
+            continue;
+        }
+
+        simulation.queriesCompleted++;
+        simulation.totalResultLatency += (fireTime + cost) - keystrokes[i];
+        scheduler.OnQueryCompleted(cost);
+    }
+    return simulation;
+}
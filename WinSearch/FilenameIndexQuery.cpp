@@ -0,0 +1,327 @@
+#include "pch.h"
+#include "SearchQueryHelper.h"
+#include <intsafe.h>
+#include <NTQuery.h>
+#include <propkey.h>
+#include <wininet.h>
+#include "Logging.h"
+
+// Runs the priming query once more, in the background, and reads every row into the in memory filename index.
+// The priming rowset itself is kept for ReuseWhere and we don't want Init to wait on draining it.
+//
+// The last index we built is kept on disk as a snapshot. On startup it is mapped and used as is until the
+// fresh build from the indexer is ready to take over, so the first keystrokes don't have to wait on it.
+struct FilenameIndexQuery : winrt::implements<FilenameIndexQuery, ISearchQuery>, public SearchQueryBase
+{
+public:
+    FilenameIndexQuery(bool allUsersSearchEnabled) : m_allUsersSearchEnabled(allUsersSearchEnabled) {}
+
+    // ISearchQuery
+    void Init() {};
+    void ExecuteSync();
+    PCWSTR GetQueryString() { return L""; }
+    DWORD GetNumResults() { return m_numResults; }
+
+    void OnPreFetchRows() override;
+    void OnFetchRowCallback(IPropertyStore* propStore) override;
+    void OnPostFetchRows() override;
+    bool CanMaterializeRowsConcurrently() override { return true; }
+    std::vector<BoundColumn> GetBoundColumns() override;
+    void OnRowBatchDecoded(ColumnarRowBatch const& batch) override;
+    std::wstring GetPrimingQueryString() override;
+    ULONGLONG GetInitialFetchLimit() override { return c_maxFilenameIndexEntries; }
+
+    std::shared_ptr<const TrigramFilenameIndex> GetIndex() { return m_index; }
+
+private:
+    enum BoundColumnIndex
+    {
+        ItemNameDisplayColumn,
+        ItemUrlColumn,
+        KindTextColumn,
+    };
+
+    // Caps the index at a couple hundred MB, the indexer still answers for anything past this
+    static constexpr size_t c_maxFilenameIndexEntries{ 500000 };
+
+    bool m_allUsersSearchEnabled{};
+    std::shared_ptr<TrigramFilenameIndex> m_index;
+    std::chrono::steady_clock::time_point m_buildStart;
+};
+
+struct FilenameIndexState
+{
+    wil::srwlock lock;
+    std::shared_ptr<const TrigramFilenameIndex> index;
+    bool allUsersSearchEnabled{};
+    bool building{};
+    bool snapshotChecked{};
+};
+
+static FilenameIndexState& GetFilenameIndexState()
+{
+    static FilenameIndexState s_state;
+    return s_state;
+}
+
+// Keeps the file and its view mapped for as long as a snapshot index is in use
+struct MappedSnapshot
+{
+    wil::unique_hfile file;
+    wil::unique_handle mapping;
+    wil::unique_mapview_ptr<void> view;
+};
+
+static const PCWSTR c_snapshotPrefix = L"FilenameIndex.";
+static const PCWSTR c_snapshotExtension = L".bin";
+static constexpr size_t c_snapshotWriteBufferSize{ 1024 * 1024 };
+
+static std::wstring GetSnapshotFolder()
+{
+    std::wstring folder(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+    folder += L'\\';
+    return folder;
+}
+
+// Snapshots are named by when they were written, so the newest one sorts last. A snapshot in use stays mapped,
+// so instead of overwriting it a new one is written next to it and the old ones are cleaned up when they can be.
+static std::vector<std::wstring> FindSnapshots(std::wstring const& folder)
+{
+    std::vector<std::wstring> snapshots;
+    WIN32_FIND_DATAW findData{};
+    wil::unique_hfind find(FindFirstFileW((folder + c_snapshotPrefix + L"*" + c_snapshotExtension).c_str(), &findData));
+    if (find)
+    {
+        do
+        {
+            snapshots.emplace_back(findData.cFileName);
+        } while (FindNextFileW(find.get(), &findData));
+    }
+    std::sort(snapshots.begin(), snapshots.end());
+    return snapshots;
+}
+
+static std::shared_ptr<const TrigramFilenameIndex> LoadFilenameIndexSnapshot(bool allUsersSearchEnabled)
+{
+    auto start = std::chrono::steady_clock::now();
+    const std::wstring folder = GetSnapshotFolder();
+    auto snapshots = FindSnapshots(folder);
+    if (snapshots.empty())
+    {
+        return nullptr;
+    }
+
+    auto mapped = std::make_shared<MappedSnapshot>();
+    mapped->file.reset(CreateFileW((folder + snapshots.back()).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!mapped->file)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER size{};
+    THROW_IF_WIN32_BOOL_FALSE(GetFileSizeEx(mapped->file.get(), &size));
+    mapped->mapping.reset(CreateFileMappingW(mapped->file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+    THROW_LAST_ERROR_IF_NULL(mapped->mapping.get());
+    mapped->view.reset(MapViewOfFile(mapped->mapping.get(), FILE_MAP_READ, 0, 0, 0));
+    THROW_LAST_ERROR_IF_NULL(mapped->view.get());
+
+    const void* data = mapped->view.get();
+    uint32_t tag = 0;
+    auto index = TrigramFilenameIndex::OpenSnapshot(data, static_cast<size_t>(size.QuadPart), mapped, &tag);
+    if ((index == nullptr) || (tag != static_cast<uint32_t>(allUsersSearchEnabled)))
+    {
+        // Old format, damaged or for the other scope, the background build will write a new one
+        return nullptr;
+    }
+
+    _tracelog(L"\nFilename index snapshot %s: %d entries mapped in %d us", snapshots.back().c_str(), static_cast<DWORD>(index->Size()),
+        static_cast<DWORD>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+    return index;
+}
+
+static void WriteFilenameIndexSnapshot(TrigramFilenameIndex const& index, bool allUsersSearchEnabled)
+{
+    const std::wstring folder = GetSnapshotFolder();
+    FILETIME64 now{};
+    GetSystemTimeAsFileTime(&now.ft);
+    wchar_t stamp[17]{};
+    swprintf_s(stamp, L"%016llx", static_cast<unsigned long long>(now.quad));
+    const std::wstring name = std::wstring(c_snapshotPrefix) + stamp + c_snapshotExtension;
+    const std::wstring tempPath = folder + name + L".tmp";
+
+    {
+        wil::unique_hfile file(CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr));
+        THROW_LAST_ERROR_IF(!file);
+        auto deleteTemp = wil::scope_exit([&]() { DeleteFileW(tempPath.c_str()); });
+
+        // Coalesce the small section writes
+        std::vector<uint8_t> buffer;
+        buffer.reserve(c_snapshotWriteBufferSize);
+        auto flush = [&]()
+        {
+            DWORD written = 0;
+            THROW_IF_WIN32_BOOL_FALSE(WriteFile(file.get(), buffer.data(), static_cast<DWORD>(buffer.size()), &written, nullptr));
+            buffer.clear();
+        };
+        index.WriteSnapshot([&](const void* data, size_t bytes)
+            {
+                const uint8_t* current = static_cast<const uint8_t*>(data);
+                while (bytes > 0)
+                {
+                    const size_t chunk = (std::min)(bytes, c_snapshotWriteBufferSize - buffer.size());
+                    buffer.insert(buffer.end(), current, current + chunk);
+                    current += chunk;
+                    bytes -= chunk;
+                    if (buffer.size() == c_snapshotWriteBufferSize)
+                    {
+                        flush();
+                    }
+                }
+            }, static_cast<uint32_t>(allUsersSearchEnabled));
+        flush();
+        file.reset();
+
+        THROW_IF_WIN32_BOOL_FALSE(MoveFileExW(tempPath.c_str(), (folder + name).c_str(), MOVEFILE_REPLACE_EXISTING));
+        deleteTemp.release();
+    }
+
+    for (auto const& snapshot : FindSnapshots(folder))
+    {
+        if (snapshot != name)
+        {
+            // Fails for the one that is still mapped, it goes away next time
+            DeleteFileW((folder + snapshot).c_str());
+        }
+    }
+}
+
+void FilenameIndexQuery::ExecuteSync()
+{
+    m_buildStart = std::chrono::steady_clock::now();
+    m_index = std::make_shared<TrigramFilenameIndex>(c_maxFilenameIndexEntries);
+
+    // Files only, mail items don't have names worth matching locally
+    ExecuteQueryStringSync(GetPrimingQueryString().c_str());
+}
+
+void FilenameIndexQuery::OnPreFetchRows()
+{
+}
+
+std::vector<BoundColumn> FilenameIndexQuery::GetBoundColumns()
+{
+    // Order has to match BoundColumnIndex
+    return {
+        { L"System.ItemNameDisplay", MAX_PATH },
+        { L"System.ItemUrl", INTERNET_MAX_URL_LENGTH },
+        { L"System.KindText", 128 },
+    };
+}
+
+void FilenameIndexQuery::OnRowBatchDecoded(ColumnarRowBatch const& batch)
+{
+    for (size_t i = 0; i < batch.RowCount(); ++i)
+    {
+        m_index->Add(batch.GetString(i, ItemNameDisplayColumn), batch.GetString(i, ItemUrlColumn), batch.GetString(i, KindTextColumn));
+    }
+}
+
+void FilenameIndexQuery::OnFetchRowCallback(IPropertyStore* propStore)
+{
+    SmartPropVariant itemNameDisplay;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemNameDisplay, itemNameDisplay.put()));
+
+    SmartPropVariant itemUrl;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemUrl, itemUrl.put()));
+
+    SmartPropVariant kindText;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_KindText, kindText.put()));
+
+    m_index->Add(itemNameDisplay.GetString(), itemUrl.GetString(), kindText.IsEmpty() ? L"" : kindText.GetString());
+}
+
+void FilenameIndexQuery::OnPostFetchRows()
+{
+    if (!m_rowsetExhausted)
+    {
+        // Hit the cap, or the build failed part way
+        _tracelog(L"\nFilename index stopped at %d entries", static_cast<DWORD>(m_index->Size()));
+    }
+
+    m_index->Finalize();
+    _tracelog(L"\nFilename index: %d entries, %d KB, built in %d ms", static_cast<DWORD>(m_index->Size()), static_cast<DWORD>(m_index->MemoryBytes() / 1024),
+        static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_buildStart).count()));
+}
+
+std::wstring FilenameIndexQuery::GetPrimingQueryString()
+{
+    QueryStringBuilder builder;
+    return builder.GeneratePrimingQuery(false, m_allUsersSearchEnabled);
+}
+
+static void CALLBACK BuildFilenameIndexCallback(PTP_CALLBACK_INSTANCE, PVOID context)
+{
+    const bool allUsersSearchEnabled = (context != nullptr);
+    std::shared_ptr<const TrigramFilenameIndex> index;
+    try
+    {
+        winrt::init_apartment(winrt::apartment_type::multi_threaded);
+        auto uninit = wil::scope_exit([]() { winrt::uninit_apartment(); });
+
+        auto query = winrt::make_self<FilenameIndexQuery>(allUsersSearchEnabled);
+        query->ExecuteSync();
+        if (query->GetNumResults() > 0)
+        {
+            index = query->GetIndex();
+            WriteFilenameIndexSnapshot(*index, allUsersSearchEnabled);
+        }
+    }
+    CATCH_LOG();
+
+    FilenameIndexState& state = GetFilenameIndexState();
+    auto lock = state.lock.lock_exclusive();
+    if (index != nullptr)
+    {
+        state.index = index;
+        state.allUsersSearchEnabled = allUsersSearchEnabled;
+    }
+    state.building = false;
+}
+
+void BuildFilenameIndexAsync(bool allUsersSearchEnabled)
+{
+    FilenameIndexState& state = GetFilenameIndexState();
+    auto lock = state.lock.lock_exclusive();
+    if (!state.snapshotChecked && (state.index == nullptr))
+    {
+        // Mapping the snapshot is cheap, it answers queries until the build below is done
+        state.snapshotChecked = true;
+        try
+        {
+            state.index = LoadFilenameIndexSnapshot(allUsersSearchEnabled);
+            state.allUsersSearchEnabled = allUsersSearchEnabled;
+        }
+        CATCH_LOG();
+    }
+
+    // A snapshot is whatever the index looked like last time, it still gets rebuilt once per run
+    if (state.building || ((state.index != nullptr) && !state.index->IsSnapshot() && (state.allUsersSearchEnabled == allUsersSearchEnabled)))
+    {
+        return;
+    }
+
+    state.building = (TrySubmitThreadpoolCallback(BuildFilenameIndexCallback, allUsersSearchEnabled ? reinterpret_cast<void*>(1) : nullptr, nullptr) != FALSE);
+    LOG_LAST_ERROR_IF(!state.building);
+}
+
+std::shared_ptr<const TrigramFilenameIndex> GetFilenameIndex(bool allUsersSearchEnabled)
+{
+    FilenameIndexState& state = GetFilenameIndexState();
+    auto lock = state.lock.lock_shared();
+    if (state.allUsersSearchEnabled != allUsersSearchEnabled)
+    {
+        // Built for a different scope
+        return nullptr;
+    }
+    return state.index;
+}
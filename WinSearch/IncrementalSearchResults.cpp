@@ -0,0 +1,78 @@
+#include "pch.h"
+#include "IncrementalSearchResults.h"
+
+using namespace winrt::Windows::Foundation;
+using namespace winrt::Microsoft::UI::Xaml::Data;
+
+void IncrementalSearchResults::AppendAvailable(DWORD available)
+{
+    // The helper has fewer if it replaced its results under us, a newer publish is on its way
+    available = (std::min)(available, m_queryHelper->GetResultCount(m_revision));
+    const DWORD size = Size();
+    if (available <= size)
+    {
+        return;
+    }
+
+    if (available == size + 1)
+    {
+        Append(nullptr);
+    }
+    else
+    {
+        // One change for the whole publish rather than one per row, the ListView only realizes what's in view
+        m_values.resize(available);
+        call_changed(winrt::Windows::Foundation::Collections::CollectionChange::Reset, 0);
+    }
+}
+
+void IncrementalSearchResults::Realize(uint32_t startIndex, uint32_t count)
+{
+    const uint32_t end = (std::min)(startIndex + count, static_cast<uint32_t>(m_values.size()));
+    for (uint32_t i = startIndex; i < end; ++i)
+    {
+        if (m_values[i] == nullptr)
+        {
+            m_values[i] = m_queryHelper->GetResult(m_revision, i);
+        }
+    }
+}
+
+IInspectable IncrementalSearchResults::GetAt(uint32_t index)
+{
+    Realize(index, 1);
+    return base_type::GetAt(index);
+}
+
+uint32_t IncrementalSearchResults::GetMany(uint32_t startIndex, winrt::array_view<IInspectable> values)
+{
+    Realize(startIndex, values.size());
+    return base_type::GetMany(startIndex, values);
+}
+
+Collections::IIterator<IInspectable> IncrementalSearchResults::First()
+{
+    // Whoever walks the whole list gets the whole list
+    Realize(0, Size());
+    return base_type::First();
+}
+
+bool IncrementalSearchResults::HasMoreItems()
+{
+    return m_queryHelper->HasMoreResults(m_cookie);
+}
+
+IAsyncOperation<LoadMoreItemsResult> IncrementalSearchResults::LoadMoreItemsAsync(uint32_t count)
+{
+    auto strongThis = get_strong();
+    winrt::apartment_context ui_thread;
+
+    // Fetching and building the results happens off of the UI thread
+    co_await winrt::resume_background();
+    DWORD available = m_queryHelper->LoadMoreResults(m_cookie, count);
+
+    co_await ui_thread;
+    const uint32_t before = Size();
+    AppendAvailable(available);
+    co_return LoadMoreItemsResult{ Size() - before };
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pch.h"
+#include "SearchQueryHelper.h"
+
+// The list the ListView binds to. It starts out with whatever the query published for the first pages, and
+// pulls more rows off of the query helper's rowset only when the ListView asks for them as the user scrolls.
+// Rows are null until the ListView asks for one, only then does the helper make a SearchResult for it.
+struct IncrementalSearchResults : winrt::implements<IncrementalSearchResults,
+        winrt::Windows::Foundation::Collections::IObservableVector<winrt::Windows::Foundation::IInspectable>,
+        winrt::Windows::Foundation::Collections::IVector<winrt::Windows::Foundation::IInspectable>,
+        winrt::Windows::Foundation::Collections::IVectorView<winrt::Windows::Foundation::IInspectable>,
+        winrt::Windows::Foundation::Collections::IIterable<winrt::Windows::Foundation::IInspectable>,
+        winrt::Microsoft::UI::Xaml::Data::ISupportIncrementalLoading>,
+    winrt::observable_vector_base<IncrementalSearchResults, winrt::Windows::Foundation::IInspectable>
+{
+public:
+    // The list shows the rows the helper published under revision and no others
+    IncrementalSearchResults(winrt::com_ptr<ISearchUXQuery> const& queryHelper, DWORD cookie, DWORD revision) :
+        m_queryHelper(queryHelper), m_cookie(cookie), m_revision(revision)
+    {
+    }
+
+    auto& get_container() noexcept { return m_values; }
+    auto& get_container() const noexcept { return m_values; }
+
+    // Appends everything the helper has up to available that we don't have yet, UI thread only
+    void AppendAvailable(DWORD available);
+
+    // IVector, the rest of it goes straight to the base
+    winrt::Windows::Foundation::IInspectable GetAt(uint32_t index);
+    uint32_t GetMany(uint32_t startIndex, winrt::array_view<winrt::Windows::Foundation::IInspectable> values);
+    winrt::Windows::Foundation::Collections::IIterator<winrt::Windows::Foundation::IInspectable> First();
+
+    // ISupportIncrementalLoading
+    bool HasMoreItems();
+    winrt::Windows::Foundation::IAsyncOperation<winrt::Microsoft::UI::Xaml::Data::LoadMoreItemsResult> LoadMoreItemsAsync(uint32_t count);
+
+private:
+    using base_type = winrt::observable_vector_base<IncrementalSearchResults, winrt::Windows::Foundation::IInspectable>;
+
+    void Realize(uint32_t startIndex, uint32_t count);
+
+    std::vector<winrt::Windows::Foundation::IInspectable> m_values;
+    winrt::com_ptr<ISearchUXQuery> m_queryHelper;
+    DWORD m_cookie{};
+    DWORD m_revision{};
+};
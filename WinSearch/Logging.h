@@ -1,33 +1,50 @@
-#pragma once
-
-inline bool _debugout(TCHAR* format, ...)
-{
-    TCHAR buffer[1000];
-
-    va_list argptr;
-    va_start(argptr, format);
-    wvsprintf(buffer, format, argptr);
-    va_end(argptr);
-
-    OutputDebugString(buffer);
-
-    return true;
-}
-
-inline bool _tracelog(TCHAR* format, ...)
-{
-    TCHAR buffer[10000];
-
-    va_list argptr;
-    va_start(argptr, format);
-    wvsprintf(buffer, format, argptr);
-    va_end(argptr);
-
-    // load the log file and write to it...
-    winrt::Windows::Storage::StorageFolder storageFolder = winrt::Windows::Storage::ApplicationData::Current().LocalFolder();
-    static winrt::Windows::Storage::StorageFile storageFile = storageFolder.CreateFileAsync(L"LogTrace.txt", 
-        winrt::Windows::Storage::CreationCollisionOption::OpenIfExists).get();
-    winrt::Windows::Storage::FileIO::AppendTextAsync(storageFile, buffer).get();
-
-    return true;
-}
+#pragma once
+
+#include "BinaryLog.h"
+
+inline bool _debugout(TCHAR* format, ...)
+{
+    TCHAR buffer[1000];
+
+    va_list argptr;
+    va_start(argptr, format);
+    wvsprintf(buffer, format, argptr);
+    va_end(argptr);
+
+    OutputDebugString(buffer);
+
+    return true;
+}
+
+// Process wide, records go to LogTrace.bin in the app's local folder and DecodeBinaryLog turns them back into text.
+// Every run appends a session of its own.
+inline BinaryLogger& GetTraceLogger()
+{
+    static BinaryLogger s_logger([]()
+        {
+            std::shared_ptr<wil::unique_hfile> file;
+            try
+            {
+                std::wstring path(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+                path += L"\\LogTrace.bin";
+                file = std::make_shared<wil::unique_hfile>(CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+                THROW_LAST_ERROR_IF(!*file);
+            }
+            CATCH_LOG();
+
+            return [file](const void* data, size_t bytes)
+            {
+                THROW_HR_IF(E_HANDLE, !file || !*file);
+                DWORD written = 0;
+                THROW_IF_WIN32_BOOL_FALSE(WriteFile(file->get(), data, static_cast<DWORD>(bytes), &written, nullptr));
+            };
+        }());
+    return s_logger;
+}
+
+// Never blocks, the arguments get copied and formatted when the log is decoded. format has to be a literal.
+template <typename... TArgs>
+inline bool _tracelog(const wchar_t* format, TArgs const&... args)
+{
+    return GetTraceLogger().Log(format, args...);
+}
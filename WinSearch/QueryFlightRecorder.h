@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "QueryLatency.h"
+
+struct QueryTimelineEvent
+{
+    uint64_t start;
+    uint64_t microseconds;
+    uint64_t arg0;
+    uint64_t arg1;
+    QueryStage stage; // QueryStage::Count for a query sent to the indexer, arg0 is its ReuseWhere id
+    uint32_t thread;
+    uint32_t textOffset; // of a query's SQL in the timeline's text
+    uint32_t textLength;
+};
+
+struct QueryTimeline
+{
+    uint32_t cookie{};
+    std::vector<QueryTimelineEvent> events;
+    std::wstring text; // the SQL of every query sent for this cookie, back to back
+    uint64_t droppedEvents{};
+    uint64_t droppedChars{};
+
+    // One span per row is too many to keep, these just get added up
+    uint64_t resultsCreated{};
+    uint64_t createResultMicroseconds{};
+};
+
+// Platform neutral, always on record of what the last few queries did, in a fixed amount of memory: every span
+// but the per row ones, and the SQL that went to the indexer. When a query takes longer than the threshold from
+// keystroke to its last results being bound, the handler gets everything we have so it can be written out.
+struct QueryFlightRecorder : public IQueryLatencyListener
+{
+public:
+    // Called on the thread that finished the slow query, usually the UI thread, so it shouldn't do the writing there
+    using SlowQueryHandler = std::function<void(uint32_t cookie, std::vector<QueryTimeline>&& window)>;
+
+    QueryFlightRecorder(size_t queryCount, size_t eventsPerQuery, size_t textCharsPerQuery, uint64_t thresholdMicroseconds,
+        uint64_t minDumpIntervalMicroseconds, SlowQueryHandler handler) :
+        m_eventsPerQuery(eventsPerQuery), m_textCharsPerQuery(textCharsPerQuery), m_thresholdMicroseconds(thresholdMicroseconds),
+        m_minDumpIntervalMicroseconds(minDumpIntervalMicroseconds), m_handler(std::move(handler))
+    {
+        // Everything is allocated up front, recording never grows anything
+        for (size_t i = 0; i < (std::max)(queryCount, static_cast<size_t>(1)); ++i)
+        {
+            auto slot = std::make_unique<Slot>();
+            slot->timeline.events.reserve(eventsPerQuery);
+            slot->timeline.text.reserve(textCharsPerQuery);
+            m_slots.push_back(std::move(slot));
+        }
+    }
+
+    void OnSpan(uint32_t cookie, QueryStage stage, uint64_t start, uint64_t microseconds, uint64_t arg0, uint64_t arg1) override
+    {
+        if (cookie == 0)
+        {
+            return;
+        }
+
+        WithTimeline(cookie, [&](QueryTimeline& timeline)
+            {
+                if (stage == QueryStage::CreateResult)
+                {
+                    timeline.resultsCreated++;
+                    timeline.createResultMicroseconds += microseconds;
+                    return;
+                }
+                AddEvent(timeline, { start, microseconds, arg0, arg1, stage, CurrentThread(), 0, 0 });
+            });
+
+        if ((stage == QueryStage::Complete) && (microseconds >= m_thresholdMicroseconds))
+        {
+            OnSlowQuery(cookie, start + microseconds);
+        }
+    }
+
+    // sql is about to go to the indexer for cookie
+    void OnQuery(uint32_t cookie, std::wstring_view sql, uint32_t reuseWhereId)
+    {
+        if (cookie == 0)
+        {
+            return;
+        }
+
+        const uint64_t now = QueryLatencyTracker::NowMicroseconds();
+        WithTimeline(cookie, [&](QueryTimeline& timeline)
+            {
+                const size_t room = (timeline.text.size() < m_textCharsPerQuery) ? (m_textCharsPerQuery - timeline.text.size()) : 0;
+                const size_t length = (std::min)(sql.size(), room);
+                timeline.droppedChars += sql.size() - length;
+                const uint32_t offset = static_cast<uint32_t>(timeline.text.size());
+                timeline.text.append(sql.data(), length);
+                AddEvent(timeline, { now, 0, reuseWhereId, 0, QueryStage::Count, CurrentThread(), offset, static_cast<uint32_t>(length) });
+            });
+    }
+
+    // Every query we still have, oldest first
+    std::vector<QueryTimeline> Snapshot() const
+    {
+        std::vector<QueryTimeline> window;
+        for (auto const& slot : m_slots)
+        {
+            std::lock_guard<std::mutex> lock(slot->lock);
+            if (slot->timeline.cookie != 0)
+            {
+                window.push_back(slot->timeline);
+            }
+        }
+        std::sort(window.begin(), window.end(), [](auto const& left, auto const& right) { return left.cookie < right.cookie; });
+        return window;
+    }
+
+private:
+    struct Slot
+    {
+        std::mutex lock;
+        QueryTimeline timeline;
+    };
+
+    template <typename TCallback>
+    void WithTimeline(uint32_t cookie, TCallback&& callback)
+    {
+        Slot& slot = *m_slots[cookie % m_slots.size()];
+        std::lock_guard<std::mutex> lock(slot.lock);
+        QueryTimeline& timeline = slot.timeline;
+        if (timeline.cookie != cookie)
+        {
+            if (timeline.cookie > cookie)
+            {
+                // Straggler from a query that has already been pushed out by a newer one
+                return;
+            }
+
+            timeline.cookie = cookie;
+            timeline.events.clear();
+            timeline.text.clear();
+            timeline.droppedEvents = 0;
+            timeline.droppedChars = 0;
+            timeline.resultsCreated = 0;
+            timeline.createResultMicroseconds = 0;
+        }
+        callback(timeline);
+    }
+
+    void AddEvent(QueryTimeline& timeline, QueryTimelineEvent const& event)
+    {
+        if (timeline.events.size() >= m_eventsPerQuery)
+        {
+            timeline.droppedEvents++;
+            return;
+        }
+        timeline.events.push_back(event);
+    }
+
+    void OnSlowQuery(uint32_t cookie, uint64_t now)
+    {
+        // One dump per interval, a bad stretch would otherwise write out the same window over and over
+        uint64_t lastDump = m_lastDump.load(std::memory_order_relaxed);
+        if (((lastDump != 0) && ((now - lastDump) < m_minDumpIntervalMicroseconds)) ||
+            !m_lastDump.compare_exchange_strong(lastDump, now, std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        if (m_handler)
+        {
+            m_handler(cookie, Snapshot());
+        }
+    }
+
+    static uint32_t CurrentThread()
+    {
+        static std::atomic<uint32_t> s_nextThread{ 1 };
+        static thread_local uint32_t t_thread = s_nextThread++;
+        return t_thread;
+    }
+
+    const size_t m_eventsPerQuery;
+    const size_t m_textCharsPerQuery;
+    const uint64_t m_thresholdMicroseconds;
+    const uint64_t m_minDumpIntervalMicroseconds;
+    SlowQueryHandler m_handler;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+    std::atomic<uint64_t> m_lastDump{};
+};
+
+// The window as Chrome trace event JSON (UTF-8), for chrome://tracing or Perfetto. Spans show up on the thread
+// that recorded them, the ones measured from the keystroke get a track per query.
+inline std::string WriteChromeTrace(std::vector<QueryTimeline> const& window)
+{
+    std::string json;
+    auto appendString = [&](std::wstring_view text)
+    {
+        json += '"';
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            if ((sizeof(wchar_t) == 2) && (c >= 0xD800) && (c <= 0xDBFF) && ((i + 1) < text.size()) &&
+                (static_cast<uint32_t>(text[i + 1]) >= 0xDC00) && (static_cast<uint32_t>(text[i + 1]) <= 0xDFFF))
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (static_cast<uint32_t>(text[++i]) - 0xDC00);
+            }
+
+            if ((c == '"') || (c == '\\'))
+            {
+                json += '\\';
+                json += static_cast<char>(c);
+            }
+            else if (c < 0x20)
+            {
+                static const char c_hex[] = "0123456789abcdef";
+                json += "\\u00";
+                json += c_hex[c >> 4];
+                json += c_hex[c & 0xF];
+            }
+            else if (c < 0x80)
+            {
+                json += static_cast<char>(c);
+            }
+            else if (c < 0x800)
+            {
+                json += static_cast<char>(0xC0 | (c >> 6));
+                json += static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                json += static_cast<char>(0xE0 | (c >> 12));
+                json += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                json += static_cast<char>(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                json += static_cast<char>(0xF0 | (c >> 18));
+                json += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                json += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                json += static_cast<char>(0x80 | (c & 0x3F));
+            }
+        }
+        json += '"';
+    };
+
+    auto appendNumber = [&](uint64_t value) { json += std::to_string(value); };
+
+    // Well clear of the thread numbers the recorder hands out
+    constexpr uint64_t c_queryTrackBase{ 1000000 };
+
+    bool first = true;
+    auto beginEvent = [&](const char* phase, std::wstring_view name, uint64_t thread)
+    {
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "{\"ph\":\"";
+        json += phase;
+        json += "\",\"pid\":1,\"tid\":";
+        appendNumber(thread);
+        json += ",\"name\":";
+        appendString(name);
+    };
+
+    json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (auto const& timeline : window)
+    {
+        const uint64_t track = c_queryTrackBase + timeline.cookie;
+        beginEvent("M", L"thread_name", track);
+        json += ",\"args\":{\"name\":";
+        appendString(L"Query " + std::to_wstring(timeline.cookie));
+        json += "}}";
+
+        for (auto const& event : timeline.events)
+        {
+            if (event.stage == QueryStage::Count)
+            {
+                beginEvent("i", L"SQL", event.thread);
+                json += ",\"s\":\"t\",\"ts\":";
+                appendNumber(event.start);
+                json += ",\"args\":{\"cookie\":";
+                appendNumber(timeline.cookie);
+                json += ",\"reuseWhereId\":";
+                appendNumber(event.arg0);
+                json += ",\"sql\":";
+                appendString(std::wstring_view(timeline.text).substr(event.textOffset, event.textLength));
+                json += "}}";
+                continue;
+            }
+
+            const bool sinceKeystroke = (event.stage == QueryStage::Debounce) || (event.stage == QueryStage::FirstBind) || (event.stage == QueryStage::Complete);
+            beginEvent("X", GetQueryStageName(event.stage), sinceKeystroke ? track : event.thread);
+            json += ",\"ts\":";
+            appendNumber(event.start);
+            json += ",\"dur\":";
+            appendNumber(event.microseconds);
+            json += ",\"args\":{\"cookie\":";
+            appendNumber(timeline.cookie);
+            if ((event.stage == QueryStage::FirstRows) || (event.stage == QueryStage::NextRows))
+            {
+                json += ",\"requested\":";
+                appendNumber(event.arg0);
+                json += ",\"returned\":";
+                appendNumber(event.arg1);
+            }
+            if (event.stage == QueryStage::Complete)
+            {
+                json += ",\"resultsCreated\":";
+                appendNumber(timeline.resultsCreated);
+                json += ",\"createResultUs\":";
+                appendNumber(timeline.createResultMicroseconds);
+                json += ",\"droppedEvents\":";
+                appendNumber(timeline.droppedEvents);
+                json += ",\"droppedSqlChars\":";
+                appendNumber(timeline.droppedChars);
+            }
+            json += "}}";
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
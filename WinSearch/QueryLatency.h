@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Where a keystroke's time goes, from the keystroke to its results being bound. Per row and per load stages
+// get one sample per row or load, the others one per query.
+enum class QueryStage : uint32_t
+{
+    Debounce,     // keystroke to the query timer firing
+    LockWait,     // waiting on the previous query to let go of the rowset
+    Execute,      // ICommandText::Execute
+    FirstRows,    // the first GetNextRows of a rowset, with the rows asked for and the rows returned
+    NextRows,     // every GetNextRows after that, same arguments
+    CreateResult, // one row turned into a result
+    Thumbnail,    // one thumbnail load on a scheduler worker, not tied to a query. 1 if it came from the store and its size.
+    UiBind,       // one batch of results handed to the list on the UI thread
+    FirstBind,    // keystroke to the first page being bound
+    Complete,     // keystroke to the last results being bound
+    Count
+};
+
+inline const wchar_t* GetQueryStageName(QueryStage stage)
+{
+    static const wchar_t* const c_names[] = { L"Debounce", L"LockWait", L"Execute", L"FirstRows", L"NextRows",
+        L"CreateResult", L"Thumbnail", L"UiBind", L"FirstBind", L"Complete" };
+    static_assert((sizeof(c_names) / sizeof(c_names[0])) == static_cast<size_t>(QueryStage::Count), "a stage is missing its name");
+    return c_names[static_cast<size_t>(stage)];
+}
+
+struct LatencySummary
+{
+    uint64_t count{};
+    uint64_t mean{};
+    uint64_t p50{};
+    uint64_t p90{};
+    uint64_t p99{};
+    uint64_t max{};
+};
+
+// Platform neutral HDR style histogram of microsecond latencies. Values are bucketed by their power of two and
+// then linearly within it, so every bucket is within about 3% of the values in it whatever their magnitude.
+// Recording is a couple of relaxed atomic adds and never blocks, reading while recording gives a slightly
+// torn but still useful picture.
+struct LatencyHistogram
+{
+public:
+    void Record(uint64_t microseconds)
+    {
+        m_buckets[GetBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(microseconds, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while ((microseconds > max) && !m_max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    LatencySummary Summarize() const
+    {
+        LatencySummary summary;
+        uint64_t counts[c_bucketCount];
+        for (size_t i = 0; i < c_bucketCount; ++i)
+        {
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+            summary.count += counts[i];
+        }
+        if (summary.count == 0)
+        {
+            return summary;
+        }
+
+        summary.mean = m_sum.load(std::memory_order_relaxed) / summary.count;
+        summary.max = m_max.load(std::memory_order_relaxed);
+        summary.p50 = (std::min)(ValueAtPercentile(counts, summary.count, 50), summary.max);
+        summary.p90 = (std::min)(ValueAtPercentile(counts, summary.count, 90), summary.max);
+        summary.p99 = (std::min)(ValueAtPercentile(counts, summary.count, 99), summary.max);
+        return summary;
+    }
+
+    // The largest value that lands in the same bucket as microseconds
+    static uint64_t GetEquivalentValue(uint64_t microseconds) { return GetBucketMax(GetBucket(microseconds)); }
+
+private:
+    static constexpr uint32_t c_subBucketBits{ 5 };
+    static constexpr uint64_t c_subBucketCount{ 1ull << c_subBucketBits };
+    static constexpr uint32_t c_maxValueBits{ 38 }; // a bit over three days, anything longer is clamped
+    static constexpr size_t c_bucketCount{ (c_maxValueBits - c_subBucketBits + 1) * c_subBucketCount };
+
+    static size_t GetBucket(uint64_t value)
+    {
+        if (value < c_subBucketCount)
+        {
+            return static_cast<size_t>(value);
+        }
+        if (value >= (1ull << c_maxValueBits))
+        {
+            return c_bucketCount - 1;
+        }
+
+        uint32_t highestBit = c_subBucketBits;
+        while ((value >> (highestBit + 1)) != 0)
+        {
+            highestBit++;
+        }
+        const uint32_t shift = highestBit - c_subBucketBits;
+        return static_cast<size_t>(((shift + 1) * c_subBucketCount) + ((value >> shift) - c_subBucketCount));
+    }
+
+    static uint64_t GetBucketMax(size_t bucket)
+    {
+        const uint64_t group = bucket / c_subBucketCount;
+        const uint64_t sub = bucket % c_subBucketCount;
+        if (group == 0)
+        {
+            return sub;
+        }
+        return ((c_subBucketCount + sub + 1) << (group - 1)) - 1;
+    }
+
+    static uint64_t ValueAtPercentile(const uint64_t* counts, uint64_t total, uint64_t percentile)
+    {
+        const uint64_t target = (std::max)(((total * percentile) + 99) / 100, static_cast<uint64_t>(1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < c_bucketCount; ++i)
+        {
+            seen += counts[i];
+            if (seen >= target)
+            {
+                return GetBucketMax(i);
+            }
+        }
+        return GetBucketMax(c_bucketCount - 1);
+    }
+
+    std::atomic<uint64_t> m_buckets[c_bucketCount]{};
+    std::atomic<uint64_t> m_sum{};
+    std::atomic<uint64_t> m_max{};
+};
+
+// Gets every span as it's recorded, with when it started. Called on whatever thread recorded it.
+struct IQueryLatencyListener
+{
+    virtual ~IQueryLatencyListener() = default;
+    virtual void OnSpan(uint32_t cookie, QueryStage stage, uint64_t start, uint64_t microseconds, uint64_t arg0, uint64_t arg1) = 0;
+};
+
+struct QueryLatencyBreakdown
+{
+    uint64_t stageMicroseconds[static_cast<size_t>(QueryStage::Count)]{}; // summed, per row stages add up
+};
+
+// Spans keyed by query cookie aggregated into a histogram per stage. The last few queries also keep their own
+// per stage totals so a slow one can be picked apart after the fact. Nothing here takes a lock, the listener
+// (if there is one) is on its own.
+struct QueryLatencyTracker
+{
+public:
+    explicit QueryLatencyTracker(IQueryLatencyListener* listener = nullptr) : m_listener(listener) {}
+
+    static uint64_t NowMicroseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // The keystroke that cookie's query is for came in at now, the end to end stages are measured from here
+    void OnKeystroke(uint32_t cookie, uint64_t now)
+    {
+        TrackedQuery& query = m_queries[cookie % c_trackedQueries];
+        query.cookie.store(0, std::memory_order_relaxed);
+        for (auto& stage : query.stageMicroseconds)
+        {
+            stage.store(0, std::memory_order_relaxed);
+        }
+        query.keystroke.store(now, std::memory_order_relaxed);
+        query.cookie.store(cookie, std::memory_order_release);
+    }
+
+
+    // Spans that can't be tied to a query pass a cookie of 0. arg0 and arg1 mean whatever the stage says they do,
+    // they only go to the listener.
+    void RecordSpan(uint32_t cookie, QueryStage stage, uint64_t start, uint64_t microseconds, uint64_t arg0 = 0, uint64_t arg1 = 0)
+    {
+        Record(cookie, stage, microseconds);
+        if (m_listener != nullptr)
+        {
+            m_listener->OnSpan(cookie, stage, start, microseconds, arg0, arg1);
+        }
+    }
+
+    void Record(uint32_t cookie, QueryStage stage, uint64_t microseconds)
+    {
+        m_histograms[static_cast<size_t>(stage)].Record(microseconds);
+        if (cookie != 0)
+        {
+            TrackedQuery& query = m_queries[cookie % c_trackedQueries];
+            if (query.cookie.load(std::memory_order_acquire) == cookie)
+            {
+                query.stageMicroseconds[static_cast<size_t>(stage)].fetch_add(microseconds, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Records now minus cookie's keystroke as stage, if we still know when that was
+    void RecordSinceKeystroke(uint32_t cookie, QueryStage stage, uint64_t now)
+    {
+        TrackedQuery& query = m_queries[cookie % c_trackedQueries];
+        if (query.cookie.load(std::memory_order_acquire) != cookie)
+        {
+            return;
+        }
+        const uint64_t keystroke = query.keystroke.load(std::memory_order_relaxed);
+        RecordSpan(cookie, stage, keystroke, (now > keystroke) ? (now - keystroke) : 0);
+    }
+
+    bool GetBreakdown(uint32_t cookie, QueryLatencyBreakdown& breakdown) const
+    {
+        TrackedQuery const& query = m_queries[cookie % c_trackedQueries];
+        if (query.cookie.load(std::memory_order_acquire) != cookie)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(QueryStage::Count); ++i)
+        {
+            breakdown.stageMicroseconds[i] = query.stageMicroseconds[i].load(std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    LatencySummary Summarize(QueryStage stage) const { return m_histograms[static_cast<size_t>(stage)].Summarize(); }
+
+    // A line per stage that has seen anything, times in microseconds
+    std::wstring Dump() const
+    {
+        std::wstring dump(L"stage         count      mean       p50       p90       p99       max\n");
+        for (size_t i = 0; i < static_cast<size_t>(QueryStage::Count); ++i)
+        {
+            const LatencySummary summary = m_histograms[i].Summarize();
+            if (summary.count == 0)
+            {
+                continue;
+            }
+
+            AppendColumn(dump, GetQueryStageName(static_cast<QueryStage>(i)), 12, false);
+            for (uint64_t value : { summary.count, summary.mean, summary.p50, summary.p90, summary.p99, summary.max })
+            {
+                AppendColumn(dump, std::to_wstring(value), 10, true);
+            }
+            dump += L'\n';
+        }
+        return dump;
+    }
+
+private:
+    static void AppendColumn(std::wstring& line, std::wstring const& value, size_t width, bool alignRight)
+    {
+        const size_t padding = (value.size() < width) ? (width - value.size()) : 0;
+        if (alignRight)
+        {
+            line.append(padding, L' ');
+        }
+        line += value;
+        if (!alignRight)
+        {
+            line.append(padding + 1, L' ');
+        }
+    }
+
+    struct TrackedQuery
+    {
+        std::atomic<uint32_t> cookie{};
+        std::atomic<uint64_t> keystroke{};
+        std::atomic<uint64_t> stageMicroseconds[static_cast<size_t>(QueryStage::Count)]{};
+    };
+
+    // Cookies go up by one per keystroke, a slot gets reused once this many newer queries have come along
+    static constexpr uint32_t c_trackedQueries{ 64 };
+
+    LatencyHistogram m_histograms[static_cast<size_t>(QueryStage::Count)];
+    TrackedQuery m_queries[c_trackedQueries];
+    IQueryLatencyListener* const m_listener;
+};
+
+// Records the time between construction and Stop (or destruction) as stage
+struct QueryLatencySpan
+{
+public:
+    QueryLatencySpan(QueryLatencyTracker& tracker, uint32_t cookie, QueryStage stage) :
+        m_tracker(tracker), m_cookie(cookie), m_stage(stage), m_start(QueryLatencyTracker::NowMicroseconds())
+    {
+    }
+
+    ~QueryLatencySpan() { Stop(); }
+
+    void SetArgs(uint64_t arg0, uint64_t arg1)
+    {
+        m_arg0 = arg0;
+        m_arg1 = arg1;
+    }
+
+    QueryLatencySpan(QueryLatencySpan const&) = delete;
+    QueryLatencySpan& operator=(QueryLatencySpan const&) = delete;
+
+    void Stop()
+    {
+        if (!m_stopped)
+        {
+            m_stopped = true;
+            m_tracker.RecordSpan(m_cookie, m_stage, m_start, QueryLatencyTracker::NowMicroseconds() - m_start, m_arg0, m_arg1);
+        }
+    }
+
+private:
+    QueryLatencyTracker& m_tracker;
+    const uint32_t m_cookie;
+    const QueryStage m_stage;
+    const uint64_t m_start;
+    uint64_t m_arg0{};
+    uint64_t m_arg1{};
+    bool m_stopped{};
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Platform neutral query text with the parts that depend on the search text left as slots. The projection,
+// scope and ORDER BY only depend on the option set, so they get put together once and every keystroke just
+// fills in the search terms and the ReuseWhere id.
+struct QueryTemplate
+{
+public:
+    // selectWithScope is everything up to and including the scope conditions, orderConditions goes last
+    QueryTemplate(std::wstring selectWithScope, std::wstring orderConditions) :
+        m_prefix(std::move(selectWithScope)), m_suffix(std::move(orderConditions))
+    {
+    }
+
+    // The query for searchText, written over query so its buffer gets reused from one keystroke to the next
+    void Fill(std::wstring& query, std::wstring_view searchText, bool contentSearchEnabled, uint32_t whereId) const
+    {
+        query.clear();
+        query.reserve(m_prefix.size() + m_suffix.size() + c_slotChars + (searchText.size() * (contentSearchEnabled ? 2 : 1)) +
+            (contentSearchEnabled ? (CountTokens(searchText) * c_tokenChars) : 0));
+        query += m_prefix;
+
+        // Filter by item name display only
+        if (!searchText.empty())
+        {
+            query += L" AND (CONTAINS(System.ItemNameDisplay, '\"";
+            query += searchText;
+            query += L"*\"')";
+        }
+
+        // Are we searching contents?
+        if (contentSearchEnabled && !searchText.empty())
+        {
+            query += L" OR (";
+            bool first = true;
+            ForEachToken(searchText, [&](std::wstring_view token)
+                {
+                    if (!first)
+                    {
+                        query += L" AND ";
+                    }
+                    first = false;
+                    query += L"CONTAINS(*, '\"";
+                    query += token;
+                    query += L"*\"')";
+                });
+            query += L')';
+        }
+
+        // group the contains
+        if (!searchText.empty())
+        {
+            query += L")";
+        }
+
+        // Always add reuse where to the query
+        query += L" AND ReuseWhere(";
+        AppendNumber(query, whereId);
+        query += L")";
+
+        query += m_suffix;
+    }
+
+    // The priming query has no slots, it's just the select and the order
+    void FillPriming(std::wstring& query) const
+    {
+        query.clear();
+        query.reserve(m_prefix.size() + m_suffix.size());
+        query += m_prefix;
+        query += m_suffix;
+    }
+
+private:
+    // Space separated, like std::getline with a ' ' delimiter splits them: empty tokens between two spaces,
+    // but none after a trailing space
+    template <typename TCallback>
+    static void ForEachToken(std::wstring_view text, TCallback&& callback)
+    {
+        size_t start = 0;
+        while (start < text.size())
+        {
+            size_t end = text.find(L' ', start);
+            if (end == std::wstring_view::npos)
+            {
+                end = text.size();
+            }
+            callback(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    static size_t CountTokens(std::wstring_view text)
+    {
+        size_t count = 0;
+        ForEachToken(text, [&](std::wstring_view) { count++; });
+        return count;
+    }
+
+    static void AppendNumber(std::wstring& query, uint32_t value)
+    {
+        wchar_t digits[10];
+        size_t count = 0;
+        do
+        {
+            digits[count++] = static_cast<wchar_t>(L'0' + (value % 10));
+            value /= 10;
+        } while (value != 0);
+
+        while (count > 0)
+        {
+            query += digits[--count];
+        }
+    }
+
+    // Fixed text around the slots, " AND (CONTAINS(System.ItemNameDisplay, '\"" and friends
+    static constexpr size_t c_slotChars{ 96 };
+    static constexpr size_t c_tokenChars{ 24 };
+
+    std::wstring m_prefix;
+    std::wstring m_suffix;
+};
+
+// Process wide, compiled templates never change so they are shared between builders and threads
+struct QueryTemplateCache
+{
+public:
+    // key has to cover everything the template was compiled from
+    template <typename TCompile>
+    std::shared_ptr<const QueryTemplate> GetOrCompile(std::wstring const& key, TCompile&& compile)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto found = m_templates.find(key);
+            if (found != m_templates.end())
+            {
+                return found->second;
+            }
+        }
+
+        // Compiled outside of the lock, it can take a while. If two threads race the first one wins.
+        std::shared_ptr<const QueryTemplate> compiled = compile();
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_templates.emplace(key, std::move(compiled)).first->second;
+    }
+
+private:
+    std::mutex m_lock;
+    std::unordered_map<std::wstring, std::shared_ptr<const QueryTemplate>> m_templates;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))) && (WCHAR_MAX <= 0xFFFF)
+#include <emmintrin.h>
+#define REFINEMENT_FILTER_SSE2 1
+#endif
+
+// Platform neutral case insensitive substring matcher used to refine results locally while the indexer query
+// for the longer text is still on its way. Candidates for the first character are found 8 characters at a
+// time with SSE2 where we have it, the rest of the needle is only compared at those positions.
+struct CaseInsensitiveMatcher
+{
+public:
+    explicit CaseInsensitiveMatcher(std::wstring_view needle)
+    {
+        m_needle.reserve(needle.size());
+        for (wchar_t ch : needle)
+        {
+            m_needle += static_cast<wchar_t>(std::towlower(ch));
+        }
+
+        if (!m_needle.empty())
+        {
+            m_firstLower = m_needle[0];
+            m_firstUpper = static_cast<wchar_t>(std::towupper(m_firstLower));
+        }
+    }
+
+    // Offset of the first match at or after start, npos if there isn't one
+    size_t Find(std::wstring_view haystack, size_t start = 0) const
+    {
+        if (m_needle.empty())
+        {
+            return (start <= haystack.size()) ? start : std::wstring_view::npos;
+        }
+        if (haystack.size() < m_needle.size())
+        {
+            return std::wstring_view::npos;
+        }
+
+        const size_t lastStart = haystack.size() - m_needle.size();
+        size_t pos = start;
+
+#ifdef REFINEMENT_FILTER_SSE2
+        const __m128i lower = _mm_set1_epi16(static_cast<short>(m_firstLower));
+        const __m128i upper = _mm_set1_epi16(static_cast<short>(m_firstUpper));
+        while ((pos + 8) <= (lastStart + 1))
+        {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack.data() + pos));
+            const __m128i hits = _mm_or_si128(_mm_cmpeq_epi16(chunk, lower), _mm_cmpeq_epi16(chunk, upper));
+            unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hits));
+            while (mask != 0)
+            {
+                // Two mask bits per character
+                const size_t candidate = pos + (CountTrailingZeros(mask) / 2);
+                if (MatchesAt(haystack, candidate))
+                {
+                    return candidate;
+                }
+                mask &= ~(3u << ((candidate - pos) * 2));
+            }
+            pos += 8;
+        }
+#endif
+
+        for (; pos <= lastStart; ++pos)
+        {
+            const wchar_t ch = haystack[pos];
+            if (((ch == m_firstLower) || (ch == m_firstUpper)) && MatchesAt(haystack, pos))
+            {
+                return pos;
+            }
+        }
+        return std::wstring_view::npos;
+    }
+
+    // The indexer matches the search text against the start of words, so by default so do we. That keeps the
+    // local refinement from showing items the indexer results are just going to take away again.
+    bool Matches(std::wstring_view haystack, bool wordStartsOnly = true) const
+    {
+        return (wordStartsOnly ? FindWordStart(haystack) : Find(haystack)) != std::wstring_view::npos;
+    }
+
+    // Offset of the first match that starts a word, npos if there isn't one
+    size_t FindWordStart(std::wstring_view haystack) const
+    {
+        size_t pos = Find(haystack);
+        while (pos != std::wstring_view::npos)
+        {
+            if ((pos == 0) || !std::iswalnum(haystack[pos - 1]))
+            {
+                return pos;
+            }
+            pos = Find(haystack, pos + 1);
+        }
+        return std::wstring_view::npos;
+    }
+
+    size_t Length() const { return m_needle.size(); }
+
+    bool Empty() const { return m_needle.empty(); }
+
+private:
+    bool MatchesAt(std::wstring_view haystack, size_t pos) const
+    {
+        for (size_t i = 1; i < m_needle.size(); ++i)
+        {
+            if (static_cast<wchar_t>(std::towlower(haystack[pos + i])) != m_needle[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // value is never 0
+    static unsigned int CountTrailingZeros(unsigned int value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return static_cast<unsigned int>(index);
+#else
+        return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+    }
+
+    std::wstring m_needle; // lower case
+    wchar_t m_firstLower{};
+    wchar_t m_firstUpper{};
+};
+
+// Indices of the items (in their original rank order) whose text still matches the refined search text
+template <typename TGetText>
+std::vector<size_t> RefineResults(size_t count, std::wstring_view searchText, TGetText&& getText)
+{
+    CaseInsensitiveMatcher matcher(searchText);
+    std::vector<size_t> matches;
+    matches.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (matcher.Matches(getText(i)))
+        {
+            matches.push_back(i);
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+
+// Platform neutral bookkeeping for fetching a rowset a page at a time. The helper only pulls rows off of
+// the rowset cursor when the list asks for them (because the user scrolled), so the cost of a query scales
+// with how far the user looks and not with how many items matched.
+struct ResultPager
+{
+public:
+    ResultPager(size_t pageSize, size_t readAheadPages) :
+        m_pageSize((pageSize > 0) ? pageSize : 1),
+        m_readAheadPages(readAheadPages)
+    {
+    }
+
+    // A new rowset is starting, firstPageSize is what it takes to fill the viewport
+    void Reset(size_t firstPageSize)
+    {
+        m_firstPageSize = (firstPageSize > 0) ? firstPageSize : m_pageSize;
+        m_fetchedRows = 0;
+        m_exhausted = false;
+    }
+
+    // How many rows to fetch when the query is first executed
+    size_t InitialFetchSize() const
+    {
+        return RoundUpToPage(m_firstPageSize) + (m_readAheadPages * m_pageSize);
+    }
+
+    // How many rows to pull off of the rowset for a request of requestedItems more items
+    size_t FetchSizeFor(size_t requestedItems) const
+    {
+        if (m_exhausted)
+        {
+            return 0;
+        }
+        return RoundUpToPage((requestedItems > 0) ? requestedItems : 1) + (m_readAheadPages * m_pageSize);
+    }
+
+    void OnRowsFetched(size_t fetchedRows, bool rowsetExhausted)
+    {
+        m_fetchedRows += fetchedRows;
+        m_exhausted = m_exhausted || rowsetExhausted;
+    }
+
+    bool HasMoreRows() const { return !m_exhausted; }
+    size_t FetchedRows() const { return m_fetchedRows; }
+    size_t PageSize() const { return m_pageSize; }
+
+private:
+    size_t RoundUpToPage(size_t rows) const
+    {
+        return ((rows + m_pageSize - 1) / m_pageSize) * m_pageSize;
+    }
+
+    const size_t m_pageSize;
+    const size_t m_readAheadPages;
+    size_t m_firstPageSize{};
+    size_t m_fetchedRows{};
+    bool m_exhausted{};
+};
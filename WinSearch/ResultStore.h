@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "SearchItemUtils.h"
+#include "StringAtoms.h"
+
+// One result, as it goes into or comes out of a ResultStore. The views have to stay put until it's appended,
+// coming out they point into the store or the ResultRowBuffer it was read with and are null terminated.
+struct ResultRow
+{
+    std::wstring_view displayName;
+    std::wstring_view url;
+    std::wstring_view launchUri; // the url for mail, the file path for files
+    StringAtom thumbnailKey{};
+    bool isMail{};
+    bool isFolder{};
+    bool canDisplay{ true };
+    int64_t rank{};
+    uint64_t dateModified{}; // yyyymmddhhmmss, 0 unless the query asked for it
+};
+
+// Where the strings a ResultStore has to put back together go, the caller's so reading doesn't change the store
+struct ResultRowBuffer
+{
+    std::wstring launchUri;
+    std::wstring url;
+};
+
+// Platform neutral store for a query's results, a column per field instead of an object per result. Strings go
+// into an arena of fixed size chunks, so growing it never copies what's there and wastes at most the end of a
+// chunk, and the flags are a bit per row. The chunks and columns are kept from query to query, appending a row
+// doesn't allocate once they've grown to the size of the usual result set.
+//
+// Launch uris are most of the bytes and results tend to come from a handful of folders, so each one is kept as
+// its folder and the rest. Folders are kept once per store and front coded: every c_folderBlock'th one in full,
+// the ones after it as how much they share with it plus the rest. Putting a launch uri back together is three
+// copies out of the arena wherever the row is. A file's url is its path again, it's only kept when it wouldn't
+// come back out the same.
+//
+// Nothing in here is locked, the owner decides who gets to append and read.
+struct ResultStore
+{
+public:
+    // A string in one piece has to fit a chunk, anything longer is cut. Nothing Windows calls a path comes close.
+    static constexpr size_t c_chunkChars{ 64 * 1024 };
+    static constexpr size_t c_folderBlock{ 16 };
+
+    ResultStore() = default;
+    ResultStore(ResultStore&&) = default;
+    ResultStore& operator=(ResultStore&&) = default;
+
+    ResultStore(ResultStore const& other)
+    {
+        *this = other;
+    }
+
+    ResultStore& operator=(ResultStore const& other)
+    {
+        if (this != &other)
+        {
+            Clear();
+            for (size_t i = 0; i < other.Size(); ++i)
+            {
+                AppendFrom(other, i);
+            }
+        }
+        return *this;
+    }
+
+    size_t Size() const { return m_names.size(); }
+    bool Empty() const { return m_names.empty(); }
+    size_t FolderCount() const { return m_folders.size(); }
+
+    void Reserve(size_t rows, size_t chars)
+    {
+        m_chunks.reserve((chars / c_chunkChars) + 1);
+        m_names.reserve(rows);
+        m_launchFolders.reserve(rows);
+        m_launchNames.reserve(rows);
+        m_thumbnailKeys.reserve(rows);
+        m_ranks.reserve(rows);
+        m_datesModified.reserve(rows);
+    }
+
+    // Keeps the memory for the next query's results
+    void Clear()
+    {
+        m_chunk = 0;
+        m_chunkUsed = 0;
+        m_names.clear();
+        m_launchFolders.clear();
+        m_launchNames.clear();
+        m_otherUrls.clear();
+        m_thumbnailKeys.clear();
+        m_ranks.clear();
+        m_datesModified.clear();
+        m_isMail.clear();
+        m_isFolder.clear();
+        m_canDisplay.clear();
+        m_urlIsLaunchUri.clear();
+        m_urlFromPath.clear();
+        m_folders.clear();
+        m_folderHashes.clear();
+        std::fill(m_folderSlots.begin(), m_folderSlots.end(), 0);
+        m_lastFolder = c_noFolder;
+    }
+
+    size_t Append(ResultRow const& row)
+    {
+        const size_t index = Size();
+        m_names.push_back(AppendString(row.displayName));
+
+        const size_t nameStart = FindNameStart(row.launchUri);
+        m_launchFolders.push_back(InternFolder(row.launchUri.substr(0, nameStart)));
+        m_launchNames.push_back(AppendString(row.launchUri.substr(nameStart)));
+
+        // Mail launches by its url, and a file's url is its path again
+        const bool urlIsLaunchUri = (row.url == row.launchUri);
+        const bool urlFromPath = !urlIsLaunchUri && IsUrlOfFilePath(row.url, row.launchUri);
+        if (!urlIsLaunchUri && !urlFromPath)
+        {
+            m_otherUrls.push_back({ static_cast<uint32_t>(index), AppendString(row.url) });
+        }
+
+        m_thumbnailKeys.push_back(row.thumbnailKey);
+        m_ranks.push_back(row.rank);
+        m_datesModified.push_back(row.dateModified);
+        PushBit(m_isMail, index, row.isMail);
+        PushBit(m_isFolder, index, row.isFolder);
+        PushBit(m_canDisplay, index, row.canDisplay);
+        PushBit(m_urlIsLaunchUri, index, urlIsLaunchUri);
+        PushBit(m_urlFromPath, index, urlFromPath);
+        return index;
+    }
+
+    // Copies a row of another store, other can't be this store
+    size_t AppendFrom(ResultStore const& other, size_t index)
+    {
+        return Append(other.GetRow(index, m_copyBuffer));
+    }
+
+    // The row's launch uri and url are put back together in buffer, they're good until it's used again
+    ResultRow GetRow(size_t index, ResultRowBuffer& buffer) const
+    {
+        ResultRow row;
+        row.displayName = GetString(m_names[index]);
+
+        GetLaunchUri(index, buffer.launchUri);
+        row.launchUri = buffer.launchUri;
+        if (GetBit(m_urlIsLaunchUri, index))
+        {
+            row.url = row.launchUri;
+        }
+        else if (GetBit(m_urlFromPath, index))
+        {
+            FilePathToUrl(row.launchUri, buffer.url);
+            row.url = buffer.url;
+        }
+        else
+        {
+            auto other = std::lower_bound(m_otherUrls.begin(), m_otherUrls.end(), index, [](OtherUrl const& url, size_t row) { return url.row < row; });
+            row.url = GetString(other->url);
+        }
+
+        row.thumbnailKey = m_thumbnailKeys[index];
+        row.isMail = GetBit(m_isMail, index);
+        row.isFolder = GetBit(m_isFolder, index);
+        row.canDisplay = GetBit(m_canDisplay, index);
+        row.rank = m_ranks[index];
+        row.dateModified = m_datesModified[index];
+        return row;
+    }
+
+    void GetLaunchUri(size_t index, std::wstring& launchUri) const
+    {
+        launchUri.clear();
+        if (m_launchFolders[index] != c_noFolder)
+        {
+            CodedFolder const& folder = m_folders[m_launchFolders[index]];
+            launchUri.append(GetString({ folder.head, folder.prefix }));
+            launchUri.append(GetString({ folder.suffix, folder.suffixLength }));
+        }
+        launchUri.append(GetString(m_launchNames[index]));
+    }
+
+    std::wstring_view GetDisplayName(size_t index) const { return GetString(m_names[index]); }
+    int64_t GetRank(size_t index) const { return m_ranks[index]; }
+    uint64_t GetDateModified(size_t index) const { return m_datesModified[index]; }
+
+    // Chars of the arena used so far, counting what was left at the end of full chunks
+    size_t ArenaChars() const { return (m_chunk * c_chunkChars) + m_chunkUsed; }
+
+    // What the store has allocated, arena, columns and folders
+    size_t MemoryBytes() const
+    {
+        return (m_chunks.size() * c_chunkChars * sizeof(wchar_t)) +
+            ((m_names.capacity() + m_launchNames.capacity()) * sizeof(StringRef)) +
+            (m_launchFolders.capacity() * sizeof(uint32_t)) +
+            (m_otherUrls.capacity() * sizeof(OtherUrl)) +
+            (m_thumbnailKeys.capacity() * sizeof(StringAtom)) +
+            (m_ranks.capacity() * sizeof(int64_t)) +
+            (m_datesModified.capacity() * sizeof(uint64_t)) +
+            ((m_isMail.capacity() + m_isFolder.capacity() + m_canDisplay.capacity() + m_urlIsLaunchUri.capacity() + m_urlFromPath.capacity()) *
+                sizeof(uint64_t)) +
+            (m_folders.capacity() * sizeof(CodedFolder)) +
+            ((m_folderHashes.capacity() + m_folderSlots.capacity()) * sizeof(uint32_t));
+    }
+
+private:
+    static constexpr uint32_t c_noFolder{ 0xFFFFFFFF };
+
+    struct StringRef
+    {
+        uint32_t offset; // chunk * c_chunkChars + where it starts in the chunk
+        uint32_t length;
+    };
+
+    // The first folder of a block is its own head and shares all of it
+    struct CodedFolder
+    {
+        uint32_t head; // the block's first folder, in full
+        uint32_t suffix;
+        uint16_t prefix; // how much of the head
+        uint16_t suffixLength;
+    };
+
+    // The url of a row whose url isn't its launch uri or its path
+    struct OtherUrl
+    {
+        uint32_t row;
+        StringRef url;
+    };
+
+    // Past the last slash of either kind, the folder keeps its slash
+    static size_t FindNameStart(std::wstring_view location)
+    {
+        for (size_t i = location.size(); i > 0; --i)
+        {
+            if ((location[i - 1] == L'\\') || (location[i - 1] == L'/'))
+            {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t InternFolder(std::wstring_view folder)
+    {
+        if (folder.empty())
+        {
+            return c_noFolder;
+        }
+
+        // Rows in a row are often from the same folder
+        if ((m_lastFolder != c_noFolder) && FolderEquals(m_lastFolder, folder))
+        {
+            return m_lastFolder;
+        }
+
+        if (((m_folders.size() + 1) * 2) > m_folderSlots.size())
+        {
+            GrowFolderSlots();
+        }
+
+        const uint32_t hash = HashString(folder);
+        const size_t mask = m_folderSlots.size() - 1;
+        for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+        {
+            const uint32_t id = m_folderSlots[slot];
+            if (id == 0)
+            {
+                m_lastFolder = AddFolder(folder, hash);
+                m_folderSlots[slot] = m_lastFolder + 1;
+                return m_lastFolder;
+            }
+
+            if ((m_folderHashes[id - 1] == hash) && FolderEquals(id - 1, folder))
+            {
+                m_lastFolder = id - 1;
+                return m_lastFolder;
+            }
+        }
+    }
+
+    uint32_t AddFolder(std::wstring_view folder, uint32_t hash)
+    {
+        const uint32_t id = static_cast<uint32_t>(m_folders.size());
+        CodedFolder coded;
+        if ((id % c_folderBlock) == 0)
+        {
+            m_folderHead = AppendString(folder);
+            coded = { m_folderHead.offset, m_folderHead.offset, static_cast<uint16_t>(m_folderHead.length), 0 };
+        }
+        else
+        {
+            const std::wstring_view head = GetString(m_folderHead);
+            const size_t shared = std::mismatch(head.begin(), head.end(), folder.begin(), folder.end()).first - head.begin();
+            const StringRef suffix = AppendString(folder.substr(shared));
+            coded = { m_folderHead.offset, suffix.offset, static_cast<uint16_t>(shared), static_cast<uint16_t>(suffix.length) };
+        }
+        m_folders.push_back(coded);
+        m_folderHashes.push_back(hash);
+        return id;
+    }
+
+    bool FolderEquals(uint32_t id, std::wstring_view folder) const
+    {
+        CodedFolder const& coded = m_folders[id];
+        return (folder.size() == (static_cast<size_t>(coded.prefix) + coded.suffixLength)) &&
+            (folder.substr(0, coded.prefix) == GetString({ coded.head, coded.prefix })) &&
+            (folder.substr(coded.prefix) == GetString({ coded.suffix, coded.suffixLength }));
+    }
+
+    void GrowFolderSlots()
+    {
+        m_folderSlots.assign((std::max)(m_folderSlots.size() * 2, static_cast<size_t>(64)), 0);
+        const size_t mask = m_folderSlots.size() - 1;
+        for (uint32_t id = 0; id < m_folders.size(); ++id)
+        {
+            size_t slot = m_folderHashes[id] & mask;
+            while (m_folderSlots[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            m_folderSlots[slot] = id + 1;
+        }
+    }
+
+    StringRef AppendString(std::wstring_view value)
+    {
+        const size_t length = (std::min)(value.size(), c_chunkChars - 1);
+        if ((m_chunk == m_chunks.size()) || ((m_chunkUsed + length + 1) > c_chunkChars))
+        {
+            // Leave whatever is left of this one, the next one is empty or one we kept
+            if (m_chunk < m_chunks.size())
+            {
+                m_chunk++;
+                m_chunkUsed = 0;
+            }
+            if (m_chunk == m_chunks.size())
+            {
+                m_chunks.emplace_back(new wchar_t[c_chunkChars]);
+            }
+        }
+
+        wchar_t* chars = m_chunks[m_chunk].get() + m_chunkUsed;
+        std::copy_n(value.data(), length, chars);
+        chars[length] = L'\0';
+
+        StringRef ref{ static_cast<uint32_t>((m_chunk * c_chunkChars) + m_chunkUsed), static_cast<uint32_t>(length) };
+        m_chunkUsed += length + 1;
+        return ref;
+    }
+
+    std::wstring_view GetString(StringRef ref) const
+    {
+        return std::wstring_view(m_chunks[ref.offset / c_chunkChars].get() + (ref.offset % c_chunkChars), ref.length);
+    }
+
+    static void PushBit(std::vector<uint64_t>& bits, size_t index, bool value)
+    {
+        if ((index % 64) == 0)
+        {
+            bits.push_back(0);
+        }
+        bits.back() |= static_cast<uint64_t>(value) << (index % 64);
+    }
+
+    static bool GetBit(std::vector<uint64_t> const& bits, size_t index)
+    {
+        return ((bits[index / 64] >> (index % 64)) & 1) != 0;
+    }
+
+    std::vector<std::unique_ptr<wchar_t[]>> m_chunks; // every string, each one null terminated
+    size_t m_chunk{}; // the one being appended to
+    size_t m_chunkUsed{};
+    std::vector<StringRef> m_names;
+    std::vector<uint32_t> m_launchFolders;
+    std::vector<StringRef> m_launchNames; // what's past the folder
+    std::vector<OtherUrl> m_otherUrls; // by row
+    std::vector<StringAtom> m_thumbnailKeys;
+    std::vector<int64_t> m_ranks;
+    std::vector<uint64_t> m_datesModified;
+    std::vector<uint64_t> m_isMail;
+    std::vector<uint64_t> m_isFolder;
+    std::vector<uint64_t> m_canDisplay;
+    std::vector<uint64_t> m_urlIsLaunchUri;
+    std::vector<uint64_t> m_urlFromPath;
+
+    std::vector<CodedFolder> m_folders;
+    std::vector<uint32_t> m_folderHashes;
+    std::vector<uint32_t> m_folderSlots; // open addressed, folder + 1 so 0 is empty
+    StringRef m_folderHead{}; // of the block being added to
+    uint32_t m_lastFolder{ c_noFolder };
+    ResultRowBuffer m_copyBuffer; // for AppendFrom
+};
+
+// What an indexer row becomes: classified by its atoms, mail launching by its url, via the chooser that binds the
+// URI for all future runs, and files with the default app, so by their path. Returns the row's index.
+inline size_t AppendSearchResult(ResultStore& results, std::wstring_view itemNameDisplay, std::wstring_view itemUrl,
+    std::wstring_view kindText, int64_t rank = 0, uint64_t dateModified = 0)
+{
+    // Everything after this goes by the atoms, the strings only get looked at the once
+    const ItemAtoms atoms = ClassifyItem(GetStringAtoms(), itemUrl, kindText);
+
+    ResultRow row;
+    row.displayName = itemNameDisplay;
+    row.url = itemUrl;
+    row.launchUri = itemUrl;
+    row.isMail = atoms.IsMail();
+    row.isFolder = atoms.IsFolder();
+    row.rank = rank;
+    row.dateModified = dateModified;
+
+    // The path is worked out in the thread's buffer, the store keeps its own copy
+    static thread_local std::wstring t_filePath;
+    if (!row.isMail)
+    {
+        t_filePath.assign(itemUrl);
+        row.isMail = !UrlToFilePath(t_filePath);
+        if (!row.isMail)
+        {
+            row.launchUri = t_filePath;
+            row.thumbnailKey = atoms.GetThumbnailKey();
+        }
+    }
+    return results.Append(row);
+}
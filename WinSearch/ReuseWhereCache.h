@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <cwctype>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Case and whitespace differences don't change what the indexer matches
+inline std::wstring NormalizeSearchText(std::wstring_view text)
+{
+    std::wstring normalized;
+    normalized.reserve(text.size());
+    bool pendingSpace = false;
+    for (wchar_t ch : text)
+    {
+        if (std::iswspace(ch))
+        {
+            pendingSpace = !normalized.empty();
+            continue;
+        }
+
+        if (pendingSpace)
+        {
+            normalized += L' ';
+            pendingSpace = false;
+        }
+        normalized += static_cast<wchar_t>(std::towlower(ch));
+    }
+    return normalized;
+}
+
+struct ReuseWhereCacheStats
+{
+    uint64_t hits{};
+    uint64_t exactHits{};    // the cached restriction was for the very same text
+    uint64_t misses{};
+    uint64_t evictions{};
+    size_t entries{};
+    size_t bytes{};
+};
+
+// Platform neutral LRU cache of already evaluated ReuseWhere restrictions. Each entry maps a normalized
+// search text plus the option flags the query ran with to the where id of its rowset, and keeps the rowset
+// handle (THandle) alive since the id is only good for as long as the rowset is.
+//
+// Results for a longer text are always a subset of the results for any prefix of it (same options), so a
+// lookup hands back the entry with the longest cached prefix. That way backspacing, retyping and toggling
+// back to an earlier option set all start from the narrowest restriction we already paid for.
+template <typename THandle>
+struct ReuseWhereCache
+{
+public:
+    struct Entry
+    {
+        std::wstring text;   // normalized
+        uint32_t options{};
+        uint32_t whereId{};
+        THandle handle{};
+        size_t bytes{};
+    };
+
+    ReuseWhereCache(size_t maxEntries, size_t maxBytes) :
+        m_maxEntries((maxEntries > 0) ? maxEntries : 1),
+        m_maxBytes(maxBytes)
+    {
+    }
+
+    // Finds the narrowest cached restriction that still covers text, returns false if there isn't one
+    bool Lookup(std::wstring_view text, uint32_t options, uint32_t* whereId, THandle* handle)
+    {
+        const std::wstring normalized = NormalizeSearchText(text);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto best = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if ((it->options != options) || (it->text.size() > normalized.size()))
+            {
+                continue;
+            }
+
+            if ((normalized.compare(0, it->text.size(), it->text) == 0) &&
+                ((best == m_entries.end()) || (it->text.size() > best->text.size())))
+            {
+                best = it;
+            }
+        }
+
+        if (best == m_entries.end())
+        {
+            m_stats.misses++;
+            return false;
+        }
+
+        m_stats.hits++;
+        if (best->text.size() == normalized.size())
+        {
+            m_stats.exactHits++;
+        }
+
+        // Most recently used goes to the front
+        m_entries.splice(m_entries.begin(), m_entries, best);
+        *whereId = best->whereId;
+        *handle = best->handle;
+        return true;
+    }
+
+    // costBytes is our estimate of what holding on to the handle costs, on top of the key itself
+    void Insert(std::wstring_view text, uint32_t options, uint32_t whereId, THandle handle, size_t costBytes)
+    {
+        Entry entry;
+        entry.text = NormalizeSearchText(text);
+        entry.options = options;
+        entry.whereId = whereId;
+        entry.handle = std::move(handle);
+        entry.bytes = sizeof(Entry) + (entry.text.size() * sizeof(wchar_t)) + costBytes;
+
+        // Evicted handles are released outside of the lock, letting go of a rowset isn't free
+        std::list<Entry> evicted;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+            {
+                if ((it->options == entry.options) && (it->text == entry.text))
+                {
+                    // Newer rowset for the same key, the old one goes away
+                    m_bytes -= it->bytes;
+                    evicted.splice(evicted.end(), m_entries, it);
+                    break;
+                }
+            }
+
+            m_bytes += entry.bytes;
+            m_entries.push_front(std::move(entry));
+
+            // Always keep the entry we just added, even if it is over budget on its own
+            while ((m_entries.size() > 1) && ((m_entries.size() > m_maxEntries) || (m_bytes > m_maxBytes)))
+            {
+                m_bytes -= m_entries.back().bytes;
+                evicted.splice(evicted.end(), m_entries, std::prev(m_entries.end()));
+                m_stats.evictions++;
+            }
+        }
+    }
+
+    void Clear()
+    {
+        std::list<Entry> evicted;
+        std::lock_guard<std::mutex> lock(m_lock);
+        evicted.swap(m_entries);
+        m_bytes = 0;
+    }
+
+    ReuseWhereCacheStats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        ReuseWhereCacheStats stats = m_stats;
+        stats.entries = m_entries.size();
+        stats.bytes = m_bytes;
+        return stats;
+    }
+
+private:
+    const size_t m_maxEntries;
+    const size_t m_maxBytes;
+    std::mutex m_lock;
+    std::list<Entry> m_entries; // most recently used first
+    size_t m_bytes{};
+    ReuseWhereCacheStats m_stats;
+};
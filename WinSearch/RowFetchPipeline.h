@@ -0,0 +1,451 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BatchSizeController.h"
+#include "CancellationToken.h"
+#include "ColumnarRowBatch.h"
+
+// Platform neutral threads for OrderedBatchPipeline's workers that stay around from one run to the next, so a fetch
+// (and every page after it) doesn't start and join threads of its own. Runs never wait on each other for a thread,
+// if every thread is busy another one is started and it stays around for later runs too. workerStart and
+// workerStop run once on every thread, when it starts and when the pool goes away, for setup like joining the MTA.
+struct BatchWorkerPool
+{
+public:
+    explicit BatchWorkerPool(std::function<void()> workerStart = nullptr, std::function<void()> workerStop = nullptr) :
+        m_workerStart(std::move(workerStart)),
+        m_workerStop(std::move(workerStop))
+    {
+    }
+
+    ~BatchWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = true;
+        }
+        m_workAvailable.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    BatchWorkerPool(BatchWorkerPool const&) = delete;
+    BatchWorkerPool& operator=(BatchWorkerPool const&) = delete;
+
+    // work can't throw. done runs after it once the thread is back in the pool, so whoever waits for it can count
+    // on having that thread again the next time they submit something.
+    void Submit(std::function<void()> work, std::function<void()> done = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_work.push_back({ std::move(work), std::move(done) });
+        if (m_work.size() <= m_idle)
+        {
+            m_workAvailable.notify_one();
+            return;
+        }
+
+        try
+        {
+            m_threads.emplace_back([this]() { ThreadLoop(); });
+        }
+        catch (...)
+        {
+            m_work.pop_back();
+            throw;
+        }
+    }
+
+    size_t ThreadCount()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_threads.size();
+    }
+
+private:
+    struct Work
+    {
+        std::function<void()> work;
+        std::function<void()> done;
+    };
+
+    void ThreadLoop()
+    {
+        if (m_workerStart)
+        {
+            m_workerStart();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_idle++;
+            while (true)
+            {
+                m_workAvailable.wait(lock, [&]() { return m_stopping || !m_work.empty(); });
+                if (m_work.empty())
+                {
+                    break;
+                }
+
+                Work work = std::move(m_work.front());
+                m_work.pop_front();
+                m_idle--;
+                lock.unlock();
+                work.work();
+                lock.lock();
+                m_idle++;
+
+                if (work.done)
+                {
+                    lock.unlock();
+                    work.done();
+                    lock.lock();
+                }
+            }
+        }
+
+        if (m_workerStop)
+        {
+            m_workerStop();
+        }
+    }
+
+    std::function<void()> m_workerStart;
+    std::function<void()> m_workerStop;
+    std::mutex m_lock;
+    std::condition_variable m_workAvailable;
+    std::deque<Work> m_work;
+    size_t m_idle{}; // threads that aren't running work, they take whatever is queued before they wait again
+    bool m_stopping{};
+    std::vector<std::thread> m_threads;
+};
+
+// Platform neutral two stage pipeline for fetching rows. The calling thread produces batches (GetNextRows)
+// while a few workers from a BatchWorkerPool transform them into results (GetRowFromHROW + building the result objects).
+// Finished batches are consumed strictly in the order they were produced, so rank ordering from the
+// provider is kept even though batches are transformed concurrently.
+//
+// The queue between the producer and the workers is bounded, so a fast provider can't run away from us
+// and hold on to an unbounded number of rows.
+//
+// produce runs on the calling thread at the same time as transform runs on the workers. Anything both of them
+// call into, like the rowset the batches came from, has to be fine with that or make them take turns.
+template <typename TBatch, typename TResult>
+struct OrderedBatchPipeline
+{
+public:
+    OrderedBatchPipeline(BatchWorkerPool& workers, size_t workerCount, size_t maxQueuedBatches) :
+        m_workers(workers),
+        m_workerCount((workerCount > 0) ? workerCount : 1),
+        m_maxQueuedBatches((maxQueuedBatches > 0) ? maxQueuedBatches : 1)
+    {
+    }
+
+    // produce:   bool(TBatch&)   fills the next batch, returns false once the source is drained
+    // transform: TResult(TBatch&) runs on the workers, concurrently for different batches
+    // consume:   void(TResult&)  runs on the workers, one batch at a time and in production order
+    // discard:   void(TBatch&)   gets every produced batch that never made it to transform once the pipeline
+    //                            stopped, so what it holds (rows, buffers) can be given back
+    // The first exception thrown by any stage stops the pipeline and is rethrown from Run.
+    template <typename TProduce, typename TTransform, typename TConsume>
+    void Run(TProduce&& produce, TTransform&& transform, TConsume&& consume)
+    {
+        Run(produce, transform, consume, [](TBatch&) {});
+    }
+
+    template <typename TProduce, typename TTransform, typename TConsume, typename TDiscard>
+    void Run(TProduce&& produce, TTransform&& transform, TConsume&& consume, TDiscard&& discard)
+    {
+        m_queue.clear();
+        m_nextSequence = 0;
+        m_nextToConsume = 0;
+        m_producerDone = false;
+        m_failed = false;
+        m_error = nullptr;
+        m_runningWorkers = 0;
+
+        for (size_t i = 0; i < m_workerCount; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_runningWorkers++;
+            }
+
+            try
+            {
+                m_workers.Submit([&]() { WorkerLoop(transform, consume); }, [this]() { OnWorkerDone(); });
+            }
+            catch (...)
+            {
+                // Fewer workers than asked for, or none, and then the producer just stops
+                OnWorkerDone();
+                Fail(std::current_exception());
+                break;
+            }
+        }
+
+        try
+        {
+            while (true)
+            {
+                TBatch batch{};
+                if (!produce(batch))
+                {
+                    break;
+                }
+
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_spaceAvailable.wait(lock, [&]() { return m_failed || (m_queue.size() < m_maxQueuedBatches); });
+                if (m_failed)
+                {
+                    lock.unlock();
+                    discard(batch);
+                    break;
+                }
+                m_queue.push_back({ m_nextSequence++, std::move(batch) });
+                m_batchAvailable.notify_one();
+            }
+        }
+        catch (...)
+        {
+            Fail(std::current_exception());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_producerDone = true;
+        }
+        m_batchAvailable.notify_all();
+
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_workersDone.wait(lock, [&]() { return m_runningWorkers == 0; });
+        }
+
+        // Workers stop taking batches once something failed, whatever they left in the queue is ours to give back
+        for (auto& item : m_queue)
+        {
+            try
+            {
+                discard(item.batch);
+            }
+            catch (...)
+            {
+                Fail(std::current_exception());
+            }
+        }
+        m_queue.clear();
+
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    struct SequencedBatch
+    {
+        uint64_t sequence;
+        TBatch batch;
+    };
+
+    template <typename TTransform, typename TConsume>
+    void WorkerLoop(TTransform& transform, TConsume& consume)
+    {
+        while (true)
+        {
+            SequencedBatch item;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_batchAvailable.wait(lock, [&]() { return m_failed || m_producerDone || !m_queue.empty(); });
+                if (m_failed || m_queue.empty())
+                {
+                    return;
+                }
+                item = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_spaceAvailable.notify_one();
+
+            try
+            {
+                TResult result = transform(item.batch);
+
+                // Wait for our turn so results come out in the order the provider gave them to us
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_turn.wait(lock, [&]() { return m_failed || (m_nextToConsume == item.sequence); });
+                    if (m_failed)
+                    {
+                        return;
+                    }
+                }
+
+                // Only the worker holding the current sequence gets here, so no lock is needed to consume
+                consume(result);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_nextToConsume++;
+                }
+                m_turn.notify_all();
+            }
+            catch (...)
+            {
+                Fail(std::current_exception());
+                return;
+            }
+        }
+    }
+
+    void OnWorkerDone()
+    {
+        // Notified under the lock, Run can return and take the pipeline with it as soon as it sees the last one
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (--m_runningWorkers == 0)
+        {
+            m_workersDone.notify_all();
+        }
+    }
+
+    void Fail(std::exception_ptr error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_failed)
+            {
+                m_failed = true;
+                m_error = error;
+            }
+        }
+        m_spaceAvailable.notify_all();
+        m_batchAvailable.notify_all();
+        m_turn.notify_all();
+    }
+
+    BatchWorkerPool& m_workers;
+    const size_t m_workerCount;
+    const size_t m_maxQueuedBatches;
+
+    std::mutex m_lock;
+    std::condition_variable m_spaceAvailable;
+    std::condition_variable m_batchAvailable;
+    std::condition_variable m_turn;
+    std::condition_variable m_workersDone;
+    std::deque<SequencedBatch> m_queue;
+    uint64_t m_nextSequence{};
+    uint64_t m_nextToConsume{};
+    bool m_producerDone{};
+    bool m_failed{};
+    std::exception_ptr m_error;
+    size_t m_runningWorkers{};
+};
+
+// A provider's handle for a row it's holding on to for us, an HROW from a rowset
+using RowHandle = uintptr_t;
+
+struct FetchedRowBatch
+{
+    ColumnarRowBatch rows;          // the values, from NextBatch or DecodeBatch
+    std::vector<RowHandle> handles; // rows still at the provider, for a source that reads their values on the workers
+    BatchSizeDecision decision{};   // what it took the source to hand these back
+};
+
+// Where FetchRowsPipelined gets its rows from, the indexer's rowset in the app and a replayed trace off box
+struct IRowBatchSource
+{
+    virtual ~IRowBatchSource() = default;
+
+    // On the fetching thread, up to maxRows rows into batch, returns how many. 0 once there are no more. The
+    // values can go into batch.rows right away or be left for DecodeBatch.
+    virtual size_t NextBatch(size_t maxRows, FetchedRowBatch& batch) = 0;
+
+    // On a worker, before the batch's rows are materialized. Whatever the batch holds at the provider has to be
+    // given back, even if this throws.
+    virtual void DecodeBatch(FetchedRowBatch&) {}
+
+    // A batch that was fetched but won't be decoded, the fetch stopped first
+    virtual void ReleaseBatch(FetchedRowBatch&) {}
+};
+
+// Fetches up to maxRows rows from source, asking it for the next batch while workerCount workers from workers
+// build the results of the ones before it. Batch sizes come from the controller. materialize(rows, row, results)
+// runs on the workers and adds the row's result, if it has one, to results, which start out empty for every
+// batch. consume(batch, results) gets the batches in the order they were fetched, one at a time. Cancellation
+// is checked between batches and rows, and nothing is consumed once it's requested. Returns how many rows were
+// fetched.
+template <typename TResults, typename TMaterialize, typename TConsume>
+uint64_t FetchRowsPipelined(IRowBatchSource& source, BatchWorkerPool& workers, size_t workerCount, size_t maxQueuedBatches,
+    AdaptiveBatchSizeController& controller, uint64_t maxRows, TMaterialize&& materialize, TConsume&& consume,
+    CancellationToken const& cancellation = {})
+{
+    struct MaterializedBatch
+    {
+        FetchedRowBatch fetched;
+        TResults results;
+    };
+
+    uint64_t fetched = 0;
+    controller.Reset();
+    OrderedBatchPipeline<FetchedRowBatch, MaterializedBatch> pipeline(workers, workerCount, maxQueuedBatches);
+    pipeline.Run(
+        [&](FetchedRowBatch& batch)
+        {
+            if (cancellation.IsCancellationRequested())
+            {
+                return false;
+            }
+
+            const size_t requested = static_cast<size_t>((std::min)(static_cast<uint64_t>(controller.NextBatchSize()), maxRows - fetched));
+            if (requested == 0)
+            {
+                return false;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            const size_t rows = source.NextBatch(requested, batch);
+            controller.OnBatchFetched(rows, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+            batch.decision = controller.GetHistory().back();
+            fetched += rows;
+            return rows > 0;
+        },
+        [&](FetchedRowBatch& batch)
+        {
+            MaterializedBatch materialized;
+            source.DecodeBatch(batch);
+            materialized.fetched = std::move(batch);
+
+            ColumnarRowBatch const& rows = materialized.fetched.rows;
+            for (size_t row = 0; (row < rows.RowCount()) && !cancellation.IsCancellationRequested(); ++row)
+            {
+                materialize(rows, row, materialized.results);
+            }
+            return materialized;
+        },
+        [&](MaterializedBatch& materialized)
+        {
+            if (cancellation.IsCancellationRequested())
+            {
+                // Nobody is going to look at these anymore
+                return;
+            }
+            consume(static_cast<FetchedRowBatch const&>(materialized.fetched), materialized.results);
+        },
+        [&](FetchedRowBatch& batch)
+        {
+            // Fetched after a stage failed, the rows still have to go back to the provider
+            source.ReleaseBatch(batch);
+        });
+    return fetched;
+}
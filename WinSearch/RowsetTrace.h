@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ColumnarRowBatch.h"
+#include "RowFetchPipeline.h"
+
+// Platform neutral record and replay of what the indexer hands back, so fetch and result building work can be
+// measured the same way every time and without an indexer.
+//
+// A trace is a header (magic, version, wchar_t size) followed by records. Every record starts with its type and
+// the id of the query it belongs to, queries on different threads get recorded interleaved.
+//   query: the SQL and the names of the columns its batches have, in order
+//   batch: rows asked for, microseconds GetNextRows took, row count, then every value of every row as
+//          varint(length + 1) (0 for null) and its characters
+// Strings are varint(length) and their characters. Everything is in native byte order.
+constexpr uint32_t c_rowsetTraceMagic{ 0x54525357 }; // WSRT
+constexpr uint32_t c_rowsetTraceVersion{ 1 };
+
+struct RowsetTraceWriter
+{
+public:
+    // write(data, size) appends to wherever the trace goes and throws if it can't. Once it throws, recording stops.
+    using WriteFunction = std::function<void(const void*, size_t)>;
+
+    explicit RowsetTraceWriter(WriteFunction write) : m_write(std::move(write))
+    {
+        std::vector<uint8_t> header;
+        AppendFixed(header, c_rowsetTraceMagic);
+        AppendFixed(header, c_rowsetTraceVersion);
+        AppendFixed(header, static_cast<uint32_t>(sizeof(wchar_t)));
+        Write(header);
+    }
+
+    // The id to record the query's batches under
+    uint32_t RecordQuery(std::wstring_view sql, std::vector<std::wstring> const& columnNames)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const uint32_t queryId = m_nextQueryId++;
+
+        std::vector<uint8_t> record;
+        record.push_back(c_queryRecord);
+        AppendVarint(record, queryId);
+        AppendString(record, sql);
+        AppendVarint(record, columnNames.size());
+        for (auto const& name : columnNames)
+        {
+            AppendString(record, name);
+        }
+        WriteLocked(record);
+        return queryId;
+    }
+
+    void RecordBatch(uint32_t queryId, size_t requested, uint64_t elapsedMicroseconds, ColumnarRowBatch const& batch)
+    {
+        // Encoded outside of the lock, only the write is serialized
+        std::vector<uint8_t> record;
+        record.reserve(64 + (batch.RowCount() * batch.ColumnCount() * 32));
+        record.push_back(c_batchRecord);
+        AppendVarint(record, queryId);
+        AppendVarint(record, requested);
+        AppendVarint(record, elapsedMicroseconds);
+        AppendVarint(record, batch.RowCount());
+        for (size_t row = 0; row < batch.RowCount(); ++row)
+        {
+            for (size_t column = 0; column < batch.ColumnCount(); ++column)
+            {
+                if (batch.IsNull(row, column))
+                {
+                    AppendVarint(record, 0);
+                    continue;
+                }
+                const std::wstring_view value = batch.GetString(row, column);
+                AppendVarint(record, value.size() + 1);
+                AppendChars(record, value);
+            }
+        }
+        Write(record);
+    }
+
+    bool Failed()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_failed;
+    }
+
+    static constexpr uint8_t c_queryRecord{ 1 };
+    static constexpr uint8_t c_batchRecord{ 2 };
+
+private:
+    template <typename T>
+    static void AppendFixed(std::vector<uint8_t>& record, T value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        record.insert(record.end(), bytes, bytes + sizeof(value));
+    }
+
+    static void AppendVarint(std::vector<uint8_t>& record, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            record.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        record.push_back(static_cast<uint8_t>(value));
+    }
+
+    static void AppendChars(std::vector<uint8_t>& record, std::wstring_view value)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(value.data());
+        record.insert(record.end(), bytes, bytes + (value.size() * sizeof(wchar_t)));
+    }
+
+    static void AppendString(std::vector<uint8_t>& record, std::wstring_view value)
+    {
+        AppendVarint(record, value.size());
+        AppendChars(record, value);
+    }
+
+    void Write(std::vector<uint8_t> const& record)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        WriteLocked(record);
+    }
+
+    void WriteLocked(std::vector<uint8_t> const& record)
+    {
+        if (m_failed)
+        {
+            return;
+        }
+
+        try
+        {
+            m_write(record.data(), record.size());
+        }
+        catch (...)
+        {
+            // A trace with a hole in it is worse than one that stops early
+            m_failed = true;
+        }
+    }
+
+    std::mutex m_lock;
+    WriteFunction m_write;
+    uint32_t m_nextQueryId{};
+    bool m_failed{};
+};
+
+struct RecordedBatch
+{
+    size_t requested{};
+    uint64_t elapsedMicroseconds{};
+    ColumnarRowBatch rows;
+};
+
+struct RecordedQuery
+{
+    std::wstring sql;
+    std::vector<std::wstring> columns;
+    std::vector<RecordedBatch> batches;
+};
+
+// Everything recorded in a trace, queries in the order they started. Returns false if it isn't a trace we can
+// read, a trace that was cut short still hands back everything up to where it ends.
+inline bool ReadRowsetTrace(const uint8_t* data, size_t size, std::vector<RecordedQuery>& queries)
+{
+    queries.clear();
+    size_t pos = 0;
+
+    auto readFixed = [&](uint32_t& value)
+    {
+        if ((size - pos) < sizeof(value))
+        {
+            return false;
+        }
+        memcpy(&value, data + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    };
+
+    auto readVarint = [&](uint64_t& value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; (pos < size) && (shift < 64); shift += 7)
+        {
+            const uint8_t byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // length chars, into a buffer that stays around for the next value
+    std::wstring chars;
+    auto readChars = [&](uint64_t length)
+    {
+        if ((length > ((size - pos) / sizeof(wchar_t))))
+        {
+            return false;
+        }
+        chars.resize(static_cast<size_t>(length));
+        memcpy(&chars[0], data + pos, static_cast<size_t>(length) * sizeof(wchar_t));
+        pos += static_cast<size_t>(length) * sizeof(wchar_t);
+        return true;
+    };
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t charSize = 0;
+    if (!readFixed(magic) || !readFixed(version) || !readFixed(charSize) ||
+        (magic != c_rowsetTraceMagic) || (version != c_rowsetTraceVersion) || (charSize != sizeof(wchar_t)))
+    {
+        return false;
+    }
+
+    std::unordered_map<uint64_t, size_t> queryIndices;
+    while (pos < size)
+    {
+        const uint8_t type = data[pos++];
+        uint64_t queryId = 0;
+        if (!readVarint(queryId))
+        {
+            break;
+        }
+
+        if (type == RowsetTraceWriter::c_queryRecord)
+        {
+            RecordedQuery query;
+            uint64_t length = 0;
+            uint64_t columnCount = 0;
+            if (!readVarint(length) || !readChars(length) || !readVarint(columnCount))
+            {
+                break;
+            }
+            query.sql = chars;
+
+            bool complete = true;
+            for (uint64_t i = 0; complete && (i < columnCount); ++i)
+            {
+                complete = readVarint(length) && readChars(length);
+                if (complete)
+                {
+                    query.columns.push_back(chars);
+                }
+            }
+            if (!complete)
+            {
+                break;
+            }
+
+            queryIndices[queryId] = queries.size();
+            queries.push_back(std::move(query));
+        }
+        else if (type == RowsetTraceWriter::c_batchRecord)
+        {
+            auto found = queryIndices.find(queryId);
+            uint64_t requested = 0;
+            uint64_t elapsed = 0;
+            uint64_t rowCount = 0;
+            if ((found == queryIndices.end()) || !readVarint(requested) || !readVarint(elapsed) || !readVarint(rowCount))
+            {
+                break;
+            }
+
+            RecordedQuery& query = queries[found->second];
+            RecordedBatch batch;
+            batch.requested = static_cast<size_t>(requested);
+            batch.elapsedMicroseconds = elapsed;
+            batch.rows.Reset(query.columns.size(), static_cast<size_t>(rowCount), 0);
+
+            bool complete = true;
+            for (uint64_t row = 0; complete && (row < rowCount); ++row)
+            {
+                for (size_t column = 0; complete && (column < query.columns.size()); ++column)
+                {
+                    uint64_t length = 0;
+                    complete = readVarint(length) && ((length == 0) || readChars(length - 1));
+                    if (!complete)
+                    {
+                        break;
+                    }
+
+                    if (length == 0)
+                    {
+                        batch.rows.AppendNull(column);
+                    }
+                    else
+                    {
+                        batch.rows.AppendValue(column, chars.data(), chars.size());
+                    }
+                }
+                if (complete)
+                {
+                    batch.rows.CommitRow();
+                }
+            }
+            if (!complete)
+            {
+                break;
+            }
+            query.batches.push_back(std::move(batch));
+        }
+        else
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+// Hands back a recorded query's rows with its columns in the order asked for, columns that weren't recorded
+// come back null. Time is charged per row from the batch it was recorded in, so replaying with other batch
+// sizes still costs about what the indexer would have. speed 2 replays twice as fast as recorded, 0 doesn't
+// wait at all.
+struct ReplayRowBatchSource : public IRowBatchSource
+{
+public:
+    using SleepFunction = std::function<void(std::chrono::microseconds)>;
+
+    ReplayRowBatchSource(RecordedQuery const& query, std::vector<std::wstring> const& columns, double speed,
+        SleepFunction sleep = [](std::chrono::microseconds duration) { std::this_thread::sleep_for(duration); }) :
+        m_query(query), m_speed(speed), m_sleep(std::move(sleep))
+    {
+        for (auto const& column : (columns.empty() ? query.columns : columns))
+        {
+            auto found = std::find(query.columns.begin(), query.columns.end(), column);
+            m_columnMap.push_back((found != query.columns.end()) ? static_cast<size_t>(found - query.columns.begin()) : c_missingColumn);
+        }
+    }
+
+    size_t NextBatch(size_t maxRows, FetchedRowBatch& fetched) override
+    {
+        ColumnarRowBatch& batch = fetched.rows;
+        batch.Reset(m_columnMap.size(), maxRows, maxRows * c_expectedCharsPerRow);
+        double costMicroseconds = 0;
+        size_t rows = 0;
+        while ((rows < maxRows) && (m_batch < m_query.batches.size()))
+        {
+            RecordedBatch const& recorded = m_query.batches[m_batch];
+            if (m_row >= recorded.rows.RowCount())
+            {
+                m_batch++;
+                m_row = 0;
+                continue;
+            }
+
+            for (size_t column = 0; column < m_columnMap.size(); ++column)
+            {
+                const size_t source = m_columnMap[column];
+                if ((source == c_missingColumn) || recorded.rows.IsNull(m_row, source))
+                {
+                    batch.AppendNull(column);
+                    continue;
+                }
+                const std::wstring_view value = recorded.rows.GetString(m_row, source);
+                batch.AppendValue(column, value.data(), value.size());
+            }
+            batch.CommitRow();
+
+            costMicroseconds += static_cast<double>(recorded.elapsedMicroseconds) / static_cast<double>(recorded.rows.RowCount());
+            m_row++;
+            rows++;
+        }
+
+        if ((m_speed > 0) && (costMicroseconds > 0))
+        {
+            m_sleep(std::chrono::microseconds(static_cast<int64_t>(costMicroseconds / m_speed)));
+        }
+        return rows;
+    }
+
+private:
+    static constexpr size_t c_missingColumn{ static_cast<size_t>(-1) };
+    static constexpr size_t c_expectedCharsPerRow{ 256 };
+
+    RecordedQuery const& m_query;
+    const double m_speed;
+    SleepFunction m_sleep;
+    std::vector<size_t> m_columnMap;
+    size_t m_batch{};
+    size_t m_row{};
+};
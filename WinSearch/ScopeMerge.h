@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Platform neutral incremental k-way merge of result streams that each come in their own rank order, one
+// stream per scope of a fanned out query. An item is only handed out once every stream that is still open
+// has something queued to compare it against, so what we've handed out never has to be reordered. There's
+// a stream per scope and only a handful of scopes, the heads are compared with a linear scan.
+template <typename TItem, typename TLess>
+struct IncrementalMerge
+{
+public:
+    explicit IncrementalMerge(size_t sourceCount = 0, TLess less = TLess()) : m_less(std::move(less))
+    {
+        Reset(sourceCount);
+    }
+
+    void Reset(size_t sourceCount)
+    {
+        m_sources.clear();
+        m_sources.resize(sourceCount);
+    }
+
+    size_t SourceCount() const { return m_sources.size(); }
+
+    // Items from one source have to be pushed in that source's order
+    void Push(size_t source, TItem&& item)
+    {
+        m_sources[source].queue.push_back(std::move(item));
+        m_sources[source].pushed++;
+    }
+
+    // Nothing more is coming from source
+    void Finish(size_t source) { m_sources[source].finished = true; }
+
+    bool IsFinished(size_t source) const { return m_sources[source].finished; }
+    size_t Pending(size_t source) const { return m_sources[source].queue.size(); }
+    uint64_t Pushed(size_t source) const { return m_sources[source].pushed; }
+
+    bool HasPending() const
+    {
+        for (auto const& source : m_sources)
+        {
+            if (!source.queue.empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Items queued for source, in its order, that haven't been handed out yet
+    template <typename TCallback>
+    void ForEachPending(size_t source, TCallback&& callback) const
+    {
+        for (auto const& item : m_sources[source].queue)
+        {
+            callback(item);
+        }
+    }
+
+    // Hands everything that can't be preceded by an item still to come to emit(TItem&&), in merged order.
+    // Ties go to the lower source. Returns how many items were handed out.
+    template <typename TEmit>
+    size_t Drain(TEmit&& emit)
+    {
+        size_t emitted = 0;
+        while (true)
+        {
+            Source* next = nullptr;
+            for (auto& source : m_sources)
+            {
+                if (source.queue.empty())
+                {
+                    if (!source.finished)
+                    {
+                        // Whatever this one comes up with next could go first
+                        return emitted;
+                    }
+                    continue;
+                }
+
+                if ((next == nullptr) || m_less(source.queue.front(), next->queue.front()))
+                {
+                    next = &source;
+                }
+            }
+
+            if (next == nullptr)
+            {
+                return emitted;
+            }
+
+            emit(std::move(next->queue.front()));
+            next->queue.pop_front();
+            emitted++;
+        }
+    }
+
+private:
+    struct Source
+    {
+        std::deque<TItem> queue;
+        uint64_t pushed{};
+        bool finished{};
+    };
+
+    TLess m_less;
+    std::vector<Source> m_sources;
+};
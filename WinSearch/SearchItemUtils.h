@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cwctype>
+#include <string>
+#include <string_view>
+
+// Platform neutral string handling for search text and result urls, kept free of Windows types so it can be
+// built and measured anywhere.
+
+// The scheme of a url without its colon, empty for a plain path (a drive letter isn't a scheme)
+inline std::wstring_view GetUrlScheme(std::wstring_view url)
+{
+    for (size_t i = 0; i < url.size(); ++i)
+    {
+        if (url[i] == L':')
+        {
+            return (i >= 2) ? url.substr(0, i) : std::wstring_view();
+        }
+        if ((url[i] == L'/') || (url[i] == L'\\'))
+        {
+            break;
+        }
+    }
+    return {};
+}
+
+// Mail items come back with a mapi: or mapi16: url
+inline bool IsMailUrl(std::wstring_view url)
+{
+    const std::wstring_view scheme = GetUrlScheme(url);
+    return (scheme == L"mapi") || (scheme == L"mapi16");
+}
+
+// Turns a file: url into a file path in place, returns false and leaves mail urls alone. Slashes are flipped
+// whether or not there was a file: to strip.
+inline bool UrlToFilePath(std::wstring& url)
+{
+    if (IsMailUrl(url))
+    {
+        return false;
+    }
+
+    std::replace(url.begin(), url.end(), L'/', L'\\');
+
+    constexpr std::wstring_view fileProtocol(L"file:");
+    const size_t indexProtocolFound = url.find(fileProtocol);
+    if ((indexProtocolFound != std::wstring::npos) && ((indexProtocolFound + fileProtocol.size()) < url.size()))
+    {
+        url.erase(0, indexProtocolFound + fileProtocol.size());
+        return true;
+    }
+    return false;
+}
+
+// The url UrlToFilePath got path from, put back together. Only a url IsUrlOfFilePath agrees with comes back the
+// same, anything else has to be kept as it was.
+inline void FilePathToUrl(std::wstring_view path, std::wstring& url)
+{
+    constexpr std::wstring_view fileProtocol(L"file:");
+    url.assign(fileProtocol);
+    url.append(path);
+    std::replace(url.begin() + fileProtocol.size(), url.end(), L'\\', L'/');
+}
+
+// True if FilePathToUrl(path) gives back url, without building it
+inline bool IsUrlOfFilePath(std::wstring_view url, std::wstring_view path)
+{
+    constexpr std::wstring_view fileProtocol(L"file:");
+    if ((url.size() != (fileProtocol.size() + path.size())) || (url.substr(0, fileProtocol.size()) != fileProtocol))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < path.size(); ++i)
+    {
+        if (url[fileProtocol.size() + i] != ((path[i] == L'\\') ? L'/' : path[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Extension including the dot, empty if the file name doesn't have one. Dots in folder names don't count.
+inline std::wstring_view GetExtension(std::wstring_view path)
+{
+    for (size_t i = path.size(); i > 0; --i)
+    {
+        const wchar_t c = path[i - 1];
+        if (c == L'.')
+        {
+            return path.substr(i - 1);
+        }
+        if ((c == L'\\') || (c == L'/'))
+        {
+            break;
+        }
+    }
+    return {};
+}
+
+// True if current is a case insensitive prefix of next, a query for next can then narrow down current's
+// results instead of starting over. Nothing is a prefix of an empty text.
+inline bool IsSearchTextPrefix(std::wstring_view current, std::wstring_view next)
+{
+    if (next.empty() || (current.size() > next.size()))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < current.size(); ++i)
+    {
+        if (std::towlower(current[i]) != std::towlower(next[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
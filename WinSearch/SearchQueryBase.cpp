@@ -1,137 +1,734 @@
-#include "pch.h"
-#include "SearchQueryHelper.h"
-#include <intsafe.h>
-#include <NTQuery.h>
-#include <propkey.h>
-#include <SearchResult.h>
-#include "Logging.h"
-
-using namespace winrt::Windows::Foundation::Collections;
-
-void SearchQueryBase::FetchRows(_Out_ ULONGLONG* totalFetched)
-{
-    ULONGLONG fetched = 0;
-    *totalFetched = 0;
-
-    winrt::com_ptr<IGetRow> getRow = m_rowset.as<IGetRow>();
-
-    DBCOUNTITEM rowCountReturned;
-
-    do
-    {
-        HROW rowBuffer[5000] = {}; // Request enough large batch to increase efficiency
-        HROW* rowReturned = rowBuffer;
-
-        THROW_IF_FAILED(m_rowset->GetNextRows(DB_NULL_HCHAPTER, 0, ARRAYSIZE(rowBuffer), &rowCountReturned, &rowReturned));
-        THROW_IF_FAILED(ULongLongAdd(fetched, rowCountReturned, &fetched));
-
-        for (unsigned int i = 0; (i < rowCountReturned); i++)
-        {
-            winrt::com_ptr<IUnknown> unknown;
-            THROW_IF_FAILED(getRow->GetRowFromHROW(nullptr, rowBuffer[i], IID_IPropertyStore, unknown.put()));
-            winrt::com_ptr<IPropertyStore> propStore = unknown.as<IPropertyStore>();
-
-            m_numResults++;
-            OnFetchRowCallback(propStore.get());
-        }
-
-        THROW_IF_FAILED(m_rowset->ReleaseRows(rowCountReturned, rowReturned, nullptr, nullptr, nullptr));
-    } while (rowCountReturned > 0);
-
-    *totalFetched = fetched;
-}
-
-DWORD SearchQueryBase::GetReuseWhereId(IRowset* rowset)
-{
-    winrt::com_ptr<IRowsetInfo> rowsetInfo;
-    THROW_IF_FAILED(rowset->QueryInterface(IID_PPV_ARGS(rowsetInfo.put())));
-
-    DBPROPIDSET propset;
-    DBPROPSET* prgPropSets;
-    DBPROPID whereid = MSIDXSPROP_WHEREID;
-    propset.rgPropertyIDs = &whereid;
-    propset.cPropertyIDs = 1;
-
-    propset.guidPropertySet = DBPROPSET_MSIDXS_ROWSETEXT;
-    ULONG cPropertySets;
-
-    THROW_IF_FAILED(rowsetInfo->GetProperties(1, &propset, &cPropertySets, &prgPropSets));
-
-    wil::unique_cotaskmem_ptr<DBPROP> sprgProps(prgPropSets->rgProperties);
-    wil::unique_cotaskmem_ptr<DBPROPSET> sprgPropSets(prgPropSets);
-
-    return prgPropSets->rgProperties->vValue.ulVal;
-}
-
-void SearchQueryBase::PrimeIndexAndCacheWhereId()
-{
-    // We need to generate a search query string with the search text the user entered above
-    std::wstring queryStr = GetPrimingQueryString();
-
-    winrt::com_ptr<ICommandText> cmdTxt;
-    GetCommandText(cmdTxt);
-    THROW_IF_FAILED(cmdTxt->SetCommandText(DBGUID_DEFAULT, queryStr.c_str()));
-
-    DBROWCOUNT rowCount = 0;
-    winrt::com_ptr<IUnknown> unkRowsetPtr;
-    THROW_IF_FAILED(cmdTxt->Execute(nullptr, IID_IRowset, nullptr, &rowCount, unkRowsetPtr.put()));
-
-    m_reuseRowset = unkRowsetPtr.as<IRowset>();
-
-    m_reuseWhereID = GetReuseWhereId(m_reuseRowset.get());
-}
-
-void SearchQueryBase::ExecuteQueryStringSync(PCWSTR queryStr)
-{
-    try
-    {
-        auto lock = m_cs.lock();
-
-        // We need to generate a search query string with the search text the user entered above
-        if (m_rowset != nullptr)
-        {
-            // We have a previous rowset, this means the user is typing and we should store this
-            // recapture the where ID from this so the next ExecuteSync call will be faster
-            m_reuseRowset = m_rowset;
-            m_reuseWhereID = GetReuseWhereId(m_reuseRowset.get());
-        }
-
-        m_rowset = nullptr;
-
-        winrt::com_ptr<ICommandText> cmdTxt;
-        GetCommandText(cmdTxt);
-        THROW_IF_FAILED(cmdTxt->SetCommandText(DBGUID_DEFAULT, queryStr));
-
-        DBROWCOUNT rowCount = 0;
-        winrt::com_ptr<IUnknown> unkRowsetPtr;
-        THROW_IF_FAILED(cmdTxt->Execute(nullptr, IID_IRowset, nullptr, &rowCount, unkRowsetPtr.put()));
-
-        m_rowset = unkRowsetPtr.as<IRowset>();
-
-        OnPreFetchRows();
-
-        ULONGLONG rowsFetched = 0;
-        FetchRows(&rowsFetched);
-    }
-    CATCH_LOG();
-
-    OnPostFetchRows();
-}
-
-void SearchQueryBase::GetCommandText(winrt::com_ptr<ICommandText>& cmdText)
-{
-    // Query CommandText
-    winrt::com_ptr<IDBInitialize> dataSource;
-    THROW_IF_FAILED(CoCreateInstance(CLSID_CollatorDataSource, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(dataSource.put())));
-    THROW_IF_FAILED(dataSource->Initialize());
-
-    winrt::com_ptr<IDBCreateSession> session = dataSource.as<IDBCreateSession>();
-    winrt::com_ptr<IUnknown> unkSessionPtr;
-    THROW_IF_FAILED(session->CreateSession(0, IID_IDBCreateCommand, unkSessionPtr.put()));
-
-    winrt::com_ptr<IDBCreateCommand> createCommand = unkSessionPtr.as<IDBCreateCommand>();
-    winrt::com_ptr<IUnknown> unkCmdPtr;
-    THROW_IF_FAILED(createCommand->CreateCommand(0, IID_ICommandText, unkCmdPtr.put()));
-
-    cmdText = unkCmdPtr.as<ICommandText>();
-}
\ No newline at end of file
+#include "pch.h"
+#include "SearchQueryHelper.h"
+#include <intsafe.h>
+#include <NTQuery.h>
+#include <propkey.h>
+#include <SearchResult.h>
+#include "Logging.h"
+
+using namespace winrt::Windows::Foundation::Collections;
+
+static uint64_t ElapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Set WINSEARCH_RECORD_ROWSETS to have every pipelined fetch written to RowsetTrace.bin in the app's local folder,
+// so it can be replayed through ReplayRowBatchSource without an indexer. nullptr when we aren't recording.
+static RowsetTraceWriter* GetRowsetTraceWriter()
+{
+    static std::unique_ptr<RowsetTraceWriter> s_writer = []() -> std::unique_ptr<RowsetTraceWriter>
+    {
+        try
+        {
+            if (GetEnvironmentVariableW(L"WINSEARCH_RECORD_ROWSETS", nullptr, 0) == 0)
+            {
+                return nullptr;
+            }
+
+            std::wstring path(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+            path += L"\\RowsetTrace.bin";
+            auto file = std::make_shared<wil::unique_hfile>(CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+            THROW_LAST_ERROR_IF(!*file);
+
+            _tracelog(L"\nRecording rowsets to %s", path.c_str());
+            return std::make_unique<RowsetTraceWriter>([file](const void* data, size_t bytes)
+                {
+                    DWORD written = 0;
+                    THROW_IF_WIN32_BOOL_FALSE(WriteFile(file->get(), data, static_cast<DWORD>(bytes), &written, nullptr));
+                });
+        }
+        CATCH_LOG();
+        return nullptr;
+    }();
+    return s_writer.get();
+}
+
+// The pipeline keeps rows as RowHandles, which are HROWs by another name
+static_assert(sizeof(RowHandle) == sizeof(HROW), "a RowHandle has to hold an HROW");
+
+static HROW* AsHROWs(std::vector<RowHandle>& rows)
+{
+    return reinterpret_cast<HROW*>(rows.data());
+}
+
+std::vector<RowHandle> SearchQueryBase::TakeRowBuffer()
+{
+    {
+        auto lock = m_rowBufferPoolLock.lock_exclusive();
+        if (!m_rowBufferPool.empty())
+        {
+            std::vector<RowHandle> buffer = std::move(m_rowBufferPool.back());
+            m_rowBufferPool.pop_back();
+            return buffer;
+        }
+    }
+
+    std::vector<RowHandle> buffer;
+    buffer.reserve(m_batchSizeController.MaxBatchSize());
+    return buffer;
+}
+
+void SearchQueryBase::RecycleRowBuffer(std::vector<RowHandle>&& buffer)
+{
+    auto lock = m_rowBufferPoolLock.lock_exclusive();
+    m_rowBufferPool.push_back(std::move(buffer));
+}
+
+void SearchQueryBase::ReleaseRowBatch(std::vector<RowHandle>&& rows)
+{
+    {
+        auto lock = m_rowsetCallLock.lock();
+        m_rowset->ReleaseRows(rows.size(), AsHROWs(rows), nullptr, nullptr, nullptr);
+    }
+    RecycleRowBuffer(std::move(rows));
+}
+
+DBCOUNTITEM SearchQueryBase::FetchNextRowBatch(std::vector<RowHandle>& rows, ULONGLONG* fetched, ULONGLONG maxRows)
+{
+    // Let the controller decide how much to ask for, small first so the first page comes back quickly
+    const ULONGLONG remaining = maxRows - *fetched;
+    rows.resize(static_cast<size_t>((std::min)(static_cast<ULONGLONG>(m_batchSizeController.NextBatchSize()), remaining)));
+    if (rows.empty())
+    {
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const DBCOUNTITEM rowCountReturned = GetNextRowBatch(rows);
+    m_batchSizeController.OnBatchFetched(rowCountReturned, ElapsedMicroseconds(start));
+    THROW_IF_FAILED(ULongLongAdd(*fetched, rowCountReturned, fetched));
+    return rowCountReturned;
+}
+
+// GetNextRows for as many rows as there's room for, rows is cut down to the ones that came back
+DBCOUNTITEM SearchQueryBase::GetNextRowBatch(std::vector<RowHandle>& rows)
+{
+    HROW* rowReturned = AsHROWs(rows);
+    DBCOUNTITEM rowCountReturned = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        auto lock = m_rowsetCallLock.lock();
+        THROW_IF_FAILED(m_rowset->GetNextRows(DB_NULL_HCHAPTER, 0, static_cast<DBROWCOUNT>(rows.size()), &rowCountReturned, &rowReturned));
+    }
+    GetQueryLatency().RecordSpan(m_latencyCookie, (m_rowsFetched == 0) ? QueryStage::FirstRows : QueryStage::NextRows,
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(start.time_since_epoch()).count()), ElapsedMicroseconds(start),
+        rows.size(), rowCountReturned);
+
+    m_rowsFetched += rowCountReturned;
+    if (rowCountReturned < rows.size())
+    {
+        m_rowsetExhausted = true;
+    }
+    rows.resize(rowCountReturned);
+    return rowCountReturned;
+}
+
+void SearchQueryBase::LogBatchSizeDecisions(ULONGLONG fetched)
+{
+    auto const& history = m_batchSizeController.GetHistory();
+    if (history.empty())
+    {
+        return;
+    }
+
+    _tracelog(L"\nFetchRows: %d rows in %d batches, first batch %d/%d rows in %d us, settled batch size %d",
+        static_cast<DWORD>(fetched),
+        static_cast<DWORD>(history.size()),
+        static_cast<DWORD>(history.front().returned),
+        static_cast<DWORD>(history.front().requested),
+        static_cast<DWORD>(history.front().elapsedMicroseconds),
+        static_cast<DWORD>(m_batchSizeController.NextBatchSize()));
+}
+
+bool SearchQueryBase::BindRowsetColumns()
+{
+    std::vector<BoundColumn> columns = GetBoundColumns();
+    if (columns.empty())
+    {
+        return false;
+    }
+
+    if ((m_boundRowset == m_rowset) && (m_rowAccessor != nullptr))
+    {
+        // Already bound for this rowset, paging fetches reuse the accessor
+        return true;
+    }
+    ReleaseRowsetAccessor();
+
+    winrt::com_ptr<IColumnsInfo> columnsInfo = m_rowset.try_as<IColumnsInfo>();
+    winrt::com_ptr<IAccessor> accessor = m_rowset.try_as<IAccessor>();
+    if ((columnsInfo == nullptr) || (accessor == nullptr))
+    {
+        return false;
+    }
+
+    DBORDINAL columnCount = 0;
+    DBCOLUMNINFO* columnInfo = nullptr;
+    OLECHAR* columnNames = nullptr;
+    if (FAILED(columnsInfo->GetColumnInfo(&columnCount, &columnInfo, &columnNames)))
+    {
+        return false;
+    }
+    wil::unique_cotaskmem_ptr<DBCOLUMNINFO> columnInfoCleanup(columnInfo);
+    wil::unique_cotaskmem_ptr<OLECHAR> columnNamesCleanup(columnNames);
+
+    // Every value gets its status, its length and an inline buffer in one row sized buffer
+    std::vector<DBBINDING> bindings(columns.size());
+    std::vector<BoundColumnLayout> layouts(columns.size());
+    DBBYTEOFFSET offset = 0;
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        DBORDINAL ordinal = 0;
+        for (DBORDINAL j = 0; j < columnCount; ++j)
+        {
+            if ((columnInfo[j].pwszName != nullptr) && (_wcsicmp(columnInfo[j].pwszName, columns[i].name) == 0))
+            {
+                ordinal = columnInfo[j].iOrdinal;
+                break;
+            }
+        }
+
+        if (ordinal == 0)
+        {
+            _tracelog(L"\nColumn %s not found in rowset, decoding through property stores.", columns[i].name);
+            return false;
+        }
+
+        layouts[i].statusOffset = offset;
+        layouts[i].lengthOffset = layouts[i].statusOffset + sizeof(DBSTATUS) + sizeof(DWORD); // keep the length 8 byte aligned
+        layouts[i].valueOffset = layouts[i].lengthOffset + sizeof(DBLENGTH);
+        layouts[i].maxChars = columns[i].maxChars;
+        offset = layouts[i].valueOffset + (((columns[i].maxChars + 1) * sizeof(wchar_t) + 7) & ~static_cast<DBBYTEOFFSET>(7));
+
+        bindings[i].iOrdinal = ordinal;
+        bindings[i].obStatus = layouts[i].statusOffset;
+        bindings[i].obLength = layouts[i].lengthOffset;
+        bindings[i].obValue = layouts[i].valueOffset;
+        bindings[i].dwPart = DBPART_VALUE | DBPART_LENGTH | DBPART_STATUS;
+        bindings[i].dwMemOwner = DBMEMOWNER_CLIENTOWNED;
+        bindings[i].eParamIO = DBPARAMIO_NOTPARAM;
+        bindings[i].cbMaxLen = (columns[i].maxChars + 1) * sizeof(wchar_t);
+        bindings[i].wType = DBTYPE_WSTR;
+    }
+
+    HACCESSOR accessorHandle{};
+    if (FAILED(accessor->CreateAccessor(DBACCESSOR_ROWDATA, bindings.size(), bindings.data(), offset, &accessorHandle, nullptr)))
+    {
+        return false;
+    }
+
+    m_boundRowset = m_rowset;
+    m_rowAccessor = accessor;
+    m_rowAccessorHandle = accessorHandle;
+    m_boundColumnLayouts.swap(layouts);
+    m_boundRowSize = offset;
+    return true;
+}
+
+void SearchQueryBase::ReleaseRowsetAccessor()
+{
+    if (m_rowAccessor != nullptr)
+    {
+        m_rowAccessor->ReleaseAccessor(m_rowAccessorHandle, nullptr);
+    }
+    m_rowAccessor = nullptr;
+    m_rowAccessorHandle = {};
+    m_boundRowset = nullptr;
+    m_boundColumnLayouts.clear();
+    m_boundRowSize = 0;
+}
+
+void SearchQueryBase::DecodeRowBatch(std::vector<RowHandle> const& rows, ColumnarRowBatch& batch)
+{
+    // One GetData per row into a reused buffer, then the values are copied into the batch arena. No property
+    // store objects, no PROPVARIANTs and no per value allocations.
+    batch.Reset(m_boundColumnLayouts.size(), rows.size(), rows.size() * c_expectedCharsPerRow);
+    std::vector<BYTE> rowData(m_boundRowSize);
+
+    for (RowHandle row : rows)
+    {
+        THROW_IF_FAILED(m_rowset->GetData(static_cast<HROW>(row), m_rowAccessorHandle, rowData.data()));
+
+        for (size_t i = 0; i < m_boundColumnLayouts.size(); ++i)
+        {
+            BoundColumnLayout const& layout = m_boundColumnLayouts[i];
+            DBSTATUS status = *reinterpret_cast<DBSTATUS*>(rowData.data() + layout.statusOffset);
+            if ((status == DBSTATUS_S_OK) || (status == DBSTATUS_S_TRUNCATED))
+            {
+                DBLENGTH length = *reinterpret_cast<DBLENGTH*>(rowData.data() + layout.lengthOffset);
+                size_t chars = (std::min)(static_cast<size_t>(length / sizeof(wchar_t)), layout.maxChars);
+                batch.AppendValue(i, reinterpret_cast<const wchar_t*>(rowData.data() + layout.valueOffset), chars);
+            }
+            else
+            {
+                batch.AppendNull(i);
+            }
+        }
+        batch.CommitRow();
+    }
+}
+
+void SearchQueryBase::FetchRows(_Out_ ULONGLONG* totalFetched, ULONGLONG maxRows)
+{
+    if (CanMaterializeRowsConcurrently() && BindRowsetColumns())
+    {
+        FetchRowsPipelined(totalFetched, maxRows);
+        return;
+    }
+
+    ULONGLONG fetched = 0;
+    *totalFetched = 0;
+
+    winrt::com_ptr<IGetRow> getRow = m_rowset.as<IGetRow>();
+    m_batchSizeController.Reset();
+
+    std::vector<RowHandle> rowBuffer = TakeRowBuffer();
+    auto recycleBuffer = wil::scope_exit([&]() { RecycleRowBuffer(std::move(rowBuffer)); });
+
+    DBCOUNTITEM rowCountReturned;
+
+    do
+    {
+        rowCountReturned = FetchNextRowBatch(rowBuffer, &fetched, maxRows);
+
+        for (unsigned int i = 0; (i < rowCountReturned) && !m_fetchCancellation.IsCancellationRequested(); i++)
+        {
+            winrt::com_ptr<IUnknown> unknown;
+            THROW_IF_FAILED(getRow->GetRowFromHROW(nullptr, rowBuffer[i], IID_IPropertyStore, unknown.put()));
+            winrt::com_ptr<IPropertyStore> propStore = unknown.as<IPropertyStore>();
+
+            m_numResults++;
+            OnFetchRowCallback(propStore.get());
+        }
+
+        THROW_IF_FAILED(m_rowset->ReleaseRows(rowCountReturned, AsHROWs(rowBuffer), nullptr, nullptr, nullptr));
+
+        OnPostFetchRowBatch();
+    } while ((rowCountReturned > 0) && !m_fetchCancellation.IsCancellationRequested());
+
+    LogBatchSizeDecisions(fetched);
+    *totalFetched = fetched;
+}
+
+// The pipeline's workers, kept for every fetch after the first. They join the MTA once when they start, and the
+// ones for background queries stay in background mode.
+static BatchWorkerPool& GetRowFetchWorkers(bool background)
+{
+    static BatchWorkerPool s_workers(
+        []() { winrt::init_apartment(winrt::apartment_type::multi_threaded); },
+        []() { winrt::uninit_apartment(); });
+    static BatchWorkerPool s_backgroundWorkers(
+        []()
+        {
+            winrt::init_apartment(winrt::apartment_type::multi_threaded);
+            SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+        },
+        []()
+        {
+            SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+            winrt::uninit_apartment();
+        });
+    return background ? s_backgroundWorkers : s_workers;
+}
+
+// The rowset as a source for the pipelined fetch. GetNextRows runs on the fetching thread while the workers call
+// GetData and ReleaseRows, and nothing says the rowset can take calls from several threads at once, so they take
+// turns on m_rowsetCallLock. What runs alongside the indexer is building the results, and that doesn't touch the
+// rowset.
+struct SearchQueryBase::RowsetBatchSource : public IRowBatchSource
+{
+public:
+    explicit RowsetBatchSource(SearchQueryBase& query) : m_query(query) {}
+
+    size_t NextBatch(size_t maxRows, FetchedRowBatch& batch) override
+    {
+        batch.handles = m_query.TakeRowBuffer();
+        batch.handles.resize(maxRows);
+        const size_t rows = static_cast<size_t>(m_query.GetNextRowBatch(batch.handles));
+        if (rows == 0)
+        {
+            m_query.RecycleRowBuffer(std::move(batch.handles));
+        }
+        return rows;
+    }
+
+    void DecodeBatch(FetchedRowBatch& batch) override
+    {
+        // We have our own copy of the values once they're decoded, the provider can have its rows back
+        auto rowsetLock = m_query.m_rowsetCallLock.lock();
+        auto releaseRows = wil::scope_exit([&]() { m_query.ReleaseRowBatch(std::move(batch.handles)); });
+        m_query.DecodeRowBatch(batch.handles, batch.rows);
+    }
+
+    void ReleaseBatch(FetchedRowBatch& batch) override
+    {
+        m_query.ReleaseRowBatch(std::move(batch.handles));
+    }
+
+private:
+    SearchQueryBase& m_query;
+};
+
+void SearchQueryBase::FetchRowsPipelined(_Out_ ULONGLONG* totalFetched, ULONGLONG maxRows)
+{
+    *totalFetched = 0;
+
+    RowsetTraceWriter* traceWriter = GetRowsetTraceWriter();
+    if ((traceWriter != nullptr) && (m_tracedRowset != m_rowset.get()))
+    {
+        // Paging fetches from the same rowset keep adding batches to the query they started under
+        std::vector<std::wstring> columnNames;
+        for (auto const& column : GetBoundColumns())
+        {
+            columnNames.emplace_back(column.name);
+        }
+        m_traceQueryId = traceWriter->RecordQuery(m_queryText, columnNames);
+        m_tracedRowset = m_rowset.get();
+    }
+
+    // While the workers turn one batch into results, this thread is already asking the indexer for the next one
+    RowsetBatchSource source(*this);
+    const size_t workerCount = std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, c_maxMaterializeWorkers);
+    const ULONGLONG fetched = ::FetchRowsPipelined<ResultStore>(source, GetRowFetchWorkers(IsBackgroundQuery()), workerCount,
+        c_maxQueuedRowBatches, m_batchSizeController, maxRows,
+        [&](ColumnarRowBatch const& rows, size_t row, ResultStore& results)
+        {
+            if (row == 0)
+            {
+                results.Reserve(rows.RowCount(), rows.RowCount() * c_expectedCharsPerRow);
+            }
+            MaterializeRow(rows, row, results);
+        },
+        [&](FetchedRowBatch const& batch, ResultStore const& results)
+        {
+            if (traceWriter != nullptr)
+            {
+                traceWriter->RecordBatch(m_traceQueryId, batch.decision.requested, batch.decision.elapsedMicroseconds, batch.rows);
+            }
+
+            OnRowBatchDecoded(batch.rows);
+            m_numResults += static_cast<DWORD>(batch.rows.RowCount());
+            for (size_t i = 0; i < results.Size(); ++i)
+            {
+                OnRowMaterialized(results, i);
+            }
+            OnPostFetchRowBatch();
+        },
+        m_fetchCancellation);
+
+    LogBatchSizeDecisions(fetched);
+    *totalFetched = fetched;
+}
+
+DWORD SearchQueryBase::GetReuseWhereId(IRowset* rowset)
+{
+    winrt::com_ptr<IRowsetInfo> rowsetInfo;
+    THROW_IF_FAILED(rowset->QueryInterface(IID_PPV_ARGS(rowsetInfo.put())));
+
+    DBPROPIDSET propset;
+    DBPROPSET* prgPropSets;
+    DBPROPID whereid = MSIDXSPROP_WHEREID;
+    propset.rgPropertyIDs = &whereid;
+    propset.cPropertyIDs = 1;
+
+    propset.guidPropertySet = DBPROPSET_MSIDXS_ROWSETEXT;
+    ULONG cPropertySets;
+
+    THROW_IF_FAILED(rowsetInfo->GetProperties(1, &propset, &cPropertySets, &prgPropSets));
+
+    wil::unique_cotaskmem_ptr<DBPROP> sprgProps(prgPropSets->rgProperties);
+    wil::unique_cotaskmem_ptr<DBPROPSET> sprgPropSets(prgPropSets);
+
+    return prgPropSets->rgProperties->vValue.ulVal;
+}
+
+void SearchQueryBase::PrimeIndexAndCacheWhereId(uint32_t reuseOptions, CancellationToken const& cancellation)
+{
+    // Another helper may have already primed with these options
+    uint32_t whereId = 0;
+    winrt::com_ptr<IRowset> reuseRowset;
+    if (GetReuseWhereCache().Lookup(L"", reuseOptions, &whereId, &reuseRowset))
+    {
+        m_reuseRowset = reuseRowset;
+        m_reuseWhereID = whereId;
+        return;
+    }
+
+    // We need to generate a search query string with the search text the user entered above
+    std::wstring queryStr = GetPrimingQueryString();
+
+    winrt::com_ptr<ICommandText> cmdTxt;
+    GetCommandText(cmdTxt);
+    THROW_IF_FAILED(cmdTxt->SetCommandText(DBGUID_DEFAULT, queryStr.c_str()));
+
+    // Priming can take as long as a query, a superseded one aborts it like it aborts the query
+    CancellationRegistration abortCommand(cancellation, [&cmdTxt]()
+        {
+            cmdTxt->Cancel();
+        });
+
+    DBROWCOUNT rowCount = 0;
+    winrt::com_ptr<IUnknown> unkRowsetPtr;
+    HRESULT hr = cmdTxt->Execute(nullptr, IID_IRowset, nullptr, &rowCount, unkRowsetPtr.put());
+    if (FAILED(hr) && cancellation.IsCancellationRequested())
+    {
+        THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+    }
+    THROW_IF_FAILED(hr);
+
+    m_reuseRowset = unkRowsetPtr.as<IRowset>();
+
+    m_reuseWhereID = GetReuseWhereId(m_reuseRowset.get());
+    GetReuseWhereCache().Insert(L"", reuseOptions, m_reuseWhereID, m_reuseRowset, c_reuseRowsetCostBytes);
+}
+
+DWORD SearchQueryBase::AcquireReuseWhereId(PCWSTR searchText, uint32_t reuseOptions)
+{
+    // Narrowest restriction anyone has evaluated for a prefix of this text, otherwise the one we primed with
+    uint32_t whereId = 0;
+    winrt::com_ptr<IRowset> reuseRowset;
+    if (GetReuseWhereCache().Lookup(searchText, reuseOptions, &whereId, &reuseRowset))
+    {
+        // Hold on to the rowset so the where id stays valid while our query runs, even if it gets evicted
+        auto lock = m_cs.lock();
+        m_reuseRowset = reuseRowset;
+        m_reuseWhereID = whereId;
+    }
+    return m_reuseWhereID;
+}
+
+void SearchQueryBase::CacheReuseWhereId(PCWSTR searchText, uint32_t reuseOptions)
+{
+    try
+    {
+        auto lock = m_cs.lock();
+        if (m_rowset == nullptr)
+        {
+            // Failed or canceled before the provider evaluated the query, nothing to reuse
+            return;
+        }
+
+        GetReuseWhereCache().Insert(searchText, reuseOptions, GetReuseWhereId(m_rowset.get()), m_rowset, c_reuseRowsetCostBytes);
+
+        ReuseWhereCacheStats stats = GetReuseWhereCache().GetStats();
+        _tracelog(L"\nReuseWhere cache: %d hits (%d exact), %d misses, %d evictions, %d entries, %d bytes",
+            static_cast<DWORD>(stats.hits), static_cast<DWORD>(stats.exactHits), static_cast<DWORD>(stats.misses),
+            static_cast<DWORD>(stats.evictions), static_cast<DWORD>(stats.entries), static_cast<DWORD>(stats.bytes));
+    }
+    CATCH_LOG();
+}
+
+void SearchQueryBase::ExecuteQueryStringSync(PCWSTR queryStr, CancellationToken const& cancellation, DWORD cookie)
+{
+    // Held through OnPostFetchRows so paging requests for this rowset can't sneak in before we're done with it
+    QueryLatencySpan lockWait(GetQueryLatency(), cookie, QueryStage::LockWait);
+    auto lock = m_cs.lock();
+    lockWait.Stop();
+    m_fetchCancellation = cancellation;
+    m_latencyCookie = cookie;
+
+    try
+    {
+        // The previous rowset's where id was put in the reuse cache when its query finished, the restriction
+        // the caller built this query with comes from there. It goes even if we're canceled, so nothing pages
+        // or caches a where id off of the previous query's rowset as if it were this one's.
+        ReleaseRowsetAccessor();
+        m_rowset = nullptr;
+        m_tracedRowset = nullptr;
+        m_rowsFetched = 0;
+        m_rowsetExhausted = false;
+
+        if (cancellation.IsCancellationRequested())
+        {
+            // Superseded while we were waiting for the previous query to get out of the way
+            THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+        }
+
+        winrt::com_ptr<ICommandText> cmdTxt;
+        GetCommandText(cmdTxt);
+        THROW_IF_FAILED(cmdTxt->SetCommandText(DBGUID_DEFAULT, queryStr));
+        if (GetRowsetTraceWriter() != nullptr)
+        {
+            m_queryText = queryStr;
+        }
+
+        // If we get superseded while the provider is still evaluating the query, abort it there
+        CancellationRegistration abortCommand(cancellation, [&cmdTxt]()
+            {
+                cmdTxt->Cancel();
+            });
+
+        DBROWCOUNT rowCount = 0;
+        winrt::com_ptr<IUnknown> unkRowsetPtr;
+        QueryLatencySpan execute(GetQueryLatency(), cookie, QueryStage::Execute);
+        HRESULT hr = cmdTxt->Execute(nullptr, IID_IRowset, nullptr, &rowCount, unkRowsetPtr.put());
+        execute.Stop();
+        if (FAILED(hr) && cancellation.IsCancellationRequested())
+        {
+            THROW_HR(HRESULT_FROM_WIN32(ERROR_CANCELLED));
+        }
+        THROW_IF_FAILED(hr);
+
+        m_rowset = unkRowsetPtr.as<IRowset>();
+
+        OnPreFetchRows();
+
+        ULONGLONG rowsFetched = 0;
+        FetchRows(&rowsFetched, GetInitialFetchLimit());
+    }
+    catch (...)
+    {
+        if (!cancellation.IsCancellationRequested())
+        {
+            LOG_CAUGHT_EXCEPTION();
+        }
+    }
+
+    if (cancellation.IsCancellationRequested())
+    {
+        _tracelog(L"\nQuery canceled, lock released %d us after cancellation", static_cast<DWORD>(cancellation.MicrosecondsSinceCancellation()));
+    }
+
+    OnPostFetchRows();
+}
+
+// True if the calling thread is in the MTA, whether it joined it or is in it implicitly
+static bool IsInMultithreadedApartment()
+{
+    APTTYPE type;
+    APTTYPEQUALIFIER qualifier;
+    return SUCCEEDED(CoGetApartmentType(&type, &qualifier)) && (type == APTTYPE_MTA);
+}
+
+void SearchQueryBase::GetCommandText(winrt::com_ptr<ICommandText>& cmdText)
+{
+    // The pool's sessions are all created in the MTA, and anything created there can be called from any other MTA
+    // thread without marshaling. So they only get handed to MTA threads, anyone else pays for a session of its own.
+    if (!IsInMultithreadedApartment())
+    {
+        winrt::com_ptr<IUnknown> unkCmdPtr;
+        THROW_IF_FAILED(CollatorSessionProvider().CreateSession()->CreateCommand(0, IID_ICommandText, unkCmdPtr.put()));
+        cmdText = unkCmdPtr.as<ICommandText>();
+        return;
+    }
+
+    // Query CommandText, sessions come out of the pool already initialized
+    auto session = GetCollatorSessionPool().Acquire();
+
+    winrt::com_ptr<IUnknown> unkCmdPtr;
+    HRESULT hr = session.get()->CreateCommand(0, IID_ICommandText, unkCmdPtr.put());
+    if (FAILED(hr))
+    {
+        // Don't hand a broken session to the next query
+        session.Discard();
+        THROW_HR(hr);
+    }
+
+    cmdText = unkCmdPtr.as<ICommandText>();
+
+    SessionPoolStats stats = GetCollatorSessionPool().GetStats();
+    _tracelog(L"\nSession pool: %d hits, %d misses, %d discarded, %d us average and %d us max to create a session",
+        static_cast<DWORD>(stats.hits), static_cast<DWORD>(stats.misses), static_cast<DWORD>(stats.discarded),
+        static_cast<DWORD>(stats.AverageCreationMicroseconds()), static_cast<DWORD>(stats.maxCreationMicroseconds));
+}
+
+CollatorSession CollatorSessionProvider::CreateSession()
+{
+    winrt::com_ptr<IDBInitialize> dataSource;
+    THROW_IF_FAILED(CoCreateInstance(CLSID_CollatorDataSource, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(dataSource.put())));
+    THROW_IF_FAILED(dataSource->Initialize());
+
+    winrt::com_ptr<IDBCreateSession> session = dataSource.as<IDBCreateSession>();
+    winrt::com_ptr<IUnknown> unkSessionPtr;
+    THROW_IF_FAILED(session->CreateSession(0, IID_IDBCreateCommand, unkSessionPtr.put()));
+
+    return unkSessionPtr.as<IDBCreateCommand>();
+}
+
+SessionPool<CollatorSession>& GetCollatorSessionPool()
+{
+    // A few idle sessions is plenty, a command only holds its session while it is being created
+    static SessionPool<CollatorSession> s_sessionPool(std::make_shared<CollatorSessionProvider>(), 4);
+    return s_sessionPool;
+}
+
+void PrewarmCollatorSessions()
+{
+    // Same rule as GetCommandText, nothing goes in the pool that wasn't created in the MTA
+    if (IsInMultithreadedApartment())
+    {
+        GetCollatorSessionPool().Prewarm(c_prewarmedCollatorSessions);
+    }
+}
+
+static void WriteSlowQueryTrace(uint32_t cookie, std::vector<QueryTimeline> const& window)
+{
+    const std::string json = WriteChromeTrace(window);
+    std::wstring path(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+    path += L"\\SlowQuery.";
+    path += std::to_wstring(cookie);
+    path += L".json";
+
+    wil::unique_hfile file(CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    THROW_LAST_ERROR_IF(!file);
+    DWORD written = 0;
+    THROW_IF_WIN32_BOOL_FALSE(WriteFile(file.get(), json.data(), static_cast<DWORD>(json.size()), &written, nullptr));
+    _tracelog(L"\nSlow query %d, wrote the last %d queries to %s", cookie, static_cast<DWORD>(window.size()), path.c_str());
+}
+
+struct SlowQueryTrace
+{
+    uint32_t cookie;
+    std::vector<QueryTimeline> window;
+};
+
+static void CALLBACK WriteSlowQueryTraceCallback(PTP_CALLBACK_INSTANCE, PVOID context)
+{
+    std::unique_ptr<SlowQueryTrace> trace(static_cast<SlowQueryTrace*>(context));
+    try
+    {
+        WriteSlowQueryTrace(trace->cookie, trace->window);
+    }
+    CATCH_LOG();
+}
+
+QueryFlightRecorder& GetQueryFlightRecorder()
+{
+    static QueryFlightRecorder s_flightRecorder(c_flightRecorderQueries, c_flightRecorderEventsPerQuery, c_flightRecorderSqlCharsPerQuery,
+        c_slowQueryThresholdMicroseconds, c_slowQueryDumpIntervalMicroseconds, [](uint32_t cookie, std::vector<QueryTimeline>&& window)
+        {
+            // Found out about on the UI thread, the formatting and the write go to the threadpool. The recorder
+            // already holds dumps to one per interval, so there's never more than one of these in flight.
+            auto trace = std::make_unique<SlowQueryTrace>(SlowQueryTrace{ cookie, std::move(window) });
+            if (TrySubmitThreadpoolCallback(WriteSlowQueryTraceCallback, trace.get(), nullptr))
+            {
+                trace.release();
+            }
+            else
+            {
+                LOG_LAST_ERROR();
+            }
+        });
+    return s_flightRecorder;
+}
+
+QueryLatencyTracker& GetQueryLatency()
+{
+    static QueryLatencyTracker s_queryLatency(&GetQueryFlightRecorder());
+    return s_queryLatency;
+}
+
+QueryTemplateCache& GetQueryTemplateCache()
+{
+    static QueryTemplateCache s_queryTemplateCache;
+    return s_queryTemplateCache;
+}
+
+ReuseWhereCache<winrt::com_ptr<IRowset>>& GetReuseWhereCache()
+{
+    // Enough to cover backspacing through a typical query and flipping an option or two back and forth
+    static ReuseWhereCache<winrt::com_ptr<IRowset>> s_reuseWhereCache(c_maxReuseWhereEntries, c_maxReuseWhereBytes);
+    return s_reuseWhereCache;
+}
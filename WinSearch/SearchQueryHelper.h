@@ -1,272 +1,416 @@
-#pragma once
-
-#include "pch.h"
-#include "Logging.h"
-#include "SearchResult.h"
-#include "SearchResultHelpers.h"
-
-struct __declspec(uuid("7f8e1286-559c-4da1-b4dc-1b414d0da123")) ISearchQuery : ::IUnknown
-{
-    virtual void Init() = 0;
-    virtual void ExecuteSync() = 0;
-    virtual PCWSTR GetQueryString() = 0;
-    virtual DWORD GetNumResults() = 0;
-};
-
-struct __declspec(uuid("7f0c248a-4dc7-45f7-8ea1-9be6545eee8e")) ISearchUXQuery : ::IUnknown
-{
-    virtual void Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled) = 0;
-    virtual void Execute(PCWSTR searchText, DWORD cookie) = 0;
-    virtual DWORD GetCookie() = 0;
-    virtual bool GetContentSearchEnabled() = 0;
-    virtual winrt::WinSearch::SearchResult GetResult(DWORD idx) = 0;
-    virtual void WaitForQueryCompletedEvent() = 0;
-    virtual void CancelOutstandingQueries() = 0;
-};
-
-struct SearchQueryBase
-{
-protected:
-    SearchQueryBase() {};
-
-    void FetchRows(_Out_ ULONGLONG* totalFetched);
-    void ExecuteQueryStringSync(PCWSTR queryStr);
-    void PrimeIndexAndCacheWhereId();
-    void GetCommandText(winrt::com_ptr<ICommandText>& cmdText);
-    DWORD GetReuseWhereId(IRowset* rowset);
-
-    virtual void OnPreFetchRows() = 0;
-    virtual void OnFetchRowCallback(IPropertyStore* propStore) = 0;
-    virtual void OnPostFetchRows() = 0;
-    virtual std::wstring GetPrimingQueryString() = 0;
-
-    winrt::com_ptr<IRowset> m_rowset;
-    winrt::com_ptr<IRowset> m_reuseRowset;
-    wil::critical_section m_cs;
-
-    DWORD m_reuseWhereID{0};
-    DWORD m_numResults{0};
-};
-
-__declspec(selectany) CLSID CLSID_CollatorDataSource = { 0x9E175B8B, 0xF52A, 0x11D8, 0xB9, 0xA5, 0x50, 0x50, 0x54, 0x50, 0x30, 0x30 };
-
-union FILETIME64
-{
-    INT64 quad;
-    FILETIME ft;
-};
-
-winrt::com_ptr<ISearchQuery> CreateSearchQueryHelper();
-winrt::com_ptr<ISearchQuery> CreateStaticPropertyAnalysisQuery();
-
-struct QueryStringBuilder
-{
-    const PCWSTR c_select = L"SELECT";
-    const PCWSTR c_fromIndex = L"FROM SystemIndex WHERE";
-    const PCWSTR c_scopeFileConditions = L" SCOPE='file:' AND SCOPE <> 'file://C:/users/tltay'";
-    const PCWSTR c_scopeEmailConditions = L" OR SCOPE='mapi:' OR SCOPE='mapi16:'";
-    const PCWSTR c_orderConditions = L" ORDER BY System.Search.Rank, System.DateModified, System.ItemNameDisplay DESC";
-    std::wstring m_usersScope;
-    std::vector<std::wstring> m_properties{ L"System.ItemUrl", L"System.ItemNameDisplay", L"path", L"System.Search.EntryID",
-        L"System.Kind", L"System.KindText", L"System.Search.GatherTime", L"System.Search.QueryPropertyHits" };
-    std::wstring m_scopeStr; // can be overriden to provide a custom scope
-
-
-    std::wstring GenerateSingleUserScope()
-    {
-        wchar_t myProfileDir[MAX_PATH]{};
-        GetEnvironmentVariable(L"%USERPROFILE%", myProfileDir, ARRAYSIZE(myProfileDir));
-        std::wstring myProfileDirStr(myProfileDir);
-
-        // find the trailing slash
-//        _tracelog(L"CurrentUserProfilePath: %s\n", userProfilesDir.c_str());
-
-        // Get all the users, and filter out the one that is not us
-        std::wstring scopeStr;
-        auto users = winrt::Windows::System::User::FindAllAsync().get();
-        for (const auto& user : users)
-        {
-            std::wstring foundUserProfileDir(winrt::Windows::Storage::UserDataPaths::GetForUser(user).Profile());
-            _tracelog(L"Found user profile: %s\n", foundUserProfileDir.c_str());
-            scopeStr += L" AND SCOPE <> ";
-            scopeStr += foundUserProfileDir.c_str();
-        }
-
-        return scopeStr;
-    }
-
-    void SetScope(PCWSTR scope)
-    {
-        m_scopeStr = scope;
-    }
-
-    void SetProperties(std::vector<std::wstring> const& properties)
-    {
-        m_properties = properties;
-    }
-
-    std::wstring GenerateProperties()
-    {
-        std::wstring propertyStr;
-        for (auto prop : m_properties)
-        {
-            propertyStr += L' ';
-            propertyStr += prop.c_str();
-            propertyStr += L',';
-        }
-        // remove the last comma
-        propertyStr.pop_back();
-
-        // add a space
-        propertyStr += L' ';
-
-        return propertyStr;
-    }
-
-    std::wstring GenerateSelectQueryWithScope(bool mailSearchEnabled, bool allUsersSearchEnabled)
-    {
-        if (!allUsersSearchEnabled && m_usersScope.empty())
-        {
-            m_usersScope = GenerateSingleUserScope();
-        }
-
-        std::wstring queryStr(c_select);
-        queryStr += GenerateProperties();
-        queryStr += c_fromIndex;
-        queryStr += L' ';
-        queryStr += L"(";
-
-        if (m_scopeStr.empty())
-        {
-            queryStr += c_scopeFileConditions;
-        }
-        else
-        {
-            queryStr += m_scopeStr.c_str();
-        }
-        
-        
-        if (mailSearchEnabled)
-        {
-            queryStr += c_scopeEmailConditions;
-        }
-
-        if (!allUsersSearchEnabled)
-        {
-            //queryStr += m_usersScope;
-        }
-
-        queryStr += L")";
-        return queryStr;
-    }
-
-    std::wstring GeneratePrimingQuery(bool mailSearchEnabled, bool allUsersSearchEnabled)
-    {
-        std::wstring queryStr(GenerateSelectQueryWithScope(mailSearchEnabled, allUsersSearchEnabled));
-        queryStr += c_orderConditions;
-
-        _tracelog(L"\nPriming SQL: %ws", queryStr.c_str());
-        return queryStr;
-    }
-
-    std::vector<std::wstring> GenerateSearchQueryTokens(PCWSTR searchText)
-    {
-        std::vector<std::wstring> strings;
-        std::wstringstream f(searchText);
-        std::wstring s;
-        while (std::getline(f, s, L' ')) {
-            strings.push_back(s);
-        }
-        return strings;
-    }
-
-    std::wstring GenerateQuery(PCWSTR searchText, bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled, DWORD whereId)
-    {
-        std::wstring queryStr(GenerateSelectQueryWithScope(mailSearchEnabled, allUsersSearchEnabled));
-        size_t lenSearchText = wcslen(searchText);
-
-        // Filter by item name display only
-        if ((lenSearchText > 0))
-        {
-            queryStr += L" AND (CONTAINS(System.ItemNameDisplay, '\"";
-            queryStr += searchText;
-            queryStr += L"*\"')";
-        }
-
-        std::vector<std::wstring> tokens = GenerateSearchQueryTokens(searchText);
-
-        // Are we searching contents?
-        if (contentSearchEnabled && (lenSearchText > 0))
-        {
-            queryStr += L" OR (";
-            for (int i = 0; i < tokens.size(); ++i)
-            {
-                queryStr += L"CONTAINS(*, '\"";
-                queryStr += tokens[i].c_str();
-                queryStr += L"*\"')";
-
-                if (i < (tokens.size() - 1))
-                {
-                    queryStr += L" AND ";
-                }
-            }
-            queryStr += L')';
-        }
-
-        // group the contains
-        if (lenSearchText)
-        {
-            queryStr += L")";
-        }
-
-        // Always add reuse where to the query
-        queryStr += L" AND ReuseWhere(";
-        queryStr += std::to_wstring(whereId);
-        queryStr += L")";
-
-        queryStr += c_orderConditions;
-
-        _tracelog(L"SQL: %ws", queryStr.c_str());
-        return queryStr;
-    }
-
-};
-
-struct SmartPropVariant
-{
-    SmartPropVariant() { PropVariantInit(&m_pv); }
-    ~SmartPropVariant() { PropVariantClear(&m_pv); }
-
-    std::wstring GetString()
-    {
-        THROW_HR_IF(E_INVALIDARG, (m_pv.vt != VT_LPWSTR));
-
-        std::wstring prop = m_pv.pwszVal;
-        return prop;
-    }
-
-    DWORD GetDWORD()
-    {
-        THROW_HR_IF(E_INVALIDARG, (m_pv.vt != VT_I4));
-
-        return m_pv.lVal;
-    }
-
-    PROPVARIANT* put()
-    {
-        return &m_pv;
-    }
-
-    PROPVARIANT get()
-    {
-        return m_pv;
-    }
-
-    bool IsEmpty()
-    {
-        return ((m_pv.vt == VT_EMPTY) || (m_pv.vt == VT_NULL));
-    }
-
-private:
-    PROPVARIANT m_pv;
+#pragma once
+
+#include "pch.h"
+#include "Logging.h"
+#include "SearchResult.h"
+#include "SearchResultHelpers.h"
+#include "SessionPool.h"
+#include "StreamingResults.h"
+#include "RowFetchPipeline.h"
+#include "BatchSizeController.h"
+#include "ResultPager.h"
+#include "ColumnarRowBatch.h"
+#include "ResultStore.h"
+#include "CancellationToken.h"
+#include "ReuseWhereCache.h"
+#include "RefinementFilter.h"
+#include "TrigramIndex.h"
+#include "SpeculationPlanner.h"
+#include "DebounceScheduler.h"
+#include "ScopeMerge.h"
+#include "QueryTemplate.h"
+#include "RowsetTrace.h"
+#include "QueryFlightRecorder.h"
+
+struct __declspec(uuid("7f8e1286-559c-4da1-b4dc-1b414d0da123")) ISearchQuery : ::IUnknown
+{
+    virtual void Init() = 0;
+    virtual void ExecuteSync() = 0;
+    virtual PCWSTR GetQueryString() = 0;
+    virtual DWORD GetNumResults() = 0;
+};
+
+struct __declspec(uuid("7f0c248a-4dc7-45f7-8ea1-9be6545eee8e")) ISearchUXQuery : ::IUnknown
+{
+    virtual void Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled) = 0;
+    virtual void Execute(PCWSTR searchText, DWORD cookie) = 0;
+    virtual DWORD GetCookie() = 0;
+    virtual bool GetContentSearchEnabled() = 0;
+    // Of the results published under revision, which are only kept until they're replaced twice. Null and 0 after that.
+    virtual winrt::WinSearch::SearchResult GetResult(DWORD revision, DWORD idx) = 0; // a new projection every call
+    virtual DWORD GetResultCount(DWORD revision) = 0;
+    virtual void SetFirstPageSize(DWORD firstPageSize) = 0;
+    virtual ResultStreamUpdate WaitForResults(DWORD cookie, DWORD revision, DWORD seen) = 0;
+    virtual DWORD LoadMoreResults(DWORD cookie, DWORD count) = 0;
+    virtual bool HasMoreResults(DWORD cookie) = 0;
+    virtual void CancelOutstandingQueries() = 0;
+};
+
+// A column decoded through an accessor instead of an IPropertyStore per row
+struct BoundColumn
+{
+    PCWSTR name;
+    size_t maxChars;
+};
+
+struct SearchQueryBase
+{
+protected:
+    SearchQueryBase() {};
+
+    void FetchRows(_Out_ ULONGLONG* totalFetched, ULONGLONG maxRows = ULLONG_MAX);
+    void FetchRowsPipelined(_Out_ ULONGLONG* totalFetched, ULONGLONG maxRows);
+    DBCOUNTITEM FetchNextRowBatch(std::vector<RowHandle>& rows, ULONGLONG* fetched, ULONGLONG maxRows);
+    DBCOUNTITEM GetNextRowBatch(std::vector<RowHandle>& rows);
+    std::vector<RowHandle> TakeRowBuffer();
+    void RecycleRowBuffer(std::vector<RowHandle>&& buffer);
+    void ReleaseRowBatch(std::vector<RowHandle>&& rows);
+    void LogBatchSizeDecisions(ULONGLONG fetched);
+    bool BindRowsetColumns();
+    void ReleaseRowsetAccessor();
+    void DecodeRowBatch(std::vector<RowHandle> const& rows, ColumnarRowBatch& batch);
+    void ExecuteQueryStringSync(PCWSTR queryStr, CancellationToken const& cancellation = {}, DWORD cookie = 0);
+    void PrimeIndexAndCacheWhereId(uint32_t reuseOptions, CancellationToken const& cancellation = {});
+    DWORD AcquireReuseWhereId(PCWSTR searchText, uint32_t reuseOptions);
+    void CacheReuseWhereId(PCWSTR searchText, uint32_t reuseOptions);
+    void GetCommandText(winrt::com_ptr<ICommandText>& cmdText);
+    DWORD GetReuseWhereId(IRowset* rowset);
+
+    virtual void OnPreFetchRows() = 0;
+    virtual void OnFetchRowCallback(IPropertyStore* propStore) = 0;
+    virtual void OnPostFetchRows() = 0;
+    virtual void OnPostFetchRowBatch() {};
+
+    // Queries that can build their results off of the fetch thread opt in to the pipelined fetch. Rows are decoded
+    // a batch at a time through an accessor on the columns from GetBoundColumns, MaterializeRow is then called
+    // concurrently on worker threads to append the row's result (if it has one) to the batch's results, and
+    // OnRowMaterialized in rank order, one result at a time. If the columns can't be bound we fall back to the
+    // serial IPropertyStore path.
+    virtual bool CanMaterializeRowsConcurrently() { return false; }
+    virtual std::vector<BoundColumn> GetBoundColumns() { return {}; }
+    virtual void MaterializeRow(ColumnarRowBatch const&, size_t, ResultStore&) {};
+    virtual void OnRowMaterialized(ResultStore const&, size_t) {};
+    virtual void OnRowBatchDecoded(ColumnarRowBatch const&) {}; // in rank order, before the batch's OnRowMaterialized calls
+    virtual std::wstring GetPrimingQueryString() = 0;
+
+    // Queries nobody is waiting on, the pipeline's workers run at background priority for them like the thread
+    // that runs the query does
+    virtual bool IsBackgroundQuery() { return false; }
+
+    // Queries that page their results in on demand only fetch this many rows up front, the rest of the
+    // rowset stays on the cursor until FetchRows is called again
+    virtual ULONGLONG GetInitialFetchLimit() { return ULLONG_MAX; }
+
+    winrt::com_ptr<IRowset> m_rowset;
+    winrt::com_ptr<IRowset> m_reuseRowset;
+    wil::critical_section m_cs;
+
+    DWORD m_reuseWhereID{0};
+    DWORD m_numResults{0};
+    CancellationToken m_fetchCancellation; // of the query that owns the current rowset, checked between batches and rows
+    DWORD m_latencyCookie{}; // of the query that owns the current rowset, 0 if it doesn't have one
+    ULONGLONG m_rowsFetched{}; // from the current rowset
+    bool m_rowsetExhausted{};
+
+    // Start with about a page worth of rows, and let bulk fetches grow well past the old fixed 5000
+    static constexpr size_t c_initialRowBatchSize{ 64 };
+    static constexpr size_t c_maxRowBatchSize{ 16384 };
+    static constexpr size_t c_rowBatchGrowthFactor{ 2 };
+    AdaptiveBatchSizeController m_batchSizeController{ c_initialRowBatchSize, c_maxRowBatchSize, c_rowBatchGrowthFactor };
+    std::vector<std::vector<RowHandle>> m_rowBufferPool; // HROW buffers are reused across batches and queries
+    wil::srwlock m_rowBufferPoolLock;
+    wil::critical_section m_rowsetCallLock; // the pipeline's threads take turns calling into m_rowset
+    static constexpr size_t c_maxQueuedRowBatches{ 2 };
+    static constexpr size_t c_maxMaterializeWorkers{ 4 };
+    struct RowsetBatchSource; // m_rowset as the pipeline's IRowBatchSource
+
+    struct BoundColumnLayout
+    {
+        DBBYTEOFFSET statusOffset;
+        DBBYTEOFFSET lengthOffset;
+        DBBYTEOFFSET valueOffset;
+        size_t maxChars;
+    };
+    winrt::com_ptr<IRowset> m_boundRowset;
+    winrt::com_ptr<IAccessor> m_rowAccessor;
+    HACCESSOR m_rowAccessorHandle{};
+    std::vector<BoundColumnLayout> m_boundColumnLayouts;
+    DBLENGTH m_boundRowSize{};
+    static constexpr size_t c_expectedCharsPerRow{ 256 };
+
+    // Only kept when rowsets are being recorded, see GetRowsetTraceWriter
+    std::wstring m_queryText;
+    IRowset* m_tracedRowset{}; // compared against, never used
+    uint32_t m_traceQueryId{};
+
+    // We can't see what an open rowset costs the provider, so every cached one is charged a flat estimate
+    static constexpr size_t c_reuseRowsetCostBytes{ 64 * 1024 };
+};
+
+constexpr size_t c_maxReuseWhereEntries{ 32 };
+constexpr size_t c_maxReuseWhereBytes{ 1024 * 1024 };
+
+// A few hundred KB for the last 16 queries, and a slow one gets written out at most twice a minute
+constexpr size_t c_flightRecorderQueries{ 16 };
+constexpr size_t c_flightRecorderEventsPerQuery{ 256 };
+constexpr size_t c_flightRecorderSqlCharsPerQuery{ 8192 };
+constexpr uint64_t c_slowQueryThresholdMicroseconds{ 500 * 1000 };
+constexpr uint64_t c_slowQueryDumpIntervalMicroseconds{ 30 * 1000 * 1000 };
+
+__declspec(selectany) CLSID CLSID_CollatorDataSource = { 0x9E175B8B, 0xF52A, 0x11D8, 0xB9, 0xA5, 0x50, 0x50, 0x54, 0x50, 0x30, 0x30 };
+
+using CollatorSession = winrt::com_ptr<IDBCreateCommand>;
+
+// Creates initialized sessions on the collator data source for the session pool
+struct CollatorSessionProvider : ISessionProvider<CollatorSession>
+{
+    CollatorSession CreateSession() override;
+};
+
+// Process wide pool of warm collator sessions shared by every query helper. Only MTA threads get sessions out of
+// it, see GetCommandText.
+SessionPool<CollatorSession>& GetCollatorSessionPool();
+
+// Enough for a query and the speculation behind it to start without creating a session
+constexpr size_t c_prewarmedCollatorSessions{ 2 };
+
+// Fills the pool up to c_prewarmedCollatorSessions, does nothing when called from outside the MTA
+void PrewarmCollatorSessions();
+
+// Process wide cache of evaluated ReuseWhere restrictions, so a new helper (backspace, option toggle) can start
+// from a restriction an earlier helper already evaluated instead of priming from scratch
+ReuseWhereCache<winrt::com_ptr<IRowset>>& GetReuseWhereCache();
+
+union FILETIME64
+{
+    INT64 quad;
+    FILETIME ft;
+};
+
+winrt::com_ptr<ISearchQuery> CreateSearchQueryHelper();
+winrt::com_ptr<ISearchQuery> CreateStaticPropertyAnalysisQuery();
+
+// Process wide index of file names, built in the background from the priming query the first time a helper
+// gets initialized. Null until it is ready, or if it was built for the other all users setting.
+void BuildFilenameIndexAsync(bool allUsersSearchEnabled);
+std::shared_ptr<const TrigramFilenameIndex> GetFilenameIndex(bool allUsersSearchEnabled);
+
+// Process wide cache of compiled query templates, see QueryStringBuilder::GetQueryTemplate
+QueryTemplateCache& GetQueryTemplateCache();
+
+// Process wide, gets every span GetQueryLatency records. Slow queries get written next to the trace log as
+// SlowQuery.<cookie>.json.
+QueryFlightRecorder& GetQueryFlightRecorder();
+
+// Which scopes a query covers. Queries normally cover them all at once, a fanned out query runs a query
+// per scope instead.
+enum class QueryScope
+{
+    All,
+    Files,
+    Mail,
+};
+
+struct QueryStringBuilder
+{
+    const PCWSTR c_select = L"SELECT";
+    const PCWSTR c_fromIndex = L"FROM SystemIndex WHERE";
+    const PCWSTR c_scopeFileConditions = L" SCOPE='file:' AND SCOPE <> 'file://C:/users/tltay'";
+    const PCWSTR c_scopeEmailConditions = L" OR SCOPE='mapi:' OR SCOPE='mapi16:'";
+    const PCWSTR c_scopeEmailOnlyConditions = L" SCOPE='mapi:' OR SCOPE='mapi16:'";
+    const PCWSTR c_orderConditions = L" ORDER BY System.Search.Rank, System.DateModified, System.ItemNameDisplay DESC";
+    std::wstring m_usersScope;
+    std::vector<std::wstring> m_properties{ L"System.ItemUrl", L"System.ItemNameDisplay", L"path", L"System.Search.EntryID",
+        L"System.Kind", L"System.KindText", L"System.Search.GatherTime", L"System.Search.QueryPropertyHits" };
+    std::wstring m_scopeStr; // can be overriden to provide a custom scope
+    std::shared_ptr<const QueryTemplate> m_template; // last one we used, for m_templateOptions
+    uint32_t m_templateOptions{};
+
+
+    std::wstring GenerateSingleUserScope()
+    {
+        wchar_t myProfileDir[MAX_PATH]{};
+        GetEnvironmentVariable(L"%USERPROFILE%", myProfileDir, ARRAYSIZE(myProfileDir));
+        std::wstring myProfileDirStr(myProfileDir);
+
+        // find the trailing slash
+//        _tracelog(L"CurrentUserProfilePath: %s\n", userProfilesDir.c_str());
+
+        // Get all the users, and filter out the one that is not us
+        std::wstring scopeStr;
+        auto users = winrt::Windows::System::User::FindAllAsync().get();
+        for (const auto& user : users)
+        {
+            std::wstring foundUserProfileDir(winrt::Windows::Storage::UserDataPaths::GetForUser(user).Profile());
+            _tracelog(L"Found user profile: %s\n", foundUserProfileDir.c_str());
+            scopeStr += L" AND SCOPE <> ";
+            scopeStr += foundUserProfileDir.c_str();
+        }
+
+        return scopeStr;
+    }
+
+    void SetScope(PCWSTR scope)
+    {
+        m_scopeStr = scope;
+        m_template = nullptr;
+    }
+
+    void SetProperties(std::vector<std::wstring> const& properties)
+    {
+        m_properties = properties;
+        m_template = nullptr;
+    }
+
+    void AddProperty(PCWSTR property)
+    {
+        m_properties.push_back(property);
+        m_template = nullptr;
+    }
+
+    std::wstring GenerateProperties()
+    {
+        std::wstring propertyStr;
+        for (auto prop : m_properties)
+        {
+            propertyStr += L' ';
+            propertyStr += prop.c_str();
+            propertyStr += L',';
+        }
+        // remove the last comma
+        propertyStr.pop_back();
+
+        // add a space
+        propertyStr += L' ';
+
+        return propertyStr;
+    }
+
+    std::wstring GenerateSelectQueryWithScope(bool mailSearchEnabled, bool allUsersSearchEnabled, QueryScope scope = QueryScope::All)
+    {
+        if (!allUsersSearchEnabled && m_usersScope.empty())
+        {
+            m_usersScope = GenerateSingleUserScope();
+        }
+
+        std::wstring queryStr(c_select);
+        queryStr += GenerateProperties();
+        queryStr += c_fromIndex;
+        queryStr += L' ';
+        queryStr += L"(";
+
+        if (scope == QueryScope::Mail)
+        {
+            queryStr += c_scopeEmailOnlyConditions;
+        }
+        else if (m_scopeStr.empty())
+        {
+            queryStr += c_scopeFileConditions;
+        }
+        else
+        {
+            queryStr += m_scopeStr.c_str();
+        }
+        
+        
+        if (mailSearchEnabled && (scope == QueryScope::All))
+        {
+            queryStr += c_scopeEmailConditions;
+        }
+
+        if (!allUsersSearchEnabled)
+        {
+            //queryStr += m_usersScope;
+        }
+
+        queryStr += L")";
+        return queryStr;
+    }
+
+    std::wstring GeneratePrimingQuery(bool mailSearchEnabled, bool allUsersSearchEnabled, QueryScope scope = QueryScope::All)
+    {
+        std::wstring queryStr;
+        GetQueryTemplate(mailSearchEnabled, allUsersSearchEnabled, scope)->FillPriming(queryStr);
+
+        _tracelog(L"\nPriming SQL: %ws", queryStr.c_str());
+        return queryStr;
+    }
+
+    std::wstring GenerateQuery(PCWSTR searchText, bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled, DWORD whereId,
+        QueryScope scope = QueryScope::All)
+    {
+        std::wstring queryStr;
+        GenerateQuery(queryStr, searchText, contentSearchEnabled, mailSearchEnabled, allUsersSearchEnabled, whereId, scope);
+        return queryStr;
+    }
+
+    // Same as above, into a buffer the caller keeps around from one query to the next
+    void GenerateQuery(std::wstring& queryStr, PCWSTR searchText, bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled,
+        DWORD whereId, QueryScope scope = QueryScope::All)
+    {
+        GetQueryTemplate(mailSearchEnabled, allUsersSearchEnabled, scope)->Fill(queryStr, searchText, contentSearchEnabled, whereId);
+
+        _tracelog(L"SQL: %ws", queryStr.c_str());
+    }
+
+    // Everything but the search text and the where id, put together the first time anyone in the process asks
+    // for this option set. The builder holds on to the last one it used so a keystroke doesn't even build the key.
+    std::shared_ptr<const QueryTemplate> const& GetQueryTemplate(bool mailSearchEnabled, bool allUsersSearchEnabled, QueryScope scope)
+    {
+        const uint32_t options = (mailSearchEnabled ? 0x1 : 0) | (allUsersSearchEnabled ? 0x2 : 0) | (static_cast<uint32_t>(scope) << 2);
+        if ((m_template == nullptr) || (m_templateOptions != options))
+        {
+            std::wstring key(std::to_wstring(options));
+            key += L'|';
+            key += m_scopeStr;
+            key += L'|';
+            key += GenerateProperties();
+            m_template = GetQueryTemplateCache().GetOrCompile(key, [&]()
+                {
+                    return std::make_shared<const QueryTemplate>(GenerateSelectQueryWithScope(mailSearchEnabled, allUsersSearchEnabled, scope), c_orderConditions);
+                });
+            m_templateOptions = options;
+        }
+        return m_template;
+    }
+
+};
+
+struct SmartPropVariant
+{
+    SmartPropVariant() { PropVariantInit(&m_pv); }
+    ~SmartPropVariant() { PropVariantClear(&m_pv); }
+
+    std::wstring GetString()
+    {
+        THROW_HR_IF(E_INVALIDARG, (m_pv.vt != VT_LPWSTR));
+
+        std::wstring prop = m_pv.pwszVal;
+        return prop;
+    }
+
+    DWORD GetDWORD()
+    {
+        THROW_HR_IF(E_INVALIDARG, (m_pv.vt != VT_I4));
+
+        return m_pv.lVal;
+    }
+
+    PROPVARIANT* put()
+    {
+        return &m_pv;
+    }
+
+    PROPVARIANT get()
+    {
+        return m_pv;
+    }
+
+    bool IsEmpty()
+    {
+        return ((m_pv.vt == VT_EMPTY) || (m_pv.vt == VT_NULL));
+    }
+
+private:
+    PROPVARIANT m_pv;
 };
\ No newline at end of file
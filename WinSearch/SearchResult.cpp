@@ -1,178 +1,350 @@
-#include "pch.h"
-#include "SearchResult.h"
-#include "SearchResult.g.cpp"
-#include "shellapi.h"
-
-#include <winrt/Windows.Storage.Streams.h>
-
-namespace winrt::WinSearch::implementation
-{
-    hstring SearchResult::ItemDisplayName()
-    {
-        return m_itemDisplayName;
-    }
-    void SearchResult::ItemDisplayName(hstring const&)
-    {
-        throw hresult_not_implemented();
-    }
-    hstring SearchResult::ItemUrl()
-    {
-        // Special overrides for files
-        if (!m_isMail)
-        {
-            return m_launchUri;
-        }
-        return m_itemUrl;
-    }
-    void SearchResult::ItemUrl(hstring const&)
-    {
-        throw hresult_not_implemented();
-    }
-    hstring SearchResult::LaunchUri()
-    {
-        return m_launchUri;
-    }
-    void SearchResult::LaunchUri(hstring const&)
-    {
-        throw hresult_not_implemented();
-    }
-
-    bool SearchResult::IsFolder()
-    {
-        return m_isFolder;
-    }
-
-    bool SearchResult::IsMail()
-    {
-        return m_isMail;
-    }
-
-    bool SearchResult::CanDisplay()
-    {
-        return m_canDisplay;
-    }
-
-    winrt::Windows::Foundation::IAsyncAction SearchResult::LaunchAsync()
-    {
-        co_await winrt::resume_background(); // do this on a bg thread
-        if (!IsMail())
-        {
-            if (!IsFolder())
-            {
-                winrt::Windows::Storage::StorageFile file = winrt::Windows::Storage::StorageFile::GetFileFromPathAsync(m_launchUri.c_str()).get();
-                winrt::Windows::System::Launcher::LaunchFileAsync(file).get();
-            }
-            else
-            {
-                winrt::Windows::Storage::StorageFolder folder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(m_launchUri.c_str()).get();
-                winrt::Windows::System::Launcher::LaunchFolderAsync(folder).get();
-            }
-        }
-        else
-        {
-            winrt::Windows::Foundation::Uri uri{ m_launchUri.c_str() };
-            try
-            {
-                if (winrt::Windows::System::Launcher::LaunchUriAsync(uri).get())
-                {
-
-                }
-                else
-                {
-                    // Try again with a popup to choose the app
-                    winrt::Windows::System::LauncherOptions options;
-                    options.DisplayApplicationPicker(true);
-
-                    winrt::Windows::System::Launcher::LaunchUriAsync(uri, options).get();
-                }
-            }
-            catch (winrt::hresult_error const&)
-            {
-            }
-        }
-    }
-
-    void SearchResult::TryGetThumbnailForStorageItem()
-    {
-        if (g_imageUriManager.NeedProcessThumbnailForItem(m_launchUri.c_str(), IsFolder()))
-        {
-            if (IsFolder())
-            {
-                try
-                {
-                    // Create the storage folder from the item
-                    winrt::Windows::Storage::StorageFolder folder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(m_launchUri.c_str()).get();
-
-                    // Get the thumbnail
-                    winrt::Windows::Storage::FileProperties::ThumbnailMode mode = winrt::Windows::Storage::FileProperties::ThumbnailMode::ListView;
-                    winrt::Windows::Storage::FileProperties::StorageItemThumbnail thumb = folder.GetThumbnailAsync(mode, 25).get();
-
-                    m_thumbnail = thumb;
-                    g_imageUriManager.AddThumbnailForFolder(thumb);
-                }
-                catch (winrt::hresult_error const& ex)
-                {
-                    if (ex.code() == E_ACCESSDENIED)
-                    {
-                        m_canDisplay = false;
-                    }
-                    m_thumbnail = nullptr;
-                }
-            }
-            else
-            {
-                try
-                {
-                    // Create the storage folder from the item
-                    winrt::Windows::Storage::StorageFile folder = winrt::Windows::Storage::StorageFile::GetFileFromPathAsync(m_launchUri.c_str()).get();
-
-                    // Get the thumbnail
-                    winrt::Windows::Storage::FileProperties::ThumbnailMode mode = winrt::Windows::Storage::FileProperties::ThumbnailMode::ListView;
-                    winrt::Windows::Storage::FileProperties::StorageItemThumbnail thumb = folder.GetThumbnailAsync(mode, 25).get();
-
-                    m_thumbnail = thumb;
-                    g_imageUriManager.AddThumbnailForStorageFile(thumb, m_launchUri.c_str());
-                }
-                catch (winrt::hresult_error const& ex)
-                {
-                    if (ex.code() == E_ACCESSDENIED)
-                    {
-                        m_canDisplay = false;
-                    }
-                    m_thumbnail = nullptr;
-                }
-            }
-        }
-        else
-        {
-            m_thumbnail = g_imageUriManager.GetThumbnailForItem(m_launchUri.c_str(), IsFolder(), IsMail());
-        }
-    }
-
-    winrt::Windows::Storage::FileProperties::StorageItemThumbnail SearchResult::Thumbnail()
-    {
-        return m_thumbnail;
-    }
-
-    void SearchResult::Thumbnail(winrt::Windows::Storage::FileProperties::StorageItemThumbnail const& thumbnail)
-    {
-        m_thumbnail = thumbnail;
-    }
-
-
-    winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage SearchResult::ItemImage()
-    {
-        winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage bitmapImage{};
-        if (m_thumbnail != nullptr)
-        {
-            bitmapImage.SetSource(m_thumbnail.CloneStream());
-        }
-        
-        return bitmapImage;
-    }
-
-    void SearchResult::ItemImage(winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage const&)
-    {
-        throw hresult_not_implemented();
-    }
-}
+#include "pch.h"
+#include "SearchResult.h"
+#include "SearchResult.g.cpp"
+#include "shellapi.h"
+
+#include <winrt/Windows.ApplicationModel.h>
+#include <winrt/Windows.Storage.Streams.h>
+#include "Logging.h"
+#include "Throughput.h"
+
+namespace winrt::WinSearch::implementation
+{
+    hstring SearchResult::ItemDisplayName()
+    {
+        return m_itemDisplayName;
+    }
+    void SearchResult::ItemDisplayName(hstring const&)
+    {
+        throw hresult_not_implemented();
+    }
+    hstring SearchResult::ItemUrl()
+    {
+        // Special overrides for files
+        if (!m_isMail)
+        {
+            return m_launchUri;
+        }
+        return m_itemUrl;
+    }
+    void SearchResult::ItemUrl(hstring const&)
+    {
+        throw hresult_not_implemented();
+    }
+    hstring SearchResult::LaunchUri()
+    {
+        return m_launchUri;
+    }
+    void SearchResult::LaunchUri(hstring const&)
+    {
+        throw hresult_not_implemented();
+    }
+
+    bool SearchResult::IsFolder()
+    {
+        return m_isFolder;
+    }
+
+    bool SearchResult::IsMail()
+    {
+        return m_isMail;
+    }
+
+    bool SearchResult::CanDisplay()
+    {
+        return m_canDisplay;
+    }
+
+    winrt::Windows::Foundation::IAsyncAction SearchResult::LaunchAsync()
+    {
+        co_await winrt::resume_background(); // do this on a bg thread
+        if (!IsMail())
+        {
+            if (!IsFolder())
+            {
+                winrt::Windows::Storage::StorageFile file = winrt::Windows::Storage::StorageFile::GetFileFromPathAsync(m_launchUri.c_str()).get();
+                winrt::Windows::System::Launcher::LaunchFileAsync(file).get();
+            }
+            else
+            {
+                winrt::Windows::Storage::StorageFolder folder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(m_launchUri.c_str()).get();
+                winrt::Windows::System::Launcher::LaunchFolderAsync(folder).get();
+            }
+        }
+        else
+        {
+            winrt::Windows::Foundation::Uri uri{ m_launchUri.c_str() };
+            try
+            {
+                if (winrt::Windows::System::Launcher::LaunchUriAsync(uri).get())
+                {
+
+                }
+                else
+                {
+                    // Try again with a popup to choose the app
+                    winrt::Windows::System::LauncherOptions options;
+                    options.DisplayApplicationPicker(true);
+
+                    winrt::Windows::System::Launcher::LaunchUriAsync(uri, options).get();
+                }
+            }
+            catch (winrt::hresult_error const&)
+            {
+            }
+        }
+    }
+
+    void SearchResult::RequestThumbnail()
+    {
+        m_thumbnailRequested = true;
+
+        winrt::apartment_context uiThread;
+        winrt::weak_ref<SearchResult> weakThis = get_weak();
+        winrt::Windows::Storage::Streams::IRandomAccessStream cached{ nullptr };
+        if (GetThumbnailScheduler().Request(m_thumbnailKey, m_launchUri, IsFolder(),
+            [weakThis, uiThread](winrt::Windows::Storage::Streams::IRandomAccessStream const& thumbnail)
+            {
+                OnThumbnailLoaded(weakThis, uiThread, thumbnail);
+            }, &cached))
+        {
+            // Another row's load finished since we were created
+            SetThumbnail(cached);
+        }
+    }
+
+    winrt::fire_and_forget SearchResult::OnThumbnailLoaded(winrt::weak_ref<SearchResult> weakThis, winrt::apartment_context uiThread,
+        winrt::Windows::Storage::Streams::IRandomAccessStream thumbnail)
+    {
+        co_await uiThread;
+        if (auto strongThis = weakThis.get())
+        {
+            strongThis->SetThumbnail(thumbnail);
+        }
+    }
+
+    void SearchResult::SetThumbnail(winrt::Windows::Storage::Streams::IRandomAccessStream const& thumbnail)
+    {
+        if (thumbnail == nullptr)
+        {
+            // Failed or dropped while we were scrolled past, ask again the next time we're shown
+            m_thumbnailRequested = false;
+            return;
+        }
+
+        m_thumbnail = thumbnail;
+        if (m_itemImage != nullptr)
+        {
+            m_itemImage.SetSource(m_thumbnail.CloneStream());
+        }
+    }
+
+    winrt::Windows::Storage::Streams::IRandomAccessStream SearchResult::Thumbnail()
+    {
+        return m_thumbnail;
+    }
+
+    void SearchResult::Thumbnail(winrt::Windows::Storage::Streams::IRandomAccessStream const& thumbnail)
+    {
+        m_thumbnail = thumbnail;
+    }
+
+
+    winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage SearchResult::ItemImage()
+    {
+        // Only called when the row gets shown. The image starts out blank unless we already have the thumbnail,
+        // and keeps the one Image control bound to so it can be filled in whenever the load finishes.
+        if (m_itemImage == nullptr)
+        {
+            m_itemImage = winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage{};
+            if (m_thumbnail != nullptr)
+            {
+                m_itemImage.SetSource(m_thumbnail.CloneStream());
+            }
+        }
+
+        if ((m_thumbnail == nullptr) && (m_thumbnailKey != c_noAtom) && !m_thumbnailRequested)
+        {
+            RequestThumbnail();
+        }
+        return m_itemImage;
+    }
+
+    void SearchResult::ItemImage(winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage const&)
+    {
+        throw hresult_not_implemented();
+    }
+}
+
+namespace
+{
+    winrt::Windows::Storage::Streams::IRandomAccessStream LoadShellThumbnail(std::wstring const& path, bool isFolder)
+    {
+        winrt::Windows::Storage::FileProperties::ThumbnailMode mode = winrt::Windows::Storage::FileProperties::ThumbnailMode::ListView;
+        if (isFolder)
+        {
+            winrt::Windows::Storage::StorageFolder folder = winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(path).get();
+            return folder.GetThumbnailAsync(mode, 25).get();
+        }
+
+        winrt::Windows::Storage::StorageFile file = winrt::Windows::Storage::StorageFile::GetFileFromPathAsync(path).get();
+        return file.GetThumbnailAsync(mode, 25).get();
+    }
+
+    std::vector<uint8_t> ReadThumbnailBytes(winrt::Windows::Storage::Streams::IRandomAccessStream const& thumbnail)
+    {
+        winrt::Windows::Storage::Streams::Buffer buffer(static_cast<uint32_t>(thumbnail.Size()));
+        winrt::Windows::Storage::Streams::IBuffer read = thumbnail.GetInputStreamAt(0).ReadAsync(buffer, buffer.Capacity(),
+            winrt::Windows::Storage::Streams::InputStreamOptions::None).get();
+        return std::vector<uint8_t>(read.data(), read.data() + read.Length());
+    }
+
+    winrt::Windows::Storage::Streams::IRandomAccessStream ThumbnailFromBytes(std::vector<uint8_t> const& bytes)
+    {
+        winrt::Windows::Storage::Streams::InMemoryRandomAccessStream stream;
+        winrt::Windows::Storage::Streams::DataWriter writer(stream);
+        writer.WriteBytes(bytes);
+        writer.StoreAsync().get();
+        writer.DetachStream();
+        stream.Seek(0);
+        return stream;
+    }
+
+    // Runs on a scheduler worker
+    winrt::Windows::Storage::Streams::IRandomAccessStream LoadThumbnail(StringAtom thumbnailKey, std::wstring const& path, bool isFolder)
+    {
+        QueryLatencySpan span(GetQueryLatency(), 0, QueryStage::Thumbnail);
+
+        // Atoms only mean something to this run, the store keeps the text
+        const std::wstring_view key = GetStringAtoms().GetText(thumbnailKey);
+        std::vector<uint8_t> bytes;
+        if (GetThumbnailStore().Find(key, bytes))
+        {
+            span.SetArgs(1, bytes.size());
+            return ThumbnailFromBytes(bytes);
+        }
+
+        winrt::Windows::Storage::Streams::IRandomAccessStream thumbnail = LoadShellThumbnail(path, isFolder);
+        try
+        {
+            bytes = ReadThumbnailBytes(thumbnail);
+            GetThumbnailStore().Insert(key, bytes.data(), bytes.size());
+        }
+        CATCH_LOG();
+        span.SetArgs(0, bytes.size());
+        return thumbnail;
+    }
+
+    struct ThumbnailStoreFile
+    {
+        wil::unique_hfile file;
+        wil::unique_handle mapping;
+        wil::unique_mapview_ptr<uint8_t> view;
+        std::unique_ptr<MappedThumbnailStore> store;
+    };
+}
+
+MappedThumbnailStore& GetThumbnailStore()
+{
+    static ThumbnailStoreFile s_storeFile = []()
+        {
+            ThumbnailStoreFile storeFile;
+            try
+            {
+                std::wstring path(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path());
+                path += L"\\ThumbnailCache.bin";
+
+                // Not shared, a second instance runs without it rather than both writing to it
+                storeFile.file.reset(CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+                THROW_LAST_ERROR_IF(!storeFile.file);
+
+                LARGE_INTEGER size{};
+                size.QuadPart = c_thumbnailStoreBytes;
+                THROW_IF_WIN32_BOOL_FALSE(SetFilePointerEx(storeFile.file.get(), size, nullptr, FILE_BEGIN));
+                THROW_IF_WIN32_BOOL_FALSE(SetEndOfFile(storeFile.file.get()));
+
+                storeFile.mapping.reset(CreateFileMappingW(storeFile.file.get(), nullptr, PAGE_READWRITE, 0, 0, nullptr));
+                THROW_LAST_ERROR_IF(!storeFile.mapping);
+                storeFile.view.reset(static_cast<uint8_t*>(MapViewOfFile(storeFile.mapping.get(), FILE_MAP_WRITE, 0, 0, c_thumbnailStoreBytes)));
+                THROW_LAST_ERROR_IF(!storeFile.view);
+            }
+            CATCH_LOG();
+
+            storeFile.store = std::make_unique<MappedThumbnailStore>(storeFile.view.get(), storeFile.view ? c_thumbnailStoreBytes : 0);
+            return storeFile;
+        }();
+    return *s_storeFile.store;
+}
+
+SearchResultThumbnailScheduler& GetThumbnailScheduler()
+{
+    // The workers use the store, it has to be around until they're gone
+    GetThumbnailStore();
+
+    static SearchResultThumbnailScheduler s_scheduler(g_imageUriManager, LoadThumbnail, c_thumbnailWorkers, c_maxQueuedThumbnails,
+        []() { winrt::init_apartment(winrt::apartment_type::multi_threaded); },
+        []() { winrt::uninit_apartment(); });
+    return s_scheduler;
+}
+
+void BenchmarkThumbnails()
+{
+    winrt::init_apartment(winrt::apartment_type::multi_threaded);
+    auto uninit = wil::scope_exit([]() { winrt::uninit_apartment(); });
+
+    // One file per extension out of our own install folder
+    std::vector<std::wstring> paths;
+    std::vector<StringAtom> keys;
+    for (auto const& file : winrt::Windows::ApplicationModel::Package::Current().InstalledLocation().GetFilesAsync().get())
+    {
+        std::wstring path(file.Path());
+        const StringAtom key = GetStringAtoms().Intern(GetExtension(path));
+        if ((key != c_noAtom) && (keys.size() < 16) && (std::find(keys.begin(), keys.end(), key) == keys.end()))
+        {
+            keys.push_back(key);
+            paths.push_back(std::move(path));
+        }
+    }
+    if (paths.empty())
+    {
+        return;
+    }
+
+    // Cold loads from the shell against reading them back out of a store, a throwaway one so the real one isn't touched
+    std::vector<uint8_t> storeView(c_thumbnailStoreBytes);
+    MappedThumbnailStore store(storeView.data(), storeView.size());
+    SearchResultImageUriManager cache;
+    uint64_t shellMicroseconds = 0;
+    uint64_t storeMicroseconds = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        uint64_t start = QueryLatencyTracker::NowMicroseconds();
+        winrt::Windows::Storage::Streams::IRandomAccessStream thumbnail = LoadShellThumbnail(paths[i], false);
+        shellMicroseconds += QueryLatencyTracker::NowMicroseconds() - start;
+
+        std::vector<uint8_t> encoded = ReadThumbnailBytes(thumbnail);
+        bytes += encoded.size();
+        store.Insert(GetStringAtoms().GetText(keys[i]), encoded.data(), encoded.size());
+
+        start = QueryLatencyTracker::NowMicroseconds();
+        THROW_HR_IF(E_UNEXPECTED, !store.Find(GetStringAtoms().GetText(keys[i]), encoded));
+        cache.Add(keys[i], ThumbnailFromBytes(encoded));
+        storeMicroseconds += QueryLatencyTracker::NowMicroseconds() - start;
+    }
+
+    _tracelog(L"\nThumbnail benchmark: %d extensions, %d KB, cold from the shell %d us each, from the store %d us each",
+        static_cast<DWORD>(paths.size()), static_cast<DWORD>(bytes / 1024),
+        static_cast<DWORD>(shellMicroseconds / paths.size()), static_cast<DWORD>(storeMicroseconds / paths.size()));
+
+    // Every row looks in the cache, readers shouldn't slow each other down as they're added
+    for (size_t threadCount : { 1, 2, 4, 8 })
+    {
+        CallThroughput lookups = MeasureCallThroughput(threadCount, 100000, [&](size_t thread, size_t call)
+            {
+                cache.Find(keys[(thread + call) % keys.size()]);
+            });
+        _tracelog(L"\nThumbnail lookups on %d threads: %d ns/lookup (%d lookups/s)", static_cast<DWORD>(threadCount),
+            static_cast<DWORD>(lookups.nanosecondsPerCall), static_cast<DWORD>(lookups.callsPerSecond));
+    }
+}
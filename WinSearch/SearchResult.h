@@ -1,62 +1,61 @@
-#pragma once
-#include "SearchResult.g.h"
-
-#include <SearchResultHelpers.h>
-
-extern SearchResultImageUriManager g_imageUriManager;
-
-namespace winrt::WinSearch::implementation
-{
-    struct SearchResult : SearchResultT<SearchResult>
-    {
-        SearchResult() = default;
-        SearchResult(PCWSTR itemDisplayName, PCWSTR itemUrl, PCWSTR filePath, bool isMail, bool isFolder)
-        {
-            m_itemDisplayName = itemDisplayName;
-            m_itemUrl = itemUrl;
-            m_isMail = isMail;
-            m_isFolder = isFolder;
-
-            if (m_launchUri.empty())
-            {
-                // We need to figure this out now so when we render all computations are ready
-                if (m_isMail)
-                {
-                    // Launch via chooser that binds the URI for all future runs
-                    m_launchUri = m_itemUrl;
-                }
-                else
-                {
-                    // Launch the file with the default app, so use the file path
-                    m_launchUri = filePath;
-                    TryGetThumbnailForStorageItem();
-                }
-            }
-        }
-
-        hstring ItemDisplayName();
-        void ItemDisplayName(hstring const& value);
-        hstring ItemUrl();
-        void ItemUrl(hstring const& value);
-        hstring LaunchUri();
-        void LaunchUri(hstring const& value);
-        winrt::Windows::Foundation::IAsyncAction LaunchAsync();
-        bool IsFolder();
-        bool IsMail();
-        bool CanDisplay();
-        winrt::Windows::Storage::FileProperties::StorageItemThumbnail Thumbnail();
-        void Thumbnail(winrt::Windows::Storage::FileProperties::StorageItemThumbnail const& value);
-        winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage ItemImage();
-        void ItemImage(winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage const& value);
-    private:
-        void TryGetThumbnailForStorageItem();
-        hstring m_imageUriPath;
-        hstring m_itemDisplayName;
-        hstring m_itemUrl;
-        hstring m_launchUri;
-        bool m_isMail = false;
-        bool m_isFolder = false;
-        bool m_canDisplay{true};
-        winrt::Windows::Storage::FileProperties::StorageItemThumbnail m_thumbnail = nullptr;
-    };
-}
+#pragma once
+#include "SearchResult.g.h"
+
+#include <SearchResultHelpers.h>
+#include "ResultStore.h"
+
+extern SearchResultImageUriManager g_imageUriManager;
+
+namespace winrt::WinSearch::implementation
+{
+    struct SearchResult : SearchResultT<SearchResult>
+    {
+        SearchResult() = default;
+        // A projection of a row of the helper's results, made when the list shows it
+        SearchResult(ResultRow const& row) :
+            m_itemDisplayName(row.displayName),
+            m_itemUrl(row.url),
+            m_launchUri(row.launchUri),
+            m_isMail(row.isMail),
+            m_isFolder(row.isFolder),
+            m_canDisplay(row.canDisplay),
+            m_thumbnailKey(row.thumbnailKey)
+        {
+            if (!m_isMail)
+            {
+                // Only if some other row already loaded it, loading is left until we're shown
+                m_thumbnail = g_imageUriManager.Find(m_thumbnailKey);
+            }
+        }
+
+        hstring ItemDisplayName();
+        void ItemDisplayName(hstring const& value);
+        hstring ItemUrl();
+        void ItemUrl(hstring const& value);
+        hstring LaunchUri();
+        void LaunchUri(hstring const& value);
+        winrt::Windows::Foundation::IAsyncAction LaunchAsync();
+        bool IsFolder();
+        bool IsMail();
+        bool CanDisplay();
+        winrt::Windows::Storage::Streams::IRandomAccessStream Thumbnail();
+        void Thumbnail(winrt::Windows::Storage::Streams::IRandomAccessStream const& value);
+        winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage ItemImage();
+        void ItemImage(winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage const& value);
+    private:
+        void RequestThumbnail();
+        static winrt::fire_and_forget OnThumbnailLoaded(winrt::weak_ref<SearchResult> weakThis, winrt::apartment_context uiThread,
+            winrt::Windows::Storage::Streams::IRandomAccessStream thumbnail);
+        void SetThumbnail(winrt::Windows::Storage::Streams::IRandomAccessStream const& thumbnail);
+        hstring m_itemDisplayName;
+        hstring m_itemUrl;
+        hstring m_launchUri;
+        bool m_isMail = false;
+        bool m_isFolder = false;
+        bool m_canDisplay{true};
+        winrt::Windows::Storage::Streams::IRandomAccessStream m_thumbnail = nullptr;
+        winrt::Microsoft::UI::Xaml::Media::Imaging::BitmapImage m_itemImage = nullptr;
+        bool m_thumbnailRequested{};
+        StringAtom m_thumbnailKey{};
+    };
+}
@@ -1,114 +1,42 @@
-#pragma once
-
-#include "pch.h"
-#include <winrt/Windows.Storage.FileProperties.h>
-#include <winrt/Microsoft.UI.Xaml.Media.Imaging.h>
-
-inline bool IsMailItem(PCWSTR url)
-{
-    std::wstring urlStr(url);
-    size_t indexProtocolFound = urlStr.find(L"mapi");
-    return (indexProtocolFound != std::wstring::npos);
-}
-
-inline void ConvertUrlToFilePath(std::wstring& url, bool* converted)
-{
-    *converted = false;
-    if (IsMailItem(url.c_str()))
-    {
-        return;
-    }
-
-    std::replace(url.begin(), url.end(), L'/', L'\\'); // replace all '/' to '\\'
-
-    std::wstring fileProtocolString;
-
-    fileProtocolString = L"file:";
-
-    size_t indexProtocolFound = url.find(fileProtocolString.c_str());
-
-    if ((indexProtocolFound != std::wstring::npos)
-        && ((indexProtocolFound + fileProtocolString.length()) < url.size()))
-    {
-        url = url.substr(indexProtocolFound + fileProtocolString.length());
-        *converted = true;
-    }
-}
-
-struct SearchResultImageUriManager
-{
-public:
-    SearchResultImageUriManager() { }
-
-    bool NeedProcessThumbnailForItem(PCWSTR itemPath, bool isFolder)
-    {
-        auto lock = m_cs.lock();
-        if (isFolder && (m_folderThumbnail == nullptr))
-        {
-            return true;
-        }
-        else if (!isFolder)
-        {
-            std::wstring filePath(itemPath);
-            std::wstring ext = filePath.substr(filePath.rfind('.'));
-            if (ext.c_str() != nullptr && ext.c_str()[0] != L'\0')
-            {
-                auto it = m_extThumbnailPathMapping.find(ext);
-                if (it == m_extThumbnailPathMapping.end())
-                {
-                    return true;
-                }
-            }
-        }
-
-        return false;
-    }
-
-    void AddThumbnailForFolder(winrt::Windows::Storage::FileProperties::StorageItemThumbnail thumbnail)
-    {
-        auto lock = m_cs.lock();
-        m_folderThumbnail = thumbnail;
-    }
-
-    void AddThumbnailForStorageFile(winrt::Windows::Storage::FileProperties::StorageItemThumbnail thumbnail, PCWSTR itemPath)
-    {
-        auto lock = m_cs.lock();
-        std::wstring filePath(itemPath);
-        std::wstring ext = filePath.substr(filePath.rfind('.'));
-        if (ext.c_str() != nullptr && ext.c_str()[0] != L'\0')
-        {
-            m_extThumbnailPathMapping.emplace(ext, thumbnail);
-        }
-    }
-
-    winrt::Windows::Storage::FileProperties::StorageItemThumbnail GetThumbnailForItem(PCWSTR itemPath, bool isFolder, bool isMail)
-    {
-        auto lock = m_cs.lock();
-        if (isFolder)
-        {
-            return m_folderThumbnail;
-        }
-        else if (!isMail)
-        {
-            std::wstring filePath(itemPath);
-            std::wstring ext = filePath.substr(filePath.rfind('.'));
-            if (ext.c_str() != nullptr && ext.c_str()[0] != L'\0')
-            {
-                auto it = m_extThumbnailPathMapping.find(ext);
-                if (it != m_extThumbnailPathMapping.end())
-                {
-                    return it->second;
-                }
-            }
-        }
-
-        return nullptr;
-    }
-
-private:
-    std::unordered_map<std::wstring, winrt::Windows::Storage::FileProperties::StorageItemThumbnail> m_extThumbnailPathMapping;
-    std::wstring m_mailImageUriPath;
-    winrt::Windows::Storage::FileProperties::StorageItemThumbnail m_folderThumbnail = nullptr;
-
-    wil::critical_section m_cs;
-};
\ No newline at end of file
+#pragma once
+
+#include "pch.h"
+#include <winrt/Windows.Storage.FileProperties.h>
+#include <winrt/Windows.Storage.Streams.h>
+#include <winrt/Microsoft.UI.Xaml.Media.Imaging.h>
+#include "SearchItemUtils.h"
+#include "ThumbnailCache.h"
+#include "ThumbnailScheduler.h"
+#include "ThumbnailStore.h"
+#include "QueryLatency.h"
+
+inline bool IsMailItem(PCWSTR url)
+{
+    return IsMailUrl(url);
+}
+
+// Process wide, always on
+QueryLatencyTracker& GetQueryLatency();
+
+// Thumbnails are kept as the stream of the encoded image, either the one the shell gave us or one read back from
+// the store
+using SearchResultImageUriManager = ExtensionThumbnailCache<winrt::Windows::Storage::Streams::IRandomAccessStream>;
+using SearchResultThumbnailScheduler = ThumbnailScheduler<winrt::Windows::Storage::Streams::IRandomAccessStream>;
+
+// Thumbnails are only loaded for rows that get shown. A couple of workers is plenty, most of the time every row
+// after the first page is an extension we already have.
+constexpr size_t c_thumbnailWorkers{ 2 };
+constexpr size_t c_maxQueuedThumbnails{ 64 };
+
+// Process wide, loads into g_imageUriManager. Shut down when the window closes.
+SearchResultThumbnailScheduler& GetThumbnailScheduler();
+
+// Thumbnails the shell gave us last time, so a new run doesn't have to ask again. A few KB each at list view size.
+constexpr size_t c_thumbnailStoreBytes{ 4 * 1024 * 1024 };
+
+// Process wide, ThumbnailCache.bin in the app's local folder. Misses everything if another instance has it.
+MappedThumbnailStore& GetThumbnailStore();
+
+// Set WINSEARCH_BENCHMARK_THUMBNAILS to have the app time cold thumbnail loads and cache lookups at startup, the
+// results go to the log
+void BenchmarkThumbnails();
@@ -1,209 +1,1324 @@
-#include "pch.h"
-#include "SearchQueryHelper.h"
-#include <intsafe.h>
-#include <NTQuery.h>
-#include <propkey.h>
-#include <SearchResult.h>
-#include "Logging.h"
-
-using namespace winrt::Windows::Foundation::Collections;
-
-struct SearchUXQueryHelper : winrt::implements<SearchUXQueryHelper, ISearchQuery, ISearchUXQuery>, public SearchQueryBase
-{
-public:
-    // ISearchUXQuery
-    void Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled);
-    bool GetContentSearchEnabled() { return m_contentSearchEnabled; }
-    winrt::WinSearch::SearchResult GetResult(DWORD idx);
-    void WaitForQueryCompletedEvent();
-    void CancelOutstandingQueries();
-    void Execute(PCWSTR searchText, DWORD cookie);
-    DWORD GetCookie();
-
-    // ISearchQuery
-    void Init() {};
-    void ExecuteSync() {};
-    PCWSTR GetQueryString() { return m_searchText.c_str(); }
-    DWORD GetNumResults() { return m_numResults; }
-
-    // Other public methods
-    static void CALLBACK QueryTimerCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER);
-    void OnPreFetchRows() override;
-    void OnPostFetchRows() override;
-    void OnFetchRowCallback(IPropertyStore* propStore) override;
-    std::wstring GetPrimingQueryString() override;
-
-private:
-    void ExecuteSyncInternal();
-    void CreateSearchResult(IPropertyStore* propStore);
-
-    winrt::com_ptr<IRowset> m_rowset;
-    winrt::com_ptr<IRowset> m_reuseRowset;
-    wil::critical_section m_cs;
-
-    DWORD m_cookie{};
-    std::wstring m_searchText;
-    bool m_contentSearchEnabled{};
-    bool m_mailSearchEnabled{};
-    bool m_allUsersSearchEnabled{};
-    winrt::Windows::Foundation::Collections::IVector<winrt::WinSearch::SearchResult> m_searchResults;
-    const DWORD m_queryTimerThreshold{ 85 };
-    wil::unique_threadpool_timer m_queryTpTimer;
-    wil::unique_event m_queryCompletedEvent;
-};
-
-winrt::com_ptr<ISearchQuery> CreateSearchQueryHelper()
-{
-    winrt::com_ptr<ISearchQuery> query{ winrt::make<SearchUXQueryHelper>().as<ISearchQuery>() };
-    return query;
-}
-
-void SearchUXQueryHelper::QueryTimerCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER)
-{
-    SearchUXQueryHelper* pQueryHelper = reinterpret_cast<SearchUXQueryHelper*>(context);
-
-    pQueryHelper->ExecuteSyncInternal();
-}
-
-void SearchUXQueryHelper::WaitForQueryCompletedEvent()
-{
-    ::WaitForSingleObject(m_queryCompletedEvent.get(), INFINITE);
-}
-
-void SearchUXQueryHelper::CreateSearchResult(IPropertyStore* propStore)
-{
-    SmartPropVariant itemNameDisplay;
-    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemNameDisplay, itemNameDisplay.put()));
-
-    SmartPropVariant itemUrl;
-    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemUrl, itemUrl.put()));
-
-    // Need to calculate the image path to use, and let's try to do that based off of the kind
-    SmartPropVariant kindText;
-    THROW_IF_FAILED(propStore->GetValue(PKEY_KindText, kindText.put()));
-
-    bool isFolder = false;
-    if (!kindText.IsEmpty())
-    {
-        if (wcscmp(kindText.GetString().c_str(), L"Folder") == 0)
-        {
-            isFolder = true;
-        }
-    }
-
-    std::wstring filePath(itemUrl.GetString());
-    bool convertedToFilePath = false;
-    ConvertUrlToFilePath(filePath, &convertedToFilePath);
-    bool isMail = !convertedToFilePath;
-
-    // Create the actual result object
-    auto searchResult = winrt::make<winrt::WinSearch::implementation::SearchResult>(
-        itemNameDisplay.GetString().c_str(),
-        itemUrl.GetString().c_str(),
-        filePath.c_str(),
-        isMail,
-        isFolder);
-    if (searchResult.CanDisplay())
-    {
-        m_searchResults.Append(searchResult);
-    }
-}
-
-winrt::WinSearch::SearchResult SearchUXQueryHelper::GetResult(DWORD idx)
-{
-    return m_searchResults.GetAt(idx);
-}
-
-void SearchUXQueryHelper::OnPreFetchRows()
-{
-    // If we've gotten this far we have successful results...only now clear the result list and update it
-    m_searchResults = winrt::single_threaded_observable_vector<winrt::WinSearch::SearchResult>();
-}
-
-void SearchUXQueryHelper::OnPostFetchRows()
-{
-    // We're done...
-    m_numResults = m_searchResults.Size(); // num results is really how many we display
-    m_queryCompletedEvent.SetEvent();
-}
-
-void SearchUXQueryHelper::OnFetchRowCallback(IPropertyStore* propStore)
-{
-    CreateSearchResult(propStore);
-}
-
-void SearchUXQueryHelper::ExecuteSyncInternal()
-{
-    try
-    {
-        QueryStringBuilder builder;
-        std::wstring queryStr = builder.GenerateQuery(m_searchText.c_str(), m_contentSearchEnabled, m_mailSearchEnabled, m_allUsersSearchEnabled, m_reuseWhereID);
-        ExecuteQueryStringSync(queryStr.c_str());
-    }
-    CATCH_LOG();
-}
-
-void SearchUXQueryHelper::CancelOutstandingQueries()
-{
-    // Are we currently doing work? If so, let's cancel
-    {
-        auto lock = m_cs.lock();
-        SetThreadpoolTimer(m_queryTpTimer.get(), nullptr, 0, 0);
-        WaitForThreadpoolTimerCallbacks(m_queryTpTimer.get(), TRUE);
-        m_queryTpTimer.reset(nullptr);
-    }
-}
-
-void SearchUXQueryHelper::Execute(PCWSTR searchText, DWORD cookie)
-{
-    // We should try to coaelse queries here so that we aren't firing one for every specific key entered...
-    // If a query comes in within our threshold let's kill the firing one and create a new one
-    auto lock = m_cs.lock();
-
-    if (m_queryTpTimer.get() != nullptr)
-    {
-        // We cancel the outstanding query callback and queue a new one every time
-        SetThreadpoolTimer(m_queryTpTimer.get(), nullptr, 0, 0);
-        WaitForThreadpoolTimerCallbacks(m_queryTpTimer.get(), TRUE);
-        m_searchText = searchText;
-        m_cookie = cookie;
-
-        // queue query
-        FILETIME64 ft = { -static_cast<INT64>(m_queryTimerThreshold) * 10000 };
-        FILETIME fireTime = ft.ft;
-        _tracelog(L"Queue query: %d\n", m_cookie);
-        SetThreadpoolTimer(m_queryTpTimer.get(), &fireTime, 0, 0);
-    }
-}
-
-std::wstring SearchUXQueryHelper::GetPrimingQueryString()
-{
-    QueryStringBuilder builder;
-    std::wstring queryStr = builder.GeneratePrimingQuery(m_mailSearchEnabled, m_allUsersSearchEnabled);
-    return queryStr;
-}
-
-void SearchUXQueryHelper::Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled)
-{
-    // Create all the objects we will want cached
-    try
-    {
-        m_contentSearchEnabled = contentSearchEnabled;
-        m_mailSearchEnabled = mailSearchEnabled;
-        m_allUsersSearchEnabled = allUsersSearchEnabled;
-        m_queryTpTimer.reset(CreateThreadpoolTimer(SearchUXQueryHelper::QueryTimerCallback, reinterpret_cast<void*>(this), nullptr));
-        THROW_LAST_ERROR_IF_NULL(m_queryTpTimer.get());
-
-        m_queryCompletedEvent.create();
-        THROW_LAST_ERROR_IF_NULL(m_queryCompletedEvent.get());
-
-        // Execute a synchronous query on file/mapi items to prime the index and keep that handle around
-        PrimeIndexAndCacheWhereId();
-    }
-    CATCH_LOG();
-}
-
-DWORD SearchUXQueryHelper::GetCookie()
-{
-    return m_cookie;
+#include "pch.h"
+#include "SearchQueryHelper.h"
+#include <functional>
+#include <intsafe.h>
+#include <list>
+#include <NTQuery.h>
+#include <propkey.h>
+#include <SearchResult.h>
+#include <thread>
+#include <wininet.h>
+#include "Logging.h"
+
+using namespace winrt::Windows::Foundation::Collections;
+
+// Runs the query for a likely next keystroke off to the side, without touching the helper's rowset or results
+struct SpeculativeQuery : public SearchQueryBase
+{
+public:
+    using CreateResult = std::function<void(ColumnarRowBatch const&, size_t, ResultStore&)>;
+
+    SpeculativeQuery(std::vector<BoundColumn> columns, CreateResult createResult, ULONGLONG pageSize) :
+        m_columns(std::move(columns)), m_createResult(std::move(createResult)), m_pageSize(pageSize)
+    {
+    }
+
+    // True if the query ran to completion and Results() hold its first page
+    bool Run(std::wstring const& text, bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled, uint32_t reuseOptions,
+        CancellationToken const& cancellation)
+    {
+        DWORD whereId = AcquireReuseWhereId(text.c_str(), reuseOptions);
+        if (whereId == 0)
+        {
+            // Nothing primed with these options yet
+            return false;
+        }
+
+        QueryStringBuilder builder;
+        std::wstring queryStr = builder.GenerateQuery(text.c_str(), contentSearchEnabled, mailSearchEnabled, allUsersSearchEnabled, whereId);
+        ExecuteQueryStringSync(queryStr.c_str(), cancellation);
+        if (!m_completed || cancellation.IsCancellationRequested())
+        {
+            return false;
+        }
+
+        // The real query for this text gets the narrowest restriction there is
+        CacheReuseWhereId(text.c_str(), reuseOptions);
+        return true;
+    }
+
+    ResultStore& Results() { return m_results; }
+
+    void OnPreFetchRows() override {};
+    void OnFetchRowCallback(IPropertyStore*) override { m_decodedThroughPropertyStores = true; }
+    void OnPostFetchRows() override { m_completed = (m_rowset != nullptr) && !m_decodedThroughPropertyStores; }
+    bool CanMaterializeRowsConcurrently() override { return true; }
+    std::vector<BoundColumn> GetBoundColumns() override { return m_columns; }
+    void MaterializeRow(ColumnarRowBatch const& batch, size_t row, ResultStore& results) override { m_createResult(batch, row, results); }
+    std::wstring GetPrimingQueryString() override { return {}; }
+    ULONGLONG GetInitialFetchLimit() override { return m_pageSize; }
+    bool IsBackgroundQuery() override { return true; }
+
+    void OnRowMaterialized(ResultStore const& results, size_t row) override
+    {
+        m_results.AppendFrom(results, row);
+    }
+
+private:
+    std::vector<BoundColumn> m_columns;
+    CreateResult m_createResult;
+    const ULONGLONG m_pageSize;
+    ResultStore m_results;
+    bool m_decodedThroughPropertyStores{}; // not worth speculating without the accessor, those rows are dropped
+    bool m_completed{};
+};
+
+// A result from one scope of a fanned out query, with what the scopes get merged on. The row itself waits in
+// the scope's pending rows until it's merged.
+struct ScopedResult
+{
+    uint32_t scope;
+    uint32_t row;
+    int64_t rank;
+    uint64_t dateModified; // yyyymmddhhmmss, so the bound text and the property store value compare the same
+};
+
+// Same order as QueryStringBuilder::c_orderConditions, so the merge agrees with what each scope's rowset hands back
+struct ScopedResultOrder
+{
+    bool operator()(ScopedResult const& left, ScopedResult const& right) const
+    {
+        return (left.rank != right.rank) ? (left.rank < right.rank) : (left.dateModified < right.dateModified);
+    }
+};
+
+// The provider converts dates to text as yyyy-mm-dd hh:mm:ss[.fff]
+static uint64_t SortableTimestamp(std::wstring_view text)
+{
+    uint64_t value = 0;
+    size_t digits = 0;
+    for (size_t i = 0; (i < text.size()) && (digits < 14); ++i)
+    {
+        if ((text[i] >= L'0') && (text[i] <= L'9'))
+        {
+            value = (value * 10) + (text[i] - L'0');
+            digits++;
+        }
+    }
+    return value;
+}
+
+static uint64_t SortableTimestamp(FILETIME const& fileTime)
+{
+    SYSTEMTIME time{};
+    if (!FileTimeToSystemTime(&fileTime, &time))
+    {
+        return 0;
+    }
+    return (time.wYear * 10000000000ull) + (time.wMonth * 100000000ull) + (time.wDay * 1000000ull) +
+        (time.wHour * 10000ull) + (time.wMinute * 100ull) + time.wSecond;
+}
+
+// One scope of a fanned out query, on its own session and rowset. Rows are handed over in the scope's rank
+// order, with what the scopes get merged on in their rank columns.
+struct ScopeQuery : public SearchQueryBase
+{
+public:
+    using CreateResult = std::function<void(ResultStore&, DWORD, std::wstring_view, std::wstring_view, std::wstring_view, int64_t, uint64_t)>;
+    using ResultCallback = std::function<void(ResultStore const&, size_t)>;
+    using FirstPageCallback = std::function<void(bool exhausted)>;
+
+    ScopeQuery(QueryScope scope, CreateResult createResult, ResultCallback onResult, FirstPageCallback onFirstPage) :
+        m_scope(scope), m_createResult(std::move(createResult)), m_onResult(std::move(onResult)), m_onFirstPage(std::move(onFirstPage))
+    {
+    }
+
+    void Run(std::wstring const& text, bool contentSearchEnabled, bool allUsersSearchEnabled, uint32_t reuseOptions, ULONGLONG firstPageSize,
+        CancellationToken const& cancellation, DWORD cookie)
+    {
+        m_allUsersSearchEnabled = allUsersSearchEnabled;
+        m_firstPageSize = firstPageSize;
+
+        DWORD whereId = AcquireReuseWhereId(text.c_str(), reuseOptions);
+        if (whereId == 0)
+        {
+            // First time this scope runs on its own with these options, from then on it comes from the cache
+            PrimeIndexAndCacheWhereId(reuseOptions, cancellation);
+            whereId = m_reuseWhereID;
+        }
+
+        QueryStringBuilder builder;
+        builder.AddProperty(L"System.Search.Rank");
+        builder.AddProperty(L"System.DateModified");
+        std::wstring queryStr = builder.GenerateQuery(text.c_str(), contentSearchEnabled, true, allUsersSearchEnabled, whereId, m_scope);
+        GetQueryFlightRecorder().OnQuery(cookie, queryStr, whereId);
+        ExecuteQueryStringSync(queryStr.c_str(), cancellation, cookie);
+        CacheReuseWhereId(text.c_str(), reuseOptions);
+    }
+
+    // Up to count more rows from where the first page left off, false once there aren't any more. Canceled
+    // through the token of whoever is asking, the query this scope ran for may be long superseded.
+    bool FetchMore(ULONGLONG count, CancellationToken const& cancellation)
+    {
+        auto lock = m_cs.lock();
+        m_fetchCancellation = cancellation;
+        if ((m_rowset != nullptr) && !m_rowsetExhausted)
+        {
+            ULONGLONG fetched = 0;
+            FetchRows(&fetched, count);
+        }
+        return (m_rowset != nullptr) && !m_rowsetExhausted;
+    }
+
+    bool HasMoreRows()
+    {
+        auto lock = m_cs.lock();
+        return (m_rowset != nullptr) && !m_rowsetExhausted;
+    }
+
+    void OnPreFetchRows() override {};
+    void OnPostFetchRows() override
+    {
+        if (!m_fetchCancellation.IsCancellationRequested())
+        {
+            m_onFirstPage((m_rowset == nullptr) || m_rowsetExhausted);
+        }
+    }
+
+    bool CanMaterializeRowsConcurrently() override { return true; }
+    ULONGLONG GetInitialFetchLimit() override { return m_firstPageSize; }
+
+    std::wstring GetPrimingQueryString() override
+    {
+        QueryStringBuilder builder;
+        return builder.GeneratePrimingQuery(true, m_allUsersSearchEnabled, m_scope);
+    }
+
+    std::vector<BoundColumn> GetBoundColumns() override
+    {
+        // Order has to match BoundColumnIndex
+        return {
+            { L"System.ItemNameDisplay", MAX_PATH },
+            { L"System.ItemUrl", INTERNET_MAX_URL_LENGTH },
+            { L"System.KindText", 128 },
+            { L"System.Search.Rank", 32 },
+            { L"System.DateModified", 64 },
+        };
+    }
+
+    void MaterializeRow(ColumnarRowBatch const& batch, size_t row, ResultStore& results) override
+    {
+        // The batch's values are null terminated
+        m_createResult(results, m_latencyCookie, batch.GetString(row, ItemNameDisplayColumn), batch.GetString(row, ItemUrlColumn), batch.GetString(row, KindTextColumn),
+            _wtoi64(batch.GetString(row, RankColumn).data()), SortableTimestamp(batch.GetString(row, DateModifiedColumn)));
+    }
+
+    void OnRowMaterialized(ResultStore const& results, size_t row) override
+    {
+        m_onResult(results, row);
+    }
+
+    void OnFetchRowCallback(IPropertyStore* propStore) override
+    {
+        SmartPropVariant itemNameDisplay;
+        THROW_IF_FAILED(propStore->GetValue(PKEY_ItemNameDisplay, itemNameDisplay.put()));
+
+        SmartPropVariant itemUrl;
+        THROW_IF_FAILED(propStore->GetValue(PKEY_ItemUrl, itemUrl.put()));
+
+        SmartPropVariant kindText;
+        THROW_IF_FAILED(propStore->GetValue(PKEY_KindText, kindText.put()));
+
+        PROPVARIANT rank{};
+        THROW_IF_FAILED(propStore->GetValue(PKEY_Search_Rank, &rank));
+        const int64_t rankValue = PropVariantToInt64WithDefault(rank, 0);
+        PropVariantClear(&rank);
+
+        PROPVARIANT dateModified{};
+        THROW_IF_FAILED(propStore->GetValue(PKEY_DateModified, &dateModified));
+        FILETIME dateModifiedValue{};
+        PropVariantToFileTime(dateModified, PSTF_UTC, &dateModifiedValue);
+        PropVariantClear(&dateModified);
+
+        m_fetchedRow.Clear();
+        m_createResult(m_fetchedRow, m_latencyCookie, itemNameDisplay.GetString(), itemUrl.GetString(), kindText.IsEmpty() ? L"" : kindText.GetString(),
+            rankValue, SortableTimestamp(dateModifiedValue));
+        if (!m_fetchedRow.Empty())
+        {
+            m_onResult(m_fetchedRow, 0);
+        }
+    }
+
+private:
+    enum BoundColumnIndex
+    {
+        ItemNameDisplayColumn,
+        ItemUrlColumn,
+        KindTextColumn,
+        RankColumn,
+        DateModifiedColumn,
+    };
+
+    const QueryScope m_scope;
+    CreateResult m_createResult;
+    ResultCallback m_onResult;
+    FirstPageCallback m_onFirstPage;
+    ResultStore m_fetchedRow; // for rows that come through a property store
+    ULONGLONG m_firstPageSize{};
+    bool m_allUsersSearchEnabled{};
+};
+
+struct SearchUXQueryHelper : winrt::implements<SearchUXQueryHelper, ISearchQuery, ISearchUXQuery>, public SearchQueryBase
+{
+public:
+    // ISearchUXQuery
+    void Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled);
+    bool GetContentSearchEnabled() { return m_contentSearchEnabled; }
+    winrt::WinSearch::SearchResult GetResult(DWORD revision, DWORD idx);
+    DWORD GetResultCount(DWORD revision);
+    void SetFirstPageSize(DWORD firstPageSize);
+    ResultStreamUpdate WaitForResults(DWORD cookie, DWORD revision, DWORD seen);
+    DWORD LoadMoreResults(DWORD cookie, DWORD count);
+    bool HasMoreResults(DWORD cookie);
+    void CancelOutstandingQueries();
+    void Execute(PCWSTR searchText, DWORD cookie);
+    DWORD GetCookie();
+
+    // ISearchQuery
+    void Init() {};
+    void ExecuteSync() {};
+    PCWSTR GetQueryString() { return m_searchText.c_str(); }
+    DWORD GetNumResults() { return m_numResults; }
+
+    // Other public methods
+    static void CALLBACK QueryTimerCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER);
+    static void CALLBACK SpeculationWorkCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WORK);
+    void OnPreFetchRows() override;
+    void OnPostFetchRows() override;
+    void OnPostFetchRowBatch() override;
+    void OnFetchRowCallback(IPropertyStore* propStore) override;
+    bool CanMaterializeRowsConcurrently() override { return true; }
+    std::vector<BoundColumn> GetBoundColumns() override;
+    void MaterializeRow(ColumnarRowBatch const& batch, size_t row, ResultStore& results) override;
+    void OnRowMaterialized(ResultStore const& results, size_t row) override;
+    std::wstring GetPrimingQueryString() override;
+    ULONGLONG GetInitialFetchLimit() override;
+
+private:
+    void ExecuteSyncInternal();
+    void CancelRunningQuery();
+    bool TryRefineResultsLocally(PCWSTR searchText, DWORD cookie);
+    bool TryAnswerFromFilenameIndex(PCWSTR searchText, DWORD cookie);
+    bool TryAnswerFromSpeculation(PCWSTR searchText, DWORD cookie);
+    void ScheduleSpeculation(CancellationToken const& queryCancellation);
+    void CancelSpeculation();
+    void RunSpeculation();
+    void ExecuteFanOut(uint32_t reuseOptions, CancellationToken const& cancellation);
+    void OnScopeResult(size_t scope, ResultStore const& results, size_t row);
+    void OnScopeFirstPage(size_t scope, bool exhausted);
+    void BeginScopeResults();
+    size_t DrainScopeMerge();
+    void LoadMoreScopeResults(DWORD count);
+    void PublishProvisionalResults(ResultStore&& results, PCWSTR searchText, DWORD cookie);
+    size_t ReplaceResults(ResultStore* replacement, DWORD cookie, PCWSTR resultsText = nullptr, bool provisionalResults = false);
+    ResultStore const* GetResultsOf(DWORD revision);
+    uint32_t GetReuseOptions();
+    // cookie is the query the time it takes gets charged to, 0 for work no keystroke is waiting on
+    void AppendSearchResult(ResultStore& results, DWORD cookie, IPropertyStore* propStore);
+    void AppendSearchResult(ResultStore& results, DWORD cookie, std::wstring_view itemNameDisplay, std::wstring_view itemUrl, std::wstring_view kindText,
+        int64_t rank = 0, uint64_t dateModified = 0);
+
+    enum BoundColumnIndex
+    {
+        ItemNameDisplayColumn,
+        ItemUrlColumn,
+        KindTextColumn,
+    };
+
+    wil::critical_section m_cs; // guards the query timer, the query itself runs under SearchQueryBase::m_cs
+
+    DWORD m_cookie{};
+    std::atomic<DWORD> m_runningCookie{};
+    std::wstring m_searchText;
+    bool m_contentSearchEnabled{};
+    bool m_mailSearchEnabled{};
+    bool m_allUsersSearchEnabled{};
+    ResultStore m_searchResults; // the list makes projections of the rows it shows, see GetResult
+    wil::srwlock m_resultsLock; // results are appended on the fetch thread while the UI reads the published ones
+    ResultStore m_fetchedRow; // for rows that come through a property store
+    ResultStreamPublisher m_resultStream;
+    ResultPager m_pager{ c_resultPageSize, 0 };
+    std::atomic<DWORD> m_firstPageSize{ c_resultPageSize };
+    std::atomic<bool> m_hasMoreResults{};
+    std::wstring m_resultsText; // what m_searchResults are results for, guarded by m_resultsLock like them
+    bool m_provisionalResults{}; // m_searchResults is a local refinement and not backed by m_rowset, also m_resultsLock
+    // The list keeps showing the rows it has until the ones that replace them are published, so the results they
+    // replaced stay around until the next replacement. Both are published under a revision, also m_resultsLock.
+    ResultStore m_previousResults;
+    uint32_t m_resultsRevision{};
+    uint32_t m_previousRevision{};
+    static constexpr size_t c_resultPageSize{ 50 };
+    // How long to coalesce keystrokes, learned from typing cadence and how long recent queries took. Starts
+    // out at the 85ms we always used.
+    DebounceScheduler m_debounce{ std::make_unique<AdaptiveDebouncePolicy>(85, 20, 250, 30) };
+    const DWORD m_resultStreamBatchSize{ 500 };
+    QueryStringBuilder m_queryBuilder; // only used by the query timer callback, so the template and buffer stay warm
+    std::wstring m_queryBuffer;
+    CancellationSource m_queryCancellation; // for the queued or running query, replaced by every Execute
+    wil::srwlock m_cancellationLock;
+
+    // With mail in the mix every scope gets a query of its own so slow mail stores don't hold up file results.
+    // The scope queries are guarded by SearchQueryBase::m_cs like m_rowset once they're done with their first
+    // page, the rest by m_scopeMergeLock since the scopes push rows from their own threads.
+    static constexpr bool c_scopeFanOutEnabled{ true };
+    std::vector<std::unique_ptr<ScopeQuery>> m_scopeQueries; // of the current results, empty unless they were fanned out
+    IncrementalMerge<ScopedResult, ScopedResultOrder> m_scopeMerge;
+    std::vector<ResultStore> m_scopeRows; // a scope's rows that are still in the merge, by scope
+    wil::srwlock m_scopeMergeLock;
+    size_t m_scopeFirstPages{};
+    bool m_scopeResultsBegun{};
+    bool m_scopeAhead{}; // showing the fastest scope on its own until every scope has its first page
+
+    // Speculative queries for the likely next keystrokes, run while the user pauses
+    struct SpeculativeResults
+    {
+        std::wstring text; // normalized
+        uint32_t options;
+        ResultStore results;
+        bool used;
+    };
+    SpeculationPlanner m_speculationPlanner;
+    SpeculationBudget m_speculationBudget{ std::chrono::milliseconds(1000), std::chrono::milliseconds(250) };
+    std::list<SpeculativeResults> m_speculativeResults; // most recently used first
+    std::wstring m_speculationText;
+    uint32_t m_speculationOptions{};
+    CancellationSource m_speculationCancellation;
+    wil::srwlock m_speculationLock; // guards all of the speculation state
+    static constexpr size_t c_maxSpeculativeContinuations{ 3 };
+    static constexpr size_t c_maxSpeculativeResults{ 8 };
+    static constexpr size_t c_speculationCatalogSample{ 512 };
+
+    // Last, so their callbacks are waited on before anything they use goes away
+    wil::unique_threadpool_timer m_queryTpTimer;
+    wil::unique_threadpool_work m_speculationWork;
+};
+
+winrt::com_ptr<ISearchQuery> CreateSearchQueryHelper()
+{
+    winrt::com_ptr<ISearchQuery> query{ winrt::make<SearchUXQueryHelper>().as<ISearchQuery>() };
+    return query;
+}
+
+void SearchUXQueryHelper::QueryTimerCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER)
+{
+    SearchUXQueryHelper* pQueryHelper = reinterpret_cast<SearchUXQueryHelper*>(context);
+
+    pQueryHelper->ExecuteSyncInternal();
+}
+
+void SearchUXQueryHelper::SpeculationWorkCallback(PTP_CALLBACK_INSTANCE, PVOID context, PTP_WORK)
+{
+    SearchUXQueryHelper* pQueryHelper = reinterpret_cast<SearchUXQueryHelper*>(context);
+
+    pQueryHelper->RunSpeculation();
+}
+
+void SearchUXQueryHelper::SetFirstPageSize(DWORD firstPageSize)
+{
+    m_firstPageSize = firstPageSize;
+    m_resultStream.SetPageSizes(firstPageSize, m_resultStreamBatchSize);
+}
+
+ULONGLONG SearchUXQueryHelper::GetInitialFetchLimit()
+{
+    // Only what's needed to fill the viewport, the list asks for more as the user scrolls
+    return m_pager.InitialFetchSize();
+}
+
+DWORD SearchUXQueryHelper::LoadMoreResults(DWORD cookie, DWORD count)
+{
+    try
+    {
+        // Serialize with the query itself, a newer query may be replacing the rowset under us
+        auto lock = SearchQueryBase::m_cs.lock();
+        bool provisionalResults;
+        {
+            auto resultsLock = m_resultsLock.lock_shared();
+            provisionalResults = m_provisionalResults;
+        }
+        if ((cookie != m_runningCookie) || ((m_rowset == nullptr) && m_scopeQueries.empty()) || provisionalResults)
+        {
+            return 0;
+        }
+
+        const size_t rowsToFetch = m_pager.FetchSizeFor(count);
+        if (!m_scopeQueries.empty())
+        {
+            LoadMoreScopeResults(count);
+        }
+        else if (rowsToFetch > 0)
+        {
+            ULONGLONG fetched = 0;
+            FetchRows(&fetched, rowsToFetch);
+            m_pager.OnRowsFetched(static_cast<size_t>(fetched), m_rowsetExhausted);
+            m_hasMoreResults = m_pager.HasMoreRows();
+        }
+    }
+    CATCH_LOG();
+
+    auto lock = m_resultsLock.lock_shared();
+    m_numResults = static_cast<DWORD>(m_searchResults.Size());
+    return m_numResults;
+}
+
+bool SearchUXQueryHelper::HasMoreResults(DWORD cookie)
+{
+    // Called from the UI thread, so no waiting on the query lock here
+    return (cookie == m_runningCookie) && m_hasMoreResults;
+}
+
+ResultStreamUpdate SearchUXQueryHelper::WaitForResults(DWORD cookie, DWORD revision, DWORD seen)
+{
+    return m_resultStream.WaitForUpdate(cookie, revision, seen);
+}
+
+void SearchUXQueryHelper::AppendSearchResult(ResultStore& results, DWORD cookie, std::wstring_view itemNameDisplay, std::wstring_view itemUrl,
+    std::wstring_view kindText, int64_t rank, uint64_t dateModified)
+{
+    QueryLatencySpan span(GetQueryLatency(), cookie, QueryStage::CreateResult);
+    ::AppendSearchResult(results, itemNameDisplay, itemUrl, kindText, rank, dateModified);
+}
+
+void SearchUXQueryHelper::AppendSearchResult(ResultStore& results, DWORD cookie, IPropertyStore* propStore)
+{
+    SmartPropVariant itemNameDisplay;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemNameDisplay, itemNameDisplay.put()));
+
+    SmartPropVariant itemUrl;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_ItemUrl, itemUrl.put()));
+
+    SmartPropVariant kindText;
+    THROW_IF_FAILED(propStore->GetValue(PKEY_KindText, kindText.put()));
+
+    std::wstring itemNameDisplayStr(itemNameDisplay.GetString());
+    std::wstring itemUrlStr(itemUrl.GetString());
+    std::wstring kindTextStr(kindText.IsEmpty() ? L"" : kindText.GetString());
+    AppendSearchResult(results, cookie, itemNameDisplayStr, itemUrlStr, kindTextStr);
+}
+
+std::vector<BoundColumn> SearchUXQueryHelper::GetBoundColumns()
+{
+    // Order has to match BoundColumnIndex
+    return {
+        { L"System.ItemNameDisplay", MAX_PATH },
+        { L"System.ItemUrl", INTERNET_MAX_URL_LENGTH },
+        { L"System.KindText", 128 },
+    };
+}
+
+void SearchUXQueryHelper::MaterializeRow(ColumnarRowBatch const& batch, size_t row, ResultStore& results)
+{
+    AppendSearchResult(results, m_latencyCookie,
+        batch.GetString(row, ItemNameDisplayColumn),
+        batch.GetString(row, ItemUrlColumn),
+        batch.GetString(row, KindTextColumn));
+}
+
+void SearchUXQueryHelper::OnRowMaterialized(ResultStore const& results, size_t row)
+{
+    size_t count;
+    {
+        auto lock = m_resultsLock.lock_exclusive();
+        m_searchResults.AppendFrom(results, row);
+        count = m_searchResults.Size();
+    }
+    m_resultStream.OnRowsAvailable(count);
+}
+
+ResultStore const* SearchUXQueryHelper::GetResultsOf(DWORD revision)
+{
+    // m_resultsLock is held
+    if (revision == m_resultsRevision)
+    {
+        return &m_searchResults;
+    }
+    return (revision == m_previousRevision) ? &m_previousResults : nullptr;
+}
+
+winrt::WinSearch::SearchResult SearchUXQueryHelper::GetResult(DWORD revision, DWORD idx)
+{
+    auto lock = m_resultsLock.lock_shared();
+    ResultStore const* results = GetResultsOf(revision);
+    if ((results == nullptr) || (idx >= results->Size()))
+    {
+        // Results were replaced more than once since the caller looked
+        return nullptr;
+    }
+
+    // The projection copies the row's strings, nothing of it points into the store or the buffer
+    ResultRowBuffer buffer;
+    return winrt::make<winrt::WinSearch::implementation::SearchResult>(results->GetRow(idx, buffer));
+}
+
+DWORD SearchUXQueryHelper::GetResultCount(DWORD revision)
+{
+    auto lock = m_resultsLock.lock_shared();
+    ResultStore const* results = GetResultsOf(revision);
+    return (results != nullptr) ? static_cast<DWORD>(results->Size()) : 0;
+}
+
+size_t SearchUXQueryHelper::ReplaceResults(ResultStore* replacement, DWORD cookie, PCWSTR resultsText, bool provisionalResults)
+{
+    // The new revision is begun under the lock, so a reader never sees rows of one revision under the other.
+    // Empties the results without a replacement, and leaves what they are results for alone without resultsText.
+    auto lock = m_resultsLock.lock_exclusive();
+    std::swap(m_previousResults, m_searchResults);
+    m_previousRevision = m_resultsRevision;
+    if (replacement != nullptr)
+    {
+        std::swap(m_searchResults, *replacement);
+    }
+    else
+    {
+        m_searchResults.Clear();
+    }
+
+    if (resultsText != nullptr)
+    {
+        m_resultsText = resultsText;
+        m_provisionalResults = provisionalResults;
+    }
+    m_resultsRevision = m_resultStream.Begin(cookie);
+    return m_searchResults.Size();
+}
+
+void SearchUXQueryHelper::OnPreFetchRows()
+{
+    // If we've gotten this far we have successful results...only now clear the result list and update it
+    m_scopeQueries.clear();
+    m_pager.Reset(m_firstPageSize);
+    m_hasMoreResults = false;
+    ReplaceResults(nullptr, m_runningCookie, m_searchText.c_str());
+}
+
+void SearchUXQueryHelper::OnPostFetchRowBatch()
+{
+    // Don't sit on rows while the provider gets us the next batch
+    auto lock = m_resultsLock.lock_shared();
+    m_resultStream.Flush(m_searchResults.Size());
+}
+
+void SearchUXQueryHelper::OnPostFetchRows()
+{
+    // We're done with the first pages...anything past them gets fetched when the list asks for it
+    m_pager.OnRowsFetched(static_cast<size_t>(m_rowsFetched), m_rowsetExhausted);
+    m_hasMoreResults = (m_rowset != nullptr) && m_pager.HasMoreRows();
+
+    auto lock = m_resultsLock.lock_shared();
+    m_numResults = static_cast<DWORD>(m_searchResults.Size()); // num results is really how many we display
+    m_resultStream.Complete(m_runningCookie, m_searchResults.Size());
+}
+
+void SearchUXQueryHelper::OnFetchRowCallback(IPropertyStore* propStore)
+{
+    m_fetchedRow.Clear();
+    AppendSearchResult(m_fetchedRow, m_latencyCookie, propStore);
+    if (!m_fetchedRow.Empty())
+    {
+        OnRowMaterialized(m_fetchedRow, 0);
+    }
+}
+
+void SearchUXQueryHelper::ExecuteSyncInternal()
+{
+    try
+    {
+        m_runningCookie = m_cookie;
+        GetQueryLatency().RecordSinceKeystroke(m_runningCookie, QueryStage::Debounce, QueryLatencyTracker::NowMicroseconds());
+
+        CancellationToken cancellation;
+        {
+            auto lock = m_cancellationLock.lock_shared();
+            cancellation = m_queryCancellation.Token();
+        }
+
+        const uint32_t reuseOptions = GetReuseOptions();
+        auto start = std::chrono::steady_clock::now();
+        if (c_scopeFanOutEnabled && m_mailSearchEnabled)
+        {
+            ExecuteFanOut(reuseOptions, cancellation);
+        }
+        else
+        {
+            DWORD whereId = AcquireReuseWhereId(m_searchText.c_str(), reuseOptions);
+
+            m_queryBuilder.GenerateQuery(m_queryBuffer, m_searchText.c_str(), m_contentSearchEnabled, m_mailSearchEnabled, m_allUsersSearchEnabled, whereId);
+            GetQueryFlightRecorder().OnQuery(m_runningCookie, m_queryBuffer, whereId);
+            ExecuteQueryStringSync(m_queryBuffer.c_str(), cancellation, m_runningCookie);
+
+            // Anything typed after this (or typed again later) can start from this query's restriction
+            CacheReuseWhereId(m_searchText.c_str(), reuseOptions);
+        }
+
+        if (!cancellation.IsCancellationRequested())
+        {
+            m_debounce.OnQueryCompleted(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()));
+        }
+
+        // While the user looks at these, get a head start on what they are likely to type next
+        ScheduleSpeculation(cancellation);
+    }
+    CATCH_LOG();
+}
+
+void SearchUXQueryHelper::ExecuteFanOut(uint32_t reuseOptions, CancellationToken const& cancellation)
+{
+    // Every scope runs under its own query's lock, ours is only held while the scope queries are swapped. The
+    // old ones go right away so paging stops asking them for rows that are about to be replaced, and a slow
+    // scope doesn't hold up paging or the next keystroke's provisional results until it notices it's canceled.
+    const std::wstring searchText = m_searchText;
+    const ULONGLONG firstPageSize = GetInitialFetchLimit();
+    const DWORD cookie = m_runningCookie;
+    {
+        auto lock = SearchQueryBase::m_cs.lock();
+        m_scopeQueries.clear();
+        ReleaseRowsetAccessor();
+        m_rowset = nullptr;
+        m_hasMoreResults = false;
+        m_fetchCancellation = cancellation; // paging the scopes stops with this query
+    }
+
+    // Files share restrictions with searches that don't include mail, mail gets an option bit of its own
+    const QueryScope scopes[] = { QueryScope::Files, QueryScope::Mail };
+    const uint32_t scopeOptions[] = { reuseOptions & ~0x2u, (reuseOptions & ~0x2u) | 0x8u };
+
+    {
+        auto mergeLock = m_scopeMergeLock.lock_exclusive();
+        m_scopeMerge.Reset(ARRAYSIZE(scopes));
+        m_scopeRows.resize(ARRAYSIZE(scopes));
+        for (auto& rows : m_scopeRows)
+        {
+            rows.Clear();
+        }
+        m_scopeFirstPages = 0;
+        m_scopeResultsBegun = false;
+        m_scopeAhead = false;
+    }
+
+    std::vector<std::unique_ptr<ScopeQuery>> scopeQueries;
+    for (size_t i = 0; i < ARRAYSIZE(scopes); ++i)
+    {
+        scopeQueries.push_back(std::make_unique<ScopeQuery>(scopes[i],
+            [this](ResultStore& results, DWORD latencyCookie, std::wstring_view itemNameDisplay, std::wstring_view itemUrl, std::wstring_view kindText,
+                int64_t rank, uint64_t dateModified)
+            {
+                AppendSearchResult(results, latencyCookie, itemNameDisplay, itemUrl, kindText, rank, dateModified);
+            },
+            [this, i](ResultStore const& results, size_t row) { OnScopeResult(i, results, row); },
+            [this, i](bool exhausted) { OnScopeFirstPage(i, exhausted); }));
+    }
+
+    // Each scope on its own session, every scope but the first on a thread of its own
+    auto runScope = [&](size_t i)
+        {
+            try
+            {
+                scopeQueries[i]->Run(searchText, m_contentSearchEnabled, m_allUsersSearchEnabled, scopeOptions[i], firstPageSize, cancellation, cookie);
+            }
+            catch (...)
+            {
+                if (!cancellation.IsCancellationRequested())
+                {
+                    LOG_CAUGHT_EXCEPTION();
+                }
+            }
+        };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < scopeQueries.size(); ++i)
+    {
+        threads.emplace_back([&runScope, i]()
+            {
+                winrt::init_apartment(winrt::apartment_type::multi_threaded);
+                runScope(i);
+                winrt::uninit_apartment();
+            });
+    }
+    runScope(0);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto lock = SearchQueryBase::m_cs.lock();
+    if (cancellation.IsCancellationRequested())
+    {
+        return;
+    }
+
+    auto mergeLock = m_scopeMergeLock.lock_exclusive();
+    BeginScopeResults();
+
+    // A scope that failed never got to say it was done
+    bool hasMoreRows = false;
+    for (size_t i = 0; i < scopeQueries.size(); ++i)
+    {
+        if (scopeQueries[i]->HasMoreRows())
+        {
+            hasMoreRows = true;
+        }
+        else
+        {
+            m_scopeMerge.Finish(i);
+        }
+    }
+
+    if (m_scopeAhead)
+    {
+        m_scopeAhead = false;
+        ReplaceResults(nullptr, m_runningCookie);
+    }
+    DrainScopeMerge();
+    m_scopeQueries = std::move(scopeQueries);
+    m_hasMoreResults = hasMoreRows || m_scopeMerge.HasPending();
+
+    auto resultsLock = m_resultsLock.lock_shared();
+    m_numResults = static_cast<DWORD>(m_searchResults.Size());
+    m_resultStream.Complete(m_runningCookie, m_searchResults.Size());
+    _tracelog(L"\nFanned out query: %d results, %d files, %d mail", m_numResults,
+        static_cast<DWORD>(m_scopeMerge.Pushed(0)), static_cast<DWORD>(m_scopeMerge.Pushed(1)));
+}
+
+void SearchUXQueryHelper::BeginScopeResults()
+{
+    // The first scope to get this far replaces the old results, m_scopeMergeLock is held
+    if (m_scopeResultsBegun)
+    {
+        return;
+    }
+    m_scopeResultsBegun = true;
+    m_hasMoreResults = false;
+    ReplaceResults(nullptr, m_runningCookie, m_searchText.c_str());
+}
+
+size_t SearchUXQueryHelper::DrainScopeMerge()
+{
+    // m_scopeMergeLock is held
+    size_t emitted;
+    size_t count;
+    {
+        auto lock = m_resultsLock.lock_exclusive();
+        emitted = m_scopeMerge.Drain([&](ScopedResult&& result)
+            {
+                m_searchResults.AppendFrom(m_scopeRows[result.scope], result.row);
+            });
+        count = m_searchResults.Size();
+    }
+
+    // A scope's rows are only kept while some of them are still waiting to be merged
+    for (size_t i = 0; i < m_scopeRows.size(); ++i)
+    {
+        if (m_scopeMerge.Pending(i) == 0)
+        {
+            m_scopeRows[i].Clear();
+        }
+    }
+
+    if (emitted > 0)
+    {
+        m_resultStream.OnRowsAvailable(count);
+    }
+    return emitted;
+}
+
+void SearchUXQueryHelper::OnScopeResult(size_t scope, ResultStore const& results, size_t row)
+{
+    auto lock = m_scopeMergeLock.lock_exclusive();
+    BeginScopeResults();
+    const size_t pendingRow = m_scopeRows[scope].AppendFrom(results, row);
+    m_scopeMerge.Push(scope, { static_cast<uint32_t>(scope), static_cast<uint32_t>(pendingRow), results.GetRank(row), results.GetDateModified(row) });
+    if (!m_scopeAhead)
+    {
+        DrainScopeMerge();
+    }
+}
+
+void SearchUXQueryHelper::OnScopeFirstPage(size_t scope, bool exhausted)
+{
+    auto lock = m_scopeMergeLock.lock_exclusive();
+    BeginScopeResults();
+    if (exhausted)
+    {
+        m_scopeMerge.Finish(scope);
+    }
+    m_scopeFirstPages++;
+
+    if (m_scopeFirstPages == m_scopeMerge.SourceCount())
+    {
+        if (m_scopeAhead)
+        {
+            // Everyone is in, the merged results replace the ones we showed ahead
+            m_scopeAhead = false;
+            ReplaceResults(nullptr, m_runningCookie);
+        }
+        DrainScopeMerge();
+    }
+    else if (!m_scopeAhead && (m_scopeMerge.Pending(scope) > 0))
+    {
+        bool nothingShown;
+        {
+            auto resultsLock = m_resultsLock.lock_shared();
+            nothingShown = m_searchResults.Empty();
+        }
+
+        if (nothingShown)
+        {
+            // The other scopes haven't come up with anything to merge against yet. Rather than wait on the
+            // slowest scope, show this one on its own until they do.
+            m_scopeAhead = true;
+            auto resultsLock = m_resultsLock.lock_exclusive();
+            m_scopeMerge.ForEachPending(scope, [&](ScopedResult const& result)
+                {
+                    m_searchResults.AppendFrom(m_scopeRows[scope], result.row);
+                });
+        }
+    }
+
+    auto resultsLock = m_resultsLock.lock_shared();
+    m_resultStream.Flush(m_searchResults.Size());
+}
+
+void SearchUXQueryHelper::LoadMoreScopeResults(DWORD count)
+{
+    // Every scope that could still have something to go ahead of what is queued gets asked for another page,
+    // without m_scopeMergeLock since the rows come back through OnScopeResult
+    for (size_t i = 0; i < m_scopeQueries.size(); ++i)
+    {
+        bool needsRows;
+        {
+            auto lock = m_scopeMergeLock.lock_shared();
+            needsRows = !m_scopeMerge.IsFinished(i) && (m_scopeMerge.Pending(i) < count);
+        }
+
+        if (needsRows && !m_scopeQueries[i]->FetchMore(count, m_fetchCancellation))
+        {
+            auto lock = m_scopeMergeLock.lock_exclusive();
+            m_scopeMerge.Finish(i);
+        }
+    }
+
+    auto lock = m_scopeMergeLock.lock_exclusive();
+    DrainScopeMerge();
+
+    bool hasMoreRows = m_scopeMerge.HasPending();
+    for (size_t i = 0; i < m_scopeQueries.size(); ++i)
+    {
+        hasMoreRows = hasMoreRows || !m_scopeMerge.IsFinished(i);
+    }
+    m_hasMoreResults = hasMoreRows;
+
+    auto resultsLock = m_resultsLock.lock_shared();
+    m_resultStream.Flush(m_searchResults.Size());
+}
+
+uint32_t SearchUXQueryHelper::GetReuseOptions()
+{
+    // Every option changes the scope or the conditions, so restrictions are only shared between identical option sets.
+    // 0x8 marks the mail only scope of a fanned out query.
+    return (m_contentSearchEnabled ? 0x1 : 0) | (m_mailSearchEnabled ? 0x2 : 0) | (m_allUsersSearchEnabled ? 0x4 : 0);
+}
+
+void SearchUXQueryHelper::CancelRunningQuery()
+{
+    // The running query notices between rows, and the provider aborts the command if it is still executing,
+    // so it lets go of the query lock quickly instead of running to completion
+    auto lock = m_cancellationLock.lock_shared();
+    m_queryCancellation.Cancel();
+}
+
+bool SearchUXQueryHelper::TryRefineResultsLocally(PCWSTR searchText, DWORD cookie)
+{
+    // Only name searches narrow down strictly as text gets appended, content matches can come from anywhere
+    if (m_contentSearchEnabled)
+    {
+        return false;
+    }
+
+    try
+    {
+        // Keeps paging requests from appending to the results while we replace them
+        auto lock = SearchQueryBase::m_cs.lock();
+
+        std::wstring previousText;
+        bool provisionalResults;
+        {
+            auto resultsLock = m_resultsLock.lock_shared();
+            previousText = NormalizeSearchText(m_resultsText);
+            provisionalResults = m_provisionalResults;
+        }
+        const std::wstring newText = NormalizeSearchText(searchText);
+        if (previousText.empty() || (newText.size() <= previousText.size()) || (newText.compare(0, previousText.size(), previousText) != 0))
+        {
+            return false;
+        }
+
+        if (!provisionalResults && m_hasMoreResults)
+        {
+            // Whatever the list hasn't paged in yet could match too, and fetching it here would hold up the
+            // keystroke on the indexer. Let the query answer.
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ResultStore refined;
+        {
+            auto resultsLock = m_resultsLock.lock_shared();
+            std::vector<size_t> matches = RefineResults(m_searchResults.Size(), newText, [this](size_t i)
+                {
+                    return m_searchResults.GetDisplayName(i);
+                });
+
+            for (size_t i : matches)
+            {
+                refined.AppendFrom(m_searchResults, i);
+            }
+        }
+
+        if (refined.Empty())
+        {
+            // Nothing better to show than what's up already, wait for the indexer
+            return false;
+        }
+
+        _tracelog(L"\nRefined results to %d locally in %d us", static_cast<DWORD>(refined.Size()),
+            static_cast<DWORD>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+        PublishProvisionalResults(std::move(refined), newText.c_str(), cookie);
+        return true;
+    }
+    CATCH_LOG();
+
+    return false;
+}
+
+bool SearchUXQueryHelper::TryAnswerFromFilenameIndex(PCWSTR searchText, DWORD cookie)
+{
+    // The index only knows file names
+    if (m_contentSearchEnabled || m_mailSearchEnabled)
+    {
+        return false;
+    }
+
+    try
+    {
+        auto index = GetFilenameIndex(m_allUsersSearchEnabled);
+        if (index == nullptr)
+        {
+            // Still being built
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint32_t> ids;
+        if (!index->Find(NormalizeSearchText(searchText), m_firstPageSize, ids) || ids.empty())
+        {
+            // Too short for the index, or the index may just be out of date, let the indexer answer
+            return false;
+        }
+
+        ResultStore results;
+        for (uint32_t id : ids)
+        {
+            AppendSearchResult(results, cookie, index->GetName(id), index->GetUrl(id), index->GetKindText(id));
+        }
+
+        if (results.Empty())
+        {
+            return false;
+        }
+
+        _tracelog(L"\nAnswered from the filename index with %d results in %d us", static_cast<DWORD>(results.Size()),
+            static_cast<DWORD>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+
+        auto lock = SearchQueryBase::m_cs.lock();
+        PublishProvisionalResults(std::move(results), searchText, cookie);
+        return true;
+    }
+    CATCH_LOG();
+
+    return false;
+}
+
+void SearchUXQueryHelper::PublishProvisionalResults(ResultStore&& results, PCWSTR searchText, DWORD cookie)
+{
+    // Caller holds SearchQueryBase::m_cs. The indexer query still runs and replaces these when its first page is ready.
+    m_hasMoreResults = false;
+    const size_t count = ReplaceResults(&results, cookie, searchText, true);
+    m_resultStream.Flush(count);
+}
+
+void SearchUXQueryHelper::ScheduleSpeculation(CancellationToken const& queryCancellation)
+{
+    auto lock = m_speculationLock.lock_exclusive();
+
+    // Checked under the lock, Execute cancels the query before it cancels speculation so a superseded query
+    // can't start speculating after the fact
+    if (queryCancellation.IsCancellationRequested() || m_searchText.empty() || !m_speculationWork)
+    {
+        return;
+    }
+
+    m_speculationCancellation.Cancel();
+    m_speculationCancellation = CancellationSource();
+    m_speculationText = NormalizeSearchText(m_searchText);
+    m_speculationOptions = GetReuseOptions();
+    SubmitThreadpoolWork(m_speculationWork.get());
+}
+
+void SearchUXQueryHelper::CancelSpeculation()
+{
+    auto lock = m_speculationLock.lock_exclusive();
+    m_speculationCancellation.Cancel();
+}
+
+void SearchUXQueryHelper::RunSpeculation()
+{
+    std::wstring text;
+    uint32_t options;
+    CancellationToken cancellation;
+    std::vector<std::wstring> continuations;
+    {
+        auto lock = m_speculationLock.lock_exclusive();
+        text = m_speculationText;
+        options = m_speculationOptions;
+        cancellation = m_speculationCancellation.Token();
+        if (cancellation.IsCancellationRequested())
+        {
+            return;
+        }
+
+        auto index = (!m_contentSearchEnabled && !m_mailSearchEnabled) ? GetFilenameIndex(m_allUsersSearchEnabled) : nullptr;
+        continuations = m_speculationPlanner.Plan(text, c_maxSpeculativeContinuations, [&](auto&& callback)
+            {
+                std::vector<uint32_t> ids;
+                if ((index != nullptr) && index->Find(text, c_speculationCatalogSample, ids))
+                {
+                    for (uint32_t id : ids)
+                    {
+                        callback(index->GetName(id));
+                    }
+                }
+            });
+    }
+
+    // Only run when nothing more important wants the CPU
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    auto restorePriority = wil::scope_exit([]() { SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END); });
+
+    for (auto const& continuation : continuations)
+    {
+        if (cancellation.IsCancellationRequested())
+        {
+            break;
+        }
+
+        {
+            auto lock = m_speculationLock.lock_exclusive();
+            if (!m_speculationBudget.CanSpend(std::chrono::steady_clock::now()))
+            {
+                _tracelog(L"\nSpeculation over budget, skipping the rest");
+                break;
+            }
+
+            auto cached = std::find_if(m_speculativeResults.begin(), m_speculativeResults.end(), [&](SpeculativeResults const& entry)
+                {
+                    return (entry.options == options) && (entry.text == continuation);
+                });
+            if (cached != m_speculativeResults.end())
+            {
+                continue;
+            }
+            m_speculationPlanner.Stats().planned++;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool completed = false;
+        // Nobody has typed this yet, so its rows aren't charged to any query
+        SpeculativeQuery query(GetBoundColumns(), [this](ColumnarRowBatch const& batch, size_t row, ResultStore& results)
+            {
+                AppendSearchResult(results, 0, batch.GetString(row, ItemNameDisplayColumn), batch.GetString(row, ItemUrlColumn),
+                    batch.GetString(row, KindTextColumn));
+            },
+            m_firstPageSize);
+        try
+        {
+            completed = query.Run(continuation, m_contentSearchEnabled, m_mailSearchEnabled, m_allUsersSearchEnabled, options, cancellation);
+        }
+        CATCH_LOG();
+
+        auto lock = m_speculationLock.lock_exclusive();
+        auto now = std::chrono::steady_clock::now();
+        m_speculationBudget.OnSpent(now, std::chrono::duration_cast<std::chrono::microseconds>(now - start));
+        if (completed)
+        {
+            m_speculativeResults.push_front({ continuation, options, std::move(query.Results()), false });
+            m_speculationPlanner.Stats().completed++;
+            while (m_speculativeResults.size() > c_maxSpeculativeResults)
+            {
+                if (!m_speculativeResults.back().used)
+                {
+                    m_speculationPlanner.Stats().wasted++;
+                }
+                m_speculativeResults.pop_back();
+            }
+        }
+    }
+
+    auto lock = m_speculationLock.lock_shared();
+    SpeculationStats& stats = m_speculationPlanner.Stats();
+    _tracelog(L"\nSpeculation after '%s': %d planned, %d completed, %d hits, %d wasted", text.c_str(),
+        static_cast<DWORD>(stats.planned), static_cast<DWORD>(stats.completed), static_cast<DWORD>(stats.hits), static_cast<DWORD>(stats.wasted));
+}
+
+bool SearchUXQueryHelper::TryAnswerFromSpeculation(PCWSTR searchText, DWORD cookie)
+{
+    ResultStore results;
+    {
+        auto lock = m_speculationLock.lock_exclusive();
+        const std::wstring text = NormalizeSearchText(searchText);
+        const uint32_t options = GetReuseOptions();
+        m_speculationPlanner.OnTextTyped(text);
+
+        auto cached = std::find_if(m_speculativeResults.begin(), m_speculativeResults.end(), [&](SpeculativeResults const& entry)
+            {
+                return (entry.options == options) && (entry.text == text);
+            });
+        if ((cached == m_speculativeResults.end()) || cached->results.Empty())
+        {
+            return false;
+        }
+
+        if (!cached->used)
+        {
+            m_speculationPlanner.Stats().hits++;
+            cached->used = true;
+        }
+        results = cached->results;
+        m_speculativeResults.splice(m_speculativeResults.begin(), m_speculativeResults, cached);
+    }
+
+    // The indexer query still runs, with the restriction speculation left in the ReuseWhere cache it is quick
+    auto lock = SearchQueryBase::m_cs.lock();
+    PublishProvisionalResults(std::move(results), searchText, cookie);
+    return true;
+}
+
+void SearchUXQueryHelper::CancelOutstandingQueries()
+{
+    // Are we currently doing work? If so, let's cancel
+    {
+        auto lock = m_cs.lock();
+        SetThreadpoolTimer(m_queryTpTimer.get(), nullptr, 0, 0);
+        CancelRunningQuery();
+        CancelSpeculation();
+        WaitForThreadpoolTimerCallbacks(m_queryTpTimer.get(), TRUE);
+        m_queryTpTimer.reset(nullptr);
+        if (m_speculationWork)
+        {
+            WaitForThreadpoolWorkCallbacks(m_speculationWork.get(), TRUE);
+            m_speculationWork.reset();
+        }
+    }
+
+    // Nobody is going to produce rows for this helper anymore, let any waiters go
+    m_resultStream.Abandon();
+}
+
+void SearchUXQueryHelper::Execute(PCWSTR searchText, DWORD cookie)
+{
+    // We should try to coaelse queries here so that we aren't firing one for every specific key entered...
+    // If a query comes in within our threshold let's kill the firing one and create a new one
+    auto lock = m_cs.lock();
+
+    if (m_queryTpTimer.get() != nullptr)
+    {
+        // We cancel the outstanding query callback and queue a new one every time. A query that is already
+        // running is superseded too, cancel it so we don't wait for it to finish.
+        SetThreadpoolTimer(m_queryTpTimer.get(), nullptr, 0, 0);
+        CancelRunningQuery();
+        CancelSpeculation();
+        WaitForThreadpoolTimerCallbacks(m_queryTpTimer.get(), TRUE);
+        {
+            auto cancellationLock = m_cancellationLock.lock_exclusive();
+            m_queryCancellation = CancellationSource();
+        }
+        m_searchText = searchText;
+        m_cookie = cookie;
+        m_resultStream.Request(cookie);
+
+        // Show something right away while the indexer query is on its way, either straight from the filename
+        // index or, when typing more of the same name, from what we already have that still matches
+        if (!TryAnswerFromSpeculation(searchText, cookie) && !TryAnswerFromFilenameIndex(searchText, cookie))
+        {
+            TryRefineResultsLocally(searchText, cookie);
+        }
+
+        // queue query, a zero due time fires right away
+        DebounceSignals signals;
+        DebounceDecision decision = m_debounce.OnKeystroke(GetTickCount64(), &signals);
+        FILETIME64 ft = { -static_cast<INT64>(decision.delay) * 10000 };
+        FILETIME fireTime = ft.ft;
+        _tracelog(L"Queue query: %d in %dms (%s, typing p50 %dms, query p50 %dms p95 %dms)\n", m_cookie,
+            static_cast<DWORD>(decision.delay), decision.reason, static_cast<DWORD>(signals.typingIntervalP50),
+            static_cast<DWORD>(signals.queryCostP50), static_cast<DWORD>(signals.queryCostP95));
+        SetThreadpoolTimer(m_queryTpTimer.get(), &fireTime, 0, 0);
+    }
+    else
+    {
+        // Init failed or we were canceled, this query will never run
+        m_resultStream.Abandon();
+    }
+}
+
+std::wstring SearchUXQueryHelper::GetPrimingQueryString()
+{
+    QueryStringBuilder builder;
+    std::wstring queryStr = builder.GeneratePrimingQuery(m_mailSearchEnabled, m_allUsersSearchEnabled);
+    return queryStr;
+}
+
+void SearchUXQueryHelper::Init(bool contentSearchEnabled, bool mailSearchEnabled, bool allUsersSearchEnabled)
+{
+    // Create all the objects we will want cached
+    try
+    {
+        m_contentSearchEnabled = contentSearchEnabled;
+        m_mailSearchEnabled = mailSearchEnabled;
+        m_allUsersSearchEnabled = allUsersSearchEnabled;
+        m_queryTpTimer.reset(CreateThreadpoolTimer(SearchUXQueryHelper::QueryTimerCallback, reinterpret_cast<void*>(this), nullptr));
+        THROW_LAST_ERROR_IF_NULL(m_queryTpTimer.get());
+
+        // Speculation only gets the threadpool when nothing else wants it
+        TP_CALLBACK_ENVIRON speculationEnvironment;
+        InitializeThreadpoolEnvironment(&speculationEnvironment);
+        SetThreadpoolCallbackPriority(&speculationEnvironment, TP_CALLBACK_PRIORITY_LOW);
+        m_speculationWork.reset(CreateThreadpoolWork(SearchUXQueryHelper::SpeculationWorkCallback, reinterpret_cast<void*>(this), &speculationEnvironment));
+        DestroyThreadpoolEnvironment(&speculationEnvironment);
+        THROW_LAST_ERROR_IF_NULL(m_speculationWork.get());
+
+        // The priming query below and the first keystroke's both get a session that's ready to go
+        PrewarmCollatorSessions();
+
+        // Execute a synchronous query on file/mapi items to prime the index and keep that handle around
+        PrimeIndexAndCacheWhereId(GetReuseOptions());
+
+        // Only does anything the first time around (or when the all users scope changed)
+        BuildFilenameIndexAsync(m_allUsersSearchEnabled);
+    }
+    CATCH_LOG();
+}
+
+DWORD SearchUXQueryHelper::GetCookie()
+{
+    return m_cookie;
 }
\ No newline at end of file
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Platform neutral pool of warm provider sessions. Creating an OLE DB session against the collator
+// (CoCreateInstance + Initialize + CreateSession) is by far the most expensive part of issuing a query,
+// so we keep a handful of initialized sessions around and hand them out to whoever needs a command.
+//
+// Sessions are handed from thread to thread as they are, the pool doesn't marshal anything. The owner has to
+// make sure every session it creates can be used from every thread it hands them to.
+template <typename TSession>
+struct ISessionProvider
+{
+    virtual ~ISessionProvider() = default;
+
+    // Creates and fully initializes a new session. Expected to throw on failure.
+    virtual TSession CreateSession() = 0;
+};
+
+struct SessionPoolStats
+{
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t discarded{};
+    uint64_t created{}; // by misses and by Prewarm
+    uint64_t totalCreationMicroseconds{};
+    uint64_t maxCreationMicroseconds{};
+
+    uint64_t AverageCreationMicroseconds() const
+    {
+        return created ? (totalCreationMicroseconds / created) : 0;
+    }
+};
+
+template <typename TSession>
+struct SessionPool
+{
+public:
+    // A session checked out of the pool. It goes back to the idle list when the lease dies unless
+    // the caller found it to be broken and discarded it.
+    struct Lease
+    {
+        Lease() = default;
+        Lease(SessionPool* pool, TSession&& session) : m_pool(pool), m_session(std::move(session)) {}
+        Lease(Lease&& other) noexcept : m_pool(other.m_pool), m_session(std::move(other.m_session)) { other.m_pool = nullptr; }
+        Lease& operator=(Lease&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Release();
+                m_pool = other.m_pool;
+                m_session = std::move(other.m_session);
+                other.m_pool = nullptr;
+            }
+            return *this;
+        }
+        Lease(Lease const&) = delete;
+        Lease& operator=(Lease const&) = delete;
+        ~Lease() { Release(); }
+
+        TSession& get() { return m_session; }
+
+        void Discard()
+        {
+            if (m_pool != nullptr)
+            {
+                m_pool->m_discarded++;
+                m_pool = nullptr;
+                m_session = TSession{};
+            }
+        }
+
+    private:
+        void Release()
+        {
+            if (m_pool != nullptr)
+            {
+                m_pool->Return(std::move(m_session));
+                m_pool = nullptr;
+            }
+        }
+
+        SessionPool* m_pool{ nullptr };
+        TSession m_session{};
+    };
+
+    SessionPool(std::shared_ptr<ISessionProvider<TSession>> provider, size_t maxIdleSessions) :
+        m_provider(std::move(provider)), m_maxIdleSessions(maxIdleSessions)
+    {
+        m_idle.reserve(maxIdleSessions);
+    }
+
+    SessionPool(SessionPool const&) = delete;
+    SessionPool& operator=(SessionPool const&) = delete;
+
+    Lease Acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_idle.empty())
+            {
+                TSession session = std::move(m_idle.back());
+                m_idle.pop_back();
+                m_hits++;
+                return Lease(this, std::move(session));
+            }
+        }
+
+        // Create outside of the lock, this is the slow path and other threads can keep getting hits meanwhile
+        m_misses++;
+        return Lease(this, CreateTimed());
+    }
+
+    // Fill the idle list up to count sessions so the first queries don't pay the creation cost
+    void Prewarm(size_t count)
+    {
+        count = (std::min)(count, m_maxIdleSessions);
+        while (IdleCount() < count)
+        {
+            Return(CreateTimed());
+        }
+    }
+
+    void Clear()
+    {
+        std::vector<TSession> idle;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            idle.swap(m_idle);
+        }
+    }
+
+    size_t IdleCount()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_idle.size();
+    }
+
+    SessionPoolStats GetStats() const
+    {
+        SessionPoolStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.discarded = m_discarded;
+        stats.created = m_created;
+        stats.totalCreationMicroseconds = m_totalCreationMicroseconds;
+        stats.maxCreationMicroseconds = m_maxCreationMicroseconds;
+        return stats;
+    }
+
+private:
+    TSession CreateTimed()
+    {
+        auto start = std::chrono::steady_clock::now();
+        TSession session = m_provider->CreateSession();
+        uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        m_created++;
+        m_totalCreationMicroseconds += elapsed;
+        uint64_t currentMax = m_maxCreationMicroseconds;
+        while ((elapsed > currentMax) && !m_maxCreationMicroseconds.compare_exchange_weak(currentMax, elapsed))
+        {
+        }
+        return session;
+    }
+
+    void Return(TSession&& session)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_idle.size() < m_maxIdleSessions)
+        {
+            m_idle.push_back(std::move(session));
+        }
+        else
+        {
+            m_discarded++;
+        }
+    }
+
+    std::shared_ptr<ISessionProvider<TSession>> m_provider;
+    const size_t m_maxIdleSessions;
+    std::mutex m_lock;
+    std::vector<TSession> m_idle;
+
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_discarded{ 0 };
+    std::atomic<uint64_t> m_created{ 0 };
+    std::atomic<uint64_t> m_totalCreationMicroseconds{ 0 };
+    std::atomic<uint64_t> m_maxCreationMicroseconds{ 0 };
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cwctype>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "RefinementFilter.h"
+
+struct SpeculationStats
+{
+    uint64_t planned{};   // continuations we decided to run
+    uint64_t completed{}; // ran to completion and got cached
+    uint64_t hits{};      // a keystroke was answered from the cache
+    uint64_t wasted{};    // completed but dropped from the cache without ever being used
+};
+
+// Platform neutral guess at what the user is going to type next. Continuations are scored from what they
+// typed before after the same text, what they typed after the same last characters anywhere, and the next
+// character after the text in the names we know about.
+struct SpeculationPlanner
+{
+public:
+    // Called with every (normalized) text as it gets typed
+    void OnTextTyped(std::wstring_view text)
+    {
+        if ((text.size() == (m_previousText.size() + 1)) && (text.compare(0, m_previousText.size(), m_previousText) == 0))
+        {
+            const wchar_t next = text.back();
+            if (m_history.size() < c_maxHistoryEntries)
+            {
+                m_history[m_previousText][next]++;
+            }
+            m_suffixHistory[SuffixKey(m_previousText)][next]++;
+        }
+        m_previousText = text;
+    }
+
+    // Up to maxContinuations texts of one more character, best first. forEachCatalogName(callback) should call
+    // callback(name) for the names matching text that we know of.
+    template <typename TForEachCatalogName>
+    std::vector<std::wstring> Plan(std::wstring_view text, size_t maxContinuations, TForEachCatalogName&& forEachCatalogName) const
+    {
+        std::unordered_map<wchar_t, uint64_t> scores;
+        auto history = m_history.find(std::wstring(text));
+        if (history != m_history.end())
+        {
+            for (auto const& next : history->second)
+            {
+                scores[next.first] += next.second * c_historyWeight;
+            }
+        }
+
+        auto suffixHistory = m_suffixHistory.find(SuffixKey(text));
+        if (suffixHistory != m_suffixHistory.end())
+        {
+            for (auto const& next : suffixHistory->second)
+            {
+                scores[next.first] += next.second * c_suffixHistoryWeight;
+            }
+        }
+
+        CaseInsensitiveMatcher matcher(text);
+        forEachCatalogName([&](std::wstring_view name)
+            {
+                const size_t pos = matcher.FindWordStart(name);
+                if ((pos != std::wstring_view::npos) && ((pos + matcher.Length()) < name.size()))
+                {
+                    scores[static_cast<wchar_t>(std::towlower(name[pos + matcher.Length()]))] += c_catalogWeight;
+                }
+            });
+
+        std::vector<std::pair<wchar_t, uint64_t>> ranked(scores.begin(), scores.end());
+        std::sort(ranked.begin(), ranked.end(), [](auto const& left, auto const& right)
+            {
+                return (left.second != right.second) ? (left.second > right.second) : (left.first < right.first);
+            });
+
+        std::vector<std::wstring> continuations;
+        for (size_t i = 0; (i < ranked.size()) && (continuations.size() < maxContinuations); ++i)
+        {
+            continuations.emplace_back(std::wstring(text) + ranked[i].first);
+        }
+        return continuations;
+    }
+
+    SpeculationStats& Stats() { return m_stats; }
+
+private:
+    static std::wstring SuffixKey(std::wstring_view text)
+    {
+        return std::wstring(text.substr((text.size() > c_suffixLength) ? (text.size() - c_suffixLength) : 0));
+    }
+
+    // Somebody retyping the same thing is the strongest signal we have
+    static constexpr uint64_t c_historyWeight{ 8 };
+    static constexpr uint64_t c_suffixHistoryWeight{ 2 };
+    static constexpr uint64_t c_catalogWeight{ 1 };
+    static constexpr size_t c_suffixLength{ 2 };
+    static constexpr size_t c_maxHistoryEntries{ 4096 };
+
+    std::wstring m_previousText;
+    std::unordered_map<std::wstring, std::unordered_map<wchar_t, uint64_t>> m_history;
+    std::unordered_map<std::wstring, std::unordered_map<wchar_t, uint64_t>> m_suffixHistory;
+    SpeculationStats m_stats;
+};
+
+// Limits speculative work to budget out of every window of wall clock time. Most of the cost of a query is in
+// the indexer process where we can't measure it, so time spent waiting on speculative queries is what we budget.
+struct SpeculationBudget
+{
+public:
+    SpeculationBudget(std::chrono::microseconds window, std::chrono::microseconds budget) : m_window(window), m_budget(budget) {}
+
+    bool CanSpend(std::chrono::steady_clock::time_point now)
+    {
+        Expire(now);
+        return m_spent < m_budget;
+    }
+
+    void OnSpent(std::chrono::steady_clock::time_point now, std::chrono::microseconds elapsed)
+    {
+        Expire(now);
+        m_spending.emplace_back(now, elapsed);
+        m_spent += elapsed;
+    }
+
+private:
+    void Expire(std::chrono::steady_clock::time_point now)
+    {
+        while (!m_spending.empty() && ((now - m_spending.front().first) > m_window))
+        {
+            m_spent -= m_spending.front().second;
+            m_spending.pop_front();
+        }
+    }
+
+    const std::chrono::microseconds m_window;
+    const std::chrono::microseconds m_budget;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::chrono::microseconds>> m_spending;
+    std::chrono::microseconds m_spent{};
+};
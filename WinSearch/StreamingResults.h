@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+struct ResultStreamUpdate
+{
+    size_t available{};                     // rows published so far for the query
+    bool completed{};                       // the query is done, no more rows are coming
+    bool superseded{};                      // a newer query replaced this one (or the helper went away), stop waiting
+    uint32_t revision{};                    // bumped when the rows are replaced from the start, e.g. indexer results replacing a local refinement
+    uint64_t timeToFirstResultMicroseconds{}; // request to first published row, 0 until we have one
+};
+
+// Platform neutral hand off of rows from the fetch thread to the UI. Instead of signaling once when the
+// whole rowset has been drained, we publish the first page as soon as there are enough rows to fill the
+// viewport and then publish every batchSize rows after that.
+//
+// Producer side (fetch thread): Begin, OnRowsAvailable/Flush, Complete
+// Consumer side (UI): Request when the query is issued, then WaitForUpdate until completed or superseded
+struct ResultStreamPublisher
+{
+public:
+    void SetPageSizes(size_t firstPageSize, size_t batchSize)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_firstPageSize = (firstPageSize > 0) ? firstPageSize : 1;
+        m_batchSize = (batchSize > 0) ? batchSize : 1;
+    }
+
+    // A query was requested for cookie, anyone still waiting on an older cookie is superseded
+    void Request(uint32_t cookie)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_requestedCookie = cookie;
+            m_requestTime = std::chrono::steady_clock::now();
+        }
+        m_changed.notify_all();
+    }
+
+    // The fetch for cookie is starting, rows will be appended from zero. Beginning the same cookie again
+    // replaces whatever was published for it so far. Returns the revision the rows will be published under.
+    uint32_t Begin(uint32_t cookie)
+    {
+        uint32_t revision;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_activeCookie != cookie)
+            {
+                // Time to first result is about what the user saw first, so a replacement doesn't reset it
+                m_timeToFirstResult = 0;
+            }
+            m_activeCookie = cookie;
+            revision = ++m_revision;
+            m_published = 0;
+            m_completed = false;
+            m_nextPublishAt = m_firstPageSize;
+        }
+        m_changed.notify_all();
+        return revision;
+    }
+
+    // Called for every row appended on the fetch thread. Cheap unless we crossed a publish threshold.
+    void OnRowsAvailable(size_t count)
+    {
+        if (count >= m_nextPublishAt.load(std::memory_order_relaxed))
+        {
+            Publish(count);
+        }
+    }
+
+    // Publish whatever is there, used at the end of each provider batch so a slow provider doesn't hold back rows
+    void Flush(size_t count)
+    {
+        if (count > m_published.load(std::memory_order_relaxed))
+        {
+            Publish(count);
+        }
+    }
+
+    void Complete(uint32_t cookie, size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_activeCookie = cookie;
+            m_completed = true;
+            PublishLocked(count);
+        }
+        m_changed.notify_all();
+    }
+
+    // The producer is going away, release every waiter
+    void Abandon()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_abandoned = true;
+        }
+        m_changed.notify_all();
+    }
+
+    // Blocks until there are more than seen rows of revision for cookie, the rows get replaced, the query
+    // completes, or it is superseded
+    ResultStreamUpdate WaitForUpdate(uint32_t cookie, uint32_t revision, size_t seen)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_changed.wait(lock, [&]()
+            {
+                return m_abandoned || (m_requestedCookie != cookie) ||
+                    ((m_activeCookie == cookie) && ((m_revision != revision) || (m_published > seen) || m_completed));
+            });
+
+        ResultStreamUpdate update;
+        update.superseded = m_abandoned || (m_requestedCookie != cookie);
+        update.available = m_published;
+        update.completed = m_completed;
+        update.timeToFirstResultMicroseconds = m_timeToFirstResult;
+        update.revision = m_revision;
+        return update;
+    }
+
+private:
+    void Publish(size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            PublishLocked(count);
+            m_nextPublishAt = count + m_batchSize;
+        }
+        m_changed.notify_all();
+    }
+
+    void PublishLocked(size_t count)
+    {
+        if ((m_timeToFirstResult == 0) && (count > 0))
+        {
+            m_timeToFirstResult = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - m_requestTime).count());
+        }
+        m_published = count;
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    size_t m_firstPageSize{ 20 };
+    size_t m_batchSize{ 500 };
+    // Written under m_lock, but the producer checks them without it on every row while Begin may be running on
+    // another thread
+    std::atomic<size_t> m_nextPublishAt{ 20 };
+    std::atomic<size_t> m_published{};
+    bool m_completed{};
+    bool m_abandoned{};
+    uint32_t m_requestedCookie{};
+    uint32_t m_activeCookie{};
+    uint32_t m_revision{};
+    uint64_t m_timeToFirstResult{};
+    std::chrono::steady_clock::time_point m_requestTime{ std::chrono::steady_clock::now() };
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "SearchItemUtils.h"
+
+// A small integer standing in for a string that shows up over and over (extensions, kinds, url schemes), so
+// the per row work compares and indexes integers. 0 is no atom.
+using StringAtom = uint32_t;
+constexpr StringAtom c_noAtom{ 0 };
+
+// Interned by every table before anything else, in this order, so they can be compared against constants
+constexpr StringAtom c_folderKindAtom{ 1 };       // KindText "Folder"
+constexpr StringAtom c_fileSchemeAtom{ 2 };       // file:
+constexpr StringAtom c_mapiSchemeAtom{ 3 };       // mapi:
+constexpr StringAtom c_mapi16SchemeAtom{ 4 };     // mapi16:
+constexpr StringAtom c_folderThumbnailAtom{ 5 };  // what every folder's thumbnail is shared under, can't be an extension
+
+// FNV-1a, the strings we hash are short and this inlines where std::hash doesn't
+inline uint32_t HashString(std::wstring_view text)
+{
+    uint32_t hash = 2166136261u;
+    for (wchar_t c : text)
+    {
+        hash = (hash ^ static_cast<uint32_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+// Platform neutral, lock free interning. Lookups are a hash and a probe of an open addressed table of atoms,
+// interning something new publishes it with a compare exchange. The text of an atom never moves or goes away
+// while the table is around. Strings that are too long or don't fit any more get no atom.
+struct StringAtomTable
+{
+public:
+    static constexpr size_t c_maxAtoms{ 4096 };
+    static constexpr size_t c_maxAtomChars{ 64 };
+
+    StringAtomTable()
+    {
+        Intern(L"Folder");
+        Intern(L"file");
+        Intern(L"mapi");
+        Intern(L"mapi16");
+        Intern(L"\\folder");
+    }
+
+    ~StringAtomTable()
+    {
+        for (auto& text : m_texts)
+        {
+            delete text.load(std::memory_order_relaxed);
+        }
+    }
+
+    StringAtomTable(StringAtomTable const&) = delete;
+    StringAtomTable& operator=(StringAtomTable const&) = delete;
+
+    // Never adds, c_noAtom if text was never interned
+    StringAtom Find(std::wstring_view text) const
+    {
+        if (text.empty() || (text.size() > c_maxAtomChars))
+        {
+            return c_noAtom;
+        }
+
+        const size_t hash = Hash(text);
+        for (size_t probe = 0; probe < c_slotCount; ++probe)
+        {
+            const StringAtom atom = m_slots[(hash + probe) & (c_slotCount - 1)].load(std::memory_order_acquire);
+            if ((atom == c_noAtom) || (GetText(atom) == text))
+            {
+                return atom;
+            }
+        }
+        return c_noAtom;
+    }
+
+    StringAtom Intern(std::wstring_view text)
+    {
+        if (text.empty() || (text.size() > c_maxAtomChars))
+        {
+            return c_noAtom;
+        }
+
+        const size_t hash = Hash(text);
+        for (size_t probe = 0; probe < c_slotCount; ++probe)
+        {
+            std::atomic<StringAtom>& slot = m_slots[(hash + probe) & (c_slotCount - 1)];
+            StringAtom atom = slot.load(std::memory_order_acquire);
+            if (atom == c_noAtom)
+            {
+                // The text is published under a new atom before the atom goes in the slot, anyone who sees
+                // the atom can read it. Losing the slot to someone else wastes the atom, that's rare enough.
+                const StringAtom added = m_nextAtom.fetch_add(1, std::memory_order_relaxed);
+                if (added > c_maxAtoms)
+                {
+                    return c_noAtom;
+                }
+                m_texts[added].store(new std::wstring(text), std::memory_order_release);
+
+                if (slot.compare_exchange_strong(atom, added, std::memory_order_acq_rel, std::memory_order_acquire))
+                {
+                    return added;
+                }
+            }
+
+            if (GetText(atom) == text)
+            {
+                return atom;
+            }
+        }
+        return c_noAtom;
+    }
+
+    std::wstring_view GetText(StringAtom atom) const
+    {
+        if ((atom == c_noAtom) || (atom > c_maxAtoms))
+        {
+            return {};
+        }
+
+        std::wstring const* text = m_texts[atom].load(std::memory_order_acquire);
+        return (text != nullptr) ? std::wstring_view(*text) : std::wstring_view();
+    }
+
+    size_t Count() const
+    {
+        const size_t next = m_nextAtom.load(std::memory_order_relaxed);
+        return ((next <= c_maxAtoms) ? next : (c_maxAtoms + 1)) - 1;
+    }
+
+private:
+    static size_t Hash(std::wstring_view text)
+    {
+        return HashString(text);
+    }
+
+    static constexpr size_t c_slotCount{ c_maxAtoms * 2 }; // a power of two, and never more than half full
+
+    std::atomic<StringAtom> m_slots[c_slotCount]{};
+    std::atomic<std::wstring const*> m_texts[c_maxAtoms + 1]{};
+    std::atomic<StringAtom> m_nextAtom{ 1 };
+};
+
+// Process wide
+inline StringAtomTable& GetStringAtoms()
+{
+    static StringAtomTable s_atoms;
+    return s_atoms;
+}
+
+// What a result's row says about it, worked out once while the row is decoded so nothing after has to look at
+// the strings again
+struct ItemAtoms
+{
+    StringAtom kind{};
+    StringAtom scheme{};
+    StringAtom extension{}; // of the file name, none for mail
+
+    bool IsFolder() const
+    {
+        return kind == c_folderKindAtom;
+    }
+
+    bool IsMail() const
+    {
+        return (scheme == c_mapiSchemeAtom) || (scheme == c_mapi16SchemeAtom);
+    }
+
+    // What the thumbnail is shared under, none if there's nothing to share
+    StringAtom GetThumbnailKey() const
+    {
+        return IsFolder() ? c_folderThumbnailAtom : extension;
+    }
+};
+
+// The last string a thread interned for one kind of thing, rows in a row tend to share their kind and scheme
+// and often their extension, and comparing against the last one is cheaper than hashing
+struct StringAtomMemo
+{
+    StringAtomTable const* table{};
+    std::wstring_view text; // the atom's own text, stays put
+    StringAtom atom{};
+
+    StringAtom Intern(StringAtomTable& atoms, std::wstring_view value)
+    {
+        if ((table != &atoms) || (value != text))
+        {
+            atom = atoms.Intern(value);
+            text = atoms.GetText(atom);
+            table = &atoms;
+        }
+        return atom;
+    }
+};
+
+inline ItemAtoms ClassifyItem(StringAtomTable& atoms, std::wstring_view url, std::wstring_view kindText)
+{
+    static thread_local StringAtomMemo t_kind;
+    static thread_local StringAtomMemo t_scheme;
+    static thread_local StringAtomMemo t_extension;
+
+    ItemAtoms item;
+    item.kind = t_kind.Intern(atoms, kindText);
+    item.scheme = t_scheme.Intern(atoms, GetUrlScheme(url));
+    if (!item.IsMail())
+    {
+        // Same as the file path's, the slashes don't matter
+        item.extension = t_extension.Intern(atoms, GetExtension(url));
+    }
+    return item;
+}
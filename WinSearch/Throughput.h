@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Platform neutral timing of something called from several threads at once, for the benchmarks the app runs at
+// startup when asked to (BenchmarkThumbnails) and the ones off box
+struct CallThroughput
+{
+    double nanosecondsPerCall{};
+    double callsPerSecond{};
+};
+
+// Calls call(thread, i) callsPerThread times on each of threadCount threads at once and times it, to compare
+// what something costs the threads doing it and how well it holds up as more of them do it at once
+template <typename TCall>
+CallThroughput MeasureCallThroughput(size_t threadCount, size_t callsPerThread, TCall&& call)
+{
+    std::atomic<size_t> ready{};
+    std::atomic<bool> go{};
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> elapsed(threadCount);
+    for (size_t thread = 0; thread < threadCount; ++thread)
+    {
+        threads.emplace_back([&, thread]()
+            {
+                ready++;
+                while (!go.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < callsPerThread; ++i)
+                {
+                    call(thread, i);
+                }
+                elapsed[thread] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            });
+    }
+
+    while (ready.load() < threadCount)
+    {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    const double wallNanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+    CallThroughput throughput;
+    const double calls = static_cast<double>(threadCount * callsPerThread);
+    uint64_t totalElapsed = 0;
+    for (uint64_t threadElapsed : elapsed)
+    {
+        totalElapsed += threadElapsed;
+    }
+    if (calls > 0)
+    {
+        throughput.nanosecondsPerCall = static_cast<double>(totalElapsed) / calls;
+        throughput.callsPerSecond = (wallNanoseconds > 0) ? ((calls * 1e9) / wallNanoseconds) : 0;
+    }
+    return throughput;
+}
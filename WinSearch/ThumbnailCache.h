@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "StringAtoms.h"
+
+// Platform neutral cache of the thumbnails we've already asked the shell for. Files share the thumbnail of
+// their extension and every folder shares one, keyed by the atom ItemAtoms::GetThumbnailKey gives. TThumbnail
+// is a handle that can be null, a WinRT projection or a smart pointer.
+//
+// Every row looks in here and hardly anything is ever added, so readers don't take a lock at all. Atoms are
+// small and dense, there's a slot per atom holding an immutable node. A writer publishes a new node and keeps
+// the one it replaced around until the cache goes away, a reader may still be copying the thumbnail out of it.
+template <typename TThumbnail>
+struct ExtensionThumbnailCache
+{
+public:
+    ExtensionThumbnailCache() = default;
+
+    ~ExtensionThumbnailCache()
+    {
+        for (auto& slot : m_slots)
+        {
+            delete slot.load(std::memory_order_relaxed);
+        }
+    }
+
+    ExtensionThumbnailCache(ExtensionThumbnailCache const&) = delete;
+    ExtensionThumbnailCache& operator=(ExtensionThumbnailCache const&) = delete;
+
+    bool NeedProcessThumbnailForItem(StringAtom key)
+    {
+        return (key != c_noAtom) && (Find(key) == nullptr);
+    }
+
+    TThumbnail Find(StringAtom key)
+    {
+        if ((key == c_noAtom) || (key >= c_slotCount))
+        {
+            return nullptr;
+        }
+
+        const Node* node = m_slots[key].load(std::memory_order_acquire);
+        return (node != nullptr) ? node->thumbnail : nullptr;
+    }
+
+    void Add(StringAtom key, TThumbnail thumbnail)
+    {
+        if ((key == c_noAtom) || (key >= c_slotCount))
+        {
+            return;
+        }
+
+        auto node = std::make_unique<const Node>(Node{ std::move(thumbnail) });
+        std::lock_guard<std::mutex> lock(m_writeLock);
+        const Node* replaced = m_slots[key].exchange(node.release(), std::memory_order_acq_rel);
+        if (replaced != nullptr)
+        {
+            m_retired.emplace_back(replaced);
+        }
+    }
+
+private:
+    static constexpr size_t c_slotCount{ StringAtomTable::c_maxAtoms + 1 };
+
+    struct Node
+    {
+        TThumbnail thumbnail;
+    };
+
+    std::atomic<const Node*> m_slots[c_slotCount]{};
+    std::mutex m_writeLock;
+    std::vector<std::unique_ptr<const Node>> m_retired; // replaced, freed with the cache
+};
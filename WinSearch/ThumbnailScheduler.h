@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ThumbnailCache.h"
+
+struct ThumbnailSchedulerStats
+{
+    uint64_t requests{}; // that weren't already cached
+    uint64_t coalesced{}; // joined a load that was already queued or running for the same extension
+    uint64_t loads{};
+    uint64_t failed{};
+    uint64_t dropped{}; // pushed out of a full queue before a worker got to them
+    uint64_t suppressed{}; // turned away because the last load for the same key failed not long ago
+};
+
+// How long a key whose load failed is left alone before it gets another go, doubling with every failure in a row
+// up to maxDelay. now is the clock it goes by, tests step their own.
+struct ThumbnailRetryPolicy
+{
+    std::chrono::milliseconds initialDelay{ 2000 };
+    std::chrono::milliseconds maxDelay{ 5 * 60 * 1000 };
+    std::function<std::chrono::steady_clock::time_point()> now = []() { return std::chrono::steady_clock::now(); };
+};
+
+// Platform neutral scheduling for thumbnail loads, so nothing that builds or shows results ever waits on the shell.
+// Rows ask for their thumbnail when they get shown, a fixed set of workers loads them, and every row waiting on
+// the same extension (or any folder) shares one load. The queue is bounded and newest first: when the user
+// scrolls quickly the rows that went by without getting a worker are dropped, and ask again when they come back.
+// A key whose load failed isn't tried again until its retry policy says so, every row of a broken extension
+// would otherwise keep a worker busy failing.
+//
+// load(key, path, isFolder) does the blocking load on a worker and returns null (or throws) if it couldn't.
+template <typename TThumbnail>
+struct ThumbnailScheduler
+{
+public:
+    using LoadFunction = std::function<TThumbnail(StringAtom key, std::wstring const& path, bool isFolder)>;
+
+    // Called on a worker with the thumbnail, or with null if it failed or was dropped
+    using Callback = std::function<void(TThumbnail const& thumbnail)>;
+
+    ThumbnailScheduler(ExtensionThumbnailCache<TThumbnail>& cache, LoadFunction load, size_t workerCount, size_t maxQueued,
+        std::function<void()> workerStart = nullptr, std::function<void()> workerStop = nullptr, ThumbnailRetryPolicy retry = {}) :
+        m_cache(cache), m_load(std::move(load)), m_maxQueued((maxQueued > 0) ? maxQueued : 1),
+        m_workerStart(std::move(workerStart)), m_workerStop(std::move(workerStop)), m_retry(std::move(retry))
+    {
+        for (size_t i = 0; i < ((workerCount > 0) ? workerCount : 1); ++i)
+        {
+            m_workers.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ~ThumbnailScheduler()
+    {
+        Shutdown();
+    }
+
+    ThumbnailScheduler(ThumbnailScheduler const&) = delete;
+    ThumbnailScheduler& operator=(ThumbnailScheduler const&) = delete;
+
+    // key is what the item's thumbnail is shared under. Returns true with *cached set if we already have it,
+    // callback isn't called then. Returns false if the item has no thumbnail to share (no key), or after queuing
+    // the request. Also false, without queuing anything or ever calling callback, once we're shut down or while
+    // the key is backing off from a failed load.
+    bool Request(StringAtom key, std::wstring_view path, bool isFolder, Callback callback, TThumbnail* cached)
+    {
+        if (!m_cache.NeedProcessThumbnailForItem(key))
+        {
+            *cached = m_cache.Find(key);
+            return *cached != nullptr;
+        }
+
+        std::vector<Callback> dropped;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_stopping)
+            {
+                return false;
+            }
+
+            auto found = m_pending.find(key);
+            if (found != m_pending.end())
+            {
+                found->second.callbacks.push_back(std::move(callback));
+                m_stats.requests++;
+                m_stats.coalesced++;
+                if (!found->second.running)
+                {
+                    // Shown again, move it to the front
+                    MoveToFront(key);
+                }
+                return false;
+            }
+
+            // A load for it may have finished since we checked, they fill the cache before leaving m_pending
+            if (!m_cache.NeedProcessThumbnailForItem(key))
+            {
+                *cached = m_cache.Find(key);
+                return *cached != nullptr;
+            }
+
+            auto failed = m_failed.find(key);
+            if ((failed != m_failed.end()) && (m_retry.now() < failed->second.retryAt))
+            {
+                m_stats.suppressed++;
+                return false;
+            }
+
+            m_stats.requests++;
+            if (m_queue.size() >= m_maxQueued)
+            {
+                // The oldest request is the row most likely to have scrolled away
+                auto oldest = m_pending.find(m_queue.back());
+                dropped = std::move(oldest->second.callbacks);
+                m_stats.dropped += dropped.size();
+                m_pending.erase(oldest);
+                m_queue.pop_back();
+            }
+
+            PendingLoad& pending = m_pending[key];
+            pending.path = path;
+            pending.isFolder = isFolder;
+            pending.callbacks.push_back(std::move(callback));
+            m_queue.push_front(key);
+        }
+        m_wake.notify_one();
+
+        for (auto const& droppedCallback : dropped)
+        {
+            droppedCallback(nullptr);
+        }
+        return false;
+    }
+
+    ThumbnailSchedulerStats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_stats;
+    }
+
+    // Stops the workers, drops whatever is still queued without calling back and waits for running loads to
+    // finish. Has to be called while what the loads use is still around, the process wide scheduler is shut down
+    // when the window closes rather than left to static teardown.
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_stopping)
+            {
+                return;
+            }
+            m_stopping = true;
+
+            for (const StringAtom key : m_queue)
+            {
+                m_pending.erase(key);
+            }
+            m_queue.clear();
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+        m_idle.notify_all();
+    }
+
+    // Waits until nothing is queued or running, for tests and benchmarks
+    void WaitForIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_idle.wait(lock, [&]() { return m_pending.empty(); });
+    }
+
+private:
+    struct PendingLoad
+    {
+        std::wstring path; // the first row that asked, its thumbnail stands in for the whole extension
+        bool isFolder{};
+        bool running{};
+        std::vector<Callback> callbacks;
+    };
+
+    struct FailedLoad
+    {
+        std::chrono::steady_clock::time_point retryAt;
+        uint32_t failures{}; // in a row
+    };
+
+    // Called with m_lock held
+    void OnLoadFinished(StringAtom key, bool succeeded)
+    {
+        if (succeeded)
+        {
+            m_failed.erase(key);
+            return;
+        }
+
+        FailedLoad& failed = m_failed[key];
+        std::chrono::milliseconds delay = m_retry.initialDelay;
+        for (uint32_t i = 0; (i < failed.failures) && (delay < m_retry.maxDelay); ++i)
+        {
+            delay *= 2;
+        }
+        failed.failures++;
+        failed.retryAt = m_retry.now() + (std::min)(delay, m_retry.maxDelay);
+    }
+
+    void MoveToFront(StringAtom key)
+    {
+        for (auto it = m_queue.begin(); it != m_queue.end(); ++it)
+        {
+            if (*it == key)
+            {
+                m_queue.erase(it);
+                break;
+            }
+        }
+        m_queue.push_front(key);
+    }
+
+    void WorkerLoop()
+    {
+        if (m_workerStart)
+        {
+            m_workerStart();
+        }
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (true)
+        {
+            m_wake.wait(lock, [&]() { return m_stopping || !m_queue.empty(); });
+            if (m_stopping)
+            {
+                break;
+            }
+
+            const StringAtom key = m_queue.front();
+            m_queue.pop_front();
+            PendingLoad& pending = m_pending[key];
+            pending.running = true;
+            const std::wstring path = pending.path;
+            const bool isFolder = pending.isFolder;
+            lock.unlock();
+
+            TThumbnail thumbnail{ nullptr };
+            try
+            {
+                thumbnail = m_load(key, path, isFolder);
+            }
+            catch (...)
+            {
+                thumbnail = nullptr;
+            }
+
+            if (thumbnail != nullptr)
+            {
+                m_cache.Add(key, thumbnail);
+            }
+
+            // Anyone who asked while the load was running is in here too, anyone asking from now on hits the cache
+            lock.lock();
+            std::vector<Callback> callbacks = std::move(m_pending[key].callbacks);
+            m_pending.erase(key);
+            m_stats.loads++;
+            m_stats.failed += (thumbnail == nullptr) ? 1 : 0;
+            OnLoadFinished(key, thumbnail != nullptr);
+            const bool idle = m_pending.empty();
+            lock.unlock();
+
+            for (auto const& callback : callbacks)
+            {
+                callback(thumbnail);
+            }
+            if (idle)
+            {
+                m_idle.notify_all();
+            }
+            lock.lock();
+        }
+        lock.unlock();
+
+        if (m_workerStop)
+        {
+            m_workerStop();
+        }
+    }
+
+    ExtensionThumbnailCache<TThumbnail>& m_cache;
+    LoadFunction m_load;
+    const size_t m_maxQueued;
+    std::function<void()> m_workerStart;
+    std::function<void()> m_workerStop;
+    const ThumbnailRetryPolicy m_retry;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<StringAtom> m_queue; // keys of loads nobody has started yet, newest first
+    std::unordered_map<StringAtom, PendingLoad> m_pending; // queued or running
+    std::unordered_map<StringAtom, FailedLoad> m_failed; // last load failed, cleared by one that succeeds
+    ThumbnailSchedulerStats m_stats;
+    bool m_stopping{};
+    std::vector<std::thread> m_workers; // last, they use everything above
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+constexpr uint32_t c_thumbnailStoreMagic{ 0x53485457 }; // "WTHS"
+constexpr uint32_t c_thumbnailStoreVersion{ 1 };
+
+struct ThumbnailStoreStats
+{
+    uint64_t hits{};
+    uint64_t misses{};
+    uint64_t inserts{};
+    uint64_t evictions{};
+    uint32_t entries{};
+    uint64_t bytesUsed{};
+};
+
+// Platform neutral second tier for thumbnails, the encoded bytes of each one kept in a view of a mapped file so
+// the next run doesn't have to ask the shell again. Keyed the same way as the in memory cache (extension or the
+// folder key). The view's size is the cap: when something doesn't fit the least recently used entries are
+// evicted and what's left is packed down.
+//
+// The view is the whole store, nothing is kept on the side. A view that doesn't hold a store we can trust (new,
+// another version, or a run that died while changing it) is wiped. The layout uses wchar_t and native byte
+// order, a file is only ever read back on the platform that wrote it.
+struct MappedThumbnailStore
+{
+public:
+    static constexpr size_t c_maxEntries{ 512 };
+    static constexpr size_t c_maxKeyChars{ 31 };
+
+    // view has to stay mapped for as long as the store is around, and only one store can use it at a time
+    MappedThumbnailStore(uint8_t* view, size_t size) : m_view(view), m_size(size)
+    {
+        if (Enabled() && !IsValid())
+        {
+            Wipe();
+        }
+    }
+
+    // Too small to hold the table means there's no store, everything misses
+    bool Enabled() const
+    {
+        return (m_view != nullptr) && (m_size > c_dataStart);
+    }
+
+    bool Find(std::wstring_view key, std::vector<uint8_t>& bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        Entry* entry = Enabled() ? FindEntry(key) : nullptr;
+        if (entry == nullptr)
+        {
+            m_stats.misses++;
+            return false;
+        }
+
+        entry->lastUsed = ++GetHeader().clock;
+        const uint8_t* data = m_view + c_dataStart + entry->offset;
+        bytes.assign(data, data + entry->size);
+        m_stats.hits++;
+        return true;
+    }
+
+    // False if it can't ever fit, or the key is too long to keep
+    bool Insert(std::wstring_view key, const uint8_t* data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!Enabled() || key.empty() || (key.size() > c_maxKeyChars) || (size > DataCapacity()))
+        {
+            return false;
+        }
+
+        Header& header = GetHeader();
+        header.dirty = 1;
+        if (Entry* existing = FindEntry(key))
+        {
+            RemoveEntry(existing);
+        }
+
+        if (((header.dataUsed + size) > DataCapacity()) || (header.entryCount >= c_maxEntries))
+        {
+            MakeRoom(size);
+        }
+
+        Entry& entry = GetEntries()[header.entryCount++];
+        std::memset(entry.key, 0, sizeof(entry.key));
+        std::copy(key.begin(), key.end(), entry.key);
+        entry.offset = header.dataUsed;
+        entry.size = size;
+        entry.lastUsed = ++header.clock;
+        std::memcpy(m_view + c_dataStart + entry.offset, data, size);
+        header.dataUsed += size;
+        header.dirty = 0;
+        m_stats.inserts++;
+        return true;
+    }
+
+    ThumbnailStoreStats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        ThumbnailStoreStats stats = m_stats;
+        if (Enabled())
+        {
+            stats.entries = GetHeader().entryCount;
+            stats.bytesUsed = GetHeader().dataUsed;
+        }
+        return stats;
+    }
+
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t size; // of the view it was written to
+        uint32_t entrySize; // catches a file from a platform with another wchar_t
+        uint32_t entryCount;
+        uint32_t dirty; // set while changing anything, a store found with it set can't be trusted
+        uint32_t reserved;
+        uint64_t clock; // bumped on every use, the entries keep the value from their last one
+        uint64_t dataUsed;
+    };
+
+    struct Entry
+    {
+        wchar_t key[c_maxKeyChars + 1]; // null terminated
+        uint64_t lastUsed;
+        uint64_t offset; // into the data, after the table
+        uint64_t size;
+    };
+
+    static constexpr size_t c_dataStart{ sizeof(Header) + (sizeof(Entry) * c_maxEntries) };
+
+    Header& GetHeader() { return *reinterpret_cast<Header*>(m_view); }
+    Entry* GetEntries() { return reinterpret_cast<Entry*>(m_view + sizeof(Header)); }
+    uint64_t DataCapacity() const { return m_size - c_dataStart; }
+
+    bool IsValid()
+    {
+        Header& header = GetHeader();
+        if ((header.magic != c_thumbnailStoreMagic) || (header.version != c_thumbnailStoreVersion) || (header.size != m_size) ||
+            (header.entrySize != sizeof(Entry)) || (header.dirty != 0) || (header.entryCount > c_maxEntries) ||
+            (header.dataUsed > DataCapacity()))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < header.entryCount; ++i)
+        {
+            Entry const& entry = GetEntries()[i];
+            if ((entry.key[c_maxKeyChars] != L'\0') || (entry.offset > header.dataUsed) || (entry.size > (header.dataUsed - entry.offset)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Wipe()
+    {
+        Header& header = GetHeader();
+        std::memset(&header, 0, sizeof(header));
+        header.magic = c_thumbnailStoreMagic;
+        header.version = c_thumbnailStoreVersion;
+        header.size = m_size;
+        header.entrySize = sizeof(Entry);
+    }
+
+    Entry* FindEntry(std::wstring_view key)
+    {
+        Header& header = GetHeader();
+        for (uint32_t i = 0; i < header.entryCount; ++i)
+        {
+            Entry& entry = GetEntries()[i];
+            if (key == entry.key)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // Leaves a hole in the data until the next time we pack it
+    void RemoveEntry(Entry* entry)
+    {
+        Header& header = GetHeader();
+        *entry = GetEntries()[--header.entryCount];
+    }
+
+    void MakeRoom(size_t size)
+    {
+        Header& header = GetHeader();
+        Entry* entries = GetEntries();
+
+        // Oldest first, evict until what's left and the new one fit
+        std::sort(entries, entries + header.entryCount, [](Entry const& left, Entry const& right) { return left.lastUsed < right.lastUsed; });
+        uint64_t live = 0;
+        for (uint32_t i = 0; i < header.entryCount; ++i)
+        {
+            live += entries[i].size;
+        }
+
+        uint32_t evicted = 0;
+        while ((evicted < header.entryCount) && (((live + size) > DataCapacity()) || ((header.entryCount - evicted) >= c_maxEntries)))
+        {
+            live -= entries[evicted++].size;
+        }
+        std::move(entries + evicted, entries + header.entryCount, entries);
+        header.entryCount -= evicted;
+        m_stats.evictions += evicted;
+
+        // Pack what's left down in data order so nothing gets written over before it's moved
+        std::sort(entries, entries + header.entryCount, [](Entry const& left, Entry const& right) { return left.offset < right.offset; });
+        uint64_t used = 0;
+        for (uint32_t i = 0; i < header.entryCount; ++i)
+        {
+            if (entries[i].offset != used)
+            {
+                std::memmove(m_view + c_dataStart + used, m_view + c_dataStart + entries[i].offset, entries[i].size);
+                entries[i].offset = used;
+            }
+            used += entries[i].size;
+        }
+        header.dataUsed = used;
+    }
+
+    uint8_t* const m_view;
+    const size_t m_size;
+    std::mutex m_lock;
+    ThumbnailStoreStats m_stats;
+};
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "RefinementFilter.h"
+
+// Platform neutral in memory trigram index over file names, built once from the priming query so filename
+// searches can be answered without a round trip to the indexer.
+//
+// Names, urls and kinds live in one string arena. Every lower cased name trigram maps to the sorted list of
+// entries containing it, stored as varint encoded deltas in one byte array so a lookup touches a handful of
+// cache lines instead of a node per entry. Candidates from the posting list intersection are then checked
+// with the same word start matcher the local refinement uses.
+//
+// A finalized index can be written out as a snapshot and opened again straight out of a mapped view of the
+// file, every array is read in place so opening it costs a header check and not a rebuild.
+struct TrigramFilenameIndex
+{
+public:
+    explicit TrigramFilenameIndex(size_t maxEntries) : m_maxEntries(maxEntries) {}
+
+    // Entries have to be added in rank order, ids are handed out in that order. Returns false once the index is full.
+    bool Add(std::wstring_view name, std::wstring_view url, std::wstring_view kindText)
+    {
+        if (m_finalized || (m_entries.size() >= m_maxEntries))
+        {
+            m_truncated = true;
+            return false;
+        }
+
+        const uint32_t id = static_cast<uint32_t>(m_entries.size());
+        Entry entry;
+        entry.nameOffset = AppendString(name);
+        entry.nameLength = static_cast<uint32_t>(name.size());
+        entry.urlOffset = AppendString(url);
+        entry.urlLength = static_cast<uint32_t>(url.size());
+        entry.kind = InternKind(kindText);
+        m_entries.push_back(entry);
+
+        if (name.size() >= 3)
+        {
+            std::wstring lowered(name);
+            for (auto& ch : lowered)
+            {
+                ch = static_cast<wchar_t>(std::towlower(ch));
+            }
+
+            for (size_t i = 0; (i + 3) <= lowered.size(); ++i)
+            {
+                auto& postings = m_building[TrigramKey(lowered[i], lowered[i + 1], lowered[i + 2])];
+                if (postings.empty() || (postings.back() != id))
+                {
+                    postings.push_back(id);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Packs the posting lists, the index is read only (and safe to share between threads) after this
+    void Finalize()
+    {
+        std::vector<uint64_t> keys;
+        keys.reserve(m_building.size());
+        for (auto const& postings : m_building)
+        {
+            keys.push_back(postings.first);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        m_keys.reserve(keys.size());
+        m_postingOffsets.reserve(keys.size() + 1);
+        m_postingCounts.reserve(keys.size());
+        for (uint64_t key : keys)
+        {
+            auto const& postings = m_building[key];
+            m_keys.push_back(key);
+            m_postingOffsets.push_back(static_cast<uint32_t>(m_postings.size()));
+            m_postingCounts.push_back(static_cast<uint32_t>(postings.size()));
+
+            uint32_t previous = 0;
+            for (uint32_t id : postings)
+            {
+                AppendVarint(id - previous);
+                previous = id;
+            }
+        }
+        m_postingOffsets.push_back(static_cast<uint32_t>(m_postings.size()));
+
+        m_building = {};
+        m_strings.shrink_to_fit();
+        m_entries.shrink_to_fit();
+        m_postings.shrink_to_fit();
+
+        m_view.strings = { m_strings.data(), m_strings.size() };
+        m_view.entries = { m_entries.data(), m_entries.size() };
+        m_view.kinds = { m_kinds.data(), m_kinds.size() };
+        m_view.keys = { m_keys.data(), m_keys.size() };
+        m_view.postingOffsets = { m_postingOffsets.data(), m_postingOffsets.size() };
+        m_view.postingCounts = { m_postingCounts.data(), m_postingCounts.size() };
+        m_view.postings = { m_postings.data(), m_postings.size() };
+        m_finalized = true;
+    }
+
+    // Ids (in rank order) of up to maxResults entries with text at the start of a word in their name. Returns
+    // false if the text is too short for trigrams to narrow anything down, the caller has to ask the indexer.
+    bool Find(std::wstring_view text, size_t maxResults, std::vector<uint32_t>& ids) const
+    {
+        ids.clear();
+        if (!m_finalized || (text.size() < 3))
+        {
+            return false;
+        }
+
+        std::wstring lowered(text);
+        for (auto& ch : lowered)
+        {
+            ch = static_cast<wchar_t>(std::towlower(ch));
+        }
+
+        // Start from the rarest trigram so the intersections stay small
+        std::vector<size_t> lists;
+        for (size_t i = 0; (i + 3) <= lowered.size(); ++i)
+        {
+            const uint64_t key = TrigramKey(lowered[i], lowered[i + 1], lowered[i + 2]);
+            auto it = std::lower_bound(m_view.keys.begin(), m_view.keys.end(), key);
+            if ((it == m_view.keys.end()) || (*it != key))
+            {
+                // Nothing has this trigram, so nothing matches
+                return true;
+            }
+            lists.push_back(static_cast<size_t>(it - m_view.keys.begin()));
+        }
+        std::sort(lists.begin(), lists.end());
+        lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+        std::sort(lists.begin(), lists.end(), [this](size_t left, size_t right) { return m_view.postingCounts[left] < m_view.postingCounts[right]; });
+
+        std::vector<uint32_t> candidates;
+        DecodePostings(lists[0], candidates);
+        std::vector<uint32_t> postings;
+        std::vector<uint32_t> intersection;
+        for (size_t i = 1; (i < lists.size()) && !candidates.empty(); ++i)
+        {
+            if ((candidates.size() * c_verifyInsteadOfIntersectRatio) < m_view.postingCounts[lists[i]])
+            {
+                // Decoding a list this long costs more than checking the few candidates we have left directly
+                break;
+            }
+
+            DecodePostings(lists[i], postings);
+            intersection.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), postings.begin(), postings.end(), std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+
+        // Having all the trigrams doesn't mean they are next to each other, or at the start of a word
+        CaseInsensitiveMatcher matcher(text);
+        for (uint32_t id : candidates)
+        {
+            if ((id < m_view.entries.size()) && matcher.Matches(GetName(id)))
+            {
+                ids.push_back(id);
+                if (ids.size() >= maxResults)
+                {
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Views are null terminated
+    std::wstring_view GetName(uint32_t id) const { return GetString(m_view.entries[id].nameOffset, m_view.entries[id].nameLength); }
+    std::wstring_view GetUrl(uint32_t id) const { return GetString(m_view.entries[id].urlOffset, m_view.entries[id].urlLength); }
+    std::wstring_view GetKindText(uint32_t id) const
+    {
+        StringRef const& kind = m_view.kinds[m_view.entries[id].kind];
+        return GetString(kind.offset, kind.length);
+    }
+
+    size_t Size() const { return m_view.entries.size(); }
+    bool IsTruncated() const { return m_truncated; }
+    bool IsSnapshot() const { return m_snapshot != nullptr; }
+    size_t MemoryBytes() const
+    {
+        return (m_view.strings.size() * sizeof(wchar_t)) + (m_view.entries.size() * sizeof(Entry)) + m_view.postings.size() +
+            (m_view.keys.size() * sizeof(uint64_t)) + ((m_view.postingOffsets.size() + m_view.postingCounts.size()) * sizeof(uint32_t));
+    }
+
+    // Streams a snapshot of the finalized index through write(const void*, size_t). tag is the caller's to use,
+    // e.g. for the options the index was built with.
+    template <typename TWrite>
+    void WriteSnapshot(TWrite&& write, uint32_t tag) const
+    {
+        SnapshotHeader header{};
+        header.magic = c_snapshotMagic;
+        header.version = c_snapshotVersion;
+        header.charSize = sizeof(wchar_t);
+        header.tag = tag;
+        header.truncated = m_truncated ? 1 : 0;
+        header.stringChars = m_view.strings.size();
+        header.entries = m_view.entries.size();
+        header.kinds = m_view.kinds.size();
+        header.keys = m_view.keys.size();
+        header.postingBytes = m_view.postings.size();
+
+        uint64_t written = 0;
+        auto writeSection = [&](const void* data, uint64_t bytes)
+        {
+            // Every section starts 8 byte aligned so it can be used in place from the mapping
+            static const uint8_t padding[8]{};
+            const uint64_t aligned = AlignUp(written);
+            if (aligned > written)
+            {
+                write(padding, static_cast<size_t>(aligned - written));
+            }
+            if (bytes > 0)
+            {
+                write(data, static_cast<size_t>(bytes));
+            }
+            written = aligned + bytes;
+        };
+
+        writeSection(&header, sizeof(header));
+        writeSection(m_view.keys.data(), m_view.keys.size() * sizeof(uint64_t));
+        writeSection(m_view.entries.data(), m_view.entries.size() * sizeof(Entry));
+        writeSection(m_view.kinds.data(), m_view.kinds.size() * sizeof(StringRef));
+        writeSection(m_view.postingOffsets.data(), m_view.postingOffsets.size() * sizeof(uint32_t));
+        writeSection(m_view.postingCounts.data(), m_view.postingCounts.size() * sizeof(uint32_t));
+        writeSection(m_view.strings.data(), m_view.strings.size() * sizeof(wchar_t));
+        writeSection(m_view.postings.data(), m_view.postings.size());
+    }
+
+    // Opens a snapshot in place, data has to stay valid for as long as keepAlive is held. Returns null if the
+    // snapshot is from another version or doesn't hold together.
+    static std::shared_ptr<const TrigramFilenameIndex> OpenSnapshot(const void* data, size_t size, std::shared_ptr<const void> keepAlive, uint32_t* tag)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        if ((data == nullptr) || (size < sizeof(SnapshotHeader)) || ((reinterpret_cast<uintptr_t>(data) % 8) != 0))
+        {
+            return nullptr;
+        }
+
+        SnapshotHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if ((header.magic != c_snapshotMagic) || (header.version != c_snapshotVersion) || (header.charSize != sizeof(wchar_t)))
+        {
+            return nullptr;
+        }
+
+        auto index = std::make_shared<TrigramFilenameIndex>(0);
+        uint64_t offset = sizeof(header);
+        bool valid = true;
+        auto section = [&](auto& view, uint64_t count)
+        {
+            using T = std::remove_const_t<std::remove_pointer_t<decltype(view.data())>>;
+            offset = AlignUp(offset);
+            if (!valid || (count > (size / sizeof(T))) || ((offset + (count * sizeof(T))) > size))
+            {
+                valid = false;
+                return;
+            }
+            view = { reinterpret_cast<const T*>(bytes + offset), static_cast<size_t>(count) };
+            offset += count * sizeof(T);
+        };
+
+        section(index->m_view.keys, header.keys);
+        section(index->m_view.entries, header.entries);
+        section(index->m_view.kinds, header.kinds);
+        section(index->m_view.postingOffsets, header.keys + 1);
+        section(index->m_view.postingCounts, header.keys);
+        section(index->m_view.strings, header.stringChars);
+        section(index->m_view.postings, header.postingBytes);
+        if (!valid || !index->Validate())
+        {
+            return nullptr;
+        }
+
+        index->m_snapshot = std::move(keepAlive);
+        index->m_truncated = (header.truncated != 0);
+        index->m_finalized = true;
+        *tag = header.tag;
+        return index;
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t urlOffset;
+        uint32_t urlLength;
+        uint32_t kind;
+    };
+
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct SnapshotHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t charSize;
+        uint32_t tag;
+        uint32_t truncated;
+        uint32_t reserved;
+        uint64_t stringChars;
+        uint64_t entries;
+        uint64_t kinds;
+        uint64_t keys;
+        uint64_t postingBytes;
+    };
+
+    template <typename T>
+    struct ArrayView
+    {
+        const T* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        const T* begin() const { return m_data; }
+        const T* end() const { return m_data + m_size; }
+        T const& operator[](size_t i) const { return m_data[i]; }
+
+        const T* m_data{};
+        size_t m_size{};
+    };
+
+    // Finalize or OpenSnapshot point these at the owned arrays or into the mapping
+    struct IndexView
+    {
+        ArrayView<wchar_t> strings;
+        ArrayView<Entry> entries;
+        ArrayView<StringRef> kinds;
+        ArrayView<uint64_t> keys;
+        ArrayView<uint32_t> postingOffsets;
+        ArrayView<uint32_t> postingCounts;
+        ArrayView<uint8_t> postings;
+    };
+
+    static constexpr uint32_t c_snapshotMagic{ 0x49465357 }; // WSFI
+    static constexpr uint32_t c_snapshotVersion{ 1 };
+    static constexpr size_t c_verifyInsteadOfIntersectRatio{ 32 };
+
+    static uint64_t AlignUp(uint64_t offset) { return (offset + 7) & ~static_cast<uint64_t>(7); }
+
+    // 21 bits per character is enough for any code point, so this works for 16 and 32 bit wchar_t alike
+    static uint64_t TrigramKey(wchar_t a, wchar_t b, wchar_t c)
+    {
+        return ((static_cast<uint64_t>(a) & 0x1FFFFF) << 42) | ((static_cast<uint64_t>(b) & 0x1FFFFF) << 21) | (static_cast<uint64_t>(c) & 0x1FFFFF);
+    }
+
+    std::wstring_view GetString(uint32_t offset, uint32_t length) const { return { m_view.strings.data() + offset, length }; }
+
+    // A snapshot comes off of disk, make sure nothing in it points outside of the arrays before we trust it
+    bool Validate() const
+    {
+        auto validString = [this](uint32_t offset, uint32_t length)
+        {
+            // Strings are null terminated in the arena
+            return (static_cast<uint64_t>(offset) + length) < m_view.strings.size();
+        };
+
+        for (auto const& kind : m_view.kinds)
+        {
+            if (!validString(kind.offset, kind.length))
+            {
+                return false;
+            }
+        }
+
+        for (auto const& entry : m_view.entries)
+        {
+            if (!validString(entry.nameOffset, entry.nameLength) || !validString(entry.urlOffset, entry.urlLength) || (entry.kind >= m_view.kinds.size()))
+            {
+                return false;
+            }
+        }
+
+        for (size_t i = 0; i < m_view.keys.size(); ++i)
+        {
+            if ((m_view.postingOffsets[i] > m_view.postingOffsets[i + 1]) || ((i > 0) && (m_view.keys[i - 1] >= m_view.keys[i])))
+            {
+                return false;
+            }
+        }
+        return m_view.postingOffsets[m_view.keys.size()] == m_view.postings.size();
+    }
+
+    uint32_t AppendString(std::wstring_view value)
+    {
+        const uint32_t offset = static_cast<uint32_t>(m_strings.size());
+        m_strings.append(value);
+        m_strings.push_back(L'\0');
+        return offset;
+    }
+
+    uint32_t InternKind(std::wstring_view kindText)
+    {
+        // There are only a couple dozen kinds, a linear scan is fine
+        for (size_t i = 0; i < m_kinds.size(); ++i)
+        {
+            if (std::wstring_view(m_strings.data() + m_kinds[i].offset, m_kinds[i].length) == kindText)
+            {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        const uint32_t offset = AppendString(kindText);
+        m_kinds.push_back({ offset, static_cast<uint32_t>(kindText.size()) });
+        return static_cast<uint32_t>(m_kinds.size() - 1);
+    }
+
+    void AppendVarint(uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            m_postings.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        m_postings.push_back(static_cast<uint8_t>(value));
+    }
+
+    void DecodePostings(size_t list, std::vector<uint32_t>& ids) const
+    {
+        ids.clear();
+        ids.reserve(m_view.postingCounts[list]);
+        const uint8_t* current = m_view.postings.data() + m_view.postingOffsets[list];
+        const uint8_t* end = m_view.postings.data() + m_view.postingOffsets[list + 1];
+        uint32_t id = 0;
+        while (current < end)
+        {
+            // Bounded by end even if a snapshot got corrupted, Find checks the ids before using them
+            uint32_t delta = 0;
+            uint32_t shift = 0;
+            while (((end - current) > 1) && (*current & 0x80) && (shift < 28))
+            {
+                delta |= static_cast<uint32_t>(*current++ & 0x7F) << shift;
+                shift += 7;
+            }
+            delta |= static_cast<uint32_t>(*current++ & 0x7F) << shift;
+            id += delta;
+            ids.push_back(id);
+        }
+    }
+
+    const size_t m_maxEntries;
+    bool m_finalized{};
+    bool m_truncated{};
+
+    // Only filled in while building, a snapshot reads everything out of the mapping instead
+    std::wstring m_strings;
+    std::vector<Entry> m_entries;
+    std::vector<StringRef> m_kinds;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_building; // only until Finalize
+    std::vector<uint64_t> m_keys; // sorted
+    std::vector<uint32_t> m_postingOffsets;
+    std::vector<uint32_t> m_postingCounts;
+    std::vector<uint8_t> m_postings;
+
+    IndexView m_view;
+    std::shared_ptr<const void> m_snapshot; // keeps the mapping alive
+};